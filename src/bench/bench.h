@@ -0,0 +1,36 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef void (*bench_fn_t)(void *ctx, uint64_t iterations);
+
+typedef struct {
+    const char *filter;
+    uint64_t min_time_ns;
+    int repeat;
+} bench_config_t;
+
+typedef struct {
+    uint64_t allocs;
+    uint64_t bytes;
+} bench_alloc_stats_t;
+
+extern bench_config_t g_bench_config;
+
+bool bench_alloc_tracking_enabled(void);
+void bench_alloc_snapshot(bench_alloc_stats_t *stats);
+
+bool bench_selected(const char *name);
+void bench_run(const char *name, bench_fn_t fn, void *ctx);
+uint64_t bench_now_ns(void);
+int bench_temp_path(char *path_out, size_t path_out_size, const char *prefix);
+
+void bench_protocol(void);
+void bench_message(void);
+void bench_broadcast(void);
+void bench_database(void);
+
+#endif
@@ -0,0 +1,60 @@
+#include "bench.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__GLIBC__)
+
+/* Interpose the allocator so every allocation made by the code under test,
+ * including the ones inside libsqlite3, is counted. */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+static uint64_t g_alloc_count = 0;
+static uint64_t g_alloc_bytes = 0;
+
+static inline void count_allocation(size_t size) {
+    __atomic_fetch_add(&g_alloc_count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&g_alloc_bytes, size, __ATOMIC_RELAXED);
+}
+
+void *malloc(size_t size) {
+    count_allocation(size);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size) {
+    count_allocation(nmemb * size);
+    return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    count_allocation(size);
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr) {
+    __libc_free(ptr);
+}
+
+bool bench_alloc_tracking_enabled(void) {
+    return true;
+}
+
+void bench_alloc_snapshot(bench_alloc_stats_t *stats) {
+    stats->allocs = __atomic_load_n(&g_alloc_count, __ATOMIC_RELAXED);
+    stats->bytes = __atomic_load_n(&g_alloc_bytes, __ATOMIC_RELAXED);
+}
+
+#else
+
+bool bench_alloc_tracking_enabled(void) {
+    return false;
+}
+
+void bench_alloc_snapshot(bench_alloc_stats_t *stats) {
+    memset(stats, 0, sizeof(*stats));
+}
+
+#endif
@@ -0,0 +1,167 @@
+#include "bench.h"
+#include "server.h"
+#include "../common/include/message.h"
+#include "../common/include/utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sched.h>
+#include <sys/socket.h>
+
+#define BENCH_ROOM_ID  "00000000-0000-4000-8000-000000000001"
+#define BENCH_OTHER_ROOM_ID "00000000-0000-4000-8000-000000000002"
+#define BENCH_BATCH    256     /* well under LANE_CHAT_LIMIT, so no member is ever dropped as slow */
+
+typedef struct {
+    server_t *server;
+    chat_message_t *chat;     /* relayed in place each iteration, like a received frame */
+    int peer_fds[MAX_CLIENTS];
+    int connections;
+    volatile bool draining;
+} broadcast_ctx_t;
+
+static void *drain_thread(void *arg) {
+    broadcast_ctx_t *ctx = (broadcast_ctx_t *)arg;
+    struct pollfd pfds[MAX_CLIENTS];
+    char buffer[65536];
+
+    for (int i = 0; i < ctx->connections; i++) {
+        pfds[i].fd = ctx->peer_fds[i];
+        pfds[i].events = POLLIN;
+    }
+    while (ctx->draining) {
+        if (poll(pfds, ctx->connections, 50) <= 0) {
+            continue;
+        }
+        for (int i = 0; i < ctx->connections; i++) {
+            if (pfds[i].revents & POLLIN) {
+                if (read(pfds[i].fd, buffer, sizeof(buffer)) < 0) {
+                    perror("read");
+                }
+            }
+        }
+    }
+    return NULL;
+}
+
+/* Waits until the writers have put every queued frame on its socket. */
+static void wait_written(server_t *server) {
+    while (__atomic_load_n(&server->load.queued, __ATOMIC_RELAXED) > 0) {
+        sched_yield();
+    }
+}
+
+/*
+ * Each iteration is timed until its frames are written, not just queued, so
+ * the lane handoff and the writers' socket writes are part of the cost.
+ */
+static void bench_broadcast_once(void *arg, uint64_t iterations) {
+    broadcast_ctx_t *ctx = (broadcast_ctx_t *)arg;
+    for (uint64_t i = 0; i < iterations; i++) {
+        server_broadcast_message(ctx->server, ctx->chat);
+        if ((i + 1) % BENCH_BATCH == 0) {
+            wait_written(ctx->server);
+        }
+    }
+    wait_written(ctx->server);
+}
+
+static void run_broadcast(server_t *server, int connections, int members) {
+    char name[128];
+    snprintf(name, sizeof(name), "broadcast/conns=%d/members=%d", connections, members);
+    if (!bench_selected(name)) {
+        return;
+    }
+
+    broadcast_ctx_t ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.server = server;
+    ctx.connections = connections;
+    ctx.chat = create_chat_message(BENCH_ROOM_ID, "benchuser", "hello from the benchmark");
+    room_state_t *room = server_get_room(server, BENCH_ROOM_ID);
+    room_state_t *other_room = server_get_room(server, BENCH_OTHER_ROOM_ID);
+    if (!ctx.chat || !room || !other_room) {
+        fprintf(stderr, "Failed to register benchmark rooms\n");
+        exit(1);
+    }
+
+    for (int i = 0; i < connections; i++) {
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+            perror("socketpair");
+            exit(1);
+        }
+        client_t *client = &server->clients[i];
+        client->sockfd = fds[0];
+        client->connected = true;
+        client->authenticated = true;
+        snprintf(client->username, sizeof(client->username), "bench%d", i);
+        room_state_t *target = i < members ? room : other_room;
+        pthread_mutex_lock(&target->lock);
+        server_subscribe(server, i, target);
+        pthread_mutex_unlock(&target->lock);
+        ctx.peer_fds[i] = fds[1];
+        if (server_start_output(server, i) != 0) {
+            fprintf(stderr, "Failed to start writer for benchmark client %d\n", i);
+            exit(1);
+        }
+    }
+
+    pthread_t drainer;
+    ctx.draining = true;
+    if (pthread_create(&drainer, NULL, drain_thread, &ctx) != 0) {
+        perror("pthread_create");
+        exit(1);
+    }
+
+    bench_run(name, bench_broadcast_once, &ctx);
+
+    for (int i = 0; i < connections; i++) {
+        if (server->clients[i].slow) {
+            fprintf(stderr, "%s: client %d fell behind, results are not comparable\n", name, i);
+        }
+        server_stop_output(server, i);
+    }
+    ctx.draining = false;
+    pthread_join(drainer, NULL);
+    for (int i = 0; i < connections; i++) {
+        server_leave_all_rooms(server, i);
+        close(server->clients[i].sockfd);
+        close(ctx.peer_fds[i]);
+        server->clients[i].sockfd = -1;
+        server->clients[i].connected = false;
+        server->clients[i].authenticated = false;
+    }
+    free_message(ctx.chat);
+}
+
+void bench_broadcast(void) {
+    static const int configs[][2] = {
+        {10, 1}, {10, 10}, {100, 1}, {100, 10}, {100, 100},
+    };
+
+    char db_path[256];
+    if (bench_temp_path(db_path, sizeof(db_path), "chat-bench-broadcast") != 0) {
+        perror("bench_temp_path");
+        exit(1);
+    }
+
+    server_t *server = calloc(1, sizeof(server_t));
+    if (!server || server_init(server, db_path) != 0) {
+        fprintf(stderr, "Failed to initialize server for broadcast benchmark\n");
+        exit(1);
+    }
+
+    for (size_t i = 0; i < sizeof(configs) / sizeof(configs[0]); i++) {
+        run_broadcast(server, configs[i][0], configs[i][1]);
+    }
+
+    pthread_mutex_destroy(&server->clients_mutex);
+    server_free_rooms(server);
+    pthread_mutex_destroy(&server->rooms_mutex);
+    db_close(&server->db);
+    free(server);
+    unlink(db_path);
+}
@@ -0,0 +1,193 @@
+#include "bench.h"
+#include "../common/include/database.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define WARM_USERS 1000
+#define WARM_ROOMS 100
+#define WARM_MESSAGES 1000
+
+typedef struct {
+    database_t db;
+    char db_path[256];
+    char room_ids[WARM_ROOMS][37];
+    int owner_id;
+    uint64_t counter;
+    uint64_t next_seq;
+} database_ctx_t;
+
+static void fail(const char *what) {
+    fprintf(stderr, "database benchmark failed: %s\n", what);
+    exit(1);
+}
+
+static void bench_authenticate(void *arg, uint64_t iterations) {
+    database_ctx_t *ctx = (database_ctx_t *)arg;
+    char username[32];
+    for (uint64_t i = 0; i < iterations; i++) {
+        snprintf(username, sizeof(username), "user%d", (int)(i % WARM_USERS));
+        if (!db_authenticate_user(&ctx->db, username, "benchpassword")) {
+            fail("db_authenticate_user");
+        }
+    }
+}
+
+static void bench_get_user_id(void *arg, uint64_t iterations) {
+    database_ctx_t *ctx = (database_ctx_t *)arg;
+    char username[32];
+    for (uint64_t i = 0; i < iterations; i++) {
+        snprintf(username, sizeof(username), "user%d", (int)(i % WARM_USERS));
+        if (db_get_user_id(&ctx->db, username) <= 0) {
+            fail("db_get_user_id");
+        }
+    }
+}
+
+static void bench_room_exists(void *arg, uint64_t iterations) {
+    database_ctx_t *ctx = (database_ctx_t *)arg;
+    for (uint64_t i = 0; i < iterations; i++) {
+        if (!db_room_exists(&ctx->db, ctx->room_ids[i % WARM_ROOMS])) {
+            fail("db_room_exists");
+        }
+    }
+}
+
+static void bench_get_room_name(void *arg, uint64_t iterations) {
+    database_ctx_t *ctx = (database_ctx_t *)arg;
+    char name[64];
+    for (uint64_t i = 0; i < iterations; i++) {
+        if (db_get_room_name(&ctx->db, ctx->room_ids[i % WARM_ROOMS], name, sizeof(name)) != 0) {
+            fail("db_get_room_name");
+        }
+    }
+}
+
+static void bench_list_rooms(void *arg, uint64_t iterations) {
+    database_ctx_t *ctx = (database_ctx_t *)arg;
+    for (uint64_t i = 0; i < iterations; i++) {
+        room_t *rooms = NULL;
+        int count = 0;
+        if (db_list_rooms(&ctx->db, &rooms, &count) != 0) {
+            fail("db_list_rooms");
+        }
+        free(rooms);
+    }
+}
+
+static void bench_register_existing(void *arg, uint64_t iterations) {
+    database_ctx_t *ctx = (database_ctx_t *)arg;
+    for (uint64_t i = 0; i < iterations; i++) {
+        if (db_register_user(&ctx->db, "user0", "benchpassword") != -2) {
+            fail("db_register_user (existing)");
+        }
+    }
+}
+
+static void bench_register_new(void *arg, uint64_t iterations) {
+    database_ctx_t *ctx = (database_ctx_t *)arg;
+    char username[32];
+    for (uint64_t i = 0; i < iterations; i++) {
+        snprintf(username, sizeof(username), "new%llu", (unsigned long long)ctx->counter++);
+        if (db_register_user(&ctx->db, username, "benchpassword") <= 0) {
+            fail("db_register_user");
+        }
+    }
+}
+
+static void bench_create_room(void *arg, uint64_t iterations) {
+    database_ctx_t *ctx = (database_ctx_t *)arg;
+    char room_id[37];
+    for (uint64_t i = 0; i < iterations; i++) {
+        if (db_create_room(&ctx->db, "bench room", ctx->owner_id, room_id) != 0) {
+            fail("db_create_room");
+        }
+    }
+}
+
+static void bench_store_message(void *arg, uint64_t iterations) {
+    database_ctx_t *ctx = (database_ctx_t *)arg;
+    for (uint64_t i = 0; i < iterations; i++) {
+        if (db_store_message(&ctx->db, ctx->room_ids[1], ++ctx->next_seq, "user0",
+                             "hello from the benchmark") != 0) {
+            fail("db_store_message");
+        }
+    }
+}
+
+static void bench_messages_since(void *arg, uint64_t iterations) {
+    database_ctx_t *ctx = (database_ctx_t *)arg;
+    for (uint64_t i = 0; i < iterations; i++) {
+        stored_message_t *messages = NULL;
+        int count = 0;
+        if (db_get_messages_since(&ctx->db, ctx->room_ids[0], WARM_MESSAGES - 50, 500,
+                                  &messages, &count) != 0 || count != 50) {
+            fail("db_get_messages_since");
+        }
+        free(messages);
+    }
+}
+
+static void bench_open_close(void *arg, uint64_t iterations) {
+    database_ctx_t *ctx = (database_ctx_t *)arg;
+    for (uint64_t i = 0; i < iterations; i++) {
+        database_t db;
+        memset(&db, 0, sizeof(db));
+        if (db_init(&db, ctx->db_path) != 0) {
+            fail("db_init");
+        }
+        db_close(&db);
+    }
+}
+
+void bench_database(void) {
+    if (!bench_selected("database/")) {
+        return;
+    }
+
+    database_ctx_t *ctx = calloc(1, sizeof(database_ctx_t));
+    if (!ctx || bench_temp_path(ctx->db_path, sizeof(ctx->db_path), "chat-bench-db") != 0) {
+        fail("temporary database");
+    }
+    if (db_init(&ctx->db, ctx->db_path) != 0) {
+        fail("db_init");
+    }
+
+    sqlite3_exec(ctx->db.db, "BEGIN;", NULL, NULL, NULL);
+    char username[32];
+    for (int i = 0; i < WARM_USERS; i++) {
+        snprintf(username, sizeof(username), "user%d", i);
+        if (db_register_user(&ctx->db, username, "benchpassword") <= 0) {
+            fail("warming users");
+        }
+    }
+    ctx->owner_id = db_get_user_id(&ctx->db, "user0");
+    for (int i = 0; i < WARM_ROOMS; i++) {
+        if (db_create_room(&ctx->db, "bench room", ctx->owner_id, ctx->room_ids[i]) != 0) {
+            fail("warming rooms");
+        }
+    }
+    for (int i = 1; i <= WARM_MESSAGES; i++) {
+        if (db_store_message(&ctx->db, ctx->room_ids[0], (uint64_t)i, "user0", "hello from the benchmark") != 0) {
+            fail("warming messages");
+        }
+    }
+    sqlite3_exec(ctx->db.db, "COMMIT;", NULL, NULL, NULL);
+
+    bench_run("database/db_authenticate_user", bench_authenticate, ctx);
+    bench_run("database/db_get_user_id", bench_get_user_id, ctx);
+    bench_run("database/db_room_exists", bench_room_exists, ctx);
+    bench_run("database/db_get_room_name", bench_get_room_name, ctx);
+    bench_run("database/db_list_rooms/100", bench_list_rooms, ctx);
+    bench_run("database/db_register_user/existing", bench_register_existing, ctx);
+    bench_run("database/db_register_user/new", bench_register_new, ctx);
+    bench_run("database/db_create_room", bench_create_room, ctx);
+    bench_run("database/db_store_message", bench_store_message, ctx);
+    bench_run("database/db_get_messages_since/50", bench_messages_since, ctx);
+    bench_run("database/db_init+db_close", bench_open_close, ctx);
+
+    db_close(&ctx->db);
+    unlink(ctx->db_path);
+    free(ctx);
+}
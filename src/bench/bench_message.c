@@ -0,0 +1,114 @@
+#include "bench.h"
+#include "../common/include/message.h"
+
+#define BENCH_ROOM_ID "00000000-0000-4000-8000-000000000000"
+
+#define DEFINE_CREATE_BENCH(fn_name, expr)                      \
+    static void fn_name(void *ctx, uint64_t iterations) {       \
+        (void)ctx;                                              \
+        for (uint64_t i = 0; i < iterations; i++) {             \
+            free_message(expr);                                 \
+        }                                                       \
+    }
+
+DEFINE_CREATE_BENCH(bench_auth_request, create_auth_request("benchuser", "benchpassword"))
+DEFINE_CREATE_BENCH(bench_auth_response, create_auth_response(RESP_SUCCESS))
+DEFINE_CREATE_BENCH(bench_register_request, create_register_request("benchuser", "benchpassword"))
+DEFINE_CREATE_BENCH(bench_register_response, create_register_response(RESP_SUCCESS))
+DEFINE_CREATE_BENCH(bench_room_request, create_room_request("bench room"))
+DEFINE_CREATE_BENCH(bench_room_response, create_room_response(RESP_SUCCESS, BENCH_ROOM_ID))
+DEFINE_CREATE_BENCH(bench_join_room_request, create_join_room_request(BENCH_ROOM_ID))
+DEFINE_CREATE_BENCH(bench_join_room_response,
+                    create_join_room_response(RESP_SUCCESS, "bench room", BENCH_ROOM_ID))
+DEFINE_CREATE_BENCH(bench_leave_room_request, create_leave_room_request(BENCH_ROOM_ID))
+DEFINE_CREATE_BENCH(bench_chat_message,
+                    create_chat_message(BENCH_ROOM_ID, "benchuser", "hello from the benchmark"))
+DEFINE_CREATE_BENCH(bench_error_message, create_error_message(RESP_INTERNAL_ERROR, "bench error"))
+DEFINE_CREATE_BENCH(bench_direct_message,
+                    create_direct_message("otheruser", "benchuser", "hello from the benchmark"))
+DEFINE_CREATE_BENCH(bench_ping_message, create_ping_message(MSG_PING, 42))
+DEFINE_CREATE_BENCH(bench_hello_message, create_hello_message(PROTOCOL_VERSION, CAP_COMPACT | CAP_PIPELINING))
+
+/* The list builders are measured filled to capacity, the largest frame each sends. */
+static presence_update_t *full_presence_update(void) {
+    presence_update_t *update = create_presence_update(BENCH_ROOM_ID, PRESENCE_RESET);
+    for (int i = 0; update && i < PRESENCE_MAX_ENTRIES; i++) {
+        presence_update_add(update, PRESENCE_JOIN, "benchuser");
+    }
+    return update;
+}
+
+static ack_message_t *full_ack_message(void) {
+    ack_message_t *ack = create_ack_message();
+    for (int i = 0; ack && i < ACK_MAX_ENTRIES; i++) {
+        ack_message_add(ack, BENCH_ROOM_ID, (uint64_t)i, 0);
+    }
+    return ack;
+}
+
+static login_join_request_t *full_login_join_request(void) {
+    login_join_request_t *req = create_login_join_request("benchuser", "benchpassword");
+    for (int i = 0; req && i < LOGIN_JOIN_MAX_ROOMS; i++) {
+        login_join_request_add(req, BENCH_ROOM_ID, true, (uint64_t)i, 0);
+    }
+    return req;
+}
+
+static login_join_response_t *full_login_join_response(void) {
+    login_join_response_t *resp = create_login_join_response(RESP_SUCCESS);
+    for (int i = 0; resp && i < LOGIN_JOIN_MAX_ROOMS; i++) {
+        login_join_response_add(resp, BENCH_ROOM_ID, RESP_SUCCESS, "bench room", (uint64_t)i);
+    }
+    return resp;
+}
+
+DEFINE_CREATE_BENCH(bench_presence_update, full_presence_update())
+DEFINE_CREATE_BENCH(bench_ack_message, full_ack_message())
+DEFINE_CREATE_BENCH(bench_login_join_request, full_login_join_request())
+DEFINE_CREATE_BENCH(bench_login_join_response, full_login_join_response())
+
+static void bench_chat_compact(void *ctx, uint64_t iterations) {
+    const chat_message_t *chat = (const chat_message_t *)ctx;
+    chat_compact_t compact;
+    for (uint64_t i = 0; i < iterations; i++) {
+        chat_compact(chat, &compact);
+    }
+}
+
+static void bench_chat_expand(void *ctx, uint64_t iterations) {
+    const chat_compact_t *compact = (const chat_compact_t *)ctx;
+    chat_message_t chat;
+    for (uint64_t i = 0; i < iterations; i++) {
+        chat_expand(compact, compact->header.length, &chat);
+    }
+}
+
+void bench_message(void) {
+    bench_run("message/create_auth_request", bench_auth_request, NULL);
+    bench_run("message/create_auth_response", bench_auth_response, NULL);
+    bench_run("message/create_register_request", bench_register_request, NULL);
+    bench_run("message/create_register_response", bench_register_response, NULL);
+    bench_run("message/create_room_request", bench_room_request, NULL);
+    bench_run("message/create_room_response", bench_room_response, NULL);
+    bench_run("message/create_join_room_request", bench_join_room_request, NULL);
+    bench_run("message/create_join_room_response", bench_join_room_response, NULL);
+    bench_run("message/create_leave_room_request", bench_leave_room_request, NULL);
+    bench_run("message/create_chat_message", bench_chat_message, NULL);
+    bench_run("message/create_error_message", bench_error_message, NULL);
+    bench_run("message/create_direct_message", bench_direct_message, NULL);
+    bench_run("message/create_ping_message", bench_ping_message, NULL);
+    bench_run("message/create_hello_message", bench_hello_message, NULL);
+    bench_run("message/create_presence_update", bench_presence_update, NULL);
+    bench_run("message/create_ack_message", bench_ack_message, NULL);
+    bench_run("message/create_login_join_request", bench_login_join_request, NULL);
+    bench_run("message/create_login_join_response", bench_login_join_response, NULL);
+
+    chat_message_t *chat = create_chat_message(BENCH_ROOM_ID, "benchuser", "hello from the benchmark");
+    chat_compact_t compact;
+    if (chat) {
+        chat_compact(chat, &compact);
+        bench_run("message/chat_compact", bench_chat_compact, chat);
+        bench_run("message/chat_expand", bench_chat_expand, &compact);
+        free_message(chat);
+    }
+}
@@ -0,0 +1,78 @@
+#include "bench.h"
+#include "../common/include/protocol.h"
+#include "../common/include/message.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+typedef struct {
+    int fds[2];
+    void *message;
+    size_t length;
+} protocol_ctx_t;
+
+static void bench_roundtrip(void *arg, uint64_t iterations) {
+    protocol_ctx_t *ctx = (protocol_ctx_t *)arg;
+    char buffer[2048];
+    for (uint64_t i = 0; i < iterations; i++) {
+        if (send_message(ctx->fds[0], ctx->message, ctx->length) != 0 ||
+            receive_message(ctx->fds[1], buffer, sizeof(buffer)) != (int)ctx->length) {
+            fprintf(stderr, "protocol roundtrip failed\n");
+            exit(1);
+        }
+    }
+}
+
+static void run_roundtrip(const char *name, void *message, size_t length) {
+    protocol_ctx_t ctx;
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, ctx.fds) != 0) {
+        perror("socketpair");
+        exit(1);
+    }
+    ctx.message = message;
+    ctx.length = length;
+    bench_run(name, bench_roundtrip, &ctx);
+    close(ctx.fds[0]);
+    close(ctx.fds[1]);
+}
+
+static void bench_check(void *arg, uint64_t iterations) {
+    protocol_ctx_t *ctx = (protocol_ctx_t *)arg;
+    volatile bool valid = true;
+    for (uint64_t i = 0; i < iterations; i++) {
+        valid = message_check(ctx->message, ctx->length) && valid;
+    }
+    if (!valid) {
+        fprintf(stderr, "protocol check failed\n");
+        exit(1);
+    }
+}
+
+static void run_check(const char *name, void *message, size_t length) {
+    protocol_ctx_t ctx = { .message = message, .length = length };
+    bench_run(name, bench_check, &ctx);
+}
+
+void bench_protocol(void) {
+    auth_response_t *auth_resp = create_auth_response(RESP_SUCCESS);
+    auth_request_t *auth_req = create_auth_request("benchuser", "benchpassword");
+    chat_message_t *chat = create_chat_message("00000000-0000-4000-8000-000000000000",
+                                               "benchuser", "hello from the benchmark");
+
+    run_roundtrip("protocol/roundtrip/auth_response", auth_resp, sizeof(auth_response_t));
+    run_roundtrip("protocol/roundtrip/auth_request", auth_req, sizeof(auth_request_t));
+    run_roundtrip("protocol/roundtrip/chat_message", chat, sizeof(chat_message_t));
+
+    presence_update_t *presence = create_presence_update("00000000-0000-4000-8000-000000000000", 0);
+    for (int i = 0; i < PRESENCE_MAX_ENTRIES; i++) {
+        presence_update_add(presence, PRESENCE_JOIN, "benchuser");
+    }
+    run_check("protocol/check/chat_message", chat, sizeof(chat_message_t));
+    run_check("protocol/check/presence", presence, presence->header.length);
+
+    free_message(presence);
+    free_message(auth_resp);
+    free_message(auth_req);
+    free_message(chat);
+}
@@ -0,0 +1,142 @@
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_MAX_REPEAT 32
+
+bench_config_t g_bench_config = {
+    .filter = NULL,
+    .min_time_ns = 200000000ULL,
+    .repeat = 5,
+};
+
+uint64_t bench_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+bool bench_selected(const char *name) {
+    return !g_bench_config.filter || strstr(name, g_bench_config.filter) != NULL;
+}
+
+int bench_temp_path(char *path_out, size_t path_out_size, const char *prefix) {
+    const char *tmpdir = getenv("TMPDIR");
+    if (!tmpdir || tmpdir[0] == '\0') {
+        tmpdir = "/tmp";
+    }
+    int written = snprintf(path_out, path_out_size, "%s/%s-XXXXXX", tmpdir, prefix);
+    if (written < 0 || (size_t)written >= path_out_size) {
+        return -1;
+    }
+    int fd = mkstemp(path_out);
+    if (fd < 0) {
+        return -1;
+    }
+    close(fd);
+    return 0;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static uint64_t time_iterations(bench_fn_t fn, void *ctx, uint64_t iterations) {
+    uint64_t start = bench_now_ns();
+    fn(ctx, iterations);
+    return bench_now_ns() - start;
+}
+
+void bench_run(const char *name, bench_fn_t fn, void *ctx) {
+    if (!bench_selected(name)) {
+        return;
+    }
+
+    uint64_t iterations = 1;
+    uint64_t elapsed = time_iterations(fn, ctx, iterations);
+    while (elapsed < g_bench_config.min_time_ns && iterations < (1ULL << 32)) {
+        uint64_t next = elapsed > 0
+            ? (uint64_t)((double)iterations * 1.2 * g_bench_config.min_time_ns / elapsed)
+            : iterations * 100;
+        if (next <= iterations) {
+            next = iterations + 1;
+        }
+        if (next > iterations * 100) {
+            next = iterations * 100;
+        }
+        iterations = next;
+        elapsed = time_iterations(fn, ctx, iterations);
+    }
+
+    int repeat = g_bench_config.repeat;
+    double samples[BENCH_MAX_REPEAT];
+    bench_alloc_stats_t before, after;
+    bench_alloc_snapshot(&before);
+    for (int i = 0; i < repeat; i++) {
+        samples[i] = (double)time_iterations(fn, ctx, iterations) / (double)iterations;
+    }
+    bench_alloc_snapshot(&after);
+    qsort(samples, repeat, sizeof(double), compare_double);
+
+    double total_ops = (double)iterations * repeat;
+    if (bench_alloc_tracking_enabled()) {
+        printf("%-44s %12llu %12.1f ns/op %9.2f allocs/op %10.1f B/op\n",
+               name, (unsigned long long)iterations, samples[repeat / 2],
+               (double)(after.allocs - before.allocs) / total_ops,
+               (double)(after.bytes - before.bytes) / total_ops);
+    } else {
+        printf("%-44s %12llu %12.1f ns/op %9s allocs/op %10s B/op\n",
+               name, (unsigned long long)iterations, samples[repeat / 2], "n/a", "n/a");
+    }
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[]) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-f") == 0 || strcmp(argv[i], "--filter") == 0) {
+            if (i + 1 < argc) {
+                g_bench_config.filter = argv[i + 1];
+                i++;
+            }
+        } else if (strcmp(argv[i], "-t") == 0 || strcmp(argv[i], "--min-time") == 0) {
+            if (i + 1 < argc) {
+                int ms = atoi(argv[i + 1]);
+                if (ms > 0) {
+                    g_bench_config.min_time_ns = (uint64_t)ms * 1000000ULL;
+                }
+                i++;
+            }
+        } else if (strcmp(argv[i], "-r") == 0 || strcmp(argv[i], "--repeat") == 0) {
+            if (i + 1 < argc) {
+                int repeat = atoi(argv[i + 1]);
+                if (repeat > 0 && repeat <= BENCH_MAX_REPEAT) {
+                    g_bench_config.repeat = repeat;
+                }
+                i++;
+            }
+        } else if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            printf("Usage: %s [options]\n", argv[0]);
+            printf("Options:\n");
+            printf("  -f, --filter TEXT   Only run benchmarks whose name contains TEXT\n");
+            printf("  -t, --min-time MS   Minimum time per measurement (default: 200)\n");
+            printf("  -r, --repeat N      Measurements per benchmark, median is reported (default: 5)\n");
+            printf("  -h, --help          Show this help message\n");
+            return 0;
+        }
+    }
+
+    srand(42);
+    printf("%-44s %12s %18s %19s %15s\n", "benchmark", "iterations", "time", "allocations", "bytes");
+
+    bench_protocol();
+    bench_message();
+    bench_broadcast();
+    bench_database();
+
+    return 0;
+}
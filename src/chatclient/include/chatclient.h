@@ -0,0 +1,192 @@
+#ifndef CHATCLIENT_H
+#define CHATCLIENT_H
+
+#include "protocol.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Headless, non-blocking chat client.
+ *
+ * A session never blocks (apart from name resolution in
+ * chat_session_connect()) and never spawns threads. Drive it either with
+ * chat_session_poll() (one session), by polling chat_session_fd() yourself
+ * and calling chat_session_handle_io(), or by adding many sessions to a
+ * chat_loop_t. Every request returns a request ID and later produces exactly
+ * one CHAT_EVENT_COMPLETION carrying that ID. With CAP_PIPELINING the ID
+ * also tags the request on the wire, so any number of requests can be in
+ * flight at once and each answer, errors included, completes the request it
+ * belongs to. Sessions are not thread-safe and must not be destroyed from
+ * inside an event callback.
+ *
+ * A session can be in any number of rooms at once; chat_session_room_*()
+ * enumerate them (joins still waiting for the server are listed but not
+ * joined), and messages and leaves name the room they apply to.
+ *
+ * Every joined room keeps its member list, read with
+ * chat_session_room_member*(). The server sends the full list on join
+ * (reported as one CHAT_EVENT_PRESENCE with a NULL username) and then one
+ * CHAT_EVENT_PRESENCE per user who comes or goes.
+ *
+ * chat_session_login_join() logs in and joins up to LOGIN_JOIN_MAX_ROOMS
+ * rooms in one round trip, delivering up to `history` of each room's latest
+ * messages first. Its one completion carries the login's status; rooms the
+ * server could not join are dropped from the room list.
+ *
+ * chat_session_send_direct() messages one user wherever they are logged in.
+ * Messages sent while they were offline arrive as CHAT_EVENT_DIRECT right
+ * after their next login.
+ *
+ * A server with rate limits drops messages sent too fast and says so with a
+ * CHAT_EVENT_ERROR whose error_code is RESP_RATE_LIMITED; back off before
+ * sending more.
+ *
+ * Every connection opens with a hello that agrees on a protocol version and
+ * the capabilities (CAP_*) the session may use with this server, read with
+ * chat_session_capabilities(). CHAT_EVENT_CONNECTED waits for the answer.
+ * Against a server older than the hello the session speaks version 1: no
+ * request tags, so answers are matched in order, full-size chat frames, and
+ * chat_session_login_join() fails for want of CAP_MULTI_ROOM.
+ *
+ * chat_session_set_compression() also asks the server to deflate the frames
+ * both ways; a server that declines leaves them as they are.
+ *
+ * An overloaded server turns new connections away with RESP_OVERLOADED
+ * (failing a login already queued) and closes them; connect again later.
+ *
+ * With reconnect enabled, a logged-in session whose connection drops waits a
+ * jittered, exponentially growing delay, reconnects, logs in again, rejoins
+ * its rooms (all in one round trip) and replays the messages it missed, by
+ * per-room sequence number, before going live. CHAT_EVENT_RECONNECTING
+ * precedes every attempt and CHAT_EVENT_RESUMED follows a successful one;
+ * CHAT_EVENT_DISCONNECTED is only reported once the session gives up. New
+ * requests fail while the session is reconnecting. The retry delay is a
+ * timer: call chat_session_tick() once chat_session_next_timeout() expires,
+ * which chat_session_poll() and chat_loop_run_once() do on their own.
+ */
+
+typedef struct chat_session chat_session_t;
+typedef struct chat_loop chat_loop_t;
+
+typedef enum {
+    CHAT_SESSION_DISCONNECTED,
+    CHAT_SESSION_CONNECTING,
+    CHAT_SESSION_CONNECTED,
+    CHAT_SESSION_AUTHENTICATED,
+    CHAT_SESSION_IN_ROOM
+} chat_session_state_t;
+
+typedef enum {
+    CHAT_REQUEST_LOGIN,
+    CHAT_REQUEST_REGISTER,
+    CHAT_REQUEST_CREATE_ROOM,
+    CHAT_REQUEST_JOIN_ROOM,
+    CHAT_REQUEST_LEAVE_ROOM,
+    CHAT_REQUEST_SEND_MESSAGE,
+    CHAT_REQUEST_SEND_DIRECT,
+    CHAT_REQUEST_LOGIN_JOIN
+} chat_request_type_t;
+
+typedef enum {
+    CHAT_EVENT_CONNECTED,
+    CHAT_EVENT_DISCONNECTED,
+    CHAT_EVENT_COMPLETION,
+    CHAT_EVENT_MESSAGE,
+    CHAT_EVENT_ERROR,
+    CHAT_EVENT_RECONNECTING,
+    CHAT_EVENT_RESUMED,
+    CHAT_EVENT_PRESENCE,
+    CHAT_EVENT_DIRECT
+} chat_event_type_t;
+
+/* Status of a completion that never reached the server. */
+#define CHAT_STATUS_LOCAL_ERROR -1
+
+#define CHAT_RECONNECT_INITIAL_DELAY_MS 500
+#define CHAT_RECONNECT_MAX_DELAY_MS 30000
+
+typedef struct {
+    int initial_delay_ms;       /* <= 0 uses CHAT_RECONNECT_INITIAL_DELAY_MS */
+    int max_delay_ms;           /* <= 0 uses CHAT_RECONNECT_MAX_DELAY_MS */
+    int max_attempts;           /* 0 retries forever */
+} chat_reconnect_policy_t;
+
+typedef struct {
+    chat_event_type_t type;
+
+    /* CHAT_EVENT_COMPLETION */
+    uint32_t request_id;
+    chat_request_type_t request;
+    int status;                 /* RESP_* or CHAT_STATUS_LOCAL_ERROR */
+
+    /* CHAT_EVENT_COMPLETION (create/join), CHAT_EVENT_MESSAGE and CHAT_EVENT_PRESENCE */
+    const char *room_id;
+    const char *room_name;
+
+    /* CHAT_EVENT_MESSAGE, CHAT_EVENT_DIRECT (the sender) and CHAT_EVENT_PRESENCE (NULL once a
+     * member snapshot is complete) */
+    const char *username;
+    const char *message;
+    uint64_t seq;               /* per-room sequence number, 0 if unknown */
+
+    /* CHAT_EVENT_DIRECT */
+    uint64_t sent_at;           /* unix time; older than now if it waited for us to log in */
+
+    /* CHAT_EVENT_PRESENCE */
+    bool joined;                /* false if username left the room */
+
+    /* CHAT_EVENT_RECONNECTING */
+    int attempt;
+    int delay_ms;
+
+    /* CHAT_EVENT_ERROR, CHAT_EVENT_DISCONNECTED, CHAT_EVENT_RECONNECTING */
+    int error_code;
+    const char *error_message;
+} chat_event_t;
+
+typedef void (*chat_event_cb_t)(chat_session_t *session, const chat_event_t *event, void *user_data);
+
+chat_session_t *chat_session_create(chat_event_cb_t callback, void *user_data);
+void chat_session_destroy(chat_session_t *session);
+void *chat_session_user_data(const chat_session_t *session);
+
+int chat_session_connect(chat_session_t *session, const char *hostname, int port);
+void chat_session_close(chat_session_t *session);
+int chat_session_set_reconnect(chat_session_t *session, const chat_reconnect_policy_t *policy);
+bool chat_session_reconnecting(const chat_session_t *session);
+int chat_session_set_compression(chat_session_t *session, bool enabled);
+uint32_t chat_session_capabilities(const chat_session_t *session);
+
+int chat_session_login(chat_session_t *session, const char *username, const char *password);
+int chat_session_login_join(chat_session_t *session, const char *username, const char *password,
+                            const char *const *room_ids, int room_count, int history);
+int chat_session_register(chat_session_t *session, const char *username, const char *password);
+int chat_session_create_room(chat_session_t *session, const char *room_name);
+int chat_session_join_room(chat_session_t *session, const char *room_id);
+int chat_session_leave_room(chat_session_t *session, const char *room_id);
+int chat_session_send_message(chat_session_t *session, const char *room_id, const char *message);
+int chat_session_send_direct(chat_session_t *session, const char *username, const char *message);
+
+int chat_session_fd(const chat_session_t *session);
+short chat_session_events(const chat_session_t *session);
+int chat_session_handle_io(chat_session_t *session, short revents);
+int chat_session_poll(chat_session_t *session, int timeout_ms);
+int chat_session_next_timeout(const chat_session_t *session);
+void chat_session_tick(chat_session_t *session);
+
+chat_session_state_t chat_session_state(const chat_session_t *session);
+const char *chat_session_username(const chat_session_t *session);
+int chat_session_room_count(const chat_session_t *session);
+const char *chat_session_room_id(const chat_session_t *session, int index);
+const char *chat_session_room_name(const chat_session_t *session, int index);
+bool chat_session_room_joined(const chat_session_t *session, int index);
+int chat_session_room_member_count(const chat_session_t *session, int index);
+const char *chat_session_room_member(const chat_session_t *session, int index, int member);
+
+chat_loop_t *chat_loop_create(void);
+void chat_loop_destroy(chat_loop_t *loop);
+int chat_loop_add(chat_loop_t *loop, chat_session_t *session);
+void chat_loop_remove(chat_loop_t *loop, chat_session_t *session);
+int chat_loop_run_once(chat_loop_t *loop, int timeout_ms);
+
+#endif
@@ -0,0 +1,183 @@
+#include "session_internal.h"
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/epoll.h>
+
+#define CHAT_LOOP_MAX_EVENTS 256
+
+struct chat_loop {
+    int epfd;
+    chat_session_t *timers;     /* sessions waiting to reconnect */
+};
+
+static uint32_t to_epoll_events(short events) {
+    uint32_t result = 0;
+    if (events & POLLIN) {
+        result |= EPOLLIN;
+    }
+    if (events & POLLOUT) {
+        result |= EPOLLOUT;
+    }
+    return result;
+}
+
+static short from_epoll_events(uint32_t events) {
+    short result = 0;
+    if (events & EPOLLIN) {
+        result |= POLLIN;
+    }
+    if (events & EPOLLOUT) {
+        result |= POLLOUT;
+    }
+    if (events & EPOLLERR) {
+        result |= POLLERR;
+    }
+    if (events & EPOLLHUP) {
+        result |= POLLHUP;
+    }
+    return result;
+}
+
+static void timer_unlink(chat_loop_t *loop, chat_session_t *session) {
+    if (!session->timer_linked) {
+        return;
+    }
+    if (session->timer_prev) {
+        session->timer_prev->timer_next = session->timer_next;
+    } else {
+        loop->timers = session->timer_next;
+    }
+    if (session->timer_next) {
+        session->timer_next->timer_prev = session->timer_prev;
+    }
+    session->timer_prev = NULL;
+    session->timer_next = NULL;
+    session->timer_linked = false;
+}
+
+chat_loop_t *chat_loop_create(void) {
+    chat_loop_t *loop = (chat_loop_t *)calloc(1, sizeof(chat_loop_t));
+    if (!loop) {
+        return NULL;
+    }
+    loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epfd < 0) {
+        free(loop);
+        return NULL;
+    }
+    return loop;
+}
+
+void chat_loop_destroy(chat_loop_t *loop) {
+    if (!loop) {
+        return;
+    }
+    close(loop->epfd);
+    free(loop);
+}
+
+int chat_loop_add(chat_loop_t *loop, chat_session_t *session) {
+    if (!loop || !session || session->loop) {
+        return -1;
+    }
+    session->loop = loop;
+    session->loop_events = 0;
+    chat_loop_session_changed(loop, session);
+    chat_loop_timer_changed(loop, session);
+    return 0;
+}
+
+void chat_loop_remove(chat_loop_t *loop, chat_session_t *session) {
+    if (!loop || !session || session->loop != loop) {
+        return;
+    }
+    chat_loop_session_closing(loop, session);
+    timer_unlink(loop, session);
+    session->loop = NULL;
+}
+
+void chat_loop_timer_changed(chat_loop_t *loop, chat_session_t *session) {
+    if (session->retry_pending && !session->timer_linked) {
+        session->timer_prev = NULL;
+        session->timer_next = loop->timers;
+        if (loop->timers) {
+            loop->timers->timer_prev = session;
+        }
+        loop->timers = session;
+        session->timer_linked = true;
+    } else if (!session->retry_pending) {
+        timer_unlink(loop, session);
+    }
+}
+
+static chat_session_t *due_timer(chat_loop_t *loop, uint64_t now, int *next_ms) {
+    *next_ms = -1;
+    for (chat_session_t *session = loop->timers; session; session = session->timer_next) {
+        if (session->retry_at_ns <= now) {
+            return session;
+        }
+        int ms = (int)((session->retry_at_ns - now + 999999) / 1000000);
+        if (*next_ms < 0 || ms < *next_ms) {
+            *next_ms = ms;
+        }
+    }
+    return NULL;
+}
+
+void chat_loop_session_changed(chat_loop_t *loop, chat_session_t *session) {
+    if (session->sockfd < 0) {
+        return;
+    }
+    uint32_t wanted = to_epoll_events(chat_session_events(session));
+    if (wanted == session->loop_events) {
+        return;
+    }
+
+    struct epoll_event ev;
+    ev.events = wanted;
+    ev.data.ptr = session;
+    int op = session->loop_events == 0 ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+    if (epoll_ctl(loop->epfd, op, session->sockfd, &ev) == 0) {
+        session->loop_events = wanted;
+    }
+}
+
+void chat_loop_session_closing(chat_loop_t *loop, chat_session_t *session) {
+    if (session->loop_events != 0 && session->sockfd >= 0) {
+        epoll_ctl(loop->epfd, EPOLL_CTL_DEL, session->sockfd, NULL);
+    }
+    session->loop_events = 0;
+}
+
+int chat_loop_run_once(chat_loop_t *loop, int timeout_ms) {
+    if (!loop) {
+        return -1;
+    }
+    int timer_ms;
+    if (due_timer(loop, chat_now_ns(), &timer_ms)) {
+        timer_ms = 0;
+    }
+    if (timer_ms >= 0 && (timeout_ms < 0 || timer_ms < timeout_ms)) {
+        timeout_ms = timer_ms;
+    }
+
+    struct epoll_event events[CHAT_LOOP_MAX_EVENTS];
+    int count = epoll_wait(loop->epfd, events, CHAT_LOOP_MAX_EVENTS, timeout_ms);
+    if (count < 0) {
+        return errno == EINTR ? 0 : -1;
+    }
+    for (int i = 0; i < count; i++) {
+        chat_session_t *session = (chat_session_t *)events[i].data.ptr;
+        chat_session_handle_io(session, from_epoll_events(events[i].events));
+    }
+
+    /* Rescan after each tick: callbacks may add or remove other timers. */
+    uint64_t now = chat_now_ns();
+    chat_session_t *session;
+    while ((session = due_timer(loop, now, &timer_ms)) != NULL) {
+        chat_session_tick(session);
+    }
+    return count;
+}
@@ -0,0 +1,1543 @@
+#include "session_internal.h"
+#include "message.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <time.h>
+
+static void emit_event(chat_session_t *session, const chat_event_t *event) {
+    if (session->callback) {
+        session->callback(session, event, session->user_data);
+    }
+}
+
+uint64_t chat_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t next_random(chat_session_t *session) {
+    uint64_t x = session->rng_state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    session->rng_state = x;
+    return x;
+}
+
+static session_room_t *find_room(chat_session_t *session, const char *room_id) {
+    for (int i = 0; i < session->room_count; i++) {
+        if (strcmp(session->rooms[i].room_id, room_id) == 0) {
+            return &session->rooms[i];
+        }
+    }
+    return NULL;
+}
+
+static session_room_t *add_room(chat_session_t *session, const char *room_id) {
+    session_room_t *room = find_room(session, room_id);
+    if (room) {
+        return room;
+    }
+    if (session->room_count == session->room_capacity) {
+        int capacity = session->room_capacity ? session->room_capacity * 2 : 8;
+        session_room_t *rooms = (session_room_t *)realloc(session->rooms, capacity * sizeof(session_room_t));
+        if (!rooms) {
+            return NULL;
+        }
+        session->rooms = rooms;
+        session->room_capacity = capacity;
+    }
+    room = &session->rooms[session->room_count++];
+    memset(room, 0, sizeof(*room));
+    safe_strcpy(room->room_id, room_id, sizeof(room->room_id));
+    return room;
+}
+
+static void remove_room(chat_session_t *session, const char *room_id) {
+    session_room_t *room = find_room(session, room_id);
+    if (room) {
+        free(room->members);
+        *room = session->rooms[--session->room_count];
+    }
+}
+
+static void clear_rooms(chat_session_t *session) {
+    for (int i = 0; i < session->room_count; i++) {
+        free(session->rooms[i].members);
+    }
+    session->room_count = 0;
+}
+
+static int find_member(const session_room_t *room, const char *username) {
+    for (int i = 0; i < room->member_count; i++) {
+        if (strcmp(room->members[i], username) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* Returns true if the member list changed. */
+static bool set_member(session_room_t *room, const char *username, bool present) {
+    int index = find_member(room, username);
+    if (!present) {
+        if (index < 0) {
+            return false;
+        }
+        memcpy(room->members[index], room->members[--room->member_count], MAX_USERNAME_LEN);
+        return true;
+    }
+    if (index >= 0) {
+        return false;
+    }
+    if (room->member_count == room->member_capacity) {
+        int capacity = room->member_capacity ? room->member_capacity * 2 : 8;
+        char (*members)[MAX_USERNAME_LEN] = realloc(room->members, capacity * sizeof(*members));
+        if (!members) {
+            return false;
+        }
+        room->members = members;
+        room->member_capacity = capacity;
+    }
+    safe_strcpy(room->members[room->member_count++], username, MAX_USERNAME_LEN);
+    return true;
+}
+
+static void update_room_state(chat_session_t *session) {
+    if (session->state < CHAT_SESSION_AUTHENTICATED) {
+        return;
+    }
+    session->state = CHAT_SESSION_AUTHENTICATED;
+    for (int i = 0; i < session->room_count; i++) {
+        if (session->rooms[i].joined) {
+            session->state = CHAT_SESSION_IN_ROOM;
+            return;
+        }
+    }
+}
+
+static int pending_push(pending_queue_t *queue, const pending_request_t *request) {
+    if (queue->count == queue->capacity) {
+        size_t capacity = queue->capacity ? queue->capacity * 2 : 8;
+        pending_request_t *items = (pending_request_t *)malloc(capacity * sizeof(pending_request_t));
+        if (!items) {
+            return -1;
+        }
+        for (size_t i = 0; i < queue->count; i++) {
+            items[i] = queue->items[(queue->head + i) % queue->capacity];
+        }
+        free(queue->items);
+        queue->items = items;
+        queue->head = 0;
+        queue->capacity = capacity;
+    }
+    queue->items[(queue->head + queue->count) % queue->capacity] = *request;
+    queue->count++;
+    return 0;
+}
+
+static pending_request_t *pending_at(pending_queue_t *queue, size_t i) {
+    return &queue->items[(queue->head + i) % queue->capacity];
+}
+
+static bool pending_take(pending_queue_t *queue, size_t i, pending_request_t *out) {
+    if (i >= queue->count) {
+        return false;
+    }
+    *out = *pending_at(queue, i);
+    for (size_t j = i; j > 0; j--) {
+        *pending_at(queue, j) = *pending_at(queue, j - 1);
+    }
+    queue->head = (queue->head + 1) % queue->capacity;
+    queue->count--;
+    return true;
+}
+
+static bool pending_take_type(pending_queue_t *queue, chat_request_type_t type, pending_request_t *out) {
+    for (size_t i = 0; i < queue->count; i++) {
+        if (pending_at(queue, i)->type == type) {
+            return pending_take(queue, i, out);
+        }
+    }
+    return false;
+}
+
+static bool pending_take_id(pending_queue_t *queue, uint32_t id, pending_request_t *out) {
+    for (size_t i = 0; i < queue->count; i++) {
+        if (pending_at(queue, i)->id == id) {
+            return pending_take(queue, i, out);
+        }
+    }
+    return false;
+}
+
+/* Untagged joins can be answered by different backends behind a proxy, so match them by room rather than order. */
+static bool pending_take_join(pending_queue_t *queue, const char *room_id, pending_request_t *out) {
+    for (size_t i = 0; i < queue->count; i++) {
+        pending_request_t *request = pending_at(queue, i);
+        if (request->type == CHAT_REQUEST_JOIN_ROOM && strncmp(request->arg, room_id, MAX_ROOM_ID_LEN) == 0) {
+            return pending_take(queue, i, out);
+        }
+    }
+    return pending_take_type(queue, CHAT_REQUEST_JOIN_ROOM, out);
+}
+
+/* A tagged answer names its request; an untagged one goes to the oldest request of its type. */
+static bool take_answer(chat_session_t *session, uint32_t request_id, chat_request_type_t type,
+                        pending_request_t *out) {
+    if (request_id != 0) {
+        return pending_take_id(&session->awaiting_response, request_id, out);
+    }
+    return pending_take_type(&session->awaiting_response, type, out);
+}
+
+static void resume_step(chat_session_t *session, const pending_request_t *request, int status);
+
+static void complete_request(chat_session_t *session, const pending_request_t *request, int status,
+                             const char *room_id, const char *room_name,
+                             int error_code, const char *error_message) {
+    if (request->internal) {
+        resume_step(session, request, status);
+        return;
+    }
+    chat_event_t event;
+    memset(&event, 0, sizeof(event));
+    event.type = CHAT_EVENT_COMPLETION;
+    event.request_id = request->id;
+    event.request = request->type;
+    event.status = status;
+    event.room_id = room_id;
+    event.room_name = room_name;
+    event.error_code = error_code;
+    event.error_message = error_message;
+    emit_event(session, &event);
+}
+
+static void fail_queue(chat_session_t *session, pending_queue_t *queue) {
+    pending_request_t request;
+    while (pending_take(queue, 0, &request)) {
+        if (!request.internal) {
+            complete_request(session, &request, CHAT_STATUS_LOCAL_ERROR, NULL, NULL, 0, "Disconnected");
+        }
+    }
+    free(queue->items);
+}
+
+static void notify_loop(chat_session_t *session) {
+    if (session->loop) {
+        chat_loop_session_changed(session->loop, session);
+    }
+}
+
+static void set_retry(chat_session_t *session, bool pending, uint64_t at_ns) {
+    session->retry_pending = pending;
+    session->retry_at_ns = at_ns;
+    if (session->loop) {
+        chat_loop_timer_changed(session->loop, session);
+    }
+}
+
+static bool close_socket(chat_session_t *session) {
+    if (session->sockfd < 0) {
+        return false;
+    }
+
+    if (session->loop) {
+        chat_loop_session_closing(session->loop, session);
+    }
+    close(session->sockfd);
+    session->sockfd = -1;
+    session->state = CHAT_SESSION_DISCONNECTED;
+    session->generation++;
+    session->in_len = 0;
+    session->out_start = 0;
+    session->out_len = 0;
+    session->hello_pending = false;
+    session->server_version = 0;
+    session->server_caps = 0;
+    compress_stream_free(session->deflater);
+    compress_stream_free(session->inflater);
+    session->deflater = NULL;
+    session->inflater = NULL;
+
+    pending_queue_t awaiting_response = session->awaiting_response;
+    pending_queue_t awaiting_write = session->awaiting_write;
+    memset(&session->awaiting_response, 0, sizeof(pending_queue_t));
+    memset(&session->awaiting_write, 0, sizeof(pending_queue_t));
+    fail_queue(session, &awaiting_response);
+    fail_queue(session, &awaiting_write);
+    return true;
+}
+
+static void forget_identity(chat_session_t *session) {
+    session->resuming = false;
+    session->attempt = 0;
+    session->username[0] = '\0';
+    session->password[0] = '\0';
+    clear_rooms(session);
+    session->resume_joins = 0;
+    session->unconfirmed_count = 0;
+}
+
+static void emit_disconnected(chat_session_t *session, int error_code, const char *reason) {
+    chat_event_t event;
+    memset(&event, 0, sizeof(event));
+    event.type = CHAT_EVENT_DISCONNECTED;
+    event.error_code = error_code;
+    event.error_message = reason;
+    emit_event(session, &event);
+}
+
+static void session_teardown(chat_session_t *session, int error_code, const char *reason) {
+    bool was_resuming = session->resuming;
+    set_retry(session, false, 0);
+    forget_identity(session);
+    if (close_socket(session) || was_resuming) {
+        emit_disconnected(session, error_code, reason);
+    }
+}
+
+static void schedule_retry(chat_session_t *session, int error_code, const char *reason) {
+    const chat_reconnect_policy_t *policy = &session->reconnect_policy;
+    session->attempt++;
+    if (policy->max_attempts > 0 && session->attempt > policy->max_attempts) {
+        session_teardown(session, error_code, reason);
+        return;
+    }
+
+    /* Equal jitter: half the capped exponential delay, plus a random half. */
+    uint64_t cap = (uint64_t)policy->initial_delay_ms;
+    for (int i = 1; i < session->attempt && cap < (uint64_t)policy->max_delay_ms; i++) {
+        cap *= 2;
+    }
+    if (cap > (uint64_t)policy->max_delay_ms) {
+        cap = (uint64_t)policy->max_delay_ms;
+    }
+    int delay_ms = (int)(cap / 2 + next_random(session) % (cap / 2 + 1));
+    set_retry(session, true, chat_now_ns() + (uint64_t)delay_ms * 1000000ULL);
+
+    chat_event_t event;
+    memset(&event, 0, sizeof(event));
+    event.type = CHAT_EVENT_RECONNECTING;
+    event.attempt = session->attempt;
+    event.delay_ms = delay_ms;
+    event.error_code = error_code;
+    event.error_message = reason;
+    emit_event(session, &event);
+}
+
+/* Connection failures go through here; protocol violations use session_teardown(). */
+static void session_lost(chat_session_t *session, int error_code, const char *reason) {
+    bool resumable = session->reconnect_enabled && session->password[0] != '\0' &&
+                     (session->resuming || session->state >= CHAT_SESSION_AUTHENTICATED);
+    if (!resumable) {
+        session_teardown(session, error_code, reason);
+        return;
+    }
+    if (!session->resuming) {
+        session->resuming = true;
+        session->attempt = 0;
+    }
+    for (int i = session->room_count - 1; i >= 0; i--) {
+        if (!session->rooms[i].joined) {
+            free(session->rooms[i].members);
+            session->rooms[i] = session->rooms[--session->room_count];
+        }
+    }
+    close_socket(session);
+    schedule_retry(session, error_code, reason);
+}
+
+static int session_queue_tagged(chat_session_t *session, const void *frame, size_t length, uint32_t request_id);
+static int session_queue_frame(chat_session_t *session, const void *frame, size_t length);
+static int session_flush(chat_session_t *session);
+
+/* Sent messages the server never echoed may or may not have arrived; their ids make resending them safe. */
+static void resend_unconfirmed(chat_session_t *session) {
+    int kept = 0;
+    for (int i = 0; i < session->unconfirmed_count; i++) {
+        chat_message_t *msg = &session->unconfirmed[i];
+        session_room_t *room = find_room(session, msg->room_id);
+        if (!room || !room->joined || session_queue_frame(session, msg, sizeof(chat_message_t)) != 0) {
+            continue;
+        }
+        session->unconfirmed[kept++] = *msg;
+    }
+    session->unconfirmed_count = kept;
+    if (kept > 0) {
+        session_flush(session);
+        notify_loop(session);
+    }
+}
+
+static void finish_resume(chat_session_t *session) {
+    session->resuming = false;
+    session->attempt = 0;
+    resend_unconfirmed(session);
+
+    chat_event_t event;
+    memset(&event, 0, sizeof(event));
+    event.type = CHAT_EVENT_RESUMED;
+    emit_event(session, &event);
+}
+
+chat_session_t *chat_session_create(chat_event_cb_t callback, void *user_data) {
+    chat_session_t *session = (chat_session_t *)calloc(1, sizeof(chat_session_t));
+    if (!session) {
+        return NULL;
+    }
+    session->sockfd = -1;
+    session->state = CHAT_SESSION_DISCONNECTED;
+    session->callback = callback;
+    session->user_data = user_data;
+    session->rng_state = chat_now_ns() ^ (uint64_t)(uintptr_t)session;
+    if (session->rng_state == 0) {
+        session->rng_state = 0x9e3779b97f4a7c15ULL;
+    }
+    /* A random start keeps ids from different sessions of one user apart. */
+    session->next_msg_id = next_random(session);
+    return session;
+}
+
+void chat_session_destroy(chat_session_t *session) {
+    if (!session) {
+        return;
+    }
+    if (session->loop) {
+        chat_loop_remove(session->loop, session);
+    }
+    session->callback = NULL;
+    session_teardown(session, 0, NULL);
+    free(session->awaiting_response.items);
+    free(session->awaiting_write.items);
+    free(session->unconfirmed);
+    free(session->out_buf);
+    clear_rooms(session);
+    free(session->rooms);
+    free(session);
+}
+
+void *chat_session_user_data(const chat_session_t *session) {
+    return session ? session->user_data : NULL;
+}
+
+/*
+ * Queued first on every connection, untagged since the server may not know
+ * tags either. Until it is answered requests go out untagged and chat frames
+ * in full, which any server reads.
+ */
+static void send_hello(chat_session_t *session) {
+    uint32_t wanted = CAP_COMPACT | CAP_MULTI_ROOM | CAP_PIPELINING;
+    if (session->compression) {
+        session->deflater = compress_stream_create(true);
+        session->inflater = compress_stream_create(false);
+        if (session->deflater && session->inflater) {
+            wanted |= CAP_COMPRESSION;
+        }
+    }
+    hello_message_t *hello = create_hello_message(PROTOCOL_VERSION, wanted);
+    if (hello && session_queue_frame(session, hello, sizeof(hello_message_t)) == 0) {
+        session->hello_pending = true;
+    }
+    free_message(hello);
+}
+
+static int session_open(chat_session_t *session) {
+    const char *hostname = session->hostname;
+    int port = session->port;
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    char port_str[16];
+    snprintf(port_str, sizeof(port_str), "%d", port);
+
+    struct addrinfo *result = NULL;
+    if (getaddrinfo(hostname, port_str, &hints, &result) != 0 || !result) {
+        return -1;
+    }
+
+    int sockfd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sockfd < 0) {
+        freeaddrinfo(result);
+        return -1;
+    }
+    int opt = 1;
+    setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+
+    int rc = connect(sockfd, result->ai_addr, result->ai_addrlen);
+    freeaddrinfo(result);
+    if (rc < 0 && errno != EINPROGRESS) {
+        close(sockfd);
+        return -1;
+    }
+
+    session->sockfd = sockfd;
+    session->state = CHAT_SESSION_CONNECTING;
+    session->in_len = 0;
+    session->out_start = 0;
+    session->out_len = 0;
+    send_hello(session);
+    notify_loop(session);
+    return 0;
+}
+
+int chat_session_connect(chat_session_t *session, const char *hostname, int port) {
+    if (!session || !hostname || port <= 0 || session->sockfd >= 0) {
+        return -1;
+    }
+    set_retry(session, false, 0);
+    forget_identity(session);
+    safe_strcpy(session->hostname, hostname, sizeof(session->hostname));
+    session->port = port;
+    return session_open(session);
+}
+
+void chat_session_close(chat_session_t *session) {
+    if (session) {
+        session_teardown(session, 0, NULL);
+    }
+}
+
+int chat_session_set_reconnect(chat_session_t *session, const chat_reconnect_policy_t *policy) {
+    if (!session || (policy && policy->max_attempts < 0)) {
+        return -1;
+    }
+    session->reconnect_enabled = policy != NULL;
+    if (policy) {
+        session->reconnect_policy = *policy;
+        if (session->reconnect_policy.initial_delay_ms <= 0) {
+            session->reconnect_policy.initial_delay_ms = CHAT_RECONNECT_INITIAL_DELAY_MS;
+        }
+        if (session->reconnect_policy.max_delay_ms <= 0) {
+            session->reconnect_policy.max_delay_ms = CHAT_RECONNECT_MAX_DELAY_MS;
+        }
+        if (session->reconnect_policy.max_delay_ms < session->reconnect_policy.initial_delay_ms) {
+            session->reconnect_policy.max_delay_ms = session->reconnect_policy.initial_delay_ms;
+        }
+    }
+    return 0;
+}
+
+bool chat_session_reconnecting(const chat_session_t *session) {
+    return session && session->resuming;
+}
+
+/* What the server granted this connection: 0 until CHAT_EVENT_CONNECTED, and from servers older than the hello. */
+uint32_t chat_session_capabilities(const chat_session_t *session) {
+    return session ? session->server_caps : 0;
+}
+
+/* Takes effect from the next connection on, reconnects included. */
+int chat_session_set_compression(chat_session_t *session, bool enabled) {
+    if (!session) {
+        return -1;
+    }
+    session->compression = enabled;
+    return 0;
+}
+
+static int session_flush(chat_session_t *session) {
+    while (session->out_len > 0) {
+        ssize_t sent = send(session->sockfd, session->out_buf + session->out_start,
+                            session->out_len, MSG_NOSIGNAL);
+        if (sent > 0) {
+            session->out_start += (size_t)sent;
+            session->out_len -= (size_t)sent;
+            session->bytes_written += (uint64_t)sent;
+            continue;
+        }
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        return -1;
+    }
+    if (session->out_len == 0) {
+        session->out_start = 0;
+    }
+    return 0;
+}
+
+/* A request_id of 0 queues the frame untagged. */
+static int session_queue_tagged(chat_session_t *session, const void *frame, size_t length, uint32_t request_id) {
+    chat_compact_t compact;
+    if ((session->server_caps & CAP_COMPACT) && ((const message_header_t *)frame)->type == MSG_CHAT_MESSAGE &&
+        length == sizeof(chat_message_t)) {
+        length = chat_compact((const chat_message_t *)frame, &compact);
+        frame = &compact;
+    }
+    char packed[COMPRESS_BOUND(CHAT_MAX_FRAME_SIZE)];
+    if ((session->server_caps & CAP_COMPRESSION) && length >= COMPRESS_MIN_FRAME &&
+        COMPRESS_BOUND(length) <= sizeof(packed)) {
+        int packed_length = compress_frame(session->deflater, false, frame, length, request_id, packed,
+                                           sizeof(packed));
+        if (packed_length < 0) {
+            /* The stream is broken now; later frames go out as they are, which the server still reads. */
+            session->server_caps &= ~CAP_COMPRESSION;
+            return -1;
+        }
+        frame = packed;
+        length = (size_t)packed_length;
+        request_id = 0;
+    }
+    size_t wire_length = length + (request_id ? FRAME_TAG_SIZE : 0);
+    if (session->out_start + session->out_len + wire_length > session->out_capacity) {
+        if (session->out_start > 0) {
+            memmove(session->out_buf, session->out_buf + session->out_start, session->out_len);
+            session->out_start = 0;
+        }
+        size_t capacity = session->out_capacity ? session->out_capacity : CHAT_MAX_FRAME_SIZE;
+        while (session->out_len + wire_length > capacity) {
+            capacity *= 2;
+        }
+        if (capacity != session->out_capacity) {
+            char *out_buf = (char *)realloc(session->out_buf, capacity);
+            if (!out_buf) {
+                return -1;
+            }
+            session->out_buf = out_buf;
+            session->out_capacity = capacity;
+        }
+    }
+
+    char *dest = session->out_buf + session->out_start + session->out_len;
+    message_header_t *header = (message_header_t *)dest;
+    if (request_id) {
+        uint32_t net_id = htonl(request_id);
+        memcpy(dest, frame, sizeof(message_header_t));
+        memcpy(dest + sizeof(message_header_t), &net_id, FRAME_TAG_SIZE);
+        memcpy(dest + sizeof(message_header_t) + FRAME_TAG_SIZE, (const char *)frame + sizeof(message_header_t),
+               length - sizeof(message_header_t));
+        header->length = htonl((header->length + FRAME_TAG_SIZE) | FRAME_TAGGED);
+    } else {
+        memcpy(dest, frame, length);
+        header->length = htonl(header->length);
+    }
+    session->out_len += wire_length;
+    session->bytes_queued += wire_length;
+    return 0;
+}
+
+static int session_queue_frame(chat_session_t *session, const void *frame, size_t length) {
+    return session_queue_tagged(session, frame, length, 0);
+}
+
+static int session_submit(chat_session_t *session, chat_request_type_t type, const void *frame,
+                          size_t length, bool expects_response, const char *arg, bool internal) {
+    if (!frame || session->sockfd < 0 || (session->resuming && !internal)) {
+        return -1;
+    }
+
+    pending_request_t request;
+    memset(&request, 0, sizeof(request));
+    request.id = ++session->next_request_id;
+    if (request.id == 0) {
+        request.id = ++session->next_request_id;
+    }
+    /* Tagged with its id, so the answer finds it however many requests are in flight. */
+    if (session_queue_tagged(session, frame, length,
+                             (session->server_caps & CAP_PIPELINING) ? request.id : 0) != 0) {
+        return -1;
+    }
+    request.type = type;
+    request.out_end = session->bytes_queued;
+    request.internal = internal;
+    if (arg) {
+        safe_strcpy(request.arg, arg, sizeof(request.arg));
+    }
+    if (pending_push(expects_response ? &session->awaiting_response : &session->awaiting_write,
+                     &request) != 0) {
+        return -1;
+    }
+
+    if (session->state != CHAT_SESSION_CONNECTING) {
+        session_flush(session);
+    }
+    notify_loop(session);
+    return (int)request.id;
+}
+
+int chat_session_login(chat_session_t *session, const char *username, const char *password) {
+    if (!session || !username || !password || session->state == CHAT_SESSION_DISCONNECTED) {
+        return -1;
+    }
+    auth_request_t *req = create_auth_request(username, password);
+    int id = session_submit(session, CHAT_REQUEST_LOGIN, req, sizeof(auth_request_t), true, username, false);
+    free_message(req);
+    if (id > 0) {
+        safe_strcpy(session->login_password, password, sizeof(session->login_password));
+    }
+    return id;
+}
+
+int chat_session_login_join(chat_session_t *session, const char *username, const char *password,
+                            const char *const *room_ids, int room_count, int history) {
+    if (!session || !username || !password || (room_count > 0 && !room_ids) || room_count < 0 ||
+        room_count > LOGIN_JOIN_MAX_ROOMS || session->state == CHAT_SESSION_DISCONNECTED ||
+        (!session->hello_pending && !(session->server_caps & CAP_MULTI_ROOM))) {
+        return -1;
+    }
+    login_join_request_t *req = create_login_join_request(username, password);
+    if (!req) {
+        return -1;
+    }
+    uint16_t tail = history < 0 ? 0 : history > MAX_HISTORY_REPLAY ? MAX_HISTORY_REPLAY : (uint16_t)history;
+    for (int i = 0; i < room_count; i++) {
+        login_join_request_add(req, room_ids[i], false, 0, tail);
+    }
+    int id = session_submit(session, CHAT_REQUEST_LOGIN_JOIN, req, req->header.length, true, username, false);
+    free_message(req);
+    if (id > 0) {
+        safe_strcpy(session->login_password, password, sizeof(session->login_password));
+        for (int i = 0; i < room_count; i++) {
+            add_room(session, room_ids[i]);
+        }
+    }
+    return id;
+}
+
+int chat_session_register(chat_session_t *session, const char *username, const char *password) {
+    if (!session || !username || !password || session->state == CHAT_SESSION_DISCONNECTED) {
+        return -1;
+    }
+    register_request_t *req = create_register_request(username, password);
+    int id = session_submit(session, CHAT_REQUEST_REGISTER, req, sizeof(register_request_t), true, username,
+                            false);
+    free_message(req);
+    return id;
+}
+
+int chat_session_create_room(chat_session_t *session, const char *room_name) {
+    if (!session || !room_name || session->state < CHAT_SESSION_AUTHENTICATED) {
+        return -1;
+    }
+    create_room_request_t *req = create_room_request(room_name);
+    int id = session_submit(session, CHAT_REQUEST_CREATE_ROOM, req, sizeof(create_room_request_t), true,
+                            room_name, false);
+    free_message(req);
+    return id;
+}
+
+int chat_session_join_room(chat_session_t *session, const char *room_id) {
+    if (!session || !room_id || session->state < CHAT_SESSION_AUTHENTICATED) {
+        return -1;
+    }
+    join_room_request_t *req = create_join_room_request(room_id);
+    int id = session_submit(session, CHAT_REQUEST_JOIN_ROOM, req, sizeof(join_room_request_t), true, room_id,
+                            false);
+    free_message(req);
+    if (id > 0 && !find_room(session, room_id)) {
+        add_room(session, room_id);
+    }
+    return id;
+}
+
+int chat_session_leave_room(chat_session_t *session, const char *room_id) {
+    if (!session || !room_id || session->state < CHAT_SESSION_IN_ROOM) {
+        return -1;
+    }
+    session_room_t *room = find_room(session, room_id);
+    if (!room || !room->joined) {
+        return -1;
+    }
+    leave_room_request_t *req = create_leave_room_request(room_id);
+    int id = session_submit(session, CHAT_REQUEST_LEAVE_ROOM, req, sizeof(leave_room_request_t), false, NULL,
+                            false);
+    free_message(req);
+    if (id > 0) {
+        remove_room(session, room_id);
+        update_room_state(session);
+    }
+    return id;
+}
+
+static void remember_sent(chat_session_t *session, const chat_message_t *msg) {
+    if (!session->unconfirmed) {
+        session->unconfirmed = (chat_message_t *)malloc(CHAT_RETRY_WINDOW * sizeof(chat_message_t));
+        if (!session->unconfirmed) {
+            return;
+        }
+    }
+    if (session->unconfirmed_count == CHAT_RETRY_WINDOW) {
+        /* The oldest is given up on; it will not be resent. */
+        memmove(session->unconfirmed, session->unconfirmed + 1, (CHAT_RETRY_WINDOW - 1) * sizeof(chat_message_t));
+        session->unconfirmed_count--;
+    }
+    session->unconfirmed[session->unconfirmed_count++] = *msg;
+}
+
+static void confirm_sent(chat_session_t *session, uint64_t msg_id) {
+    for (int i = 0; i < session->unconfirmed_count; i++) {
+        if (session->unconfirmed[i].msg_id == msg_id) {
+            memmove(session->unconfirmed + i, session->unconfirmed + i + 1,
+                    (size_t)(session->unconfirmed_count - i - 1) * sizeof(chat_message_t));
+            session->unconfirmed_count--;
+            return;
+        }
+    }
+}
+
+int chat_session_send_message(chat_session_t *session, const char *room_id, const char *message) {
+    if (!session || !room_id || !message || session->state < CHAT_SESSION_IN_ROOM) {
+        return -1;
+    }
+    session_room_t *room = find_room(session, room_id);
+    if (!room || !room->joined) {
+        return -1;
+    }
+    chat_message_t *msg = create_chat_message(room_id, session->username, message);
+    if (!msg) {
+        return -1;
+    }
+    if (++session->next_msg_id == 0) {
+        session->next_msg_id++;
+    }
+    msg->msg_id = session->next_msg_id;
+    int id = session_submit(session, CHAT_REQUEST_SEND_MESSAGE, msg, sizeof(chat_message_t), false, NULL, false);
+    if (id > 0) {
+        remember_sent(session, msg);
+    }
+    free_message(msg);
+    return id;
+}
+
+int chat_session_send_direct(chat_session_t *session, const char *username, const char *message) {
+    if (!session || !username || !message || session->state < CHAT_SESSION_AUTHENTICATED) {
+        return -1;
+    }
+    direct_message_t *msg = create_direct_message(username, session->username, message);
+    int id = session_submit(session, CHAT_REQUEST_SEND_DIRECT, msg, sizeof(direct_message_t), false, NULL, false);
+    free_message(msg);
+    return id;
+}
+
+/* One frame acks every joined room that has moved on by at least `threshold` messages. */
+static void queue_acks(chat_session_t *session, uint64_t threshold) {
+    ack_message_t *ack = NULL;
+    for (int i = 0; i < session->room_count; i++) {
+        session_room_t *room = &session->rooms[i];
+        if (!room->joined || room->last_seq <= room->acked_seq || room->last_seq - room->acked_seq < threshold) {
+            continue;
+        }
+        if (!ack && !(ack = create_ack_message())) {
+            return;
+        }
+        if (ack->count == ACK_MAX_ENTRIES) {
+            session_queue_frame(session, ack, ack->header.length);
+            ack->count = 0;
+            ack->header.length = ACK_MESSAGE_SIZE(0);
+        }
+        ack_message_add(ack, room->room_id, room->last_seq, 0);
+        room->acked_seq = room->last_seq;
+    }
+    if (ack && ack->count > 0) {
+        session_queue_frame(session, ack, ack->header.length);
+    }
+    free_message(ack);
+}
+
+static void request_resend(chat_session_t *session, session_room_t *room) {
+    ack_message_t *ack = create_ack_message();
+    if (ack && ack_message_add(ack, room->room_id, room->last_seq, ACK_GAP) == 0 &&
+        session_queue_frame(session, ack, ack->header.length) == 0) {
+        room->resend_pending = true;
+        room->acked_seq = room->last_seq;
+    }
+    free_message(ack);
+}
+
+static bool resume_join(chat_session_t *session, const session_room_t *room);
+
+/*
+ * Logs in and rejoins the first LOGIN_JOIN_MAX_ROOMS rooms in one request;
+ * joins for any others follow it down the same connection without waiting,
+ * so the whole resume costs one round trip. A server without CAP_MULTI_ROOM
+ * gets a plain login with every join behind it instead.
+ */
+static void resume_login(chat_session_t *session) {
+    int id = -1;
+    int joined = 0;
+    if (session->server_caps & CAP_MULTI_ROOM) {
+        login_join_request_t *req = create_login_join_request(session->username, session->password);
+        for (; req && joined < session->room_count && joined < LOGIN_JOIN_MAX_ROOMS; joined++) {
+            login_join_request_add(req, session->rooms[joined].room_id, true, session->rooms[joined].last_seq, 0);
+        }
+        if (req) {
+            id = session_submit(session, CHAT_REQUEST_LOGIN_JOIN, req, req->header.length, true,
+                                session->username, true);
+        }
+        free_message(req);
+    } else {
+        auth_request_t *req = create_auth_request(session->username, session->password);
+        if (req) {
+            id = session_submit(session, CHAT_REQUEST_LOGIN, req, sizeof(auth_request_t), true,
+                                session->username, true);
+        }
+        free_message(req);
+    }
+    if (id <= 0) {
+        session_lost(session, ENOMEM, "Failed to queue login");
+        return;
+    }
+    session->resume_joins = 1;
+    for (int i = joined; i < session->room_count; i++) {
+        if (!resume_join(session, &session->rooms[i])) {
+            session_lost(session, ENOMEM, "Failed to queue join");
+            return;
+        }
+        session->resume_joins++;
+    }
+}
+
+static bool resume_join(chat_session_t *session, const session_room_t *room) {
+    join_room_request_t *req = create_join_room_request(room->room_id);
+    if (!req) {
+        return false;
+    }
+    req->resume = 1;
+    req->since_seq = room->last_seq;
+    int id = session_submit(session, CHAT_REQUEST_JOIN_ROOM, req, sizeof(join_room_request_t), true,
+                            room->room_id, true);
+    free_message(req);
+    return id > 0;
+}
+
+static void resume_step(chat_session_t *session, const pending_request_t *request, int status) {
+    switch (request->type) {
+        case CHAT_REQUEST_LOGIN:
+        case CHAT_REQUEST_LOGIN_JOIN:
+            if (status == RESP_OVERLOADED) {
+                /* Refused for load, not for the credentials: keep backing off. */
+                session_lost(session, EAGAIN, "Server overloaded");
+                return;
+            }
+            if (status != RESP_SUCCESS) {
+                session_teardown(session, EACCES, "Login rejected while reconnecting");
+                return;
+            }
+            if (--session->resume_joins == 0) {
+                finish_resume(session);
+            }
+            break;
+
+        case CHAT_REQUEST_JOIN_ROOM:
+            if (status != RESP_SUCCESS) {
+                remove_room(session, request->arg);
+                update_room_state(session);
+            }
+            if (--session->resume_joins == 0) {
+                finish_resume(session);
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+/*
+ * The server answered the hello, or turned out to predate it; frames use
+ * what it granted from here on. Only now is the session reported connected,
+ * or a reconnect resumed, so both know what the server understands.
+ */
+static void session_ready(chat_session_t *session, uint16_t version, uint32_t capabilities) {
+    session->hello_pending = false;
+    session->server_version = version;
+    session->server_caps = capabilities;
+    if (!session->deflater || !session->inflater) {
+        session->server_caps &= ~CAP_COMPRESSION;
+    }
+    if (session->resuming) {
+        resume_login(session);
+        return;
+    }
+    chat_event_t event;
+    memset(&event, 0, sizeof(event));
+    event.type = CHAT_EVENT_CONNECTED;
+    emit_event(session, &event);
+}
+
+static void dispatch_frame(chat_session_t *session, char *frame, uint32_t length, uint32_t request_id) {
+    message_header_t *header = (message_header_t *)frame;
+    pending_request_t request;
+
+    /* Types this library does not know are skipped; known ones must be whole. */
+    if (!message_known(header->type)) {
+        return;
+    }
+    if (!message_check(frame, length)) {
+        session_teardown(session, EPROTO, "Malformed frame from server");
+        return;
+    }
+    switch (header->type) {
+        case MSG_AUTH_RESPONSE: {
+            auth_response_t *resp = (auth_response_t *)frame;
+            if (!take_answer(session, request_id, CHAT_REQUEST_LOGIN, &request)) {
+                return;
+            }
+            if (resp->status == RESP_SUCCESS) {
+                safe_strcpy(session->username, request.arg, sizeof(session->username));
+                if (!request.internal) {
+                    safe_strcpy(session->password, session->login_password, sizeof(session->password));
+                }
+                if (session->state < CHAT_SESSION_AUTHENTICATED) {
+                    session->state = CHAT_SESSION_AUTHENTICATED;
+                }
+            }
+            complete_request(session, &request, resp->status, NULL, NULL, 0, NULL);
+            break;
+        }
+
+        case MSG_LOGIN_JOIN_RESPONSE: {
+            login_join_response_t *resp = (login_join_response_t *)frame;
+            if (!take_answer(session, request_id, CHAT_REQUEST_LOGIN_JOIN, &request)) {
+                return;
+            }
+            if (resp->status == RESP_SUCCESS) {
+                safe_strcpy(session->username, request.arg, sizeof(session->username));
+                if (!request.internal) {
+                    safe_strcpy(session->password, session->login_password, sizeof(session->password));
+                }
+                if (session->state < CHAT_SESSION_AUTHENTICATED) {
+                    session->state = CHAT_SESSION_AUTHENTICATED;
+                }
+            }
+            for (int i = 0; i < resp->count; i++) {
+                login_join_result_t *result = &resp->results[i];
+                char room_id[MAX_ROOM_ID_LEN];
+                safe_strcpy(room_id, result->room_id, sizeof(room_id));
+                session_room_t *room = find_room(session, room_id);
+                if (!room) {
+                    continue;
+                }
+                if (result->status == RESP_SUCCESS) {
+                    safe_strcpy(room->room_name, result->room_name, sizeof(room->room_name));
+                    if (result->head_seq > room->last_seq) {
+                        room->last_seq = result->head_seq;
+                    }
+                    room->joined = true;
+                    room->resend_pending = false;
+                } else if (request.internal || !room->joined) {
+                    remove_room(session, room_id);
+                }
+            }
+            if (resp->status != RESP_SUCCESS && !request.internal) {
+                /* Nothing was joined, so drop the rooms this login asked for. */
+                for (int i = session->room_count - 1; i >= 0; i--) {
+                    if (!session->rooms[i].joined) {
+                        remove_room(session, session->rooms[i].room_id);
+                    }
+                }
+            }
+            update_room_state(session);
+            complete_request(session, &request, resp->status, NULL, NULL, 0, NULL);
+            break;
+        }
+
+        case MSG_REGISTER_RESPONSE: {
+            register_response_t *resp = (register_response_t *)frame;
+            if (take_answer(session, request_id, CHAT_REQUEST_REGISTER, &request)) {
+                complete_request(session, &request, resp->status, NULL, NULL, 0, NULL);
+            }
+            break;
+        }
+
+        case MSG_CREATE_ROOM_RESPONSE: {
+            create_room_response_t *resp = (create_room_response_t *)frame;
+            if (!take_answer(session, request_id, CHAT_REQUEST_CREATE_ROOM, &request)) {
+                return;
+            }
+            char room_id[MAX_ROOM_ID_LEN];
+            safe_strcpy(room_id, resp->room_id, sizeof(room_id));
+            session_room_t *room = resp->status == RESP_SUCCESS ? add_room(session, room_id) : NULL;
+            if (room) {
+                safe_strcpy(room->room_name, request.arg, sizeof(room->room_name));
+                /* The snapshot went out before the room was ours to track; a new room holds only us. */
+                set_member(room, session->username, true);
+                room->joined = true;
+                update_room_state(session);
+            }
+            complete_request(session, &request, resp->status, room_id, request.arg, 0, NULL);
+            break;
+        }
+
+        case MSG_JOIN_ROOM_RESPONSE: {
+            join_room_response_t *resp = (join_room_response_t *)frame;
+            char room_id[MAX_ROOM_ID_LEN];
+            char room_name[MAX_ROOM_NAME_LEN];
+            safe_strcpy(room_id, resp->room_id, sizeof(room_id));
+            if (!(request_id ? pending_take_id(&session->awaiting_response, request_id, &request)
+                             : pending_take_join(&session->awaiting_response, room_id, &request))) {
+                return;
+            }
+            safe_strcpy(room_name, resp->room_name, sizeof(room_name));
+            session_room_t *room = find_room(session, request.arg);
+            if (resp->status == RESP_SUCCESS && room) {
+                safe_strcpy(room->room_name, room_name, sizeof(room->room_name));
+                if (resp->head_seq > room->last_seq) {
+                    room->last_seq = resp->head_seq;
+                }
+                room->joined = true;
+                room->resend_pending = false;
+                update_room_state(session);
+            } else if (room && !room->joined) {
+                remove_room(session, request.arg);
+            }
+            complete_request(session, &request, resp->status, room_id, room_name, 0, NULL);
+            break;
+        }
+
+        case MSG_CHAT_MESSAGE: {
+            chat_message_t *msg = (chat_message_t *)frame;
+            char room_id[MAX_ROOM_ID_LEN];
+            char username[MAX_USERNAME_LEN];
+            char text[MAX_MESSAGE_LEN];
+            safe_strcpy(room_id, msg->room_id, sizeof(room_id));
+            safe_strcpy(username, msg->username, sizeof(username));
+            safe_strcpy(text, msg->message, sizeof(text));
+            /* Servers from before sequencing end the frame before seq; the frame is read in place, so no padding. */
+            uint64_t seq = length >= offsetof(chat_message_t, msg_id) ? msg->seq : 0;
+            session_room_t *room = find_room(session, room_id);
+            if (room && seq != 0) {
+                if (seq <= room->last_seq) {
+                    return;
+                }
+                /* A hole: drop what follows it until the server has resent the missing part, in order. */
+                if (room->joined && room->last_seq != 0 && seq != room->last_seq + 1) {
+                    if (!room->resend_pending) {
+                        request_resend(session, room);
+                    }
+                    return;
+                }
+                room->last_seq = seq;
+            }
+            /* Older servers send shorter frames without the id. */
+            if (length >= sizeof(chat_message_t) && msg->msg_id != 0 &&
+                strcmp(username, session->username) == 0) {
+                confirm_sent(session, msg->msg_id);
+            }
+
+            chat_event_t event;
+            memset(&event, 0, sizeof(event));
+            event.type = CHAT_EVENT_MESSAGE;
+            event.room_id = room_id;
+            event.room_name = room && room->joined ? room->room_name : NULL;
+            event.username = username;
+            event.message = text;
+            event.seq = seq;
+            emit_event(session, &event);
+            break;
+        }
+
+        case MSG_DIRECT: {
+            direct_message_t *msg = (direct_message_t *)frame;
+            char from[MAX_USERNAME_LEN];
+            char text[MAX_MESSAGE_LEN];
+            safe_strcpy(from, msg->from, sizeof(from));
+            safe_strcpy(text, msg->message, sizeof(text));
+
+            chat_event_t event;
+            memset(&event, 0, sizeof(event));
+            event.type = CHAT_EVENT_DIRECT;
+            event.username = from;
+            event.message = text;
+            event.sent_at = msg->sent_at;
+            emit_event(session, &event);
+            break;
+        }
+
+        case MSG_PRESENCE: {
+            presence_update_t *update = (presence_update_t *)frame;
+            char room_id[MAX_ROOM_ID_LEN];
+            safe_strcpy(room_id, update->room_id, sizeof(room_id));
+            session_room_t *room = find_room(session, room_id);
+            if (!room) {
+                return;
+            }
+            if (update->flags & PRESENCE_RESET) {
+                room->member_count = 0;
+                room->snapshot_open = true;
+            }
+
+            chat_event_t event;
+            memset(&event, 0, sizeof(event));
+            event.type = CHAT_EVENT_PRESENCE;
+            event.room_id = room_id;
+            for (int i = 0; i < update->count; i++) {
+                char username[MAX_USERNAME_LEN];
+                safe_strcpy(username, update->entries[i].username, sizeof(username));
+                bool joined = update->entries[i].op == PRESENCE_JOIN;
+                /* Snapshot entries are reported once, as a whole, when the last frame arrives. */
+                if (set_member(room, username, joined) && !room->snapshot_open) {
+                    event.room_name = room->joined ? room->room_name : NULL;
+                    event.username = username;
+                    event.joined = joined;
+                    emit_event(session, &event);
+                    room = find_room(session, room_id);
+                    if (!room) {
+                        return;
+                    }
+                }
+            }
+            if (room->snapshot_open && !(update->flags & PRESENCE_MORE)) {
+                room->snapshot_open = false;
+                event.room_name = room->joined ? room->room_name : NULL;
+                event.username = NULL;
+                event.joined = true;
+                emit_event(session, &event);
+            }
+            break;
+        }
+
+        case MSG_ACK: {
+            ack_message_t *ack = (ack_message_t *)frame;
+            /* The server has resent what it could; whatever is still missing is gone for good. */
+            for (int i = 0; i < ack->count; i++) {
+                char room_id[MAX_ROOM_ID_LEN];
+                safe_strcpy(room_id, ack->entries[i].room_id, sizeof(room_id));
+                session_room_t *room = find_room(session, room_id);
+                if (room && (ack->entries[i].flags & ACK_GAP)) {
+                    room->resend_pending = false;
+                    if (room->last_seq < ack->entries[i].seq) {
+                        room->last_seq = ack->entries[i].seq;
+                    }
+                }
+            }
+            break;
+        }
+
+        case MSG_PING: {
+            /* A quiet spell: settle the acks the batching held back. */
+            queue_acks(session, 1);
+            ping_message_t *pong = create_ping_message(MSG_PONG, ((ping_message_t *)frame)->stamp);
+            if (pong && session_queue_frame(session, pong, sizeof(ping_message_t)) == 0) {
+                session_flush(session);
+            }
+            free_message(pong);
+            break;
+        }
+
+        case MSG_HELLO: {
+            hello_message_t *hello = (hello_message_t *)frame;
+            if (!session->hello_pending) {
+                return;
+            }
+            if (hello->version < PROTOCOL_MIN_VERSION) {
+                session_teardown(session, EPROTONOSUPPORT, "Server speaks no protocol version we know");
+                return;
+            }
+            session_ready(session, hello->version, hello->capabilities);
+            break;
+        }
+
+        case MSG_CHAT_COMPACT: {
+            chat_message_t chat;
+            if (chat_expand(frame, length, &chat) != 0) {
+                session_teardown(session, EPROTO, "Malformed chat frame from server");
+                return;
+            }
+            dispatch_frame(session, (char *)&chat, sizeof(chat_message_t), request_id);
+            break;
+        }
+
+        case MSG_ERROR: {
+            error_message_t *err = (error_message_t *)frame;
+            if (session->hello_pending && request_id == 0 && err->error_code != RESP_OVERLOADED) {
+                /* The first answer is the hello's: a server from before it reports an unknown message. */
+                session_ready(session, PROTOCOL_MIN_VERSION, 0);
+                break;
+            }
+            char text[MAX_MESSAGE_LEN];
+            safe_strcpy(text, err->error_message, sizeof(text));
+            /* Rate limiting drops fire-and-forget messages, so it never answers a request. */
+            bool answered = err->error_code != RESP_RATE_LIMITED &&
+                            (request_id ? pending_take_id(&session->awaiting_response, request_id, &request)
+                                        : pending_take(&session->awaiting_response, 0, &request));
+            if (answered) {
+                complete_request(session, &request, err->error_code, NULL, NULL, err->error_code, text);
+            } else {
+                chat_event_t event;
+                memset(&event, 0, sizeof(event));
+                event.type = CHAT_EVENT_ERROR;
+                event.error_code = err->error_code;
+                event.error_message = text;
+                emit_event(session, &event);
+            }
+            break;
+        }
+
+        default:
+            break;
+    }
+}
+
+/* Dispatches the frame a MSG_COMPRESSED frame carries. */
+static int unpack_frame(chat_session_t *session, const char *frame, uint32_t length) {
+    uint32_t request_id = 0;
+    int wire_length = decompress_frame(session->inflater, frame, length, session->unpacked,
+                                       sizeof(session->unpacked));
+    int inner = wire_length < 0 ? -1 : decode_frame(session->unpacked, (size_t)wire_length, session->unpacked,
+                                                     sizeof(session->unpacked), &request_id);
+    if (inner < 0 || ((message_header_t *)session->unpacked)->type == MSG_COMPRESSED) {
+        session_teardown(session, EPROTO, "Malformed compressed frame from server");
+        return -1;
+    }
+    dispatch_frame(session, session->unpacked, (uint32_t)inner, request_id);
+    return 0;
+}
+
+static int session_read(chat_session_t *session) {
+    uint32_t generation = session->generation;
+
+    for (;;) {
+        size_t space = sizeof(session->in_buf) - session->in_len;
+        ssize_t received = recv(session->sockfd, session->in_buf + session->in_len, space, 0);
+        if (received == 0) {
+            session_lost(session, 0, "Connection closed by server");
+            return -1;
+        }
+        if (received < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return 0;
+            }
+            session_lost(session, errno, strerror(errno));
+            return -1;
+        }
+        session->in_len += (size_t)received;
+
+        size_t offset = 0;
+        while (session->in_len - offset >= sizeof(message_header_t)) {
+            message_header_t *header = (message_header_t *)(session->in_buf + offset);
+            uint32_t raw_length = ntohl(header->length);
+            uint32_t length = raw_length & ~FRAME_TAGGED;
+            size_t tag = (raw_length & FRAME_TAGGED) ? FRAME_TAG_SIZE : 0;
+            if (length < sizeof(message_header_t) + tag || length > CHAT_MAX_FRAME_SIZE) {
+                session_teardown(session, EPROTO, "Malformed frame from server");
+                return -1;
+            }
+            if (session->in_len - offset < length) {
+                break;
+            }
+            /* Slide the header over the request id so the frame reads as an untagged one. */
+            uint32_t request_id = 0;
+            char *frame = session->in_buf + offset;
+            if (tag) {
+                memcpy(&request_id, frame + sizeof(message_header_t), FRAME_TAG_SIZE);
+                request_id = ntohl(request_id);
+                memmove(frame + tag, frame, sizeof(message_header_t));
+                frame += tag;
+            }
+            header = (message_header_t *)frame;
+            header->length = length - (uint32_t)tag;
+            if (header->type != MSG_COMPRESSED) {
+                dispatch_frame(session, frame, header->length, request_id);
+            } else if (unpack_frame(session, frame, header->length) != 0) {
+                return -1;
+            }
+            if (session->generation != generation) {
+                return -1;
+            }
+            offset += length;
+        }
+        if (offset > 0) {
+            memmove(session->in_buf, session->in_buf + offset, session->in_len - offset);
+            session->in_len -= offset;
+        }
+        if ((size_t)received < space) {
+            return 0;
+        }
+    }
+}
+
+static void complete_writes(chat_session_t *session) {
+    uint32_t generation = session->generation;
+    pending_request_t request;
+    while (session->awaiting_write.count > 0 &&
+           pending_at(&session->awaiting_write, 0)->out_end <= session->bytes_written) {
+        pending_take(&session->awaiting_write, 0, &request);
+        complete_request(session, &request, RESP_SUCCESS, NULL, NULL, 0, NULL);
+        if (session->generation != generation) {
+            return;
+        }
+    }
+}
+
+int chat_session_handle_io(chat_session_t *session, short revents) {
+    if (!session || session->sockfd < 0) {
+        return -1;
+    }
+    uint32_t generation = session->generation;
+
+    if (session->state == CHAT_SESSION_CONNECTING) {
+        if (!(revents & (POLLOUT | POLLERR | POLLHUP))) {
+            return 0;
+        }
+        int err = 0;
+        socklen_t err_len = sizeof(err);
+        if (getsockopt(session->sockfd, SOL_SOCKET, SO_ERROR, &err, &err_len) < 0) {
+            err = errno;
+        }
+        if (err != 0) {
+            session_lost(session, err, strerror(err));
+            return -1;
+        }
+        session->state = CHAT_SESSION_CONNECTED;
+        if (!session->hello_pending) {
+            session_ready(session, PROTOCOL_MIN_VERSION, 0);
+        }
+        if (session->generation != generation) {
+            return -1;
+        }
+    }
+
+    if (revents & (POLLIN | POLLERR | POLLHUP)) {
+        if (session_read(session) != 0) {
+            return -1;
+        }
+        queue_acks(session, CHAT_ACK_EVERY);
+    }
+
+    if (session->out_len > 0 && session_flush(session) != 0) {
+        session_lost(session, errno, strerror(errno));
+        return -1;
+    }
+    complete_writes(session);
+    if (session->generation != generation) {
+        return -1;
+    }
+
+    notify_loop(session);
+    return 0;
+}
+
+int chat_session_fd(const chat_session_t *session) {
+    return session ? session->sockfd : -1;
+}
+
+short chat_session_events(const chat_session_t *session) {
+    if (!session || session->sockfd < 0) {
+        return 0;
+    }
+    if (session->state == CHAT_SESSION_CONNECTING) {
+        return POLLOUT;
+    }
+    short events = POLLIN;
+    if (session->out_len > 0 || session->awaiting_write.count > 0) {
+        events |= POLLOUT;
+    }
+    return events;
+}
+
+int chat_session_next_timeout(const chat_session_t *session) {
+    if (!session || !session->retry_pending) {
+        return -1;
+    }
+    uint64_t now = chat_now_ns();
+    if (session->retry_at_ns <= now) {
+        return 0;
+    }
+    return (int)((session->retry_at_ns - now + 999999) / 1000000);
+}
+
+void chat_session_tick(chat_session_t *session) {
+    if (!session || !session->retry_pending || session->retry_at_ns > chat_now_ns()) {
+        return;
+    }
+    set_retry(session, false, 0);
+    if (session_open(session) != 0) {
+        schedule_retry(session, errno, "Reconnect failed");
+    }
+}
+
+int chat_session_poll(chat_session_t *session, int timeout_ms) {
+    if (!session) {
+        return -1;
+    }
+    int timer_ms = chat_session_next_timeout(session);
+    if (timer_ms >= 0 && (timeout_ms < 0 || timer_ms < timeout_ms)) {
+        timeout_ms = timer_ms;
+    }
+    if (session->sockfd < 0) {
+        if (timer_ms < 0) {
+            return -1;
+        }
+        poll(NULL, 0, timeout_ms);
+        chat_session_tick(session);
+        return 0;
+    }
+    struct pollfd pfd;
+    pfd.fd = session->sockfd;
+    pfd.events = chat_session_events(session);
+    pfd.revents = 0;
+
+    int rc = poll(&pfd, 1, timeout_ms);
+    if (rc < 0) {
+        return errno == EINTR ? 0 : -1;
+    }
+    if (rc == 0) {
+        return 0;
+    }
+    return chat_session_handle_io(session, pfd.revents);
+}
+
+chat_session_state_t chat_session_state(const chat_session_t *session) {
+    return session ? session->state : CHAT_SESSION_DISCONNECTED;
+}
+
+const char *chat_session_username(const chat_session_t *session) {
+    return session ? session->username : "";
+}
+
+int chat_session_room_count(const chat_session_t *session) {
+    return session ? session->room_count : 0;
+}
+
+const char *chat_session_room_id(const chat_session_t *session, int index) {
+    if (!session || index < 0 || index >= session->room_count) {
+        return NULL;
+    }
+    return session->rooms[index].room_id;
+}
+
+const char *chat_session_room_name(const chat_session_t *session, int index) {
+    if (!session || index < 0 || index >= session->room_count) {
+        return NULL;
+    }
+    return session->rooms[index].room_name;
+}
+
+bool chat_session_room_joined(const chat_session_t *session, int index) {
+    return session && index >= 0 && index < session->room_count && session->rooms[index].joined;
+}
+
+int chat_session_room_member_count(const chat_session_t *session, int index) {
+    if (!session || index < 0 || index >= session->room_count) {
+        return 0;
+    }
+    return session->rooms[index].member_count;
+}
+
+const char *chat_session_room_member(const chat_session_t *session, int index, int member) {
+    if (!session || index < 0 || index >= session->room_count ||
+        member < 0 || member >= session->rooms[index].member_count) {
+        return NULL;
+    }
+    return session->rooms[index].members[member];
+}
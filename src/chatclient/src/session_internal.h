@@ -0,0 +1,103 @@
+#ifndef SESSION_INTERNAL_H
+#define SESSION_INTERNAL_H
+
+#include "../include/chatclient.h"
+#include "compress.h"
+#include <stddef.h>
+
+#define CHAT_MAX_FRAME_SIZE 2048
+#define CHAT_INPUT_BUFFER_SIZE (4 * CHAT_MAX_FRAME_SIZE)
+#define CHAT_ACK_EVERY 32   /* messages a room may run ahead of its last ack */
+#define CHAT_RETRY_WINDOW 32    /* sent chat messages kept until the server echoes them back */
+
+typedef struct {
+    uint32_t id;
+    chat_request_type_t type;
+    uint64_t out_end;
+    bool internal;
+    char arg[MAX_ROOM_NAME_LEN];
+} pending_request_t;
+
+typedef struct {
+    char room_id[MAX_ROOM_ID_LEN];
+    char room_name[MAX_ROOM_NAME_LEN];
+    uint64_t last_seq;          /* newest sequence number delivered from this room */
+    uint64_t acked_seq;         /* newest sequence number acked to the server */
+    bool resend_pending;        /* asked the server to fill a gap; later messages wait for it */
+    bool joined;                /* false while the join is still in flight */
+    char (*members)[MAX_USERNAME_LEN];
+    int member_count;
+    int member_capacity;
+    bool snapshot_open;         /* a member snapshot is still arriving */
+} session_room_t;
+
+typedef struct {
+    pending_request_t *items;
+    size_t head;
+    size_t count;
+    size_t capacity;
+} pending_queue_t;
+
+struct chat_session {
+    int sockfd;
+    chat_session_state_t state;
+    uint32_t generation;
+    chat_event_cb_t callback;
+    void *user_data;
+
+    char username[MAX_USERNAME_LEN];
+    char password[MAX_PASSWORD_LEN];
+    char login_password[MAX_PASSWORD_LEN];
+    session_room_t *rooms;
+    int room_count;
+    int room_capacity;
+    int resume_joins;
+
+    char hostname[256];
+    int port;
+    bool reconnect_enabled;
+    chat_reconnect_policy_t reconnect_policy;
+    bool resuming;
+    bool retry_pending;
+    int attempt;
+    uint64_t retry_at_ns;
+    uint64_t rng_state;
+
+    uint32_t next_request_id;
+    uint64_t next_msg_id;
+    chat_message_t *unconfirmed;    /* oldest first; resent after a reconnect */
+    int unconfirmed_count;
+    pending_queue_t awaiting_response;
+    pending_queue_t awaiting_write;
+
+    char in_buf[CHAT_INPUT_BUFFER_SIZE];
+    size_t in_len;
+
+    char *out_buf;
+    size_t out_start;
+    size_t out_len;
+    size_t out_capacity;
+    uint64_t bytes_queued;
+    uint64_t bytes_written;
+
+    bool compression;               /* asked for in the hello sent on every connect */
+    bool hello_pending;             /* the server has not answered this connection's hello yet */
+    uint16_t server_version;        /* agreed in the hello; 0 for a server older than it */
+    uint32_t server_caps;           /* CAP_* the server granted this connection */
+    compress_stream_t *deflater;    /* per connection, like the server's side of them */
+    compress_stream_t *inflater;
+    char unpacked[CHAT_MAX_FRAME_SIZE];
+
+    chat_loop_t *loop;
+    uint32_t loop_events;
+    chat_session_t *timer_prev;
+    chat_session_t *timer_next;
+    bool timer_linked;
+};
+
+uint64_t chat_now_ns(void);
+void chat_loop_session_changed(chat_loop_t *loop, chat_session_t *session);
+void chat_loop_session_closing(chat_loop_t *loop, chat_session_t *session);
+void chat_loop_timer_changed(chat_loop_t *loop, chat_session_t *session);
+
+#endif
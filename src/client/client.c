@@ -1,15 +1,10 @@
 #include "client.h"
 #include "../common/include/protocol.h"
-#include "../common/include/message.h"
 #include "../common/include/utils.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
-#include <arpa/inet.h>
-#include <sys/socket.h>
-#include <netinet/in.h>
-#include <netdb.h>
 #include <signal.h>
 #include <errno.h> 
 
@@ -18,9 +13,7 @@ static client_t *g_client = NULL;
 void handle_signal(int sig) {
     if (g_client) {
         g_client->running = false;
-        client_disconnect(g_client);
     }
-    exit(0);
 }
 
 int client_init(client_t *client) {
@@ -28,11 +21,11 @@ int client_init(client_t *client) {
         return -1;
     }
     memset(client, 0, sizeof(client_t));
-    client->sockfd = -1;
     client->state = CLIENT_STATE_DISCONNECTED;
     client->running = false;
-    if (pthread_mutex_init(&client->mutex, NULL) != 0) {
-        printf("Failed to initialize mutex\n");
+    client->session = chat_session_create(client_handle_event, client);
+    if (!client->session) {
+        printf("Failed to create session\n");
         return -1;
     }
     g_client = client;
@@ -47,43 +40,19 @@ int client_connect(client_t *client, const char *hostname, int port) {
         printf("Invalid parameters for client_connect\n");
         return -1;
     }
-    client->sockfd = socket(AF_INET, SOCK_STREAM, 0);
-    if (client->sockfd < 0) {
+    if (chat_session_connect(client->session, hostname, port) != 0) {
         return -1;
     }
-    struct hostent *server = gethostbyname(hostname);
-    if (server == NULL) {
-        close(client->sockfd);
-        client->sockfd = -1;
-        return -1;
+    while (chat_session_state(client->session) == CHAT_SESSION_CONNECTING) {
+        if (chat_session_poll(client->session, 1000) != 0) {
+            return -1;
+        }
     }
-    struct sockaddr_in server_addr;
-    memset(&server_addr, 0, sizeof(server_addr));
-    server_addr.sin_family = AF_INET;
-    memcpy(&server_addr.sin_addr.s_addr, server->h_addr, server->h_length);
-    server_addr.sin_port = htons(port);   
-    char ip_str[INET_ADDRSTRLEN];
-    inet_ntop(AF_INET, &server_addr.sin_addr, ip_str, sizeof(ip_str));
-    
-    if (connect(client->sockfd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
-        close(client->sockfd);
-        client->sockfd = -1;
+    if (chat_session_state(client->session) != CHAT_SESSION_CONNECTED) {
         return -1;
     }
     
-    
-    client->running = true;
-    if (pthread_create(&client->recv_thread, NULL, client_receive_thread, client) != 0) {
-        close(client->sockfd);
-        client->sockfd = -1;
-        client->running = false;
-        return -1;
-    }
-    
-    pthread_mutex_lock(&client->mutex);
     client->state = CLIENT_STATE_CONNECTED;
-    pthread_mutex_unlock(&client->mutex);
-    
     return 0;
 }
 
@@ -93,151 +62,130 @@ void client_disconnect(client_t *client) {
     }
     
     client->running = false;
-    if (client->sockfd >= 0) {
-        close(client->sockfd);
-        client->sockfd = -1;
-    }
-    if (client->recv_thread) {
-        pthread_join(client->recv_thread, NULL);
-        client->recv_thread = 0;
-    }
-    pthread_mutex_lock(&client->mutex);
+    chat_session_destroy(client->session);
+    client->session = NULL;
     client->state = CLIENT_STATE_DISCONNECTED;
     client->username[0] = '\0';
     client->current_room_id[0] = '\0';
     client->current_room_name[0] = '\0';
-    pthread_mutex_unlock(&client->mutex);
-    pthread_mutex_destroy(&client->mutex);
 }
 
 int client_login(client_t *client, const char *username, const char *password) {
     if (!client || !username || !password || client->state < CLIENT_STATE_CONNECTED) {
         return -1;
     }
-    auth_request_t *req = create_auth_request(username, password);
-    if (!req) {
-        return -1;
-    }
-    if (send_message(client->sockfd, req, sizeof(auth_request_t)) != 0) {
-        perror("Failed to send authentication request");
-        free_message(req);
-        return -1;
-    }
-    
-    free_message(req);
-    return 0;
+    int id = chat_session_login(client->session, username, password);
+    return id > 0 ? 0 : -1;
 }
 
 int client_register(client_t *client, const char *username, const char *password) {
     if (!client || !username || !password || client->state < CLIENT_STATE_CONNECTED) {
         return -1;
     }
-    
-    register_request_t *req = create_register_request(username, password);
-    if (!req) {
-        return -1;
-    }
-    
-    if (send_message(client->sockfd, req, sizeof(register_request_t)) != 0) {
-        perror("Failed to send register request");
-        free_message(req);
-        return -1;
-    }
-    
-    free_message(req);
-    return 0;
+    int id = chat_session_register(client->session, username, password);
+    return id > 0 ? 0 : -1;
 }
 
 int client_create_room(client_t *client, const char *room_name) {
     if (!client || !room_name || client->state < CLIENT_STATE_AUTHENTICATED) {
         return -1;
     }
-    
-    create_room_request_t *req = create_room_request(room_name);
-    if (!req) {
-        return -1;
-    }
-    
-    if (send_message(client->sockfd, req, sizeof(create_room_request_t)) != 0) {
-        perror("Failed to send create room request");
-        free_message(req);
-        return -1;
-    }
-    
-    free_message(req);
-    return 0;
+    int id = chat_session_create_room(client->session, room_name);
+    return id > 0 ? 0 : -1;
 }
 
 int client_join_room(client_t *client, const char *room_id) {
     if (!client || !room_id || client->state < CLIENT_STATE_AUTHENTICATED) {
         return -1;
     }
-    
-    join_room_request_t *req = create_join_room_request(room_id);
-    if (!req) {
+    int id = chat_session_join_room(client->session, room_id);
+    return id > 0 ? 0 : -1;
+}
+
+int client_leave_room(client_t *client, const char *room_id) {
+    if (!client || !room_id || client->state < CLIENT_STATE_IN_ROOM) {
         return -1;
     }
     
-    if (send_message(client->sockfd, req, sizeof(join_room_request_t)) != 0) {
-        perror("Failed to send join room request");
-        free_message(req);
-        return -1;
+    int id = chat_session_leave_room(client->session, room_id);
+    if (id > 0) {
+        client_sync_rooms(client);
     }
     
-    free_message(req);
-    return 0;
+    return id > 0 ? 0 : -1;
 }
 
-int client_leave_room(client_t *client) {
-    if (!client || client->state < CLIENT_STATE_IN_ROOM) {
+int client_switch_room(client_t *client, const char *room) {
+    if (!client || !room) {
         return -1;
     }
-    
-    leave_room_request_t *req = create_leave_room_request(client->current_room_id);
-    if (!req) {
-        return -1;
+    int count = chat_session_room_count(client->session);
+    char *end = NULL;
+    long number = strtol(room, &end, 10);
+    for (int i = 0; i < count; i++) {
+        if (!chat_session_room_joined(client->session, i)) {
+            continue;
+        }
+        if ((*end == '\0' && number == i + 1) || strcmp(chat_session_room_id(client->session, i), room) == 0) {
+            safe_strcpy(client->current_room_id, chat_session_room_id(client->session, i), MAX_ROOM_ID_LEN);
+            safe_strcpy(client->current_room_name, chat_session_room_name(client->session, i), MAX_ROOM_NAME_LEN);
+            return 0;
+        }
     }
-    
-    if (send_message(client->sockfd, req, sizeof(leave_room_request_t)) != 0) {
-        perror("Failed to send leave room request");
-        free_message(req);
-        return -1;
+    return -1;
+}
+
+void client_sync_rooms(client_t *client) {
+    if (!client) {
+        return;
+    }
+    int first = -1;
+    int count = chat_session_room_count(client->session);
+    for (int i = 0; i < count; i++) {
+        if (!chat_session_room_joined(client->session, i)) {
+            continue;
+        }
+        if (strcmp(chat_session_room_id(client->session, i), client->current_room_id) == 0) {
+            client->state = CLIENT_STATE_IN_ROOM;
+            return;
+        }
+        if (first < 0) {
+            first = i;
+        }
+    }
+    if (first >= 0) {
+        client->state = CLIENT_STATE_IN_ROOM;
+        safe_strcpy(client->current_room_id, chat_session_room_id(client->session, first), MAX_ROOM_ID_LEN);
+        safe_strcpy(client->current_room_name, chat_session_room_name(client->session, first), MAX_ROOM_NAME_LEN);
+    } else {
+        if (client->state > CLIENT_STATE_AUTHENTICATED) {
+            client->state = CLIENT_STATE_AUTHENTICATED;
+        }
+        client->current_room_id[0] = '\0';
+        client->current_room_name[0] = '\0';
     }
-    
-    free_message(req);
-    pthread_mutex_lock(&client->mutex);
-    client->state = CLIENT_STATE_AUTHENTICATED;
-    client->current_room_id[0] = '\0';
-    client->current_room_name[0] = '\0';
-    pthread_mutex_unlock(&client->mutex);
-    
-    return 0;
 }
 
 int client_send_message(client_t *client, const char *message) {
     if (!client || !message || client->state < CLIENT_STATE_IN_ROOM) {
         return -1;
     }
-    
-    chat_message_t *msg = create_chat_message(client->current_room_id, client->username, message);
-    if (!msg) {
-        return -1;
-    }
-    
-    if (send_message(client->sockfd, msg, sizeof(chat_message_t)) != 0) {
-        perror("Failed to send chat message");
-        free_message(msg);
+    int id = chat_session_send_message(client->session, client->current_room_id, message);
+    return id > 0 ? 0 : -1;
+}
+
+int client_send_direct(client_t *client, const char *username, const char *message) {
+    if (!client || !username || !message || client->state < CLIENT_STATE_AUTHENTICATED) {
         return -1;
     }
-    
-    free_message(msg);
-    
-    return 0;
+    int id = chat_session_send_direct(client->session, username, message);
+    return id > 0 ? 0 : -1;
 }
 
 int main(int argc, char *argv[]) {
     const char *hostname = "127.0.0.1"; 
     int port = 8080;
+    bool reconnect = true;
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--host") == 0) {
             if (i + 1 < argc) {
@@ -252,11 +200,14 @@ int main(int argc, char *argv[]) {
                 }
                 i++;
             }
+        } else if (strcmp(argv[i], "--no-reconnect") == 0) {
+            reconnect = false;
         } else if (strcmp(argv[i], "--help") == 0) {
             printf("Usage: %s [options]\n", argv[0]);
             printf("Options:\n");
             printf("  -h, --host HOST    Server hostname (default: %s)\n", hostname);
             printf("  -p, --port PORT    Server port (default: %d)\n", port);
+            printf("  --no-reconnect     Exit instead of reconnecting when the connection drops\n");
             printf("  --help             Show this help message\n");
             return 0;
         }
@@ -267,17 +218,20 @@ int main(int argc, char *argv[]) {
         printf("Failed to initialize client\n");
         return 1;
     }
+    if (reconnect) {
+        chat_reconnect_policy_t policy = {0};
+        chat_session_set_reconnect(client.session, &policy);
+    }
     printf("Connecting to %s:%d...\n", hostname, port);
     if (client_connect(&client, hostname, port) != 0) {
         printf("Failed to connect to server\n");
         return 1;
     }
     
-    printf("Connected to server\n");
     client.running = true;
-    while (client.running) {
-        client_display_menu(&client);
-        client_handle_input(&client);
+    client_run(&client);
+    if (client.state == CLIENT_STATE_DISCONNECTED) {
+        printf("Disconnected from server\n");
     }
     client_disconnect(&client);
     
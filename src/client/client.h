@@ -2,8 +2,14 @@
 #define CLIENT_H
 
 #include "../common/include/protocol.h"
-#include <pthread.h>
+#include "chatclient.h"
 #include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <termios.h>
+
+#define CLIENT_SCROLLBACK_LINES 2000
+#define CLIENT_FRAME_INTERVAL_MS 33
 
 typedef enum {
     CLIENT_STATE_DISCONNECTED,
@@ -12,26 +18,38 @@ typedef enum {
     CLIENT_STATE_IN_ROOM
 } client_state_t;
 
-typedef enum {
-    MENU_NONE,
-    MENU_LOGIN,
-    MENU_REGISTER,
-    MENU_CREATE_ROOM,
-    MENU_JOIN_ROOM,
-    MENU_LEAVE_ROOM,
-    MENU_CHAT,
-    MENU_QUIT
-} client_menu_t;
+typedef struct {
+    bool ansi;
+    bool raw_mode;
+    struct termios saved_termios;
+    int rows;
+    int cols;
+
+    char *lines[CLIENT_SCROLLBACK_LINES];
+    int line_head;
+    int line_count;
+    int scroll_offset;
+
+    char input[MAX_MESSAGE_LEN];
+    size_t input_len;
+    char escape[8];
+    size_t escape_len;
+
+    bool dirty;
+    bool clear_pending;
+    uint64_t last_render_ns;
+    char *frame;
+    size_t frame_capacity;
+} client_term_t;
 
 typedef struct {
-    int sockfd;
+    chat_session_t *session;
     client_state_t state;
     char username[MAX_USERNAME_LEN];
-    char current_room_id[MAX_ROOM_ID_LEN];
+    char current_room_id[MAX_ROOM_ID_LEN];      /* active room: where typed text goes */
     char current_room_name[MAX_ROOM_NAME_LEN];
-    bool running;
-    pthread_t recv_thread;
-    pthread_mutex_t mutex;
+    volatile bool running;
+    client_term_t term;
 } client_t;
 
 int client_init(client_t *client);
@@ -41,10 +59,21 @@ int client_login(client_t *client, const char *username, const char *password);
 int client_register(client_t *client, const char *username, const char *password);
 int client_create_room(client_t *client, const char *room_name);
 int client_join_room(client_t *client, const char *room_id);
-int client_leave_room(client_t *client);
+int client_leave_room(client_t *client, const char *room_id);
+int client_switch_room(client_t *client, const char *room);
+void client_sync_rooms(client_t *client);
 int client_send_message(client_t *client, const char *message);
-void *client_receive_thread(void *arg);
-void client_display_menu(client_t *client);
-void client_handle_input(client_t *client);
+int client_send_direct(client_t *client, const char *username, const char *message);
+void client_handle_event(chat_session_t *session, const chat_event_t *event, void *user_data);
+void client_run(client_t *client);
+void client_handle_command(client_t *client, char *line);
+
+int term_init(client_term_t *term);
+void term_restore(client_term_t *term);
+void term_resize(client_term_t *term);
+void term_print(client_term_t *term, const char *format, ...);
+bool term_handle_key(client_term_t *term, char c, char *line_out, size_t line_out_size);
+void term_render(client_term_t *term, const client_t *client, uint64_t now_ns);
+int term_render_timeout(const client_term_t *term, uint64_t now_ns);
 
-#endif
\ No newline at end of file
+#endif
@@ -1,126 +1,140 @@
 #include "client.h"
 #include "../common/include/protocol.h"
-#include "../common/include/message.h"
 #include "../common/include/utils.h"
 #include <stdio.h>
-#include <stdlib.h>
 #include <string.h>
-#include <unistd.h>
-#include <errno.h>
+#include <time.h>
 
-void *client_receive_thread(void *arg) {
-    client_t *client = (client_t *)arg;
-    if (!client) {
-        return NULL;
-    }
-    
-    char buffer[2048];
-    
-    while (client->running) {
-        int recv_size = receive_message(client->sockfd, buffer, sizeof(buffer));
-        if (recv_size <= 0) {
-            if (client->running) {
-                printf("\nDisconnected from server\n");
-                client->running = false;
+static void handle_completion(client_t *client, const chat_event_t *event) {
+    switch (event->request) {
+        case CHAT_REQUEST_LOGIN:
+            if (event->status == RESP_SUCCESS) {
+                client->state = CLIENT_STATE_AUTHENTICATED;
+                safe_strcpy(client->username, chat_session_username(client->session), MAX_USERNAME_LEN);
+                term_print(&client->term, "Login successful");
+            } else if (event->error_message) {
+                term_print(&client->term, "Login failed: %s", event->error_message);
+            } else {
+                term_print(&client->term, "Login failed: Invalid username or password");
             }
             break;
-        }
-        
-        message_header_t *header = (message_header_t *)buffer;
-        
-        switch (header->type) {
-            case MSG_AUTH_RESPONSE: {
-                auth_response_t *resp = (auth_response_t *)buffer;
-                
-                if (resp->status == RESP_SUCCESS) {
-                    pthread_mutex_lock(&client->mutex);
-                    client->state = CLIENT_STATE_AUTHENTICATED;
-                    pthread_mutex_unlock(&client->mutex);
-                    
-                    printf("\nLogin successful\n");
-                } else {
-                    printf("\nLogin failed: Invalid username or password\n");
-                }
-                
-                printf("Press Enter to continue...");
-                break;
+
+        case CHAT_REQUEST_REGISTER:
+            if (event->status == RESP_SUCCESS) {
+                term_print(&client->term, "Registration successful");
+            } else if (event->status == RESP_USER_EXISTS) {
+                term_print(&client->term, "Registration failed: Username already exists");
+            } else {
+                term_print(&client->term, "Registration failed: Internal error");
             }
-            
-            case MSG_REGISTER_RESPONSE: {
-                register_response_t *resp = (register_response_t *)buffer;
-                
-                if (resp->status == RESP_SUCCESS) {
-                    printf("\nRegistration successful\n");
-                } else if (resp->status == RESP_USER_EXISTS) {
-                    printf("\nRegistration failed: Username already exists\n");
-                } else {
-                    printf("\nRegistration failed: Internal error\n");
-                }
-                
-                printf("Press Enter to continue...");
-                break;
+            break;
+
+        case CHAT_REQUEST_CREATE_ROOM:
+            if (event->status == RESP_SUCCESS) {
+                client->state = CLIENT_STATE_IN_ROOM;
+                safe_strcpy(client->current_room_id, event->room_id, MAX_ROOM_ID_LEN);
+                safe_strcpy(client->current_room_name, event->room_name, MAX_ROOM_NAME_LEN);
+                term_print(&client->term, "Room created successfully");
+                term_print(&client->term, "Room ID: %s", event->room_id);
+            } else {
+                term_print(&client->term, "Failed to create room");
             }
-            
-            case MSG_CREATE_ROOM_RESPONSE: {
-                create_room_response_t *resp = (create_room_response_t *)buffer;
-                
-                if (resp->status == RESP_SUCCESS) {
-                    pthread_mutex_lock(&client->mutex);
-                    client->state = CLIENT_STATE_IN_ROOM;
-                    safe_strcpy(client->current_room_id, resp->room_id, MAX_ROOM_ID_LEN);
-                    pthread_mutex_unlock(&client->mutex);
-                    
-                    printf("\nRoom created successfully\n");
-                    printf("Room ID: %s\n", resp->room_id);
-                } else {
-                    printf("\nFailed to create room\n");
-                }
-                
-                printf("Press Enter to continue...");
-                break;
+            break;
+
+        case CHAT_REQUEST_JOIN_ROOM:
+            if (event->status == RESP_SUCCESS) {
+                client->state = CLIENT_STATE_IN_ROOM;
+                safe_strcpy(client->current_room_name, event->room_name, MAX_ROOM_NAME_LEN);
+                safe_strcpy(client->current_room_id, event->room_id, MAX_ROOM_ID_LEN);
+                term_print(&client->term, "Joined room: %s", event->room_name);
+                term_print(&client->term, "Room ID: %s", event->room_id);
+            } else {
+                term_print(&client->term, "Failed to join room: Room not found");
             }
-            
-            case MSG_JOIN_ROOM_RESPONSE: {
-                join_room_response_t *resp = (join_room_response_t *)buffer;
-                
-                if (resp->status == RESP_SUCCESS) {
-                    pthread_mutex_lock(&client->mutex);
-                    client->state = CLIENT_STATE_IN_ROOM;
-                    safe_strcpy(client->current_room_name, resp->room_name, MAX_ROOM_NAME_LEN);
-                    safe_strcpy(client->current_room_id, resp->room_id, MAX_ROOM_ID_LEN);
-                    pthread_mutex_unlock(&client->mutex);
-                    
-                    printf("\nJoined room: %s\n", resp->room_name);
-                    printf("Room ID: %s\n", resp->room_id);
-                } else {
-                    printf("\nFailed to join room: Room not found\n");
-                }
-                
-                printf("Press Enter to continue...");
+            break;
+
+        default:
+            break;
+    }
+}
+
+void client_handle_event(chat_session_t *session, const chat_event_t *event, void *user_data) {
+    (void)session;
+    client_t *client = (client_t *)user_data;
+    if (!client || !event) {
+        return;
+    }
+
+    switch (event->type) {
+        case CHAT_EVENT_COMPLETION:
+            handle_completion(client, event);
+            break;
+
+        case CHAT_EVENT_MESSAGE:
+            if (!event->room_name) {
                 break;
             }
-            
-            case MSG_CHAT_MESSAGE: {
-                chat_message_t *msg = (chat_message_t *)buffer;
-                if (client->state == CLIENT_STATE_IN_ROOM) {
-                    printf("\n[%s]: %s\n> ", msg->username, msg->message);
-                    fflush(stdout);
-                }
-                break;
+            if (strcmp(event->room_id, client->current_room_id) == 0) {
+                term_print(&client->term, "[%s]: %s", event->username, event->message);
+            } else {
+                term_print(&client->term, "#%s [%s]: %s", event->room_name, event->username, event->message);
             }
-            
-            case MSG_ERROR: {
-                error_message_t *err = (error_message_t *)buffer;
-                
-                printf("\nError: %s\n", err->error_message);
-                printf("Press Enter to continue...");
-                break;
+            break;
+
+        case CHAT_EVENT_DIRECT: {
+            time_t sent_at = (time_t)event->sent_at;
+            if (sent_at + 60 < time(NULL)) {
+                char when[32];
+                strftime(when, sizeof(when), "%Y-%m-%d %H:%M", localtime(&sent_at));
+                term_print(&client->term, "<- [%s] (sent %s): %s", event->username, when, event->message);
+            } else {
+                term_print(&client->term, "<- [%s]: %s", event->username, event->message);
             }
-            
-            default:
+            break;
+        }
+
+        case CHAT_EVENT_PRESENCE:
+            /* Snapshots are read with /who; only comings and goings are printed. */
+            if (!event->room_name || !event->username) {
                 break;
+            }
+            if (strcmp(event->room_id, client->current_room_id) == 0) {
+                term_print(&client->term, "* %s has %s the room", event->username, event->joined ? "joined" : "left");
+            } else {
+                term_print(&client->term, "#%s * %s has %s the room", event->room_name, event->username,
+                           event->joined ? "joined" : "left");
+            }
+            break;
+
+        case CHAT_EVENT_ERROR:
+            term_print(&client->term, "Error: %s", event->error_message);
+            break;
+
+        case CHAT_EVENT_RECONNECTING:
+            term_print(&client->term, "Connection lost (%s), reconnecting in %.1fs (attempt %d)",
+                       event->error_message ? event->error_message : "unknown error",
+                       event->delay_ms / 1000.0, event->attempt);
+            break;
+
+        case CHAT_EVENT_RESUMED: {
+            int rooms = 0;
+            for (int i = 0; i < chat_session_room_count(client->session); i++) {
+                rooms += chat_session_room_joined(client->session, i);
+            }
+            client_sync_rooms(client);
+            term_print(&client->term, "Reconnected, back in %d room%s", rooms, rooms == 1 ? "" : "s");
+            break;
         }
+
+        case CHAT_EVENT_DISCONNECTED:
+            client->state = CLIENT_STATE_DISCONNECTED;
+            if (client->running) {
+                term_print(&client->term, "Disconnected from server");
+                client->running = false;
+            }
+            break;
+
+        default:
+            break;
     }
-    
-    return NULL;
-} 
\ No newline at end of file
+}
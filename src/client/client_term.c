@@ -0,0 +1,431 @@
+#include "client.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#define PROMPT "> "
+#define PROMPT_LEN 2
+
+static bool is_continuation(unsigned char c) {
+    return (c & 0xC0) == 0x80;
+}
+
+static size_t display_width(const char *s, size_t len) {
+    size_t width = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (!is_continuation((unsigned char)s[i])) {
+            width++;
+        }
+    }
+    return width;
+}
+
+/* Byte length of the prefix of s that fits in max_cols columns. */
+static size_t fit_columns(const char *s, size_t len, size_t max_cols) {
+    size_t cols = 0;
+    size_t i = 0;
+    while (i < len) {
+        if (!is_continuation((unsigned char)s[i])) {
+            if (cols == max_cols) {
+                break;
+            }
+            cols++;
+        }
+        i++;
+    }
+    return i;
+}
+
+static const char *line_at(const client_term_t *term, int index) {
+    return term->lines[(term->line_head + index) % CLIENT_SCROLLBACK_LINES];
+}
+
+static int pane_rows(const client_term_t *term) {
+    int rows = term->rows - 2;
+    return rows > 0 ? rows : 1;
+}
+
+int term_init(client_term_t *term) {
+    const char *term_name = getenv("TERM");
+    term->ansi = isatty(STDIN_FILENO) && isatty(STDOUT_FILENO) &&
+                 !(term_name && strcmp(term_name, "dumb") == 0);
+    term->dirty = true;
+    if (!term->ansi) {
+        return 0;
+    }
+
+    if (tcgetattr(STDIN_FILENO, &term->saved_termios) != 0) {
+        term->ansi = false;
+        return 0;
+    }
+    struct termios raw = term->saved_termios;
+    raw.c_lflag &= ~(ICANON | ECHO | IEXTEN);
+    raw.c_iflag &= ~(IXON | ICRNL);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw) != 0) {
+        term->ansi = false;
+        return 0;
+    }
+    term->raw_mode = true;
+
+    const char *enter = "\033[?1049h\033[H\033[2J";
+    if (write(STDOUT_FILENO, enter, strlen(enter)) < 0) {
+        return -1;
+    }
+    term_resize(term);
+    return 0;
+}
+
+void term_restore(client_term_t *term) {
+    if (term->raw_mode) {
+        const char *leave = "\033[?25h\033[?1049l";
+        if (write(STDOUT_FILENO, leave, strlen(leave)) < 0) {
+            perror("write");
+        }
+        tcsetattr(STDIN_FILENO, TCSAFLUSH, &term->saved_termios);
+        term->raw_mode = false;
+    }
+    for (int i = 0; i < term->line_count; i++) {
+        free(term->lines[(term->line_head + i) % CLIENT_SCROLLBACK_LINES]);
+    }
+    term->line_count = 0;
+    free(term->frame);
+    term->frame = NULL;
+    term->frame_capacity = 0;
+}
+
+void term_resize(client_term_t *term) {
+    struct winsize ws;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_row > 0 && ws.ws_col > 0) {
+        term->rows = ws.ws_row;
+        term->cols = ws.ws_col;
+    } else {
+        term->rows = 24;
+        term->cols = 80;
+    }
+    term->dirty = true;
+    term->clear_pending = true;
+}
+
+void term_print(client_term_t *term, const char *format, ...) {
+    char line[MAX_MESSAGE_LEN + 128];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+
+    /* Remote text must never be able to inject terminal control sequences. */
+    for (char *p = line; *p; p++) {
+        if ((unsigned char)*p < 0x20 || *p == 0x7f) {
+            *p = ' ';
+        }
+    }
+
+    if (!term->ansi) {
+        printf("%s\n", line);
+        fflush(stdout);
+        return;
+    }
+
+    char *copy = strdup(line);
+    if (!copy) {
+        return;
+    }
+    if (term->line_count < CLIENT_SCROLLBACK_LINES) {
+        term->lines[(term->line_head + term->line_count) % CLIENT_SCROLLBACK_LINES] = copy;
+        term->line_count++;
+    } else {
+        free(term->lines[term->line_head]);
+        term->lines[term->line_head] = copy;
+        term->line_head = (term->line_head + 1) % CLIENT_SCROLLBACK_LINES;
+    }
+    if (term->scroll_offset > 0 && term->scroll_offset < term->line_count - 1) {
+        term->scroll_offset++;
+    }
+    term->dirty = true;
+}
+
+static void handle_escape(client_term_t *term) {
+    int step = pane_rows(term) / 2 > 0 ? pane_rows(term) / 2 : 1;
+    if (term->escape_len == 4 && memcmp(term->escape, "\033[5~", 4) == 0) {
+        term->scroll_offset += step;
+        if (term->scroll_offset > term->line_count - 1) {
+            term->scroll_offset = term->line_count > 0 ? term->line_count - 1 : 0;
+        }
+        term->dirty = true;
+    } else if (term->escape_len == 4 && memcmp(term->escape, "\033[6~", 4) == 0) {
+        term->scroll_offset = term->scroll_offset > step ? term->scroll_offset - step : 0;
+        term->dirty = true;
+    }
+}
+
+bool term_handle_key(client_term_t *term, char c, char *line_out, size_t line_out_size) {
+    unsigned char uc = (unsigned char)c;
+
+    if (term->escape_len > 0 || uc == 0x1b) {
+        term->escape[term->escape_len++] = c;
+        bool complete = false;
+        if (term->escape_len == 2 && c != '[') {
+            complete = true;
+        } else if (term->escape_len > 2 && uc >= 0x40 && uc <= 0x7e) {
+            complete = true;
+        }
+        if (complete) {
+            handle_escape(term);
+            term->escape_len = 0;
+        } else if (term->escape_len == sizeof(term->escape)) {
+            term->escape_len = 0;
+        }
+        return false;
+    }
+
+    switch (uc) {
+        case '\r':
+        case '\n': {
+            size_t len = term->input_len < line_out_size - 1 ? term->input_len : line_out_size - 1;
+            memcpy(line_out, term->input, len);
+            line_out[len] = '\0';
+            term->input_len = 0;
+            term->scroll_offset = 0;
+            term->dirty = true;
+            return true;
+        }
+
+        case 0x7f:
+        case 0x08:
+            while (term->input_len > 0) {
+                term->input_len--;
+                if (!is_continuation((unsigned char)term->input[term->input_len])) {
+                    break;
+                }
+            }
+            term->dirty = true;
+            return false;
+
+        case 0x15:
+            term->input_len = 0;
+            term->dirty = true;
+            return false;
+
+        case 0x0c:
+            term->clear_pending = true;
+            term->dirty = true;
+            return false;
+
+        default:
+            if (uc < 0x20) {
+                return false;
+            }
+            if (term->input_len < sizeof(term->input) - 1) {
+                term->input[term->input_len++] = c;
+                term->dirty = true;
+            }
+            return false;
+    }
+}
+
+static void frame_append(client_term_t *term, size_t *len, const char *data, size_t data_len) {
+    if (*len + data_len > term->frame_capacity) {
+        return;
+    }
+    memcpy(term->frame + *len, data, data_len);
+    *len += data_len;
+}
+
+static void frame_appendf(client_term_t *term, size_t *len, const char *format, ...) {
+    char buffer[256];
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (n > 0) {
+        frame_append(term, len, buffer, (size_t)n < sizeof(buffer) ? (size_t)n : sizeof(buffer) - 1);
+    }
+}
+
+static void build_status(const client_t *client, char *status, size_t status_size) {
+    if (chat_session_reconnecting(client->session)) {
+        snprintf(status, status_size, " Reconnecting... | /quit");
+        return;
+    }
+    switch (client->state) {
+        case CLIENT_STATE_DISCONNECTED:
+            snprintf(status, status_size, " Disconnected | /quit");
+            break;
+        case CLIENT_STATE_CONNECTED:
+            snprintf(status, status_size, " Connected | /register USER PASS  /login USER PASS  /quit");
+            break;
+        case CLIENT_STATE_AUTHENTICATED:
+            snprintf(status, status_size, " Logged in as %s | /create NAME  /join ROOM_ID  /quit",
+                     client->username);
+            break;
+        case CLIENT_STATE_IN_ROOM: {
+            int others = -1;
+            for (int i = 0; i < chat_session_room_count(client->session); i++) {
+                others += chat_session_room_joined(client->session, i);
+            }
+            if (others > 0) {
+                snprintf(status, status_size, " %s in %s (%s) +%d more | /switch N  /rooms  /leave  /quit",
+                         client->username, client->current_room_name, client->current_room_id, others);
+            } else {
+                snprintf(status, status_size, " %s in %s (%s) | /join ROOM_ID  /leave  /quit",
+                         client->username, client->current_room_name, client->current_room_id);
+            }
+            break;
+        }
+    }
+}
+
+/* Number of leading input bytes shown verbatim; the rest is a password. */
+static size_t visible_input_prefix(const client_term_t *term) {
+    static const char *const secret_commands[] = { "/login ", "/register " };
+    for (size_t i = 0; i < sizeof(secret_commands) / sizeof(secret_commands[0]); i++) {
+        size_t cmd_len = strlen(secret_commands[i]);
+        if (term->input_len >= cmd_len && memcmp(term->input, secret_commands[i], cmd_len) == 0) {
+            size_t pos = cmd_len;
+            while (pos < term->input_len && term->input[pos] == ' ') {
+                pos++;
+            }
+            while (pos < term->input_len && term->input[pos] != ' ') {
+                pos++;
+            }
+            return pos < term->input_len ? pos + 1 : term->input_len;
+        }
+    }
+    return term->input_len;
+}
+
+void term_render(client_term_t *term, const client_t *client, uint64_t now_ns) {
+    if (!term->ansi || !term->dirty) {
+        return;
+    }
+    if (now_ns - term->last_render_ns < (uint64_t)CLIENT_FRAME_INTERVAL_MS * 1000000ULL) {
+        return;
+    }
+
+    size_t cols = term->cols > 0 ? (size_t)term->cols : 80;
+    int rows = pane_rows(term);
+    size_t needed = (size_t)term->rows * (cols * 4 + 16) + 512;
+    if (needed > term->frame_capacity) {
+        char *frame = (char *)realloc(term->frame, needed);
+        if (!frame) {
+            return;
+        }
+        term->frame = frame;
+        term->frame_capacity = needed;
+    }
+
+    size_t len = 0;
+    frame_appendf(term, &len, "\033[?2026h\033[?25l");
+    if (term->clear_pending) {
+        frame_appendf(term, &len, "\033[2J");
+        term->clear_pending = false;
+    }
+    frame_appendf(term, &len, "\033[H");
+
+    /* Lay out wrapped scrollback rows bottom-up, newest line last. */
+    int first_row = rows;
+    int index = term->line_count - 1 - term->scroll_offset;
+    size_t row_start[256];
+    size_t row_len[256];
+    int row_line[256];
+    int max_rows = rows < 256 ? rows : 256;
+    while (first_row > rows - max_rows && index >= 0) {
+        const char *line = line_at(term, index);
+        size_t line_len = strlen(line);
+        size_t segments = line_len == 0 ? 1 : (display_width(line, line_len) + cols - 1) / cols;
+        if (segments == 0) {
+            segments = 1;
+        }
+        size_t offsets[64];
+        size_t lengths[64];
+        size_t count = 0;
+        size_t pos = 0;
+        while (count < segments && count < 64) {
+            size_t seg = fit_columns(line + pos, line_len - pos, cols);
+            offsets[count] = pos;
+            lengths[count] = seg;
+            pos += seg;
+            count++;
+        }
+        for (size_t k = count; k > 0 && first_row > rows - max_rows; k--) {
+            first_row--;
+            row_start[first_row - (rows - max_rows)] = offsets[k - 1];
+            row_len[first_row - (rows - max_rows)] = lengths[k - 1];
+            row_line[first_row - (rows - max_rows)] = index;
+        }
+        index--;
+    }
+
+    for (int r = 0; r < rows; r++) {
+        int slot = r - (rows - max_rows);
+        if (r >= first_row && slot >= 0) {
+            const char *line = line_at(term, row_line[slot]);
+            frame_append(term, &len, line + row_start[slot], row_len[slot]);
+        }
+        frame_appendf(term, &len, "\033[K\r\n");
+    }
+
+    char status[MAX_ROOM_NAME_LEN + MAX_ROOM_ID_LEN + MAX_USERNAME_LEN + 128];
+    build_status(client, status, sizeof(status));
+    if (term->scroll_offset > 0) {
+        size_t used = strlen(status);
+        snprintf(status + used, sizeof(status) - used, "  [scrolled back %d]", term->scroll_offset);
+    }
+    size_t status_len = fit_columns(status, strlen(status), cols);
+    frame_appendf(term, &len, "\033[7m");
+    frame_append(term, &len, status, status_len);
+    for (size_t w = display_width(status, status_len); w < cols; w++) {
+        frame_append(term, &len, " ", 1);
+    }
+    frame_appendf(term, &len, "\033[0m\r\n");
+
+    /* Input line: show the tail that fits, with passwords masked. */
+    size_t prefix = visible_input_prefix(term);
+    size_t input_cols = cols > PROMPT_LEN + 1 ? cols - PROMPT_LEN - 1 : 1;
+    size_t start = 0;
+    while (display_width(term->input + start, term->input_len - start) > input_cols) {
+        start++;
+        while (start < term->input_len && is_continuation((unsigned char)term->input[start])) {
+            start++;
+        }
+    }
+    frame_append(term, &len, PROMPT, PROMPT_LEN);
+    for (size_t i = start; i < term->input_len; i++) {
+        if (i < prefix) {
+            frame_append(term, &len, &term->input[i], 1);
+        } else if (!is_continuation((unsigned char)term->input[i])) {
+            frame_append(term, &len, "*", 1);
+        }
+    }
+    frame_appendf(term, &len, "\033[K");
+    size_t cursor_col = PROMPT_LEN + display_width(term->input + start, term->input_len - start) + 1;
+    frame_appendf(term, &len, "\033[%d;%zuH\033[?25h\033[?2026l", rows + 2, cursor_col);
+
+    size_t written = 0;
+    while (written < len) {
+        ssize_t n = write(STDOUT_FILENO, term->frame + written, len - written);
+        if (n <= 0) {
+            break;
+        }
+        written += (size_t)n;
+    }
+
+    term->dirty = false;
+    term->last_render_ns = now_ns;
+}
+
+int term_render_timeout(const client_term_t *term, uint64_t now_ns) {
+    if (!term->ansi || !term->dirty) {
+        return -1;
+    }
+    uint64_t next = term->last_render_ns + (uint64_t)CLIENT_FRAME_INTERVAL_MS * 1000000ULL;
+    if (now_ns >= next) {
+        return 0;
+    }
+    return (int)((next - now_ns + 999999ULL) / 1000000ULL);
+}
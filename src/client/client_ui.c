@@ -3,227 +3,227 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
-
-void clear_screen() {
-#ifdef _WIN32
-    system("cls");
-#else
-    system("clear");
-#endif
-}
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
 
-void client_display_menu(client_t *client) {
-    if (!client) {
-        return;
-    }
-    
-    clear_screen();
-    
-    printf("=============================================\n");
-    printf("              CHAT CLIENT                   \n");
-    printf("=============================================\n");
-    printf("Status: ");
-    switch (client->state) {
-        case CLIENT_STATE_DISCONNECTED:
-            printf("Disconnected\n");
-            break;
-        case CLIENT_STATE_CONNECTED:
-            printf("Connected\n");
-            break;
-        case CLIENT_STATE_AUTHENTICATED:
-            printf("Logged in as %s\n", client->username);
-            break;
-        case CLIENT_STATE_IN_ROOM:
-            printf("In room: %s\n", client->current_room_name);
-            break;
-    }
-    
-    printf("\n");
-    printf("Menu Options:\n");
-    
-    if (client->state == CLIENT_STATE_CONNECTED) {
-        printf("1. Login\n");
-        printf("2. Register\n");
-        printf("7. Quit\n");
-    } else if (client->state == CLIENT_STATE_AUTHENTICATED) {
-        printf("3. Create room\n");
-        printf("4. Join room\n");
-        printf("7. Quit\n");
-    } else if (client->state == CLIENT_STATE_IN_ROOM) {
-        printf("5. Leave room\n");
-        printf("6. Chat\n");
-        printf("7. Quit\n");
-    }
-    
-    printf("\nEnter your choice: ");
+static volatile sig_atomic_t g_resized = 0;
+
+static void handle_winch(int sig) {
+    (void)sig;
+    g_resized = 1;
 }
 
-void get_input(const char *prompt, char *buffer, size_t buffer_size) {
-    printf("%s", prompt);
-    fgets(buffer, buffer_size, stdin);
-    size_t len = strlen(buffer);
-    if (len > 0 && buffer[len - 1] == '\n') {
-        buffer[len - 1] = '\0';
-    }
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
 }
 
-void handle_login(client_t *client) {
-    char username[MAX_USERNAME_LEN];
-    char password[MAX_PASSWORD_LEN];
-    
-    get_input("Username: ", username, sizeof(username));
-    get_input("Password: ", password, sizeof(password));
-    
-    if (client_login(client, username, password) == 0) {
-        printf("Logging in...\n");
-    } else {
-        printf("Failed to send login request\n");
-        printf("Press Enter to continue...");
-        getchar();
-    }
+static void print_help(client_t *client) {
+    term_print(&client->term, "Commands:");
+    term_print(&client->term, "  /register USER PASS   Create an account");
+    term_print(&client->term, "  /login USER PASS      Log in");
+    term_print(&client->term, "  /create NAME          Create a room and join it");
+    term_print(&client->term, "  /join ROOM_ID         Join a room (you can be in many at once)");
+    term_print(&client->term, "  /rooms                List the rooms you are in");
+    term_print(&client->term, "  /switch N|ROOM_ID     Make another joined room the active one");
+    term_print(&client->term, "  /who                  List who is in the active room");
+    term_print(&client->term, "  /msg USER TEXT        Message one user (delivered at login if offline)");
+    term_print(&client->term, "  /leave [ROOM_ID]      Leave the active (or given) room");
+    term_print(&client->term, "  /quit                 Exit");
+    term_print(&client->term, "Anything else is sent to the active room. PgUp/PgDn scroll.");
 }
 
-void handle_register(client_t *client) {
-    char username[MAX_USERNAME_LEN];
-    char password[MAX_PASSWORD_LEN];
-    char confirm_password[MAX_PASSWORD_LEN];
-    
-    get_input("Username: ", username, sizeof(username));
-    get_input("Password: ", password, sizeof(password));
-    get_input("Confirm Password: ", confirm_password, sizeof(confirm_password));
-    
-    if (strcmp(password, confirm_password) != 0) {
-        printf("Passwords do not match\n");
-        printf("Press Enter to continue...");
-        getchar();
+void client_handle_command(client_t *client, char *line) {
+    char *input = trim_string(line);
+    if (input[0] == '\0') {
         return;
     }
-    
-    if (client_register(client, username, password) == 0) {
-        printf("Registering...\n");
-    } else {
-        printf("Failed to send register request\n");
-        printf("Press Enter to continue...");
-        getchar();
-    }
-}
 
-void handle_create_room(client_t *client) {
-    char room_name[MAX_ROOM_NAME_LEN];
-    
-    get_input("Room Name: ", room_name, sizeof(room_name));
-    
-    if (client_create_room(client, room_name) == 0) {
-        printf("Creating room...\n");
-    } else {
-        printf("Failed to send create room request\n");
-        printf("Press Enter to continue...");
-        getchar();
+    if (input[0] != '/') {
+        if (chat_session_reconnecting(client->session)) {
+            term_print(&client->term, "Not connected, message not sent");
+        } else if (client->state != CLIENT_STATE_IN_ROOM) {
+            term_print(&client->term, "Join a room first (/join ROOM_ID or /create NAME)");
+        } else if (client_send_message(client, input) != 0) {
+            term_print(&client->term, "Failed to send message");
+        }
+        return;
     }
-}
 
-void handle_join_room(client_t *client) {
-    char room_id[MAX_ROOM_ID_LEN];
-    
-    get_input("Room ID: ", room_id, sizeof(room_id));
-    
-    if (client_join_room(client, room_id) == 0) {
-        printf("Joining room...\n");
-    } else {
-        printf("Failed to send join room request\n");
-        printf("Press Enter to continue...");
-        getchar();
-    }
-}
+    char *saveptr = NULL;
+    char *command = strtok_r(input, " ", &saveptr);
+    char *rest = saveptr ? trim_string(saveptr) : "";
 
-void handle_chat(client_t *client) {
-    clear_screen();
-    printf("=============================================\n");
-    printf("              CHAT MODE                    \n");
-    printf("=============================================\n");
-    printf("Room: %s\n", client->current_room_name);
-    printf("Type your message and press Enter to send.\n");
-    printf("Type '/quit' to exit chat mode.\n");
-    printf("=============================================\n\n");
-    
-    char message[MAX_MESSAGE_LEN];
-    
-    while (1) {
-        get_input("> ", message, sizeof(message));
-        
-        if (strcmp(message, "/quit") == 0) {
-            break;
+    if (chat_session_reconnecting(client->session) &&
+        strcmp(command, "/quit") != 0 && strcmp(command, "/help") != 0) {
+        term_print(&client->term, "Not connected, still reconnecting");
+    } else if (strcmp(command, "/quit") == 0) {
+        client->running = false;
+    } else if (strcmp(command, "/help") == 0) {
+        print_help(client);
+    } else if (strcmp(command, "/login") == 0 || strcmp(command, "/register") == 0) {
+        bool login = strcmp(command, "/login") == 0;
+        char *username = strtok_r(NULL, " ", &saveptr);
+        char *password = strtok_r(NULL, " ", &saveptr);
+        if (!username || !password) {
+            term_print(&client->term, "Usage: %s USER PASS", command);
+        } else if (client->state != CLIENT_STATE_CONNECTED) {
+            term_print(&client->term, "Already logged in");
+        } else if ((login ? client_login(client, username, password)
+                          : client_register(client, username, password)) == 0) {
+            term_print(&client->term, login ? "Logging in..." : "Registering...");
+        } else {
+            term_print(&client->term, login ? "Failed to send login request" : "Failed to send register request");
+        }
+    } else if (strcmp(command, "/create") == 0) {
+        if (rest[0] == '\0') {
+            term_print(&client->term, "Usage: /create NAME");
+        } else if (client->state < CLIENT_STATE_AUTHENTICATED) {
+            term_print(&client->term, "Log in first");
+        } else if (client_create_room(client, rest) == 0) {
+            term_print(&client->term, "Creating room...");
+        } else {
+            term_print(&client->term, "Failed to send create room request");
+        }
+    } else if (strcmp(command, "/join") == 0) {
+        if (rest[0] == '\0') {
+            term_print(&client->term, "Usage: /join ROOM_ID");
+        } else if (client->state < CLIENT_STATE_AUTHENTICATED) {
+            term_print(&client->term, "Log in first");
+        } else if (client_join_room(client, rest) == 0) {
+            term_print(&client->term, "Joining room...");
+        } else {
+            term_print(&client->term, "Failed to send join room request");
+        }
+    } else if (strcmp(command, "/rooms") == 0) {
+        int count = chat_session_room_count(client->session);
+        for (int i = 0; i < count; i++) {
+            if (!chat_session_room_joined(client->session, i)) {
+                continue;
+            }
+            const char *room_id = chat_session_room_id(client->session, i);
+            term_print(&client->term, "%c%d. %s (%s)", strcmp(room_id, client->current_room_id) == 0 ? '*' : ' ',
+                       i + 1, chat_session_room_name(client->session, i), room_id);
+        }
+        if (client->state != CLIENT_STATE_IN_ROOM) {
+            term_print(&client->term, "You are not in any room");
+        }
+    } else if (strcmp(command, "/who") == 0) {
+        int index = -1;
+        for (int i = 0; i < chat_session_room_count(client->session) && index < 0; i++) {
+            if (chat_session_room_joined(client->session, i) &&
+                strcmp(chat_session_room_id(client->session, i), client->current_room_id) == 0) {
+                index = i;
+            }
         }
-        
-        if (message[0] != '\0') {
-            if (client_send_message(client, message) != 0) {
-                printf("Failed to send message\n");
+        if (index < 0) {
+            term_print(&client->term, "Join a room first (/join ROOM_ID or /create NAME)");
+        } else {
+            int count = chat_session_room_member_count(client->session, index);
+            term_print(&client->term, "%d in %s:", count, client->current_room_name);
+            for (int i = 0; i < count; i++) {
+                term_print(&client->term, "  %s", chat_session_room_member(client->session, index, i));
             }
         }
+    } else if (strcmp(command, "/msg") == 0) {
+        char *username = strtok_r(NULL, " ", &saveptr);
+        char *text = saveptr ? trim_string(saveptr) : "";
+        if (!username || text[0] == '\0') {
+            term_print(&client->term, "Usage: /msg USER TEXT");
+        } else if (client->state < CLIENT_STATE_AUTHENTICATED) {
+            term_print(&client->term, "Log in first");
+        } else if (client_send_direct(client, username, text) == 0) {
+            term_print(&client->term, "-> [%s]: %s", username, text);
+        } else {
+            term_print(&client->term, "Failed to send message");
+        }
+    } else if (strcmp(command, "/switch") == 0) {
+        if (rest[0] == '\0') {
+            term_print(&client->term, "Usage: /switch N|ROOM_ID");
+        } else if (client_switch_room(client, rest) == 0) {
+            term_print(&client->term, "Now talking in %s", client->current_room_name);
+        } else {
+            term_print(&client->term, "You are not in that room, try /rooms");
+        }
+    } else if (strcmp(command, "/leave") == 0) {
+        char room_name[MAX_ROOM_NAME_LEN];
+        safe_strcpy(room_name, rest[0] != '\0' ? "that room" : client->current_room_name, sizeof(room_name));
+        if (client_leave_room(client, rest[0] != '\0' ? rest : client->current_room_id) == 0) {
+            term_print(&client->term, "Left %s", room_name);
+        } else {
+            term_print(&client->term, "You are not in that room");
+        }
+    } else {
+        term_print(&client->term, "Unknown command %s, try /help", command);
     }
 }
 
-void client_handle_input(client_t *client) {
+void client_run(client_t *client) {
     if (!client) {
         return;
     }
-    
-    int choice;
-    char input[10];
-    
-    fgets(input, sizeof(input), stdin);
-    choice = atoi(input);
-    
-    switch (choice) {
-        case MENU_LOGIN:
-            if (client->state == CLIENT_STATE_CONNECTED) {
-                handle_login(client);
-            }
-            break;
-            
-        case MENU_REGISTER:
-            if (client->state == CLIENT_STATE_CONNECTED) {
-                handle_register(client);
-            }
-            break;
-            
-        case MENU_CREATE_ROOM:
-            if (client->state == CLIENT_STATE_AUTHENTICATED) {
-                handle_create_room(client);
-            }
+    if (term_init(&client->term) != 0) {
+        printf("Failed to initialize terminal\n");
+        return;
+    }
+    signal(SIGWINCH, handle_winch);
+
+    term_print(&client->term, "Connected to server. Type /help for commands.");
+
+    char line[MAX_MESSAGE_LEN];
+    char input[512];
+    while (client->running) {
+        if (g_resized) {
+            g_resized = 0;
+            term_resize(&client->term);
+        }
+
+        struct pollfd pfds[2];
+        nfds_t nfds = 1;
+        pfds[0].fd = STDIN_FILENO;
+        pfds[0].events = POLLIN;
+        pfds[0].revents = 0;
+        int sockfd = chat_session_fd(client->session);
+        if (sockfd >= 0) {
+            pfds[1].fd = sockfd;
+            pfds[1].events = chat_session_events(client->session);
+            pfds[1].revents = 0;
+            nfds = 2;
+        }
+
+        int timeout = term_render_timeout(&client->term, monotonic_ns());
+        int session_timeout = chat_session_next_timeout(client->session);
+        if (session_timeout >= 0 && (timeout < 0 || session_timeout < timeout)) {
+            timeout = session_timeout;
+        }
+        int rc = poll(pfds, nfds, timeout);
+        if (rc < 0 && errno != EINTR) {
             break;
-            
-        case MENU_JOIN_ROOM:
-            if (client->state == CLIENT_STATE_AUTHENTICATED) {
-                handle_join_room(client);
+        }
+
+        if (rc > 0 && (pfds[0].revents & (POLLIN | POLLHUP))) {
+            ssize_t n = read(STDIN_FILENO, input, sizeof(input));
+            if (n <= 0) {
+                client->running = false;
             }
-            break;
-            
-        case MENU_LEAVE_ROOM:
-            if (client->state == CLIENT_STATE_IN_ROOM) {
-                if (client_leave_room(client) == 0) {
-                    printf("Left room\n");
-                } else {
-                    printf("Failed to leave room\n");
+            for (ssize_t i = 0; i < n && client->running; i++) {
+                if (term_handle_key(&client->term, input[i], line, sizeof(line))) {
+                    client_handle_command(client, line);
                 }
             }
-            break;
-            
-        case MENU_CHAT:
-            if (client->state == CLIENT_STATE_IN_ROOM) {
-                handle_chat(client);
-            }
-            break;
-            
-        case MENU_QUIT:
-            client->running = false;
-            break;
-            
-        default:
-            printf("Invalid choice\n");
-            printf("Press Enter to continue...");
-            getchar();
-            break;
+        }
+
+        if (rc > 0 && nfds == 2 && pfds[1].revents) {
+            chat_session_handle_io(client->session, pfds[1].revents);
+        }
+        chat_session_tick(client->session);
+
+        term_render(&client->term, client, monotonic_ns());
     }
-} 
\ No newline at end of file
+
+    term_restore(&client->term);
+}
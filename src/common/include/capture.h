@@ -0,0 +1,49 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Binary traffic capture.
+ *
+ * A capture file starts with CAPTURE_MAGIC followed by a stream of records:
+ * a kind byte, then the connection ID, the nanoseconds elapsed since the
+ * previous record and the payload length as LEB128 varints, then the payload.
+ * Frame payloads are stored in wire format as the server decoded them:
+ * without the request ID of a tagged frame, with a MSG_COMPRESSED frame
+ * replaced by the frame it carries and a MSG_CHAT_COMPACT frame by the full
+ * chat frame it stands for. A replay therefore sends every frame untagged,
+ * uncompressed and full size, and needs no deflate stream state to do it.
+ */
+
+#define CAPTURE_MAGIC "CHATCAP1"
+#define CAPTURE_MAGIC_LEN 8
+#define CAPTURE_MAX_RECORD 65536
+
+#define CAPTURE_RECORD_OPEN  1
+#define CAPTURE_RECORD_FRAME 2
+#define CAPTURE_RECORD_CLOSE 3
+
+typedef struct capture_writer capture_writer_t;
+typedef struct capture_reader capture_reader_t;
+
+typedef struct {
+    uint8_t kind;
+    uint32_t conn_id;
+    uint64_t timestamp_ns;
+    uint32_t length;
+    const char *data;
+} capture_record_t;
+
+capture_writer_t *capture_open_writer(const char *path);
+void capture_close_writer(capture_writer_t *writer);
+int capture_record_open(capture_writer_t *writer, uint32_t conn_id);
+int capture_record_frame(capture_writer_t *writer, uint32_t conn_id, const void *frame, size_t length);
+int capture_record_close(capture_writer_t *writer, uint32_t conn_id);
+
+capture_reader_t *capture_open_reader(const char *path);
+void capture_close_reader(capture_reader_t *reader);
+int capture_read(capture_reader_t *reader, capture_record_t *record);
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Frame compression, raw deflate.
+ *
+ * A MSG_COMPRESSED frame carries the deflated wire bytes of exactly one other
+ * frame, request id included. Normally those bytes continue the sender's
+ * stream for the connection: every frame ends in a sync flush, so it can be
+ * inflated as soon as it arrives while later frames still refer back to the
+ * ones before. A COMPRESSED_STANDALONE frame is deflated on its own, so the
+ * same bytes can be written to every connection that negotiated compression.
+ */
+
+#define COMPRESS_WINDOW_BITS 12      /* 4 KB of history per direction */
+#define COMPRESS_MEM_LEVEL   5
+#define COMPRESS_MIN_FRAME   64      /* shorter frames are sent as they are */
+#define COMPRESS_BOUND(length) ((length) + ((length) >> 3) + ((length) >> 6) + 64)
+
+typedef struct compress_stream compress_stream_t;
+
+compress_stream_t *compress_stream_create(bool deflating);
+void compress_stream_free(compress_stream_t *stream);
+int compress_frame(compress_stream_t *stream, bool standalone, const void *message, size_t length,
+                   uint32_t request_id, void *out, size_t out_size);
+int decompress_frame(compress_stream_t *stream, const void *frame, size_t length, void *out, size_t out_size);
+
+#endif
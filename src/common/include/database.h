@@ -3,6 +3,7 @@
 
 #include <sqlite3.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 typedef struct {
     sqlite3 *db;
@@ -21,6 +22,19 @@ typedef struct {
     int owner_id;
 } room_t;
 
+typedef struct {
+    uint64_t seq;
+    char username[32];
+    char body[1024];
+} stored_message_t;
+
+typedef struct {
+    int64_t id;
+    char sender[32];
+    char body[1024];
+    uint64_t sent_at;
+} stored_direct_t;
+
 int db_init(database_t *db, const char *db_path);
 void db_close(database_t *db);
 int db_register_user(database_t *db, const char *username, const char *password);
@@ -29,6 +43,13 @@ int db_get_user_id(database_t *db, const char *username);
 int db_create_room(database_t *db, const char *name, int owner_id, char *room_id_out);
 bool db_room_exists(database_t *db, const char *room_id);
 int db_get_room_name(database_t *db, const char *room_id, char *name_out, int name_out_size);
+int db_get_rooms(database_t *db, const char *const *room_ids, int count, room_t *rooms_out, int *found_out);
 int db_list_rooms(database_t *db, room_t **rooms, int *count);
+int db_store_message(database_t *db, const char *room_id, uint64_t seq, const char *username, const char *body);
+int db_get_last_message_seq(database_t *db, const char *room_id, uint64_t *seq_out);
+int db_get_messages_since(database_t *db, const char *room_id, uint64_t since_seq, int limit,
+                          stored_message_t **messages, int *count);
+int db_queue_direct(database_t *db, const char *recipient, const char *sender, const char *body, uint64_t sent_at);
+int db_take_directs(database_t *db, const char *recipient, stored_direct_t **messages, int *count);
 
 #endif
\ No newline at end of file
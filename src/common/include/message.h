@@ -2,8 +2,10 @@
 #define MESSAGE_H
 
 #include "protocol.h"
+#include <stdbool.h>
 #include <stdint.h>
 
+void *create_message(uint8_t type);
 auth_request_t *create_auth_request(const char *username, const char *password);
 auth_response_t *create_auth_response(uint8_t status);
 register_request_t *create_register_request(const char *username, const char *password);
@@ -14,6 +16,21 @@ join_room_request_t *create_join_room_request(const char *room_id);
 join_room_response_t *create_join_room_response(uint8_t status, const char *room_name, const char *room_id);
 leave_room_request_t *create_leave_room_request(const char *room_id);
 chat_message_t *create_chat_message(const char *room_id, const char *username, const char *message);
+direct_message_t *create_direct_message(const char *to, const char *from, const char *message);
+presence_update_t *create_presence_update(const char *room_id, uint8_t flags);
+int presence_update_add(presence_update_t *update, uint8_t op, const char *username);
+ping_message_t *create_ping_message(uint8_t type, uint64_t stamp);
+ack_message_t *create_ack_message(void);
+int ack_message_add(ack_message_t *ack, const char *room_id, uint64_t seq, uint8_t flags);
+login_join_request_t *create_login_join_request(const char *username, const char *password);
+int login_join_request_add(login_join_request_t *req, const char *room_id, bool resume, uint64_t since_seq,
+                           uint16_t tail);
+login_join_response_t *create_login_join_response(uint8_t status);
+int login_join_response_add(login_join_response_t *resp, const char *room_id, uint8_t status, const char *room_name,
+                            uint64_t head_seq);
+hello_message_t *create_hello_message(uint16_t version, uint32_t capabilities);
+size_t chat_compact(const chat_message_t *chat, chat_compact_t *out);
+int chat_expand(const void *frame, size_t length, chat_message_t *out);
 error_message_t *create_error_message(uint8_t error_code, const char *error_message);
 void init_message_header(message_header_t *header, uint8_t type, uint32_t length);
 void free_message(void *message);
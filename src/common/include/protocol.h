@@ -1,25 +1,70 @@
 #ifndef PROTOCOL_H
 #define PROTOCOL_H
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <stddef.h>
 
-#define MSG_AUTH_REQUEST     1
-#define MSG_AUTH_RESPONSE    2
-#define MSG_REGISTER_REQUEST 3
-#define MSG_REGISTER_RESPONSE 4
-#define MSG_CREATE_ROOM      5
-#define MSG_CREATE_ROOM_RESPONSE 6
-#define MSG_JOIN_ROOM        7
-#define MSG_JOIN_ROOM_RESPONSE 8
-#define MSG_LEAVE_ROOM       9
-#define MSG_CHAT_MESSAGE     10
-#define MSG_ERROR            255
+/*
+ * The message schema, one line per message type: its name, its code and the
+ * layout of its frames. The MSG_ codes, the length rules every received frame
+ * is checked against (message_check) and the allocation of new frames
+ * (create_message) are all generated from it.
+ *
+ * Written by hand: the structs below, because their layout is the wire
+ * format and the schema takes sizes and offsets from them; the create_*
+ * and *_add builders in message.c, one per set of arguments, all on top of
+ * create_message(); and each side's dispatch, the server's routes[] and the
+ * client's dispatch_frame(), because which types a side accepts and what it
+ * requires first differ per side. So a new message is a line here and its
+ * struct, plus a builder and a handler where it is sent and received.
+ *
+ *   MESSAGE_FIXED(t)           exactly the size of t
+ *   MESSAGE_UPTO(t, field)     t, but may end anywhere from field on
+ *   MESSAGE_BYTES(t, field)    t up to field, then any number of bytes
+ *   MESSAGE_LIST(t, count, array, max)
+ *                              t up to array, then the uint8_t count of its entries
+ */
+#define PROTOCOL_MESSAGES(X) \
+    X(AUTH_REQUEST,             1, MESSAGE_FIXED(auth_request_t)) \
+    X(AUTH_RESPONSE,            2, MESSAGE_FIXED(auth_response_t)) \
+    X(REGISTER_REQUEST,         3, MESSAGE_FIXED(register_request_t)) \
+    X(REGISTER_RESPONSE,        4, MESSAGE_FIXED(register_response_t)) \
+    X(CREATE_ROOM,              5, MESSAGE_FIXED(create_room_request_t)) \
+    X(CREATE_ROOM_RESPONSE,     6, MESSAGE_FIXED(create_room_response_t)) \
+    X(JOIN_ROOM,                7, MESSAGE_UPTO(join_room_request_t, resume)) /* version 1: no resume */ \
+    X(JOIN_ROOM_RESPONSE,       8, MESSAGE_FIXED(join_room_response_t)) \
+    X(LEAVE_ROOM,               9, MESSAGE_FIXED(leave_room_request_t)) \
+    X(CHAT_MESSAGE,            10, MESSAGE_UPTO(chat_message_t, seq)) /* version 1: no seq or msg_id */ \
+    X(PRESENCE,                11, MESSAGE_LIST(presence_update_t, count, entries, PRESENCE_MAX_ENTRIES)) \
+    X(DIRECT,                  12, MESSAGE_FIXED(direct_message_t)) \
+    X(PING,                    13, MESSAGE_FIXED(ping_message_t)) \
+    X(PONG,                    14, MESSAGE_FIXED(ping_message_t)) \
+    X(ACK,                     15, MESSAGE_LIST(ack_message_t, count, entries, ACK_MAX_ENTRIES)) \
+    X(LOGIN_JOIN,              16, MESSAGE_LIST(login_join_request_t, count, entries, LOGIN_JOIN_MAX_ROOMS)) \
+    X(LOGIN_JOIN_RESPONSE,     17, MESSAGE_LIST(login_join_response_t, count, results, LOGIN_JOIN_MAX_ROOMS)) \
+    X(HELLO,                   18, MESSAGE_FIXED(hello_message_t)) \
+    X(COMPRESSED,              19, MESSAGE_BYTES(compressed_frame_t, data)) \
+    X(CHAT_COMPACT,            20, MESSAGE_UPTO(chat_compact_t, message)) \
+    X(ERROR,                  255, MESSAGE_FIXED(error_message_t))
+
+#define MESSAGE_FIXED(t)                { sizeof(t), sizeof(t), sizeof(t), 0, 0, 0 }
+#define MESSAGE_UPTO(t, field)          { sizeof(t), offsetof(t, field), sizeof(t), 0, 0, 0 }
+#define MESSAGE_BYTES(t, field)         { sizeof(t), offsetof(t, field), UINT32_MAX, 0, 0, 0 }
+#define MESSAGE_LIST(t, count, array, max) \
+    { sizeof(t), offsetof(t, array), sizeof(t), offsetof(t, count), sizeof(((t *)0)->array[0]), (max) }
+
+#define MESSAGE_CODE(name, code, layout) MSG_##name = (code),
+enum { PROTOCOL_MESSAGES(MESSAGE_CODE) };
+#undef MESSAGE_CODE
 
 #define RESP_SUCCESS         0
 #define RESP_AUTH_FAILED     1
 #define RESP_USER_EXISTS     2
 #define RESP_ROOM_NOT_FOUND  3
+#define RESP_USER_NOT_FOUND  4
+#define RESP_RATE_LIMITED    5    /* message dropped; not tied to any request, back off and retry */
+#define RESP_OVERLOADED      6    /* connection refused before it was served; try again later */
 #define RESP_INTERNAL_ERROR  255
 
 #define MAX_USERNAME_LEN     32
@@ -27,6 +72,52 @@
 #define MAX_ROOM_NAME_LEN    64
 #define MAX_MESSAGE_LEN      1024
 #define MAX_ROOM_ID_LEN      37  
+#define MAX_HISTORY_REPLAY   500
+
+#define PRESENCE_JOIN        1
+#define PRESENCE_LEAVE       2
+#define PRESENCE_RESET       0x01     /* first frame of a snapshot: replace the member list */
+#define PRESENCE_MORE        0x02     /* more snapshot frames follow */
+#define PRESENCE_MAX_ENTRIES 32
+#define PRESENCE_UPDATE_SIZE(count) (offsetof(presence_update_t, entries) + (count) * sizeof(presence_entry_t))
+
+#define ACK_GAP              0x01     /* from a client: resend what follows seq; from the server: resend done */
+#define ACK_MAX_ENTRIES      32
+#define ACK_MESSAGE_SIZE(count) (offsetof(ack_message_t, entries) + (count) * sizeof(ack_entry_t))
+
+#define LOGIN_JOIN_MAX_ROOMS 16
+#define LOGIN_JOIN_REQUEST_SIZE(count) (offsetof(login_join_request_t, entries) + (count) * sizeof(login_join_entry_t))
+#define LOGIN_JOIN_RESPONSE_SIZE(count) \
+    (offsetof(login_join_response_t, results) + (count) * sizeof(login_join_result_t))
+
+/*
+ * A frame whose length has FRAME_TAGGED set carries a request id right after
+ * the header, counted in the length. Responses and errors to a tagged request
+ * carry the same id, so a client can pipeline requests on one connection and
+ * match the answers by id. The receive functions strip the id, leaving the
+ * usual frame layout behind it.
+ */
+#define FRAME_TAGGED         0x80000000u
+#define FRAME_TAG_SIZE       sizeof(uint32_t)
+
+/*
+ * Version 1 is the protocol as it was before the hello, spoken by any client
+ * that does not send one: its join and chat frames end before the fields
+ * added since, and the server reads those as zero. Capabilities are granted
+ * per connection; a peer that was not granted one never receives frames that
+ * depend on it.
+ */
+#define PROTOCOL_VERSION     2
+#define PROTOCOL_MIN_VERSION 1
+
+#define CAP_COMPRESSION      0x01     /* frames either way may be MSG_COMPRESSED; see compress.h */
+#define CAP_COMPACT          0x02     /* chat frames either way may be MSG_CHAT_COMPACT */
+#define CAP_MULTI_ROOM       0x04     /* MSG_LOGIN_JOIN is understood */
+#define CAP_PIPELINING       0x08     /* requests may be tagged (FRAME_TAGGED) and answers carry the tag */
+
+#define COMPRESSED_STANDALONE 0x01    /* deflated on its own rather than as part of the connection's stream */
+#define COMPRESSED_FRAME_SIZE(data_length) (offsetof(compressed_frame_t, data) + (data_length))
+#define CHAT_COMPACT_SIZE(text_length) (offsetof(chat_compact_t, message) + (text_length) + 1)
 
 #pragma pack(1)
 
@@ -71,6 +162,8 @@ typedef struct {
 typedef struct {
     message_header_t header;
     char room_id[MAX_ROOM_ID_LEN];
+    uint8_t resume;       /* replay stored messages after since_seq before going live */
+    uint64_t since_seq;
 } join_room_request_t;
 
 typedef struct {
@@ -78,6 +171,7 @@ typedef struct {
     uint8_t status;    
     char room_name[MAX_ROOM_NAME_LEN];
     char room_id[MAX_ROOM_ID_LEN];
+    uint64_t head_seq;    /* last sequence number delivered before this response */
 } join_room_response_t;
 
 typedef struct {
@@ -90,8 +184,115 @@ typedef struct {
     char room_id[MAX_ROOM_ID_LEN];
     char username[MAX_USERNAME_LEN];
     char message[MAX_MESSAGE_LEN];
+    uint64_t seq;         /* per-room, assigned by the server; 0 from clients */
+    uint64_t msg_id;      /* chosen by the sender so a retry can be recognized; 0 for none */
 } chat_message_t;
 
+typedef struct {
+    message_header_t header;
+    char to[MAX_USERNAME_LEN];
+    char from[MAX_USERNAME_LEN];   /* stamped by the server */
+    char message[MAX_MESSAGE_LEN];
+    uint64_t sent_at;              /* unix time the server accepted it; later for queued messages */
+} direct_message_t;
+
+typedef struct {
+    uint8_t op;
+    char username[MAX_USERNAME_LEN];
+} presence_entry_t;
+
+/* Sent with only `count` entries on the wire. */
+typedef struct {
+    message_header_t header;
+    char room_id[MAX_ROOM_ID_LEN];
+    uint8_t flags;
+    uint8_t count;
+    presence_entry_t entries[PRESENCE_MAX_ENTRIES];
+} presence_update_t;
+
+typedef struct {
+    char room_id[MAX_ROOM_ID_LEN];
+    uint64_t seq;             /* every message up to here was received */
+    uint8_t flags;
+} ack_entry_t;
+
+/* Cumulative per-room acks, sent with only `count` entries on the wire. */
+typedef struct {
+    message_header_t header;
+    uint8_t count;
+    ack_entry_t entries[ACK_MAX_ENTRIES];
+} ack_message_t;
+
+typedef struct {
+    char room_id[MAX_ROOM_ID_LEN];
+    uint8_t resume;       /* replay stored messages after since_seq */
+    uint64_t since_seq;
+    uint16_t tail;        /* otherwise replay up to this many of the latest messages */
+} login_join_entry_t;
+
+/* Login and join in one round trip, sent with only `count` entries on the wire. */
+typedef struct {
+    message_header_t header;
+    char username[MAX_USERNAME_LEN];
+    char password[MAX_PASSWORD_LEN];
+    uint8_t count;
+    login_join_entry_t entries[LOGIN_JOIN_MAX_ROOMS];
+} login_join_request_t;
+
+typedef struct {
+    char room_id[MAX_ROOM_ID_LEN];
+    uint8_t status;
+    char room_name[MAX_ROOM_NAME_LEN];
+    uint64_t head_seq;
+} login_join_result_t;
+
+/* One result per requested room, in order, after any history replayed for them; none if the login failed. */
+typedef struct {
+    message_header_t header;
+    uint8_t status;       /* of the login */
+    uint8_t count;
+    login_join_result_t results[LOGIN_JOIN_MAX_ROOMS];
+} login_join_response_t;
+
+/*
+ * Sent by a client, before anything else, with the newest version it speaks
+ * and the capabilities it wants; the server answers with the version both
+ * will use and the capabilities it turned on. Either side may use a
+ * capability as soon as it knows the other has it, so the frames around the
+ * exchange may already use it. A server older than the hello answers with
+ * an error for an unknown message type instead.
+ */
+typedef struct {
+    message_header_t header;
+    uint16_t version;
+    uint32_t capabilities;
+} hello_message_t;
+
+typedef struct {
+    message_header_t header;
+    uint8_t flags;
+    uint8_t data[];
+} compressed_frame_t;
+
+/*
+ * A chat frame sent with only as much of the message as it uses, up to and
+ * including the terminator. Everything else is as in chat_message_t.
+ */
+typedef struct {
+    message_header_t header;
+    char room_id[MAX_ROOM_ID_LEN];
+    char username[MAX_USERNAME_LEN];
+    uint64_t seq;
+    uint64_t msg_id;
+    char message[MAX_MESSAGE_LEN];
+} chat_compact_t;
+
+/* Either side may ping; the other answers with MSG_PONG echoing the stamp. */
+typedef struct {
+    message_header_t header;
+    uint64_t stamp;
+} ping_message_t;
+
 typedef struct {
     message_header_t header;
     uint8_t error_code;
@@ -100,7 +301,41 @@ typedef struct {
 
 #pragma pack()
 
+/* A message type's row of the schema; all zero for codes that are not in it. */
+typedef struct {
+    uint32_t size;           /* of the struct a frame of it is built in */
+    uint32_t min_length;
+    uint32_t max_length;
+    uint16_t count_offset;   /* list frames: where the entry count is */
+    uint16_t entry_size;     /* ... and the size of each entry; 0 for other frames */
+    uint8_t max_count;
+} message_layout_t;
+
+extern const message_layout_t message_layouts[256];
+
+static inline bool message_known(uint8_t type) {
+    return message_layouts[type].size != 0;
+}
+
+/*
+ * Whether a received frame of this length, its request id already stripped,
+ * is a well-formed message of a known type: every field it claims to have,
+ * entries included, lies within the length. Frames that pass can be read as
+ * their struct, up to the length; strings in them are not yet terminated.
+ */
+static inline bool message_check(const void *frame, size_t length) {
+    const message_layout_t *layout = &message_layouts[((const message_header_t *)frame)->type];
+    if (length < layout->min_length || length > layout->max_length) {
+        return false;
+    }
+    size_t count = layout->entry_size ? ((const uint8_t *)frame)[layout->count_offset] : 0;
+    return count <= layout->max_count && length >= layout->min_length + count * layout->entry_size;
+}
+
 int send_message(int sockfd, const void *message, size_t length);
+int send_tagged_message(int sockfd, const void *message, size_t length, uint32_t request_id);
 int receive_message(int sockfd, void *buffer, size_t buffer_size);
+int receive_tagged_message(int sockfd, void *buffer, size_t buffer_size, uint32_t *request_id);
+int decode_frame(const void *wire, size_t wire_length, void *buffer, size_t buffer_size, uint32_t *request_id);
 
 #endif
\ No newline at end of file
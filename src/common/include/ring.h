@@ -0,0 +1,38 @@
+#ifndef RING_H
+#define RING_H
+
+#include <stdint.h>
+
+/*
+ * Consistent-hash ring shared by cluster nodes and the proxy.
+ *
+ * Nodes are listed as ID=HOST:PORT,... with IDs below RING_MAX_NODES. Each
+ * node gets RING_VNODES points on the ring and a key belongs to the first
+ * point at or after its hash, so every process given the same node IDs agrees
+ * on where a room lives.
+ */
+
+#define RING_MAX_NODES 64
+#define RING_VNODES 64
+
+typedef struct {
+    uint16_t node_id;
+    char host[64];
+    int port;
+} ring_node_t;
+
+typedef struct {
+    uint64_t point;
+    uint16_t node_id;
+} ring_vnode_t;
+
+typedef struct {
+    ring_vnode_t vnodes[RING_MAX_NODES * RING_VNODES];
+    int size;
+} hash_ring_t;
+
+int ring_parse_nodes(const char *spec, ring_node_t *nodes, int max_nodes);
+void ring_build(hash_ring_t *ring, const ring_node_t *nodes, int count);
+uint16_t ring_lookup(const hash_ring_t *ring, const char *key);
+
+#endif
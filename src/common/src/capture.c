@@ -0,0 +1,198 @@
+#include "../include/capture.h"
+#include "../include/protocol.h"
+#include "../include/utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+
+#define CAPTURE_WRITE_BUFFER (1 << 20)
+#define VARINT_MAX_BYTES 10
+
+struct capture_writer {
+    FILE *file;
+    pthread_mutex_t mutex;
+    uint64_t last_ns;
+};
+
+struct capture_reader {
+    FILE *file;
+    uint64_t timestamp_ns;
+    char data[CAPTURE_MAX_RECORD];
+};
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static size_t encode_varint(uint64_t value, uint8_t *out) {
+    size_t n = 0;
+    while (value >= 0x80) {
+        out[n++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    out[n++] = (uint8_t)value;
+    return n;
+}
+
+static int decode_varint(FILE *file, uint64_t *value) {
+    uint64_t result = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int c = fgetc(file);
+        if (c == EOF) {
+            return -1;
+        }
+        result |= (uint64_t)(c & 0x7f) << shift;
+        if (!(c & 0x80)) {
+            *value = result;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+capture_writer_t *capture_open_writer(const char *path) {
+    if (!path) {
+        return NULL;
+    }
+    capture_writer_t *writer = (capture_writer_t *)calloc(1, sizeof(capture_writer_t));
+    if (!writer) {
+        return NULL;
+    }
+    writer->file = fopen(path, "wb");
+    if (!writer->file) {
+        free(writer);
+        return NULL;
+    }
+    setvbuf(writer->file, NULL, _IOFBF, CAPTURE_WRITE_BUFFER);
+    if (fwrite(CAPTURE_MAGIC, 1, CAPTURE_MAGIC_LEN, writer->file) != CAPTURE_MAGIC_LEN ||
+        pthread_mutex_init(&writer->mutex, NULL) != 0) {
+        fclose(writer->file);
+        free(writer);
+        return NULL;
+    }
+    writer->last_ns = monotonic_ns();
+    return writer;
+}
+
+void capture_close_writer(capture_writer_t *writer) {
+    if (!writer) {
+        return;
+    }
+    pthread_mutex_lock(&writer->mutex);
+    fclose(writer->file);
+    writer->file = NULL;
+    pthread_mutex_unlock(&writer->mutex);
+    pthread_mutex_destroy(&writer->mutex);
+    free(writer);
+}
+
+static int write_record(capture_writer_t *writer, uint8_t kind, uint32_t conn_id,
+                        const void *header, size_t header_len, const void *body, size_t body_len) {
+    if (!writer) {
+        return -1;
+    }
+    uint8_t prefix[1 + 3 * VARINT_MAX_BYTES];
+    size_t prefix_len = 0;
+    int result = 0;
+
+    pthread_mutex_lock(&writer->mutex);
+    uint64_t now = monotonic_ns();
+    prefix[prefix_len++] = kind;
+    prefix_len += encode_varint(conn_id, prefix + prefix_len);
+    prefix_len += encode_varint(now > writer->last_ns ? now - writer->last_ns : 0, prefix + prefix_len);
+    prefix_len += encode_varint(header_len + body_len, prefix + prefix_len);
+    writer->last_ns = now > writer->last_ns ? now : writer->last_ns;
+
+    if (fwrite(prefix, 1, prefix_len, writer->file) != prefix_len ||
+        (header_len > 0 && fwrite(header, 1, header_len, writer->file) != header_len) ||
+        (body_len > 0 && fwrite(body, 1, body_len, writer->file) != body_len)) {
+        result = -1;
+    }
+    pthread_mutex_unlock(&writer->mutex);
+    return result;
+}
+
+int capture_record_open(capture_writer_t *writer, uint32_t conn_id) {
+    return write_record(writer, CAPTURE_RECORD_OPEN, conn_id, NULL, 0, NULL, 0);
+}
+
+int capture_record_frame(capture_writer_t *writer, uint32_t conn_id, const void *frame, size_t length) {
+    if (!frame || length < sizeof(message_header_t) || length > CAPTURE_MAX_RECORD) {
+        return -1;
+    }
+    message_header_t header;
+    memcpy(&header, frame, sizeof(header));
+    header.length = htonl(header.length);
+    return write_record(writer, CAPTURE_RECORD_FRAME, conn_id, &header, sizeof(header),
+                        (const char *)frame + sizeof(header), length - sizeof(header));
+}
+
+int capture_record_close(capture_writer_t *writer, uint32_t conn_id) {
+    return write_record(writer, CAPTURE_RECORD_CLOSE, conn_id, NULL, 0, NULL, 0);
+}
+
+capture_reader_t *capture_open_reader(const char *path) {
+    if (!path) {
+        return NULL;
+    }
+    capture_reader_t *reader = (capture_reader_t *)calloc(1, sizeof(capture_reader_t));
+    if (!reader) {
+        return NULL;
+    }
+    reader->file = fopen(path, "rb");
+    if (!reader->file) {
+        free(reader);
+        return NULL;
+    }
+    char magic[CAPTURE_MAGIC_LEN];
+    if (fread(magic, 1, CAPTURE_MAGIC_LEN, reader->file) != CAPTURE_MAGIC_LEN ||
+        memcmp(magic, CAPTURE_MAGIC, CAPTURE_MAGIC_LEN) != 0) {
+        log_message("Not a capture file: %s", path);
+        fclose(reader->file);
+        free(reader);
+        return NULL;
+    }
+    return reader;
+}
+
+void capture_close_reader(capture_reader_t *reader) {
+    if (!reader) {
+        return;
+    }
+    fclose(reader->file);
+    free(reader);
+}
+
+int capture_read(capture_reader_t *reader, capture_record_t *record) {
+    if (!reader || !record) {
+        return -1;
+    }
+    int kind = fgetc(reader->file);
+    if (kind == EOF) {
+        return 0;
+    }
+
+    uint64_t conn_id, delta, length;
+    if (decode_varint(reader->file, &conn_id) != 0 ||
+        decode_varint(reader->file, &delta) != 0 ||
+        decode_varint(reader->file, &length) != 0 ||
+        conn_id > UINT32_MAX || length > CAPTURE_MAX_RECORD) {
+        return -1;
+    }
+    if (length > 0 && fread(reader->data, 1, length, reader->file) != length) {
+        return -1;
+    }
+
+    reader->timestamp_ns += delta;
+    record->kind = (uint8_t)kind;
+    record->conn_id = (uint32_t)conn_id;
+    record->timestamp_ns = reader->timestamp_ns;
+    record->length = (uint32_t)length;
+    record->data = reader->data;
+    return 1;
+}
@@ -0,0 +1,165 @@
+#include "../include/compress.h"
+#include "../include/protocol.h"
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <zlib.h>
+
+struct compress_stream {
+    bool deflating;
+    bool stream_ready;        /* the connection's stream is set up */
+    bool single_ready;        /* ... and the one reset for every standalone frame */
+    bool broken;              /* a frame failed part way, so the peer's stream no longer matches */
+    z_stream stream;
+    z_stream single;
+};
+
+static int setup(const compress_stream_t *owner, z_stream *z) {
+    memset(z, 0, sizeof(z_stream));
+    if (owner->deflating) {
+        return deflateInit2(z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -COMPRESS_WINDOW_BITS, COMPRESS_MEM_LEVEL,
+                            Z_DEFAULT_STRATEGY) == Z_OK ? 0 : -1;
+    }
+    return inflateInit2(z, -COMPRESS_WINDOW_BITS) == Z_OK ? 0 : -1;
+}
+
+/* Sets either stream up on first use, and starts the standalone one afresh each time. */
+static z_stream *get_stream(compress_stream_t *owner, bool standalone) {
+    bool *ready = standalone ? &owner->single_ready : &owner->stream_ready;
+    z_stream *z = standalone ? &owner->single : &owner->stream;
+    if (!*ready) {
+        if (setup(owner, z) != 0) {
+            return NULL;
+        }
+        *ready = true;
+    } else if (standalone) {
+        if ((owner->deflating ? deflateReset(z) : inflateReset(z)) != Z_OK) {
+            return NULL;
+        }
+    }
+    return z;
+}
+
+static void teardown(const compress_stream_t *owner, z_stream *z) {
+    if (owner->deflating) {
+        deflateEnd(z);
+    } else {
+        inflateEnd(z);
+    }
+}
+
+/* Both directions' state is only allocated by the first frame that needs it. */
+compress_stream_t *compress_stream_create(bool deflating) {
+    compress_stream_t *stream = (compress_stream_t *)calloc(1, sizeof(compress_stream_t));
+    if (stream) {
+        stream->deflating = deflating;
+    }
+    return stream;
+}
+
+void compress_stream_free(compress_stream_t *stream) {
+    if (!stream) {
+        return;
+    }
+    if (stream->stream_ready) {
+        teardown(stream, &stream->stream);
+    }
+    if (stream->single_ready) {
+        teardown(stream, &stream->single);
+    }
+    free(stream);
+}
+
+/*
+ * Deflates the frame, as it would go on the wire with the given request id,
+ * into a MSG_COMPRESSED frame in out, header in host order like any frame
+ * built in memory. Returns its length, or -1; out needs COMPRESS_BOUND(length)
+ * bytes. A failure part way through the connection's stream breaks it for
+ * good, so the caller should stop compressing on that connection.
+ */
+int compress_frame(compress_stream_t *stream, bool standalone, const void *message, size_t length,
+                   uint32_t request_id, void *out, size_t out_size) {
+    size_t offset = offsetof(compressed_frame_t, data);
+    if (!stream || !stream->deflating || (stream->broken && !standalone) || !message ||
+        length < sizeof(message_header_t) || !out || out_size <= offset) {
+        return -1;
+    }
+    z_stream *z = get_stream(stream, standalone);
+    if (!z) {
+        return -1;
+    }
+
+    const message_header_t *header = (const message_header_t *)message;
+    char head[sizeof(message_header_t) + FRAME_TAG_SIZE];
+    size_t head_length = sizeof(message_header_t);
+    message_header_t *net_header = (message_header_t *)head;
+    net_header->type = header->type;
+    if (request_id) {
+        uint32_t net_id = htonl(request_id);
+        net_header->length = htonl((header->length + FRAME_TAG_SIZE) | FRAME_TAGGED);
+        memcpy(head + sizeof(message_header_t), &net_id, FRAME_TAG_SIZE);
+        head_length += FRAME_TAG_SIZE;
+    } else {
+        net_header->length = htonl(header->length);
+    }
+
+    z->next_out = (Bytef *)out + offset;
+    z->avail_out = (uInt)(out_size - offset);
+    z->next_in = (Bytef *)head;
+    z->avail_in = (uInt)head_length;
+    int rc = deflate(z, Z_NO_FLUSH);
+    if (rc == Z_OK) {
+        z->next_in = (Bytef *)message + sizeof(message_header_t);
+        z->avail_in = (uInt)(length - sizeof(message_header_t));
+        rc = deflate(z, standalone ? Z_FINISH : Z_SYNC_FLUSH);
+    }
+    /* Output space left over means the flush completed. */
+    bool done = standalone ? rc == Z_STREAM_END : rc == Z_OK && z->avail_in == 0 && z->avail_out > 0;
+    if (!done) {
+        if (!standalone) {
+            stream->broken = true;
+        }
+        return -1;
+    }
+
+    compressed_frame_t *frame = (compressed_frame_t *)out;
+    frame->header.type = MSG_COMPRESSED;
+    frame->header.length = (uint32_t)(out_size - z->avail_out);
+    frame->flags = standalone ? COMPRESSED_STANDALONE : 0;
+    return (int)frame->header.length;
+}
+
+/*
+ * Inflates a MSG_COMPRESSED frame into out, giving back the wire bytes of the
+ * frame it carries; decode_frame() turns those into a frame as received.
+ * Returns their length, or -1 if the data is corrupt or does not fit.
+ */
+int decompress_frame(compress_stream_t *stream, const void *frame, size_t length, void *out, size_t out_size) {
+    size_t offset = offsetof(compressed_frame_t, data);
+    if (!stream || stream->deflating || !frame || length <= offset || !out || out_size == 0) {
+        return -1;
+    }
+    const compressed_frame_t *packed = (const compressed_frame_t *)frame;
+    bool standalone = (packed->flags & COMPRESSED_STANDALONE) != 0;
+    if (stream->broken && !standalone) {
+        return -1;
+    }
+    z_stream *z = get_stream(stream, standalone);
+    if (!z) {
+        return -1;
+    }
+
+    z->next_in = (Bytef *)packed->data;
+    z->avail_in = (uInt)(length - offset);
+    z->next_out = (Bytef *)out;
+    z->avail_out = (uInt)out_size;
+    int rc = inflate(z, standalone ? Z_FINISH : Z_SYNC_FLUSH);
+    bool done = standalone ? rc == Z_STREAM_END : rc == Z_OK && z->avail_in == 0 && z->avail_out > 0;
+    if (!done) {
+        if (!standalone) {
+            stream->broken = true;
+        }
+        return -1;
+    }
+    return (int)(out_size - z->avail_out);
+}
@@ -3,6 +3,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #define SQL_CREATE_USERS_TABLE \
     "CREATE TABLE IF NOT EXISTS users (" \
@@ -17,6 +18,28 @@
     "owner_id INTEGER NOT NULL," \
     "FOREIGN KEY(owner_id) REFERENCES users(id));"
 
+#define SQL_CREATE_MESSAGES_TABLE \
+    "CREATE TABLE IF NOT EXISTS messages (" \
+    "room_id TEXT NOT NULL," \
+    "seq INTEGER NOT NULL," \
+    "username TEXT NOT NULL," \
+    "body TEXT NOT NULL," \
+    "created_at INTEGER NOT NULL," \
+    "PRIMARY KEY(room_id, seq)) WITHOUT ROWID;"
+
+#define SQL_CREATE_DIRECT_TABLE \
+    "CREATE TABLE IF NOT EXISTS direct_messages (" \
+    "id INTEGER PRIMARY KEY AUTOINCREMENT," \
+    "recipient TEXT NOT NULL," \
+    "sender TEXT NOT NULL," \
+    "body TEXT NOT NULL," \
+    "created_at INTEGER NOT NULL);" \
+    "CREATE INDEX IF NOT EXISTS direct_messages_recipient ON direct_messages(recipient, id);"
+
+#define SQL_PRAGMAS \
+    "PRAGMA journal_mode=WAL;" \
+    "PRAGMA synchronous=NORMAL;"
+
 #define SQL_INSERT_USER \
     "INSERT INTO users (username, password_hash) VALUES (?, ?);"
 
@@ -29,9 +52,30 @@
 #define SQL_GET_ROOM_BY_ID \
     "SELECT id, name, owner_id FROM rooms WHERE id = ?;"
 
+/* Followed by one placeholder per room and a closing parenthesis. */
+#define SQL_GET_ROOMS_BY_ID \
+    "SELECT id, name, owner_id FROM rooms WHERE id IN ("
+
 #define SQL_LIST_ROOMS \
     "SELECT id, name, owner_id FROM rooms;"
 
+#define SQL_INSERT_MESSAGE \
+    "INSERT INTO messages (room_id, seq, username, body, created_at) VALUES (?, ?, ?, ?, ?);"
+
+#define SQL_GET_LAST_MESSAGE_SEQ \
+    "SELECT MAX(seq) FROM messages WHERE room_id = ?;"
+
+#define SQL_QUEUE_DIRECT \
+    "INSERT INTO direct_messages (recipient, sender, body, created_at) VALUES (?, ?, ?, ?);"
+
+/* One statement, so concurrent drains never hand out the same message twice. */
+#define SQL_TAKE_DIRECTS \
+    "DELETE FROM direct_messages WHERE recipient = ? RETURNING id, sender, body, created_at;"
+
+#define SQL_GET_MESSAGES_SINCE \
+    "SELECT seq, username, body FROM messages WHERE room_id = ? AND seq > ? " \
+    "ORDER BY seq DESC LIMIT ?;"
+
 int db_init(database_t *db, const char *db_path) {
     if (!db || !db_path) {
         return -1;
@@ -47,6 +91,11 @@ int db_init(database_t *db, const char *db_path) {
         sqlite3_close(db->db);
         return -1;
     }
+    /*
+     * Cluster nodes share the file, which keeps them on one host and puts every
+     * node's writes behind one lock; wait out each other's locks instead of failing.
+     */
+    sqlite3_busy_timeout(db->db, 5000);
     char *err_msg = NULL;
     rc = sqlite3_exec(db->db, SQL_CREATE_USERS_TABLE, NULL, NULL, &err_msg);
     if (rc != SQLITE_OK) {
@@ -66,6 +115,30 @@ int db_init(database_t *db, const char *db_path) {
         return -1;
     }
     
+    rc = sqlite3_exec(db->db, SQL_CREATE_MESSAGES_TABLE, NULL, NULL, &err_msg);
+    if (rc != SQLITE_OK) {
+        log_message("SQL error: %s", err_msg);
+        sqlite3_free(err_msg);
+        sqlite3_close(db->db);
+        free(db->db_path);
+        return -1;
+    }
+    
+    rc = sqlite3_exec(db->db, SQL_CREATE_DIRECT_TABLE, NULL, NULL, &err_msg);
+    if (rc != SQLITE_OK) {
+        log_message("SQL error: %s", err_msg);
+        sqlite3_free(err_msg);
+        sqlite3_close(db->db);
+        free(db->db_path);
+        return -1;
+    }
+    
+    rc = sqlite3_exec(db->db, SQL_PRAGMAS, NULL, NULL, &err_msg);
+    if (rc != SQLITE_OK) {
+        log_message("SQL error: %s", err_msg);
+        sqlite3_free(err_msg);
+    }
+    
     return 0;
 }
 
@@ -262,6 +335,52 @@ int db_get_room_name(database_t *db, const char *room_id, char *name_out, int na
     return 0;
 }
 
+/* Looks up several rooms in one statement; rooms_out has room for count rows, in no particular order. */
+int db_get_rooms(database_t *db, const char *const *room_ids, int count, room_t *rooms_out, int *found_out) {
+    if (!db || !db->db || !room_ids || count <= 0 || !rooms_out || !found_out) {
+        return -1;
+    }
+    
+    size_t sql_size = sizeof(SQL_GET_ROOMS_BY_ID) + (size_t)count * 2 + 2;
+    char *sql = (char *)malloc(sql_size);
+    if (!sql) {
+        return -1;
+    }
+    char *p = sql + snprintf(sql, sql_size, "%s", SQL_GET_ROOMS_BY_ID);
+    for (int i = 0; i < count; i++) {
+        if (i) {
+            *p++ = ',';
+        }
+        *p++ = '?';
+    }
+    *p++ = ')';
+    *p = '\0';
+    
+    sqlite3_stmt *stmt;
+    int rc = sqlite3_prepare_v2(db->db, sql, -1, &stmt, NULL);
+    free(sql);
+    if (rc != SQLITE_OK) {
+        log_message("Failed to prepare statement: %s", sqlite3_errmsg(db->db));
+        return -1;
+    }
+    
+    for (int i = 0; i < count; i++) {
+        sqlite3_bind_text(stmt, i + 1, room_ids[i], -1, SQLITE_STATIC);
+    }
+    
+    int found = 0;
+    while (found < count && sqlite3_step(stmt) == SQLITE_ROW) {
+        safe_strcpy(rooms_out[found].id, (const char *)sqlite3_column_text(stmt, 0), sizeof(rooms_out[found].id));
+        safe_strcpy(rooms_out[found].name, (const char *)sqlite3_column_text(stmt, 1), sizeof(rooms_out[found].name));
+        rooms_out[found].owner_id = sqlite3_column_int(stmt, 2);
+        found++;
+    }
+    
+    *found_out = found;
+    sqlite3_finalize(stmt);
+    return 0;
+}
+
 int db_list_rooms(database_t *db, room_t **rooms, int *count) {
     if (!db || !db->db || !rooms || !count) {
         return -1;
@@ -305,4 +424,187 @@ int db_list_rooms(database_t *db, room_t **rooms, int *count) {
     sqlite3_finalize(stmt);
     
     return 0;
-} 
\ No newline at end of file
+}
+
+int db_store_message(database_t *db, const char *room_id, uint64_t seq, const char *username, const char *body) {
+    if (!db || !db->db || !room_id || !username || !body) {
+        return -1;
+    }
+    
+    sqlite3_stmt *stmt;
+    int rc;
+    
+    rc = sqlite3_prepare_v2(db->db, SQL_INSERT_MESSAGE, -1, &stmt, NULL);
+    if (rc != SQLITE_OK) {
+        log_message("Failed to prepare statement: %s", sqlite3_errmsg(db->db));
+        return -1;
+    }
+    
+    sqlite3_bind_text(stmt, 1, room_id, -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 2, (sqlite3_int64)seq);
+    sqlite3_bind_text(stmt, 3, username, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 4, body, -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 5, (sqlite3_int64)time(NULL));
+    rc = sqlite3_step(stmt);
+    if (rc != SQLITE_DONE) {
+        log_message("Failed to store message: %s", sqlite3_errmsg(db->db));
+        sqlite3_finalize(stmt);
+        return -1;
+    }
+    
+    sqlite3_finalize(stmt);
+    return 0;
+}
+
+int db_get_last_message_seq(database_t *db, const char *room_id, uint64_t *seq_out) {
+    if (!db || !db->db || !room_id || !seq_out) {
+        return -1;
+    }
+    
+    sqlite3_stmt *stmt;
+    int rc;
+    
+    rc = sqlite3_prepare_v2(db->db, SQL_GET_LAST_MESSAGE_SEQ, -1, &stmt, NULL);
+    if (rc != SQLITE_OK) {
+        log_message("Failed to prepare statement: %s", sqlite3_errmsg(db->db));
+        return -1;
+    }
+    
+    sqlite3_bind_text(stmt, 1, room_id, -1, SQLITE_STATIC);
+    
+    rc = sqlite3_step(stmt);
+    if (rc != SQLITE_ROW) {
+        sqlite3_finalize(stmt);
+        return -1;
+    }
+    
+    *seq_out = (uint64_t)sqlite3_column_int64(stmt, 0);
+    sqlite3_finalize(stmt);
+    return 0;
+}
+
+int db_get_messages_since(database_t *db, const char *room_id, uint64_t since_seq, int limit,
+                          stored_message_t **messages, int *count) {
+    if (!db || !db->db || !room_id || limit <= 0 || !messages || !count) {
+        return -1;
+    }
+    
+    sqlite3_stmt *stmt;
+    int rc;
+    
+    rc = sqlite3_prepare_v2(db->db, SQL_GET_MESSAGES_SINCE, -1, &stmt, NULL);
+    if (rc != SQLITE_OK) {
+        log_message("Failed to prepare statement: %s", sqlite3_errmsg(db->db));
+        return -1;
+    }
+    
+    sqlite3_bind_text(stmt, 1, room_id, -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 2, (sqlite3_int64)since_seq);
+    sqlite3_bind_int(stmt, 3, limit);
+    
+    *messages = (stored_message_t *)malloc(limit * sizeof(stored_message_t));
+    if (!*messages) {
+        sqlite3_finalize(stmt);
+        return -1;
+    }
+    
+    /* Newest first so LIMIT keeps the most recent messages, stored oldest first. */
+    int message_count = 0;
+    while (message_count < limit && sqlite3_step(stmt) == SQLITE_ROW) {
+        message_count++;
+        stored_message_t *msg = &(*messages)[limit - message_count];
+        msg->seq = (uint64_t)sqlite3_column_int64(stmt, 0);
+        safe_strcpy(msg->username, (const char *)sqlite3_column_text(stmt, 1), sizeof(msg->username));
+        safe_strcpy(msg->body, (const char *)sqlite3_column_text(stmt, 2), sizeof(msg->body));
+    }
+    if (message_count < limit) {
+        memmove(*messages, *messages + (limit - message_count), message_count * sizeof(stored_message_t));
+    }
+    
+    *count = message_count;
+    sqlite3_finalize(stmt);
+    
+    return 0;
+}
+
+int db_queue_direct(database_t *db, const char *recipient, const char *sender, const char *body, uint64_t sent_at) {
+    if (!db || !db->db || !recipient || !sender || !body) {
+        return -1;
+    }
+    
+    sqlite3_stmt *stmt;
+    int rc;
+    
+    rc = sqlite3_prepare_v2(db->db, SQL_QUEUE_DIRECT, -1, &stmt, NULL);
+    if (rc != SQLITE_OK) {
+        log_message("Failed to prepare statement: %s", sqlite3_errmsg(db->db));
+        return -1;
+    }
+    
+    sqlite3_bind_text(stmt, 1, recipient, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, sender, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 3, body, -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 4, (sqlite3_int64)sent_at);
+    rc = sqlite3_step(stmt);
+    if (rc != SQLITE_DONE) {
+        log_message("Failed to queue direct message: %s", sqlite3_errmsg(db->db));
+        sqlite3_finalize(stmt);
+        return -1;
+    }
+    
+    sqlite3_finalize(stmt);
+    return 0;
+}
+
+static int compare_directs(const void *a, const void *b) {
+    int64_t id_a = ((const stored_direct_t *)a)->id;
+    int64_t id_b = ((const stored_direct_t *)b)->id;
+    return (id_a > id_b) - (id_a < id_b);
+}
+
+int db_take_directs(database_t *db, const char *recipient, stored_direct_t **messages, int *count) {
+    if (!db || !db->db || !recipient || !messages || !count) {
+        return -1;
+    }
+    
+    sqlite3_stmt *stmt;
+    int rc;
+    
+    rc = sqlite3_prepare_v2(db->db, SQL_TAKE_DIRECTS, -1, &stmt, NULL);
+    if (rc != SQLITE_OK) {
+        log_message("Failed to prepare statement: %s", sqlite3_errmsg(db->db));
+        return -1;
+    }
+    
+    sqlite3_bind_text(stmt, 1, recipient, -1, SQLITE_STATIC);
+    
+    *messages = NULL;
+    int message_count = 0;
+    int capacity = 0;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        if (message_count == capacity) {
+            capacity = capacity ? capacity * 2 : 16;
+            stored_direct_t *grown = (stored_direct_t *)realloc(*messages, capacity * sizeof(stored_direct_t));
+            if (!grown) {
+                break;
+            }
+            *messages = grown;
+        }
+        stored_direct_t *msg = &(*messages)[message_count++];
+        msg->id = sqlite3_column_int64(stmt, 0);
+        safe_strcpy(msg->sender, (const char *)sqlite3_column_text(stmt, 1), sizeof(msg->sender));
+        safe_strcpy(msg->body, (const char *)sqlite3_column_text(stmt, 2), sizeof(msg->body));
+        msg->sent_at = (uint64_t)sqlite3_column_int64(stmt, 3);
+    }
+    sqlite3_finalize(stmt);
+    if (rc != SQLITE_DONE) {
+        log_message("Failed to drain direct messages: %s", sqlite3_errmsg(db->db));
+    }
+    
+    /* RETURNING rows come back in no particular order. */
+    if (message_count > 1) {
+        qsort(*messages, message_count, sizeof(stored_direct_t), compare_directs);
+    }
+    *count = message_count;
+    return 0;
+}
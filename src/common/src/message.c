@@ -10,13 +10,28 @@ void init_message_header(message_header_t *header, uint8_t type, uint32_t length
     }
 }
 
+/*
+ * A zeroed frame of the given type, allocated at the full size of its struct,
+ * with the header set for the frame as it stands: list frames start empty.
+ */
+void *create_message(uint8_t type) {
+    if (!message_known(type)) {
+        return NULL;
+    }
+    const message_layout_t *layout = &message_layouts[type];
+    message_header_t *header = (message_header_t *)calloc(1, layout->size);
+    if (header) {
+        init_message_header(header, type, layout->entry_size ? layout->min_length : layout->size);
+    }
+    return header;
+}
+
 auth_request_t *create_auth_request(const char *username, const char *password) {
-    auth_request_t *req = (auth_request_t *)malloc(sizeof(auth_request_t));
+    auth_request_t *req = (auth_request_t *)create_message(MSG_AUTH_REQUEST);
     if (!req) {
         return NULL;
     }
     
-    init_message_header(&req->header, MSG_AUTH_REQUEST, sizeof(auth_request_t));
     safe_strcpy(req->username, username, MAX_USERNAME_LEN);
     safe_strcpy(req->password, password, MAX_PASSWORD_LEN);
     
@@ -24,24 +39,22 @@ auth_request_t *create_auth_request(const char *username, const char *password)
 }
 
 auth_response_t *create_auth_response(uint8_t status) {
-    auth_response_t *resp = (auth_response_t *)malloc(sizeof(auth_response_t));
+    auth_response_t *resp = (auth_response_t *)create_message(MSG_AUTH_RESPONSE);
     if (!resp) {
         return NULL;
     }
     
-    init_message_header(&resp->header, MSG_AUTH_RESPONSE, sizeof(auth_response_t));
     resp->status = status;
     
     return resp;
 }
 
 register_request_t *create_register_request(const char *username, const char *password) {
-    register_request_t *req = (register_request_t *)malloc(sizeof(register_request_t));
+    register_request_t *req = (register_request_t *)create_message(MSG_REGISTER_REQUEST);
     if (!req) {
         return NULL;
     }
     
-    init_message_header(&req->header, MSG_REGISTER_REQUEST, sizeof(register_request_t));
     safe_strcpy(req->username, username, MAX_USERNAME_LEN);
     safe_strcpy(req->password, password, MAX_PASSWORD_LEN);
     
@@ -49,36 +62,33 @@ register_request_t *create_register_request(const char *username, const char *pa
 }
 
 register_response_t *create_register_response(uint8_t status) {
-    register_response_t *resp = (register_response_t *)malloc(sizeof(register_response_t));
+    register_response_t *resp = (register_response_t *)create_message(MSG_REGISTER_RESPONSE);
     if (!resp) {
         return NULL;
     }
     
-    init_message_header(&resp->header, MSG_REGISTER_RESPONSE, sizeof(register_response_t));
     resp->status = status;
     
     return resp;
 }
 
 create_room_request_t *create_room_request(const char *room_name) {
-    create_room_request_t *req = (create_room_request_t *)malloc(sizeof(create_room_request_t));
+    create_room_request_t *req = (create_room_request_t *)create_message(MSG_CREATE_ROOM);
     if (!req) {
         return NULL;
     }
     
-    init_message_header(&req->header, MSG_CREATE_ROOM, sizeof(create_room_request_t));
     safe_strcpy(req->room_name, room_name, MAX_ROOM_NAME_LEN);
     
     return req;
 }
 
 create_room_response_t *create_room_response(uint8_t status, const char *room_id) {
-    create_room_response_t *resp = (create_room_response_t *)malloc(sizeof(create_room_response_t));
+    create_room_response_t *resp = (create_room_response_t *)create_message(MSG_CREATE_ROOM_RESPONSE);
     if (!resp) {
         return NULL;
     }
     
-    init_message_header(&resp->header, MSG_CREATE_ROOM_RESPONSE, sizeof(create_room_response_t));
     resp->status = status;
     safe_strcpy(resp->room_id, room_id, MAX_ROOM_ID_LEN);
     
@@ -86,64 +96,236 @@ create_room_response_t *create_room_response(uint8_t status, const char *room_id
 }
 
 join_room_request_t *create_join_room_request(const char *room_id) {
-    join_room_request_t *req = (join_room_request_t *)malloc(sizeof(join_room_request_t));
+    join_room_request_t *req = (join_room_request_t *)create_message(MSG_JOIN_ROOM);
     if (!req) {
         return NULL;
     }
     
-    init_message_header(&req->header, MSG_JOIN_ROOM, sizeof(join_room_request_t));
     safe_strcpy(req->room_id, room_id, MAX_ROOM_ID_LEN);
+    req->resume = 0;
+    req->since_seq = 0;
     
     return req;
 }
 
 join_room_response_t *create_join_room_response(uint8_t status, const char *room_name, const char *room_id) {
-    join_room_response_t *resp = (join_room_response_t *)malloc(sizeof(join_room_response_t));
+    join_room_response_t *resp = (join_room_response_t *)create_message(MSG_JOIN_ROOM_RESPONSE);
     if (!resp) {
         return NULL;
     }
     
-    init_message_header(&resp->header, MSG_JOIN_ROOM_RESPONSE, sizeof(join_room_response_t));
     resp->status = status;
     safe_strcpy(resp->room_name, room_name, MAX_ROOM_NAME_LEN);
     safe_strcpy(resp->room_id, room_id, MAX_ROOM_ID_LEN);
+    resp->head_seq = 0;
     
     return resp;
 }
 
 leave_room_request_t *create_leave_room_request(const char *room_id) {
-    leave_room_request_t *req = (leave_room_request_t *)malloc(sizeof(leave_room_request_t));
+    leave_room_request_t *req = (leave_room_request_t *)create_message(MSG_LEAVE_ROOM);
     if (!req) {
         return NULL;
     }
     
-    init_message_header(&req->header, MSG_LEAVE_ROOM, sizeof(leave_room_request_t));
     safe_strcpy(req->room_id, room_id, MAX_ROOM_ID_LEN);
     
     return req;
 }
 
 chat_message_t *create_chat_message(const char *room_id, const char *username, const char *message) {
-    chat_message_t *msg = (chat_message_t *)malloc(sizeof(chat_message_t));
+    chat_message_t *msg = (chat_message_t *)create_message(MSG_CHAT_MESSAGE);
     if (!msg) {
         return NULL;
     }
     
-    init_message_header(&msg->header, MSG_CHAT_MESSAGE, sizeof(chat_message_t));
     safe_strcpy(msg->room_id, room_id, MAX_ROOM_ID_LEN);
     safe_strcpy(msg->username, username, MAX_USERNAME_LEN);
     safe_strcpy(msg->message, message, MAX_MESSAGE_LEN);
+    msg->seq = 0;
+    msg->msg_id = 0;
+    
+    return msg;
+}
+
+direct_message_t *create_direct_message(const char *to, const char *from, const char *message) {
+    direct_message_t *msg = (direct_message_t *)create_message(MSG_DIRECT);
+    if (!msg) {
+        return NULL;
+    }
+    
+    safe_strcpy(msg->to, to, MAX_USERNAME_LEN);
+    safe_strcpy(msg->from, from, MAX_USERNAME_LEN);
+    safe_strcpy(msg->message, message, MAX_MESSAGE_LEN);
+    msg->sent_at = 0;
+    
+    return msg;
+}
+
+presence_update_t *create_presence_update(const char *room_id, uint8_t flags) {
+    presence_update_t *update = (presence_update_t *)create_message(MSG_PRESENCE);
+    if (!update) {
+        return NULL;
+    }
+    
+    safe_strcpy(update->room_id, room_id, MAX_ROOM_ID_LEN);
+    update->flags = flags;
+    update->count = 0;
+    
+    return update;
+}
+
+int presence_update_add(presence_update_t *update, uint8_t op, const char *username) {
+    if (!update || !username || update->count >= PRESENCE_MAX_ENTRIES) {
+        return -1;
+    }
+    presence_entry_t *entry = &update->entries[update->count++];
+    entry->op = op;
+    safe_strcpy(entry->username, username, MAX_USERNAME_LEN);
+    update->header.length = PRESENCE_UPDATE_SIZE(update->count);
+    return 0;
+}
+
+ping_message_t *create_ping_message(uint8_t type, uint64_t stamp) {
+    ping_message_t *msg = (ping_message_t *)create_message(type);
+    if (!msg) {
+        return NULL;
+    }
+    
+    msg->stamp = stamp;
+    
+    return msg;
+}
+
+hello_message_t *create_hello_message(uint16_t version, uint32_t capabilities) {
+    hello_message_t *msg = (hello_message_t *)create_message(MSG_HELLO);
+    if (!msg) {
+        return NULL;
+    }
+    
+    msg->version = version;
+    msg->capabilities = capabilities;
     
     return msg;
 }
 
+/* Writes the chat frame as a MSG_CHAT_COMPACT frame into out and returns its length. */
+size_t chat_compact(const chat_message_t *chat, chat_compact_t *out) {
+    size_t text_length = strnlen(chat->message, MAX_MESSAGE_LEN - 1);
+    size_t length = CHAT_COMPACT_SIZE(text_length);
+    init_message_header(&out->header, MSG_CHAT_COMPACT, (uint32_t)length);
+    memcpy(out->room_id, chat->room_id, MAX_ROOM_ID_LEN);
+    memcpy(out->username, chat->username, MAX_USERNAME_LEN);
+    out->seq = chat->seq;
+    out->msg_id = chat->msg_id;
+    memcpy(out->message, chat->message, text_length);
+    out->message[text_length] = '\0';
+    return length;
+}
+
+/*
+ * Turns a MSG_CHAT_COMPACT frame of the given length back into a full chat
+ * frame; out may be the frame's own buffer. Returns -1 if it is malformed.
+ */
+int chat_expand(const void *frame, size_t length, chat_message_t *out) {
+    if (!frame || !out || length < CHAT_COMPACT_SIZE(0) || length > sizeof(chat_compact_t) ||
+        ((const char *)frame)[length - 1] != '\0') {
+        return -1;
+    }
+    chat_compact_t compact;
+    memcpy(&compact, frame, length);
+    memset(out, 0, sizeof(chat_message_t));
+    init_message_header(&out->header, MSG_CHAT_MESSAGE, sizeof(chat_message_t));
+    memcpy(out->room_id, compact.room_id, MAX_ROOM_ID_LEN);
+    memcpy(out->username, compact.username, MAX_USERNAME_LEN);
+    memcpy(out->message, compact.message, length - offsetof(chat_compact_t, message));
+    out->seq = compact.seq;
+    out->msg_id = compact.msg_id;
+    return 0;
+}
+
+ack_message_t *create_ack_message(void) {
+    ack_message_t *ack = (ack_message_t *)create_message(MSG_ACK);
+    if (!ack) {
+        return NULL;
+    }
+    
+    ack->count = 0;
+    
+    return ack;
+}
+
+int ack_message_add(ack_message_t *ack, const char *room_id, uint64_t seq, uint8_t flags) {
+    if (!ack || !room_id || ack->count >= ACK_MAX_ENTRIES) {
+        return -1;
+    }
+    ack_entry_t *entry = &ack->entries[ack->count++];
+    safe_strcpy(entry->room_id, room_id, MAX_ROOM_ID_LEN);
+    entry->seq = seq;
+    entry->flags = flags;
+    ack->header.length = ACK_MESSAGE_SIZE(ack->count);
+    return 0;
+}
+
+login_join_request_t *create_login_join_request(const char *username, const char *password) {
+    login_join_request_t *req = (login_join_request_t *)create_message(MSG_LOGIN_JOIN);
+    if (!req) {
+        return NULL;
+    }
+    
+    safe_strcpy(req->username, username, MAX_USERNAME_LEN);
+    safe_strcpy(req->password, password, MAX_PASSWORD_LEN);
+    req->count = 0;
+    
+    return req;
+}
+
+int login_join_request_add(login_join_request_t *req, const char *room_id, bool resume, uint64_t since_seq,
+                           uint16_t tail) {
+    if (!req || !room_id || req->count >= LOGIN_JOIN_MAX_ROOMS) {
+        return -1;
+    }
+    login_join_entry_t *entry = &req->entries[req->count++];
+    safe_strcpy(entry->room_id, room_id, MAX_ROOM_ID_LEN);
+    entry->resume = resume ? 1 : 0;
+    entry->since_seq = since_seq;
+    entry->tail = tail;
+    req->header.length = LOGIN_JOIN_REQUEST_SIZE(req->count);
+    return 0;
+}
+
+login_join_response_t *create_login_join_response(uint8_t status) {
+    login_join_response_t *resp = (login_join_response_t *)create_message(MSG_LOGIN_JOIN_RESPONSE);
+    if (!resp) {
+        return NULL;
+    }
+    
+    resp->status = status;
+    resp->count = 0;
+    
+    return resp;
+}
+
+int login_join_response_add(login_join_response_t *resp, const char *room_id, uint8_t status, const char *room_name,
+                            uint64_t head_seq) {
+    if (!resp || !room_id || !room_name || resp->count >= LOGIN_JOIN_MAX_ROOMS) {
+        return -1;
+    }
+    login_join_result_t *result = &resp->results[resp->count++];
+    safe_strcpy(result->room_id, room_id, MAX_ROOM_ID_LEN);
+    result->status = status;
+    safe_strcpy(result->room_name, room_name, MAX_ROOM_NAME_LEN);
+    result->head_seq = head_seq;
+    resp->header.length = LOGIN_JOIN_RESPONSE_SIZE(resp->count);
+    return 0;
+}
+
 error_message_t *create_error_message(uint8_t error_code, const char *error_message) {
-    error_message_t *err = (error_message_t *)malloc(sizeof(error_message_t));
+    error_message_t *err = (error_message_t *)create_message(MSG_ERROR);
     if (!err) {
         return NULL;
     }
     
-    init_message_header(&err->header, MSG_ERROR, sizeof(error_message_t));
     err->error_code = error_code;
     safe_strcpy(err->error_message, error_message, MAX_MESSAGE_LEN);
     
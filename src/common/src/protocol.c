@@ -7,6 +7,26 @@
 #include <sys/socket.h>
 #include <errno.h>
 
+#define MESSAGE_LAYOUT(name, code, layout) [code] = layout,
+const message_layout_t message_layouts[256] = { PROTOCOL_MESSAGES(MESSAGE_LAYOUT) };
+#undef MESSAGE_LAYOUT
+
+static int send_all(int sockfd, const void *data, size_t length) {
+    const char *p = (const char *)data;
+    while (length > 0) {
+        ssize_t sent = send(sockfd, p, length, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            return -1;
+        }
+        p += sent;
+        length -= (size_t)sent;
+    }
+    return 0;
+}
+
 int send_message(int sockfd, const void *message, size_t length) {
     
     const message_header_t *header = (const message_header_t *)message;
@@ -15,14 +35,12 @@ int send_message(int sockfd, const void *message, size_t length) {
     message_header_t net_header;
     net_header.type = type;
     net_header.length = net_length;
-    ssize_t sent = send(sockfd, &net_header, sizeof(message_header_t), 0);
-    if (sent != sizeof(message_header_t)) {
+    if (send_all(sockfd, &net_header, sizeof(message_header_t)) != 0) {
         return -1;
     }
     if (length > sizeof(message_header_t)) {
-        sent = send(sockfd, (char*)message + sizeof(message_header_t), 
-                   length - sizeof(message_header_t), 0);
-        if (sent != (ssize_t)(length - sizeof(message_header_t))) {
+        if (send_all(sockfd, (char*)message + sizeof(message_header_t), 
+                     length - sizeof(message_header_t)) != 0) {
             return -1;
         }
     }
@@ -30,9 +48,38 @@ int send_message(int sockfd, const void *message, size_t length) {
     return 0;
 }
 
+/* A request_id of 0 sends the frame untagged. */
+int send_tagged_message(int sockfd, const void *message, size_t length, uint32_t request_id) {
+    if (request_id == 0) {
+        return send_message(sockfd, message, length);
+    }
+    const message_header_t *header = (const message_header_t *)message;
+    char head[sizeof(message_header_t) + FRAME_TAG_SIZE];
+    message_header_t *net_header = (message_header_t *)head;
+    net_header->type = header->type;
+    net_header->length = htonl((header->length + FRAME_TAG_SIZE) | FRAME_TAGGED);
+    uint32_t net_id = htonl(request_id);
+    memcpy(head + sizeof(message_header_t), &net_id, FRAME_TAG_SIZE);
+    if (send_all(sockfd, head, sizeof(head)) != 0) {
+        return -1;
+    }
+    if (length > sizeof(message_header_t)) {
+        if (send_all(sockfd, (const char *)message + sizeof(message_header_t),
+                     length - sizeof(message_header_t)) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
 int receive_message(int sockfd, void *buffer, size_t buffer_size) {
+    return receive_tagged_message(sockfd, buffer, buffer_size, NULL);
+}
+
+/* Stores the frame's request id, or 0 if it has none, in *request_id when given. */
+int receive_tagged_message(int sockfd, void *buffer, size_t buffer_size, uint32_t *request_id) {
     message_header_t header;
-    ssize_t received = recv(sockfd, &header, sizeof(message_header_t), 0);
+    ssize_t received = recv(sockfd, &header, sizeof(message_header_t), MSG_WAITALL);
     
     if (received <= 0) {
         return received; 
@@ -42,18 +89,63 @@ int receive_message(int sockfd, void *buffer, size_t buffer_size) {
     }
     
     header.length = ntohl(header.length);
-    if (header.length > buffer_size) {
+    uint32_t tag = 0;
+    if (header.length & FRAME_TAGGED) {
+        header.length &= ~FRAME_TAGGED;
+        if (header.length < sizeof(message_header_t) + FRAME_TAG_SIZE ||
+            recv(sockfd, &tag, FRAME_TAG_SIZE, MSG_WAITALL) != (ssize_t)FRAME_TAG_SIZE) {
+            return -1;
+        }
+        tag = ntohl(tag);
+        header.length -= FRAME_TAG_SIZE;
+    }
+    if (request_id) {
+        *request_id = tag;
+    }
+    if (header.length < sizeof(message_header_t) || header.length > buffer_size) {
         return -1;
     }
     
     memcpy(buffer, &header, sizeof(message_header_t));
     size_t body_size = header.length - sizeof(message_header_t);
     if (body_size > 0) {
-        received = recv(sockfd, (char*)buffer + sizeof(message_header_t), body_size, 0);
+        received = recv(sockfd, (char*)buffer + sizeof(message_header_t), body_size, MSG_WAITALL);
         if (received != (ssize_t)body_size) {
             return -1;
         }
     }
     
     return header.length;
-} 
\ No newline at end of file
+} 
+/*
+ * Reads one frame from wire bytes already in memory, such as those inflated
+ * from a MSG_COMPRESSED frame, the way receive_tagged_message() reads one from
+ * a socket. The bytes must hold exactly that frame; buffer may be wire itself.
+ */
+int decode_frame(const void *wire, size_t wire_length, void *buffer, size_t buffer_size, uint32_t *request_id) {
+    if (!wire || !buffer || wire_length < sizeof(message_header_t)) {
+        return -1;
+    }
+    message_header_t header;
+    memcpy(&header, wire, sizeof(message_header_t));
+    uint32_t raw_length = ntohl(header.length);
+    uint32_t length = raw_length & ~FRAME_TAGGED;
+    size_t tag_size = (raw_length & FRAME_TAGGED) ? FRAME_TAG_SIZE : 0;
+    if (length != wire_length || length < sizeof(message_header_t) + tag_size ||
+        length - tag_size > buffer_size) {
+        return -1;
+    }
+    uint32_t tag = 0;
+    if (tag_size) {
+        memcpy(&tag, (const char *)wire + sizeof(message_header_t), FRAME_TAG_SIZE);
+        tag = ntohl(tag);
+    }
+    if (request_id) {
+        *request_id = tag;
+    }
+    header.length = length - (uint32_t)tag_size;
+    memmove((char *)buffer + sizeof(message_header_t), (const char *)wire + sizeof(message_header_t) + tag_size,
+            header.length - sizeof(message_header_t));
+    memcpy(buffer, &header, sizeof(message_header_t));
+    return (int)header.length;
+}
@@ -0,0 +1,104 @@
+#include "../include/ring.h"
+#include "../include/utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static uint64_t hash_key(const char *key) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (const unsigned char *p = (const unsigned char *)key; *p; p++) {
+        hash ^= *p;
+        hash *= 1099511628211ULL;
+    }
+    /* FNV alone clusters short keys; finish with a splitmix step to spread them over the ring. */
+    hash ^= hash >> 30;
+    hash *= 0xbf58476d1ce4e5b9ULL;
+    hash ^= hash >> 27;
+    hash *= 0x94d049bb133111ebULL;
+    hash ^= hash >> 31;
+    return hash;
+}
+
+static int compare_vnodes(const void *a, const void *b) {
+    const ring_vnode_t *x = (const ring_vnode_t *)a;
+    const ring_vnode_t *y = (const ring_vnode_t *)b;
+    if (x->point != y->point) {
+        return x->point < y->point ? -1 : 1;
+    }
+    return (int)x->node_id - (int)y->node_id;
+}
+
+int ring_parse_nodes(const char *spec, ring_node_t *nodes, int max_nodes) {
+    if (!spec || !nodes) {
+        return -1;
+    }
+    char *copy = strdup(spec);
+    if (!copy) {
+        return -1;
+    }
+    int count = 0;
+    char *saveptr = NULL;
+    for (char *entry = strtok_r(copy, ",", &saveptr); entry; entry = strtok_r(NULL, ",", &saveptr)) {
+        char *eq = strchr(entry, '=');
+        char *colon = strrchr(entry, ':');
+        if (!eq || !colon || colon < eq || eq[1] == '\0' || count == max_nodes) {
+            free(copy);
+            return -1;
+        }
+        *eq = '\0';
+        *colon = '\0';
+        int node_id = atoi(entry);
+        int port = atoi(colon + 1);
+        if (node_id < 0 || node_id >= RING_MAX_NODES || port <= 0) {
+            free(copy);
+            return -1;
+        }
+        for (int i = 0; i < count; i++) {
+            if (nodes[i].node_id == node_id) {
+                free(copy);
+                return -1;
+            }
+        }
+        nodes[count].node_id = (uint16_t)node_id;
+        nodes[count].port = port;
+        safe_strcpy(nodes[count].host, eq + 1, sizeof(nodes[count].host));
+        count++;
+    }
+    free(copy);
+    return count;
+}
+
+void ring_build(hash_ring_t *ring, const ring_node_t *nodes, int count) {
+    if (!ring || !nodes) {
+        return;
+    }
+    char key[32];
+    ring->size = 0;
+    for (int i = 0; i < count; i++) {
+        for (int v = 0; v < RING_VNODES; v++) {
+            snprintf(key, sizeof(key), "node-%d#%d", nodes[i].node_id, v);
+            ring->vnodes[ring->size].point = hash_key(key);
+            ring->vnodes[ring->size].node_id = nodes[i].node_id;
+            ring->size++;
+        }
+    }
+    qsort(ring->vnodes, ring->size, sizeof(ring_vnode_t), compare_vnodes);
+}
+
+uint16_t ring_lookup(const hash_ring_t *ring, const char *key) {
+    if (!ring || !key || ring->size == 0) {
+        return 0;
+    }
+    uint64_t point = hash_key(key);
+    int lo = 0;
+    int hi = ring->size;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (ring->vnodes[mid].point < point) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return ring->vnodes[lo == ring->size ? 0 : lo].node_id;
+}
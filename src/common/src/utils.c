@@ -5,26 +5,46 @@
 #include <time.h>
 #include <ctype.h>
 #include <stdarg.h>
+#include <stdint.h>
+#include <sys/random.h>
 
+/* Unix milliseconds << 12 | a counter for IDs within the same millisecond; advanced by CAS. */
+static uint64_t uuid_clock;
+
+/*
+ * UUIDv7: a 48-bit millisecond timestamp, then a 12-bit counter, then 62
+ * random bits. IDs sort by creation time as strings too, so new rows land at
+ * the end of an index instead of all over it, and concurrent callers never
+ * share state beyond the one atomic clock.
+ */
 void generate_uuid(char *uuid_str, size_t uuid_len) {
     if (uuid_len < 37) {
         return;
     }
-    
-    static int seeded = 0;
-    if (!seeded) {
-        srand((unsigned int)time(NULL));
-        seeded = 1;
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    uint64_t now = ((uint64_t)ts.tv_sec * 1000ULL + (uint64_t)ts.tv_nsec / 1000000ULL) << 12;
+    uint64_t last = __atomic_load_n(&uuid_clock, __ATOMIC_RELAXED);
+    uint64_t next;
+    do {
+        /* A burst past 4096 per millisecond, or a clock stepping back, borrows from the timestamp. */
+        next = now > last ? now : last + 1;
+    } while (!__atomic_compare_exchange_n(&uuid_clock, &last, next, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    uint64_t random_bits;
+    if (getrandom(&random_bits, sizeof(random_bits), 0) != (ssize_t)sizeof(random_bits)) {
+        random_bits = ((uint64_t)ts.tv_nsec << 32) ^ (uint64_t)(uintptr_t)&ts ^ next;
     }
-    
-    sprintf(uuid_str, 
-            "%08x-%04x-%04x-%04x-%04x%08x",
-            rand() & 0xffffffff,
-            rand() & 0xffff,
-            ((rand() & 0x0fff) | 0x4000), 
-            ((rand() & 0x3fff) | 0x8000),
-            rand() & 0xffff,
-            rand() & 0xffffffff);
+
+    uint64_t ms = next >> 12;
+    sprintf(uuid_str,
+            "%08x-%04x-%04x-%04x-%012llx",
+            (unsigned int)(ms >> 16),
+            (unsigned int)(ms & 0xffff),
+            (unsigned int)(0x7000 | (next & 0x0fff)),
+            (unsigned int)(0x8000 | ((random_bits >> 48) & 0x3fff)),
+            (unsigned long long)(random_bits & 0xffffffffffffULL));
 }
 
 void hash_password(const char *password, char *hash_out, size_t hash_out_size) {
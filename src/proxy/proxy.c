@@ -0,0 +1,562 @@
+#define _GNU_SOURCE
+#include "../common/include/protocol.h"
+#include "../common/include/ring.h"
+#include "../common/include/utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#define PROXY_PORT 8000
+#define PROXY_MAX_FRAME 65536
+
+typedef struct proxy_conn proxy_conn_t;
+
+typedef struct {
+    proxy_conn_t *conn;
+    uint16_t node_id;
+    int fd;                   /* -1 until the client first needs this backend */
+    int pipe[2];
+    pthread_t thread;
+    pthread_mutex_t send_mutex;     /* a pong from the reader must not land inside a forwarded frame */
+    bool swallow_auth;        /* drop the reply to the login we replayed on the client's behalf */
+} proxy_link_t;
+
+typedef struct {
+    char room_id[MAX_ROOM_ID_LEN];
+    uint16_t node_id;
+} proxy_route_t;
+
+typedef struct {
+    hash_ring_t ring;
+    ring_node_t backends[RING_MAX_NODES];
+    int backend_count;
+    uint32_t next_primary;
+} proxy_t;
+
+struct proxy_conn {
+    proxy_t *proxy;
+    int client_fd;
+    int pipe[2];
+    uint16_t primary;         /* backend for everything not tied to a room */
+    proxy_link_t links[RING_MAX_NODES];
+    pthread_mutex_t client_mutex;   /* frames from several backends reach the client whole */
+    char auth[sizeof(auth_request_t)];
+    size_t auth_len;
+    proxy_route_t *routes;    /* rooms joined through this connection and the backend holding them */
+    int route_count;
+    int route_capacity;
+};
+
+static int recv_exact(int fd, void *buffer, size_t length) {
+    char *p = (char *)buffer;
+    while (length > 0) {
+        ssize_t received = recv(fd, p, length, MSG_WAITALL);
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received <= 0) {
+            return -1;
+        }
+        p += received;
+        length -= (size_t)received;
+    }
+    return 0;
+}
+
+static int send_exact(int fd, const void *data, size_t length) {
+    const char *p = (const char *)data;
+    while (length > 0) {
+        ssize_t sent = send(fd, p, length, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            return -1;
+        }
+        p += sent;
+        length -= (size_t)sent;
+    }
+    return 0;
+}
+
+/* Moves a frame body between sockets through a pipe without copying it into user space. */
+static int splice_exact(int in_fd, int out_fd, int pipe_fds[2], size_t length) {
+    while (length > 0) {
+        ssize_t in = splice(in_fd, NULL, pipe_fds[1], NULL, length, SPLICE_F_MOVE);
+        if (in < 0 && errno == EINTR) {
+            continue;
+        }
+        if (in <= 0) {
+            return -1;
+        }
+        for (ssize_t moved = 0; moved < in;) {
+            ssize_t out = splice(pipe_fds[0], NULL, out_fd, NULL, (size_t)(in - moved), SPLICE_F_MOVE);
+            if (out < 0 && errno == EINTR) {
+                continue;
+            }
+            if (out <= 0) {
+                return -1;
+            }
+            moved += out;
+        }
+        length -= (size_t)in;
+    }
+    return 0;
+}
+
+static int read_header(int fd, message_header_t *header, uint32_t *length_out) {
+    if (recv_exact(fd, header, sizeof(message_header_t)) != 0) {
+        return -1;
+    }
+    uint32_t length = ntohl(header->length) & ~FRAME_TAGGED;
+    if (length < sizeof(message_header_t) || length > PROXY_MAX_FRAME) {
+        return -1;
+    }
+    *length_out = length;
+    return 0;
+}
+
+static int connect_backend(const ring_node_t *node) {
+    char port[16];
+    snprintf(port, sizeof(port), "%d", node->port);
+    struct addrinfo hints;
+    struct addrinfo *result = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(node->host, port, &hints, &result) != 0) {
+        return -1;
+    }
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd >= 0 && connect(fd, result->ai_addr, result->ai_addrlen) != 0) {
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(result);
+    if (fd >= 0) {
+        int opt = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+    }
+    return fd;
+}
+
+static const ring_node_t *find_backend(const proxy_t *proxy, uint16_t node_id) {
+    for (int i = 0; i < proxy->backend_count; i++) {
+        if (proxy->backends[i].node_id == node_id) {
+            return &proxy->backends[i];
+        }
+    }
+    return NULL;
+}
+
+static void *backend_reader(void *arg) {
+    proxy_link_t *link = (proxy_link_t *)arg;
+    proxy_conn_t *conn = link->conn;
+    message_header_t header;
+    uint32_t length;
+    char scratch[sizeof(auth_response_t)];
+
+    if (link->swallow_auth) {
+        if (read_header(link->fd, &header, &length) != 0 || length > sizeof(scratch) ||
+            recv_exact(link->fd, scratch, length - sizeof(message_header_t)) != 0) {
+            shutdown(conn->client_fd, SHUT_RDWR);
+            return NULL;
+        }
+    }
+
+    while (read_header(link->fd, &header, &length) == 0) {
+        /* Pings on the primary link reach the client, whose pongs go back there; we answer the others. */
+        if (header.type == MSG_PING && link->node_id != conn->primary && length == sizeof(ping_message_t)) {
+            ping_message_t pong;
+            if (recv_exact(link->fd, &pong.stamp, sizeof(pong.stamp)) != 0) {
+                break;
+            }
+            pong.header.type = MSG_PONG;
+            pong.header.length = htonl(length);
+            pthread_mutex_lock(&link->send_mutex);
+            int sent = send_exact(link->fd, &pong, sizeof(pong));
+            pthread_mutex_unlock(&link->send_mutex);
+            if (sent != 0) {
+                break;
+            }
+            continue;
+        }
+        pthread_mutex_lock(&conn->client_mutex);
+        int result = send_exact(conn->client_fd, &header, sizeof(header));
+        if (result == 0) {
+            result = splice_exact(link->fd, conn->client_fd, link->pipe, length - sizeof(message_header_t));
+        }
+        pthread_mutex_unlock(&conn->client_mutex);
+        if (result != 0) {
+            break;
+        }
+    }
+    /* Losing any backend loses the rooms on it; let the client reconnect and resume them all. */
+    shutdown(conn->client_fd, SHUT_RDWR);
+    return NULL;
+}
+
+static proxy_link_t *open_link(proxy_conn_t *conn, uint16_t node_id) {
+    proxy_link_t *link = &conn->links[node_id];
+    if (link->fd >= 0) {
+        return link;
+    }
+    const ring_node_t *node = find_backend(conn->proxy, node_id);
+    if (!node) {
+        return NULL;
+    }
+    link->fd = connect_backend(node);
+    if (link->fd < 0) {
+        log_message("Cannot reach backend %d (%s:%d)", node_id, node->host, node->port);
+        return NULL;
+    }
+    if (pipe(link->pipe) != 0) {
+        close(link->fd);
+        link->fd = -1;
+        return NULL;
+    }
+    link->conn = conn;
+    link->node_id = node_id;
+    link->swallow_auth = conn->auth_len > 0;
+    if ((link->swallow_auth && send_exact(link->fd, conn->auth, conn->auth_len) != 0) ||
+        pthread_create(&link->thread, NULL, backend_reader, link) != 0) {
+        close(link->pipe[0]);
+        close(link->pipe[1]);
+        close(link->fd);
+        link->fd = -1;
+        return NULL;
+    }
+    return link;
+}
+
+static proxy_route_t *find_route(proxy_conn_t *conn, const char *room_id) {
+    for (int i = 0; i < conn->route_count; i++) {
+        if (strcmp(conn->routes[i].room_id, room_id) == 0) {
+            return &conn->routes[i];
+        }
+    }
+    return NULL;
+}
+
+static void set_route(proxy_conn_t *conn, const char *room_id, uint16_t node_id) {
+    proxy_route_t *route = find_route(conn, room_id);
+    if (!route) {
+        if (conn->route_count == conn->route_capacity) {
+            int capacity = conn->route_capacity ? conn->route_capacity * 2 : 8;
+            proxy_route_t *routes = (proxy_route_t *)realloc(conn->routes, capacity * sizeof(proxy_route_t));
+            if (!routes) {
+                return;
+            }
+            conn->routes = routes;
+            conn->route_capacity = capacity;
+        }
+        route = &conn->routes[conn->route_count++];
+        safe_strcpy(route->room_id, room_id, MAX_ROOM_ID_LEN);
+    }
+    route->node_id = node_id;
+}
+
+static void drop_route(proxy_conn_t *conn, const char *room_id) {
+    proxy_route_t *route = find_route(conn, room_id);
+    if (route) {
+        *route = conn->routes[--conn->route_count];
+    }
+}
+
+/*
+ * Reads one client frame and forwards it, looking only at the header and, for room frames, the room ID.
+ * A request id after the header is passed through untouched, so answers stay matched to requests.
+ */
+static int forward_client_frame(proxy_conn_t *conn) {
+    char head[sizeof(message_header_t) + FRAME_TAG_SIZE + MAX_ROOM_ID_LEN];
+    message_header_t *header = (message_header_t *)head;
+    uint32_t length;
+    if (read_header(conn->client_fd, header, &length) != 0) {
+        return -1;
+    }
+    size_t prefix = sizeof(message_header_t);
+    if (ntohl(header->length) & FRAME_TAGGED) {
+        if (length < prefix + FRAME_TAG_SIZE || recv_exact(conn->client_fd, head + prefix, FRAME_TAG_SIZE) != 0) {
+            return -1;
+        }
+        prefix += FRAME_TAG_SIZE;
+    }
+    size_t body = length - prefix;
+
+    if (header->type == MSG_AUTH_REQUEST) {
+        if (body != sizeof(auth_request_t) - sizeof(message_header_t)) {
+            return -1;
+        }
+        /* Kept untagged: the copies replayed to other backends are answered to us, not the client. */
+        auth_request_t *auth = (auth_request_t *)conn->auth;
+        auth->header.type = MSG_AUTH_REQUEST;
+        auth->header.length = htonl(sizeof(auth_request_t));
+        if (recv_exact(conn->client_fd, conn->auth + sizeof(message_header_t), body) != 0) {
+            return -1;
+        }
+        conn->auth_len = sizeof(auth_request_t);
+        proxy_link_t *link = open_link(conn, conn->primary);
+        if (!link) {
+            return -1;
+        }
+        pthread_mutex_lock(&link->send_mutex);
+        int result = send_exact(link->fd, head, prefix);
+        if (result == 0) {
+            result = send_exact(link->fd, conn->auth + sizeof(message_header_t), body);
+        }
+        pthread_mutex_unlock(&link->send_mutex);
+        return result;
+    }
+
+    if (header->type == MSG_LOGIN_JOIN) {
+        /* The whole login goes to the primary, which joins every room in it; other backends get just the login. */
+        login_join_request_t req;
+        size_t frame = sizeof(message_header_t) + body;
+        if (frame < LOGIN_JOIN_REQUEST_SIZE(0) || frame > sizeof(req)) {
+            return -1;
+        }
+        if (recv_exact(conn->client_fd, (char *)&req + sizeof(message_header_t), body) != 0 ||
+            req.count > LOGIN_JOIN_MAX_ROOMS || frame < LOGIN_JOIN_REQUEST_SIZE(req.count)) {
+            return -1;
+        }
+        auth_request_t *auth = (auth_request_t *)conn->auth;
+        auth->header.type = MSG_AUTH_REQUEST;
+        auth->header.length = htonl(sizeof(auth_request_t));
+        memcpy(auth->username, req.username, MAX_USERNAME_LEN);
+        memcpy(auth->password, req.password, MAX_PASSWORD_LEN);
+        conn->auth_len = sizeof(auth_request_t);
+        proxy_link_t *link = open_link(conn, conn->primary);
+        if (!link) {
+            return -1;
+        }
+        pthread_mutex_lock(&link->send_mutex);
+        int result = send_exact(link->fd, head, prefix);
+        if (result == 0) {
+            result = send_exact(link->fd, (char *)&req + sizeof(message_header_t), body);
+        }
+        pthread_mutex_unlock(&link->send_mutex);
+        for (int i = 0; i < req.count; i++) {
+            req.entries[i].room_id[MAX_ROOM_ID_LEN - 1] = '\0';
+            set_route(conn, req.entries[i].room_id, conn->primary);
+        }
+        return result;
+    }
+
+    if (header->type == MSG_HELLO && body == sizeof(hello_message_t) - sizeof(message_header_t)) {
+        /* Compressed frames would hide the room IDs routing depends on, so the offer is withdrawn. */
+        hello_message_t hello;
+        if (recv_exact(conn->client_fd, (char *)&hello + sizeof(message_header_t), body) != 0) {
+            return -1;
+        }
+        hello.capabilities &= ~CAP_COMPRESSION;
+        proxy_link_t *link = open_link(conn, conn->primary);
+        if (!link) {
+            return -1;
+        }
+        pthread_mutex_lock(&link->send_mutex);
+        int result = send_exact(link->fd, head, prefix);
+        if (result == 0) {
+            result = send_exact(link->fd, (char *)&hello + sizeof(message_header_t), body);
+        }
+        pthread_mutex_unlock(&link->send_mutex);
+        return result;
+    }
+
+    size_t peeked = 0;
+    uint16_t target = conn->primary;
+    if ((header->type == MSG_JOIN_ROOM || header->type == MSG_LEAVE_ROOM || header->type == MSG_CHAT_MESSAGE ||
+         header->type == MSG_CHAT_COMPACT) && body >= MAX_ROOM_ID_LEN) {
+        char *room_field = head + prefix;
+        if (recv_exact(conn->client_fd, room_field, MAX_ROOM_ID_LEN) != 0) {
+            return -1;
+        }
+        peeked = MAX_ROOM_ID_LEN;
+        char room_id[MAX_ROOM_ID_LEN];
+        memcpy(room_id, room_field, MAX_ROOM_ID_LEN);
+        room_id[MAX_ROOM_ID_LEN - 1] = '\0';
+
+        proxy_route_t *route = find_route(conn, room_id);
+        if (header->type == MSG_JOIN_ROOM) {
+            target = route ? route->node_id : ring_lookup(&conn->proxy->ring, room_id);
+            set_route(conn, room_id, target);
+        } else {
+            target = route ? route->node_id : conn->primary;
+            if (header->type == MSG_LEAVE_ROOM) {
+                drop_route(conn, room_id);
+            }
+        }
+    }
+
+    proxy_link_t *link = open_link(conn, target);
+    if (!link) {
+        link = open_link(conn, conn->primary);
+    }
+    if (!link) {
+        return -1;
+    }
+    pthread_mutex_lock(&link->send_mutex);
+    int result = send_exact(link->fd, head, prefix + peeked);
+    if (result == 0) {
+        result = splice_exact(conn->client_fd, link->fd, conn->pipe, body - peeked);
+    }
+    pthread_mutex_unlock(&link->send_mutex);
+    return result;
+}
+
+static void *handle_connection(void *arg) {
+    proxy_conn_t *conn = (proxy_conn_t *)arg;
+
+    if (open_link(conn, conn->primary)) {
+        while (forward_client_frame(conn) == 0) {
+        }
+    }
+
+    for (int i = 0; i < RING_MAX_NODES; i++) {
+        if (conn->links[i].fd >= 0) {
+            shutdown(conn->links[i].fd, SHUT_RDWR);
+        }
+    }
+    for (int i = 0; i < RING_MAX_NODES; i++) {
+        proxy_link_t *link = &conn->links[i];
+        if (link->fd >= 0) {
+            pthread_join(link->thread, NULL);
+            close(link->fd);
+            close(link->pipe[0]);
+            close(link->pipe[1]);
+        }
+        pthread_mutex_destroy(&link->send_mutex);
+    }
+    close(conn->client_fd);
+    close(conn->pipe[0]);
+    close(conn->pipe[1]);
+    pthread_mutex_destroy(&conn->client_mutex);
+    free(conn->routes);
+    free(conn);
+    return NULL;
+}
+
+static proxy_conn_t *create_connection(proxy_t *proxy, int client_fd) {
+    proxy_conn_t *conn = (proxy_conn_t *)calloc(1, sizeof(proxy_conn_t));
+    if (!conn) {
+        return NULL;
+    }
+    if (pipe(conn->pipe) != 0) {
+        free(conn);
+        return NULL;
+    }
+    conn->proxy = proxy;
+    conn->client_fd = client_fd;
+    conn->primary = proxy->backends[proxy->next_primary++ % proxy->backend_count].node_id;
+    for (int i = 0; i < RING_MAX_NODES; i++) {
+        conn->links[i].fd = -1;
+        pthread_mutex_init(&conn->links[i].send_mutex, NULL);
+    }
+    pthread_mutex_init(&conn->client_mutex, NULL);
+    return conn;
+}
+
+static int listen_on(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    int opt = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    addr.sin_port = htons(port);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int main(int argc, char *argv[]) {
+    int port = PROXY_PORT;
+    const char *backends = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-p") == 0 || strcmp(argv[i], "--port") == 0) {
+            if (i + 1 < argc) {
+                port = atoi(argv[i + 1]);
+                if (port <= 0) {
+                    port = PROXY_PORT;
+                }
+                i++;
+            }
+        } else if (strcmp(argv[i], "-b") == 0 || strcmp(argv[i], "--backends") == 0) {
+            if (i + 1 < argc) {
+                backends = argv[i + 1];
+                i++;
+            }
+        } else if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            printf("Usage: %s [options] --backends SPEC\n", argv[0]);
+            printf("Options:\n");
+            printf("  -p, --port PORT       Port to listen on (default: %d)\n", PROXY_PORT);
+            printf("  -b, --backends SPEC   Backend servers as ID=HOST:PORT,... using the cluster's node IDs\n");
+            printf("  -h, --help            Show this help message\n");
+            return 0;
+        }
+    }
+
+    static proxy_t proxy;
+    proxy.backend_count = ring_parse_nodes(backends, proxy.backends, RING_MAX_NODES);
+    if (proxy.backend_count <= 0) {
+        fprintf(stderr, "Missing or invalid --backends (expected ID=HOST:PORT,...)\n");
+        return 1;
+    }
+    ring_build(&proxy.ring, proxy.backends, proxy.backend_count);
+    signal(SIGPIPE, SIG_IGN);
+
+    int listen_fd = listen_on(port);
+    if (listen_fd < 0) {
+        log_message("Failed to listen on port %d: %s", port, strerror(errno));
+        return 1;
+    }
+    log_message("Proxy listening on 127.0.0.1:%d for %d backends", port, proxy.backend_count);
+
+    for (;;) {
+        int client_fd = accept(listen_fd, NULL, NULL);
+        if (client_fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            log_message("Failed to accept connection: %s", strerror(errno));
+            break;
+        }
+        int opt = 1;
+        setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+
+        proxy_conn_t *conn = create_connection(&proxy, client_fd);
+        pthread_t thread;
+        if (!conn || pthread_create(&thread, NULL, handle_connection, conn) != 0) {
+            log_message("Failed to set up connection");
+            if (conn) {
+                close(conn->pipe[0]);
+                close(conn->pipe[1]);
+                pthread_mutex_destroy(&conn->client_mutex);
+                free(conn);
+            }
+            close(client_fd);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+
+    close(listen_fd);
+    return 0;
+}
@@ -0,0 +1,396 @@
+#include "../common/include/capture.h"
+#include "../common/include/utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#define REPLAY_MAX_BUFFERED (64u * 1024u * 1024u)
+#define REPLAY_DRAIN_MS 2000
+
+typedef struct {
+    int fd;
+    bool active;
+    bool closing;
+    char *out;
+    size_t out_start;
+    size_t out_len;
+    size_t out_cap;
+} replay_conn_t;
+
+typedef struct {
+    struct sockaddr_in server_addr;
+    double speed;
+    replay_conn_t *conns;
+    size_t conn_cap;
+    size_t active_count;
+    size_t buffered_bytes;
+    struct pollfd *pfds;
+    uint32_t *pfd_conn;
+    size_t pfd_cap;
+    uint64_t frames_sent;
+    uint64_t bytes_sent;
+    uint64_t bytes_received;
+    uint64_t connections_opened;
+    uint64_t connections_dropped;
+} replay_t;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static replay_conn_t *get_conn(replay_t *replay, uint32_t conn_id) {
+    if (conn_id >= replay->conn_cap) {
+        size_t cap = replay->conn_cap ? replay->conn_cap : 1024;
+        while (cap <= conn_id) {
+            cap *= 2;
+        }
+        replay_conn_t *conns = (replay_conn_t *)realloc(replay->conns, cap * sizeof(replay_conn_t));
+        if (!conns) {
+            return NULL;
+        }
+        memset(conns + replay->conn_cap, 0, (cap - replay->conn_cap) * sizeof(replay_conn_t));
+        replay->conns = conns;
+        replay->conn_cap = cap;
+    }
+    return &replay->conns[conn_id];
+}
+
+static void conn_close(replay_t *replay, replay_conn_t *conn) {
+    if (!conn->active) {
+        return;
+    }
+    close(conn->fd);
+    conn->fd = -1;
+    conn->active = false;
+    conn->closing = false;
+    replay->buffered_bytes -= conn->out_len;
+    conn->out_start = 0;
+    conn->out_len = 0;
+    replay->active_count--;
+}
+
+static int conn_open(replay_t *replay, uint32_t conn_id) {
+    replay_conn_t *conn = get_conn(replay, conn_id);
+    if (!conn) {
+        return -1;
+    }
+    if (conn->active) {
+        conn_close(replay, conn);
+    }
+
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *)&replay->server_addr, sizeof(replay->server_addr)) < 0) {
+        log_message("Failed to connect replay connection %u: %s", conn_id, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    int opt = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+
+    conn->fd = fd;
+    conn->active = true;
+    conn->closing = false;
+    conn->out_start = 0;
+    conn->out_len = 0;
+    replay->active_count++;
+    replay->connections_opened++;
+    return 0;
+}
+
+static int conn_flush(replay_t *replay, replay_conn_t *conn) {
+    while (conn->out_len > 0) {
+        ssize_t sent = send(conn->fd, conn->out + conn->out_start, conn->out_len, MSG_NOSIGNAL);
+        if (sent > 0) {
+            conn->out_start += (size_t)sent;
+            conn->out_len -= (size_t)sent;
+            replay->buffered_bytes -= (size_t)sent;
+            replay->bytes_sent += (uint64_t)sent;
+            continue;
+        }
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return 0;
+        }
+        replay->connections_dropped++;
+        conn_close(replay, conn);
+        return -1;
+    }
+    conn->out_start = 0;
+    if (conn->closing) {
+        conn_close(replay, conn);
+    }
+    return 0;
+}
+
+static int conn_queue(replay_t *replay, replay_conn_t *conn, const char *data, size_t length) {
+    if (conn->out_start + conn->out_len + length > conn->out_cap) {
+        if (conn->out_start > 0) {
+            memmove(conn->out, conn->out + conn->out_start, conn->out_len);
+            conn->out_start = 0;
+        }
+        size_t cap = conn->out_cap ? conn->out_cap : 4096;
+        while (conn->out_len + length > cap) {
+            cap *= 2;
+        }
+        if (cap != conn->out_cap) {
+            char *out = (char *)realloc(conn->out, cap);
+            if (!out) {
+                return -1;
+            }
+            conn->out = out;
+            conn->out_cap = cap;
+        }
+    }
+    memcpy(conn->out + conn->out_start + conn->out_len, data, length);
+    conn->out_len += length;
+    replay->buffered_bytes += length;
+    return 0;
+}
+
+static void pump(replay_t *replay, int timeout_ms) {
+    if (replay->active_count > replay->pfd_cap) {
+        size_t cap = replay->active_count * 2;
+        struct pollfd *pfds = (struct pollfd *)realloc(replay->pfds, cap * sizeof(struct pollfd));
+        uint32_t *pfd_conn = (uint32_t *)realloc(replay->pfd_conn, cap * sizeof(uint32_t));
+        if (pfds) {
+            replay->pfds = pfds;
+        }
+        if (pfd_conn) {
+            replay->pfd_conn = pfd_conn;
+        }
+        if (!pfds || !pfd_conn) {
+            return;
+        }
+        replay->pfd_cap = cap;
+    }
+
+    size_t count = 0;
+    for (size_t id = 0; id < replay->conn_cap && count < replay->active_count; id++) {
+        replay_conn_t *conn = &replay->conns[id];
+        if (!conn->active) {
+            continue;
+        }
+        replay->pfds[count].fd = conn->fd;
+        replay->pfds[count].events = POLLIN | (conn->out_len > 0 ? POLLOUT : 0);
+        replay->pfds[count].revents = 0;
+        replay->pfd_conn[count] = (uint32_t)id;
+        count++;
+    }
+
+    if (count == 0) {
+        if (timeout_ms > 0) {
+            poll(NULL, 0, timeout_ms);
+        }
+        return;
+    }
+    if (poll(replay->pfds, count, timeout_ms) <= 0) {
+        return;
+    }
+
+    char buffer[65536];
+    for (size_t i = 0; i < count; i++) {
+        replay_conn_t *conn = &replay->conns[replay->pfd_conn[i]];
+        short revents = replay->pfds[i].revents;
+        if (!conn->active || revents == 0) {
+            continue;
+        }
+        if (revents & (POLLIN | POLLHUP | POLLERR)) {
+            ssize_t received = recv(conn->fd, buffer, sizeof(buffer), 0);
+            if (received > 0) {
+                replay->bytes_received += (uint64_t)received;
+            } else if (received == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+                if (conn->out_len > 0 || !conn->closing) {
+                    replay->connections_dropped++;
+                }
+                conn_close(replay, conn);
+                continue;
+            }
+        }
+        if (revents & POLLOUT) {
+            conn_flush(replay, conn);
+        }
+    }
+}
+
+static int handle_record(replay_t *replay, const capture_record_t *record) {
+    replay_conn_t *conn = get_conn(replay, record->conn_id);
+    if (!conn) {
+        return -1;
+    }
+
+    switch (record->kind) {
+        case CAPTURE_RECORD_OPEN:
+            conn_open(replay, record->conn_id);
+            return 0;
+
+        case CAPTURE_RECORD_FRAME:
+            if (!conn->active && conn_open(replay, record->conn_id) != 0) {
+                return 0;
+            }
+            if (conn_queue(replay, conn, record->data, record->length) != 0) {
+                return -1;
+            }
+            replay->frames_sent++;
+            conn_flush(replay, conn);
+            return 0;
+
+        case CAPTURE_RECORD_CLOSE:
+            if (conn->active) {
+                conn->closing = true;
+                conn_flush(replay, conn);
+            }
+            return 0;
+
+        default:
+            log_message("Unknown capture record kind %u", record->kind);
+            return -1;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    const char *hostname = "127.0.0.1";
+    int port = 8080;
+    double speed = 1.0;
+    const char *capture_path = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--host") == 0) {
+            if (i + 1 < argc) {
+                hostname = argv[i + 1];
+                i++;
+            }
+        } else if (strcmp(argv[i], "-p") == 0 || strcmp(argv[i], "--port") == 0) {
+            if (i + 1 < argc) {
+                port = atoi(argv[i + 1]);
+                if (port <= 0) {
+                    port = 8080;
+                }
+                i++;
+            }
+        } else if (strcmp(argv[i], "-s") == 0 || strcmp(argv[i], "--speed") == 0) {
+            if (i + 1 < argc) {
+                speed = strcmp(argv[i + 1], "max") == 0 ? 0.0 : atof(argv[i + 1]);
+                if (speed < 0.0) {
+                    speed = 1.0;
+                }
+                i++;
+            }
+        } else if (strcmp(argv[i], "--help") == 0) {
+            printf("Usage: %s [options] CAPTURE_FILE\n", argv[0]);
+            printf("Options:\n");
+            printf("  -h, --host HOST    Server hostname (default: %s)\n", hostname);
+            printf("  -p, --port PORT    Server port (default: %d)\n", port);
+            printf("  -s, --speed X      Replay speed: 1 for real time, N for N times faster,\n");
+            printf("                     max to send as fast as possible (default: 1)\n");
+            printf("  --help             Show this help message\n");
+            return 0;
+        } else {
+            capture_path = argv[i];
+        }
+    }
+
+    if (!capture_path) {
+        printf("No capture file given, see --help\n");
+        return 1;
+    }
+
+    replay_t replay;
+    memset(&replay, 0, sizeof(replay));
+    replay.speed = speed;
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    char port_str[16];
+    snprintf(port_str, sizeof(port_str), "%d", port);
+    struct addrinfo *result = NULL;
+    if (getaddrinfo(hostname, port_str, &hints, &result) != 0 || !result) {
+        printf("Failed to resolve %s\n", hostname);
+        return 1;
+    }
+    memcpy(&replay.server_addr, result->ai_addr, sizeof(replay.server_addr));
+    freeaddrinfo(result);
+
+    capture_reader_t *reader = capture_open_reader(capture_path);
+    if (!reader) {
+        printf("Failed to open capture file %s\n", capture_path);
+        return 1;
+    }
+
+    uint64_t start = now_ns();
+    uint64_t records = 0;
+    capture_record_t record;
+    int rc;
+    while ((rc = capture_read(reader, &record)) == 1) {
+        if (replay.speed > 0.0) {
+            uint64_t target = start + (uint64_t)((double)record.timestamp_ns / replay.speed);
+            for (uint64_t now = now_ns(); now < target; now = now_ns()) {
+                uint64_t wait_ms = (target - now) / 1000000ULL;
+                pump(&replay, wait_ms > 50 ? 50 : (int)wait_ms);
+                if (wait_ms == 0) {
+                    break;
+                }
+            }
+        }
+        while (replay.buffered_bytes > REPLAY_MAX_BUFFERED) {
+            pump(&replay, 50);
+        }
+        if (handle_record(&replay, &record) != 0) {
+            break;
+        }
+        if ((++records & 0xff) == 0) {
+            pump(&replay, 0);
+        }
+    }
+    if (rc < 0) {
+        log_message("Capture file %s is truncated or corrupt", capture_path);
+    }
+    capture_close_reader(reader);
+
+    while (replay.buffered_bytes > 0 && replay.active_count > 0) {
+        pump(&replay, 50);
+    }
+    uint64_t elapsed = now_ns() - start;
+    uint64_t deadline = now_ns() + REPLAY_DRAIN_MS * 1000000ULL;
+    while (replay.active_count > 0 && now_ns() < deadline) {
+        pump(&replay, 50);
+    }
+    for (size_t id = 0; id < replay.conn_cap; id++) {
+        conn_close(&replay, &replay.conns[id]);
+        free(replay.conns[id].out);
+    }
+    free(replay.conns);
+    free(replay.pfds);
+    free(replay.pfd_conn);
+
+    double seconds = (double)elapsed / 1e9;
+    printf("Replayed %llu records (%llu frames, %llu connections) in %.3f s\n",
+           (unsigned long long)records, (unsigned long long)replay.frames_sent,
+           (unsigned long long)replay.connections_opened, seconds);
+    printf("Sent %llu bytes (%.0f frames/s, %.2f MB/s), received %llu bytes, %llu connections dropped\n",
+           (unsigned long long)replay.bytes_sent,
+           seconds > 0 ? (double)replay.frames_sent / seconds : 0.0,
+           seconds > 0 ? (double)replay.bytes_sent / seconds / 1e6 : 0.0,
+           (unsigned long long)replay.bytes_received,
+           (unsigned long long)replay.connections_dropped);
+    return rc < 0 ? 1 : 0;
+}
@@ -35,6 +35,10 @@ int server_init(server_t *server, const char *db_path) {
         server->clients[i].sockfd = -1;
         server->clients[i].authenticated = false;
         server->clients[i].connected = false;
+        server->clients[i].next_user = -1;
+        pthread_mutex_init(&server->clients[i].send_mutex, NULL);
+        pthread_cond_init(&server->clients[i].send_ready, NULL);
+        server->clients[i].closing = true;
     }
     
     if (pthread_mutex_init(&server->clients_mutex, NULL) != 0) {
@@ -42,12 +46,56 @@ int server_init(server_t *server, const char *db_path) {
         db_close(&server->db);
         return -1;
     }
+    if (pthread_mutex_init(&server->rooms_mutex, NULL) != 0) {
+        log_message("Failed to initialize mutex");
+        pthread_mutex_destroy(&server->clients_mutex);
+        db_close(&server->db);
+        return -1;
+    }
+    if (intern_init(&server->room_names) != 0 || intern_init(&server->user_names) != 0) {
+        log_message("Failed to initialize name tables");
+        intern_free(&server->room_names);
+        pthread_mutex_destroy(&server->rooms_mutex);
+        pthread_mutex_destroy(&server->clients_mutex);
+        db_close(&server->db);
+        return -1;
+    }
+    pthread_mutex_init(&server->users_mutex, NULL);
+    pthread_mutex_init(&server->homes_mutex, NULL);
+    for (int i = 0; i < USER_BUCKETS; i++) {
+        server->user_index[i] = -1;
+    }
+    server->homes = NULL;
+    server->home_size = 0;
+    server->home_count = 0;
+    server->rooms = NULL;
+    server->room_count = 0;
+    server->room_capacity = 0;
     
     server->running = false;
     server->server_sockfd = -1;
+    server->next_conn_id = 0;
+    memset(&server->conn_limit, 0, sizeof(rate_limit_t));
+    memset(&server->user_limit, 0, sizeof(rate_limit_t));
+    memset(&server->room_limit, 0, sizeof(rate_limit_t));
+    server->capture = NULL;
+    server->cluster = NULL;
+    server->bus = NULL;
+    server->fanout = NULL;
+    memset(&server->timers, 0, sizeof(server->timers));
+    pthread_mutex_init(&server->timers.mutex, NULL);
+    memset(&server->dedup, 0, sizeof(server->dedup));
+    pthread_mutex_init(&server->dedup.mutex, NULL);
+    memset(&server->load, 0, sizeof(server->load));
+    server->load.budget_ms = DEFAULT_LATENCY_BUDGET_MS;
+    server->compression = true;
+    server->ping_interval_ms = DEFAULT_PING_INTERVAL_MS;
+    server->auth_timeout_ms = DEFAULT_AUTH_TIMEOUT_MS;
+    server->presence_running = false;
     g_server = server;
     signal(SIGINT, handle_signal);
     signal(SIGTERM, handle_signal);
+    signal(SIGPIPE, SIG_IGN);
     
     return 0;
 }
@@ -103,6 +151,9 @@ int server_start(server_t *server, int port) {
     log_message("Server started on port %d", port);
     
     server->running = true;
+    presence_start(server);
+    timers_start(&server->timers);
+    load_start(server);
     
     while (server->running) {
         struct sockaddr_in client_addr;
@@ -115,11 +166,15 @@ int server_start(server_t *server, int port) {
             }
             continue;
         }
+        if (server_load(server) == LOAD_REFUSING) {
+            server_refuse(client_sockfd, "Server is overloaded, try again later");
+            continue;
+        }
         
         int client_index = server_add_client(server, client_sockfd, client_addr);
         if (client_index < 0) {
             log_message("Failed to add client");
-            close(client_sockfd);
+            server_refuse(client_sockfd, "Server is full, try again later");
             continue;
         }
         
@@ -151,21 +206,59 @@ void server_stop(server_t *server) {
         server->server_sockfd = -1;
     }
     
+    pthread_t threads[MAX_CLIENTS];
+    int thread_count = 0;
     pthread_mutex_lock(&server->clients_mutex);
     for (int i = 0; i < MAX_CLIENTS; i++) {
         if (server->clients[i].connected) {
-            close(server->clients[i].sockfd);
-            server->clients[i].connected = false;
-            pthread_join(server->clients[i].thread, NULL);
+            shutdown(server->clients[i].sockfd, SHUT_RDWR);
+            threads[thread_count++] = server->clients[i].thread;
         }
     }
     pthread_mutex_unlock(&server->clients_mutex);
+    for (int i = 0; i < thread_count; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    timers_stop(&server->timers);
+    pthread_mutex_destroy(&server->timers.mutex);
+    presence_stop(server);
+    bus_stop(server);
+    cluster_stop(server);
+    fanout_stop(server);
     pthread_mutex_destroy(&server->clients_mutex);
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        pthread_mutex_destroy(&server->clients[i].send_mutex);
+        pthread_cond_destroy(&server->clients[i].send_ready);
+    }
+    server_free_rooms(server);
+    pthread_mutex_destroy(&server->rooms_mutex);
+    server_free_users(server);
+    intern_free(&server->user_names);
+    pthread_mutex_destroy(&server->users_mutex);
+    pthread_mutex_destroy(&server->homes_mutex);
+    dedup_free(server);
     db_close(&server->db);
+    if (server->capture) {
+        capture_close_writer(server->capture);
+        server->capture = NULL;
+    }
     
     log_message("Server stopped");
 }
 
+int server_enable_capture(server_t *server, const char *path) {
+    if (!server || !path) {
+        return -1;
+    }
+    server->capture = capture_open_writer(path);
+    if (!server->capture) {
+        log_message("Failed to open capture file: %s", path);
+        return -1;
+    }
+    log_message("Capturing inbound traffic to %s", path);
+    return 0;
+}
+
 int server_add_client(server_t *server, int sockfd, struct sockaddr_in addr) {
     if (!server || sockfd < 0) {
         return -1;
@@ -187,13 +280,33 @@ int server_add_client(server_t *server, int sockfd, struct sockaddr_in addr) {
     }
     
     server->clients[index].sockfd = sockfd;
+    server->clients[index].conn_id = ++server->next_conn_id;
     server->clients[index].addr = addr;
     server->clients[index].authenticated = false;
     server->clients[index].connected = true;
     server->clients[index].username[0] = '\0';
-    server->clients[index].current_room_id[0] = '\0';
+    server->clients[index].room_bits = NULL;
+    server->clients[index].room_words = 0;
+    server->clients[index].room_count = 0;
+    server->clients[index].next_user = -1;
+    server->clients[index].rate.tat = 0;
+    server->clients[index].user_rate = NULL;
+    server->clients[index].limited_at = 0;
+    server->clients[index].version = PROTOCOL_MIN_VERSION;
+    server->clients[index].capabilities = 0;
+    server->clients[index].deflater = NULL;
+    server->clients[index].inflater = NULL;
+    if (server_start_output(server, index) != 0) {
+        server->clients[index].connected = false;
+        pthread_mutex_unlock(&server->clients_mutex);
+        return -1;
+    }
+    server_watch_client(server, index);
     
     pthread_mutex_unlock(&server->clients_mutex);
+    if (server->capture) {
+        capture_record_open(server->capture, server->clients[index].conn_id);
+    }
     
     return index;
 }
@@ -203,6 +316,13 @@ void server_remove_client(server_t *server, int client_index) {
         return;
     }
     
+    server_unwatch_client(server, client_index);
+    server_leave_all_rooms(server, client_index);
+    if (server->clients[client_index].authenticated) {
+        server_unindex_user(server, client_index);
+    }
+    server_stop_output(server, client_index);
+    server_free_compression(server, client_index);
     pthread_mutex_lock(&server->clients_mutex);
     if (server->clients[client_index].sockfd >= 0) {
         close(server->clients[client_index].sockfd);
@@ -212,6 +332,9 @@ void server_remove_client(server_t *server, int client_index) {
     server->clients[client_index].authenticated = false;
     server->clients[client_index].connected = false;
     pthread_mutex_unlock(&server->clients_mutex);
+    if (server->capture) {
+        capture_record_close(server->capture, server->clients[client_index].conn_id);
+    }
     log_message("Client disconnected: %s", server->clients[client_index].username);
 }
 
@@ -234,46 +357,3 @@ int server_find_client_by_sockfd(server_t *server, int sockfd) {
     
     return index;
 }
-
-int main(int argc, char *argv[]) {
-    const char *db_path = "../chat.db"; 
-    int port = SERVER_PORT;
-    
-    for (int i = 1; i < argc; i++) {
-        if (strcmp(argv[i], "-d") == 0 || strcmp(argv[i], "--db") == 0) {
-            if (i + 1 < argc) {
-                db_path = argv[i + 1];
-                i++;
-            }
-        } else if (strcmp(argv[i], "-p") == 0 || strcmp(argv[i], "--port") == 0) {
-            if (i + 1 < argc) {
-                port = atoi(argv[i + 1]);
-                if (port <= 0) {
-                    port = SERVER_PORT;
-                }
-                i++;
-            }
-        } else if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
-            printf("Usage: %s [options]\n", argv[0]);
-            printf("Options:\n");
-            printf("  -d, --db PATH     Database path (default: %s)\n", db_path);
-            printf("  -p, --port PORT   Port to listen on (default: %d)\n", SERVER_PORT);
-            printf("  -h, --help        Show this help message\n");
-            return 0;
-        }
-    }
-    
-    printf("Debug: Using database path: %s\n", db_path);
-    server_t server;
-    if (server_init(&server, db_path) != 0) {
-        log_message("Failed to initialize server");
-        return 1;
-    }
-    
-    if (server_start(&server, port) != 0) {
-        log_message("Failed to start server");
-        return 1;
-    }
-    
-    return 0;
-} 
\ No newline at end of file
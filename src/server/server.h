@@ -3,44 +3,540 @@
 
 #include "../common/include/database.h"
 #include "../common/include/protocol.h"
+#include "../common/include/capture.h"
+#include "../common/include/ring.h"
+#include "../common/include/compress.h"
 #include <pthread.h>
 #include <stdbool.h>
 #include <netinet/in.h>
 
 #define MAX_CLIENTS 100
 #define MAX_ROOMS 50
+#define MAX_CLIENT_ROOMS 256
 #define SERVER_PORT 8080
 
+#define MAX_CLUSTER_NODES RING_MAX_NODES
+#define CLUSTER_MAX_BACKLOG (4 * 1024 * 1024)
+#define CLUSTER_SUBSCRIBE_TIMEOUT_MS 2000
+
+#define BUS_SLOT_COUNT 4096
+#define PRESENCE_WINDOW_MS 250
+#define USER_BUCKETS 128             /* power of two, at least MAX_CLIENTS */
+#define INTERN_INITIAL_SLOTS 256     /* power of two */
+#define USER_HANDLE_NONE UINT32_MAX
+#define FANOUT_DEFAULT_WORKERS 4
+#define FANOUT_HOT_MEMBERS 64        /* rooms this big always fan out on the workers */
+#define FANOUT_WARM_MEMBERS 16       /* ... and rooms this big do once they are busy */
+#define FANOUT_HOT_RATE 20           /* messages per second that make a warm room busy */
+#define FANOUT_QUEUE_LIMIT 4096      /* jobs per worker; more are dropped and members fill the gap */
+#define LANE_CONTROL_LIMIT 1024      /* room for a full history replay plus responses */
+#define LANE_CHAT_LIMIT 2048
+#define LANE_BULK_LIMIT 512
+#define RETRANSMIT_WINDOW 256        /* recent messages per room kept for resends; power of two */
+#define LAG_CHECK_INTERVAL 64        /* messages between scans for members acking too far behind */
+#define TIMER_TICK_MS 100
+#define TIMER_SLOT_BITS 6
+#define TIMER_SLOTS (1 << TIMER_SLOT_BITS)
+#define TIMER_LEVELS 4               /* 64^4 ticks of 100 ms: about 19 days */
+#define DEFAULT_PING_INTERVAL_MS 30000  /* idle time before a ping; twice this without a frame drops the client */
+#define DEFAULT_AUTH_TIMEOUT_MS 30000
+#define WRITE_STALL_TIMEOUT_MS 30000 /* one frame taking this long to write drops the client */
+#define DEFAULT_LATENCY_BUDGET_MS 250  /* worst chat queueing delay the overload policy defends; 0 disables it */
+#define LOAD_CHECK_MS 100
+#define LOAD_SHED_FRAMES (16 * 1024)    /* frames queued on all connections before presence and history are shed */
+#define LOAD_REFUSE_FRAMES (64 * 1024)  /* ... and before new connections are refused */
+#define LOAD_CALM_CHECKS 20          /* consecutive quiet checks before easing off one level */
+#define DEDUP_WINDOW 64              /* message ids remembered per sender */
+#define DEDUP_SLOTS 128              /* hash set per sender; power of two, twice the window */
+#define DEDUP_BUCKETS 256            /* power of two; indexed by user handle */
+#define DEDUP_MAX_SENDERS (4 * MAX_CLIENTS)  /* beyond this the least recently active sender is forgotten */
+
+#define CLUSTER_HELLO        1
+#define CLUSTER_FORWARD      2    /* chat frame for the room's owner to sequence */
+#define CLUSTER_DELIVER      3    /* sequenced chat frame from the owner */
+#define CLUSTER_SUBSCRIBE    4    /* sender has local members of the room */
+#define CLUSTER_UNSUBSCRIBE  5
+#define CLUSTER_SUBSCRIBED   6    /* owner's ack, carries the room's last sequence */
+#define CLUSTER_PRESENCE     7    /* sender's first member by this name joined, or its last left */
+#define CLUSTER_ROSTER       8    /* owner's presence update, mirrored by the receiver */
+#define CLUSTER_USER         9    /* sender's first connection for a user logged in, or its last left */
+#define CLUSTER_DIRECT       10   /* direct message for the recipient's home node, or from it to deliver */
+
+#pragma pack(1)
+
+typedef struct {
+    message_header_t header;
+    uint16_t node_id;
+} cluster_hello_t;
+
+typedef struct {
+    message_header_t header;
+    uint16_t node_id;
+    chat_message_t chat;
+} cluster_chat_t;
+
+typedef struct {
+    message_header_t header;
+    uint16_t node_id;
+    char room_id[MAX_ROOM_ID_LEN];
+    uint64_t last_seq;
+} cluster_room_t;
+
+typedef struct {
+    message_header_t header;
+    uint16_t node_id;
+    char room_id[MAX_ROOM_ID_LEN];
+    uint8_t op;
+    char username[MAX_USERNAME_LEN];
+} cluster_presence_t;
+
+typedef struct {
+    message_header_t header;
+    uint16_t node_id;
+    presence_update_t update;     /* sent with only update.count entries */
+} cluster_roster_t;
+
+typedef struct {
+    message_header_t header;
+    uint16_t node_id;
+    uint8_t op;                   /* PRESENCE_JOIN or PRESENCE_LEAVE */
+    char username[MAX_USERNAME_LEN];
+} cluster_user_t;
+
+typedef struct {
+    message_header_t header;
+    uint16_t node_id;
+    uint8_t deliver;              /* 0: route it (sent to the home node), 1: hand it to local connections */
+    direct_message_t direct;
+} cluster_direct_t;
+
+#pragma pack()
+
+typedef struct {
+    uint32_t hash;
+    uint32_t handle;          /* dense, in the order names were interned */
+    void *value;
+    char name[];
+} intern_entry_t;
+
+typedef struct intern_slots intern_slots_t;
+
+/* Insert-only map from a string to a 32-bit handle; lookups take no lock. */
+typedef struct {
+    intern_slots_t *slots;
+    uint32_t count;
+    pthread_mutex_t mutex;    /* serializes inserts */
+} intern_table_t;
+
+typedef struct {
+    uint32_t rate;            /* messages per second, 0 for no limit */
+    uint32_t burst;           /* messages that may arrive back to back */
+} rate_limit_t;
+
+typedef struct {
+    uint64_t tat;             /* when the bucket will be full again (CLOCK_MONOTONIC ns), updated by CAS */
+} rate_bucket_t;
+
+typedef struct {
+    rate_bucket_t bucket;
+    int refs;                 /* logged-in connections sharing it, under users_mutex */
+} user_bucket_t;
+
+typedef enum {
+    LANE_CONTROL,             /* responses and errors, always written first */
+    LANE_CHAT,
+    LANE_BULK,                /* presence snapshots and updates */
+    LANE_COUNT
+} lane_t;
+
+typedef struct out_frame out_frame_t;
+
+typedef struct {
+    size_t length;            /* 0 when nobody needs it or it did not shrink */
+    char data[COMPRESS_BOUND(sizeof(chat_message_t))];
+} packed_frame_t;
+
+/* One chat delivery in each encoding some member of the room takes, each built once for all of them. */
+typedef struct {
+    size_t compact_length;    /* 0 when no member takes compact frames */
+    chat_compact_t compact;
+    packed_frame_t packed[2]; /* the full [0] and compact [1] frame deflated, for members that compress */
+} delivery_t;
+
+typedef struct wheel_timer wheel_timer_t;
+
+/* Runs on the timer thread with the wheel locked; returns the next due time in ms, or 0 to disarm. */
+typedef uint64_t (*timer_fn)(wheel_timer_t *timer, uint64_t now_ms);
+
+struct wheel_timer {
+    wheel_timer_t *next;
+    wheel_timer_t **pprev;    /* the link pointing at this timer, NULL when disarmed */
+    uint64_t expires;         /* in ticks */
+    timer_fn fire;
+    void *arg;
+};
+
+typedef struct {
+    wheel_timer_t *slots[TIMER_LEVELS][TIMER_SLOTS];
+    uint64_t tick;            /* last tick processed */
+    pthread_mutex_t mutex;
+    pthread_t thread;
+    volatile bool running;
+} timer_wheel_t;
+
+typedef struct {
+    out_frame_t *head;
+    out_frame_t *tail;
+    int depth;
+} out_lane_t;
+
+/* Missed messages read from the database before a replay takes the room lock. */
+typedef struct {
+    uint64_t since_seq;       /* the replay covers everything after this */
+    stored_message_t *messages;
+    int count;
+} history_t;
+
+typedef enum {
+    LOAD_NORMAL,
+    LOAD_SHEDDING,            /* presence and database history are skipped */
+    LOAD_REFUSING             /* ... and new connections are turned away */
+} load_state_t;
+
+typedef struct {
+    int state;                /* load_state_t; read without locking */
+    uint32_t budget_ms;
+    uint64_t queued;          /* frames waiting on every connection's lanes; atomic */
+    uint64_t chat_delay_ms;   /* worst chat frame queueing delay since the last check; atomic */
+    int calm;                 /* checks in a row that asked for a lower level */
+    wheel_timer_t timer;
+} load_monitor_t;
+
 typedef struct {
     int sockfd;
+    uint32_t conn_id;
     struct sockaddr_in addr;
     char username[MAX_USERNAME_LEN];
+    uint32_t user_id;         /* interned username, set at login */
     bool authenticated;
     pthread_t thread;
-    char current_room_id[MAX_ROOM_ID_LEN];
+    pthread_mutex_t send_mutex;  /* guards the lanes and the flags below */
+    pthread_cond_t send_ready;
+    pthread_t writer;         /* drains the lanes to the socket */
+    out_lane_t lanes[LANE_COUNT];
+    bool closing;             /* the writer should exit */
+    bool slow;                /* a lane overflowed or a write failed; further frames are refused */
+    uint64_t *room_bits;      /* subscriptions, indexed by room handle; owned by the client's thread */
+    uint32_t room_words;
+    uint32_t room_count;
+    int next_user;            /* next connection in the same user bucket, -1 at the end */
+    rate_bucket_t rate;
+    user_bucket_t *user_rate; /* shared by every connection of the user on this node */
+    uint64_t limited_at;      /* when we last told the client to slow down */
+    wheel_timer_t timer;      /* checks the auth, idle and write-stall deadlines */
+    uint64_t connected_ms;    /* the times below are monotonic ms */
+    uint64_t last_rx_ms;      /* last inbound frame, stored atomically by the client's thread */
+    uint64_t ping_sent_ms;
+    uint64_t write_since_ms;  /* start of the frame being written, 0 when idle; atomic */
+    uint32_t request_id;      /* tag of the request being handled, 0 if untagged; client's thread only */
+    uint16_t version;         /* protocol version agreed in the hello, 1 without one */
+    uint32_t capabilities;    /* CAP_* granted in the hello; stored atomically by the client's thread */
+    compress_stream_t *deflater;  /* set under send_mutex once compression is on; the writer's */
+    compress_stream_t *inflater;  /* client's thread only */
     bool connected;
 } client_t;
 
+typedef struct {
+    char username[MAX_USERNAME_LEN];
+    uint64_t nodes;           /* on the user's home node: nodes where they are logged in */
+} user_home_t;
+
+typedef struct sender_window sender_window_t;
+
+struct sender_window {
+    sender_window_t *next;    /* hash chain */
+    uint32_t user_id;
+    uint64_t used;            /* dedup_table_t.clock at the sender's last message */
+    uint64_t ring[DEDUP_WINDOW];  /* ids in arrival order, the oldest is evicted first */
+    int ring_next;
+    uint64_t set[DEDUP_SLOTS];    /* the same ids, linear probing, 0 when empty */
+};
+
+typedef struct {
+    sender_window_t *buckets[DEDUP_BUCKETS];
+    int count;
+    uint64_t clock;
+    pthread_mutex_t mutex;
+} dedup_table_t;
+
+typedef struct {
+    uint64_t seq;             /* highest sequence number the member acked, 0 until it acks */
+    bool lagging;             /* behind by more than the retransmit window */
+} member_ack_t;
+
+typedef struct {
+    char username[MAX_USERNAME_LEN];
+    uint64_t nodes;           /* nodes with a member by this name */
+} roster_entry_t;
+
+typedef struct {
+    char username[MAX_USERNAME_LEN];
+    bool was_present;         /* at the start of the current window */
+} presence_change_t;
+
+typedef struct {
+    char room_id[MAX_ROOM_ID_LEN];
+    char room_name[MAX_ROOM_NAME_LEN];
+    bool named;               /* room_name is filled in; set once, with release ordering */
+    uint32_t handle;          /* index in server_t.rooms, stable for the server's lifetime */
+    uint64_t last_seq;
+    int *members;             /* client indices */
+    member_ack_t *acks;       /* parallel to members */
+    int member_count;
+    int member_capacity;
+    pthread_mutex_t lock;     /* serializes sequencing, delivery and membership within the room */
+    rate_bucket_t rate;
+    uint64_t rate_window;     /* second the delivery count below belongs to */
+    uint32_t window_count;
+    uint32_t recent_rate;     /* deliveries in the previous full second */
+    bool hot;
+    uint32_t fanout_pending;  /* jobs still queued on fan-out workers, updated atomically */
+    chat_message_t *window;   /* last RETRANSMIT_WINDOW messages delivered here, slotted by seq */
+    compress_stream_t *packer;    /* deflates each delivery once for all compressing members */
+    uint16_t owner;           /* cluster node that sequences the room */
+    uint64_t interest;        /* on the owner: bitmask of nodes with members here */
+    bool interest_ready;      /* elsewhere: the owner has acked our subscription */
+    bool interest_pending;
+    pthread_cond_t interest_cond;
+    roster_entry_t *roster;   /* on the owner: who is here; elsewhere: mirror of the owner's */
+    int roster_count;
+    int roster_capacity;
+    presence_change_t *changes;   /* on the owner: names to announce at the end of the window */
+    int change_count;
+    int change_capacity;
+} room_state_t;
+
+typedef struct {
+    uint16_t node_id;
+    char host[64];
+    int port;
+    bool configured;
+    int sockfd;               /* outbound link, -1 while down */
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    char *buf;                /* frames waiting for the next batched write */
+    size_t len;
+    size_t capacity;
+    uint64_t dropped;
+} cluster_peer_t;
+
+typedef struct {
+    int fd;
+    pthread_t thread;
+    bool used;
+    bool done;                /* reader exited, thread waiting to be joined */
+    uint16_t node_id;
+} cluster_inbound_t;
+
+typedef struct {
+    uint16_t self_id;
+    int listen_fd;
+    pthread_t accept_thread;
+    volatile bool running;
+    cluster_peer_t peers[MAX_CLUSTER_NODES];
+    hash_ring_t ring;
+    cluster_inbound_t inbound[MAX_CLUSTER_NODES * 2];
+    pthread_mutex_t inbound_mutex;
+} cluster_t;
+
+typedef struct fanout_job fanout_job_t;
+
+typedef struct {
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t ready;     /* jobs queued */
+    fanout_job_t *head;
+    fanout_job_t *tail;
+    int depth;
+    uint64_t dropped;         /* jobs refused because the queue was full */
+} fanout_worker_t;
+
+typedef struct {
+    fanout_worker_t *workers;
+    int count;
+    volatile bool running;
+} fanout_pool_t;
+
+typedef struct bus_ring bus_ring_t;
+
+typedef struct {
+    char name[64];            /* shm_open name, lives under /dev/shm */
+    bus_ring_t *ring;
+    size_t size;
+    uint64_t cursor;          /* next ticket this process reads */
+    pthread_t thread;
+    volatile bool running;
+    uint64_t lapped;
+} shm_bus_t;
+
 typedef struct {
     int server_sockfd;
     database_t db;
     client_t clients[MAX_CLIENTS];
     pthread_mutex_t clients_mutex;
+    room_state_t **rooms;
+    int room_count;
+    int room_capacity;
+    intern_table_t room_names;    /* room_id -> handle, with the room as the value */
+    intern_table_t user_names;    /* every username seen on this node -> user handle */
+    pthread_mutex_t rooms_mutex;
+    int user_index[USER_BUCKETS];   /* username hash -> first logged-in client, chained by next_user */
+    pthread_mutex_t users_mutex;
+    user_home_t *homes;       /* open-addressed by username, for users whose home is this node */
+    uint32_t home_size;
+    uint32_t home_count;
+    pthread_mutex_t homes_mutex;  /* serializes routing, offline queueing and draining per home */
+    uint32_t next_conn_id;
+    rate_limit_t conn_limit;
+    rate_limit_t user_limit;
+    rate_limit_t room_limit;
+    capture_writer_t *capture;
+    cluster_t *cluster;       /* NULL when running standalone */
+    shm_bus_t *bus;           /* replaces the relay links between co-located nodes */
+    fanout_pool_t *fanout;    /* NULL when every room is delivered inline */
+    timer_wheel_t timers;
+    dedup_table_t dedup;      /* recent message ids per sender, for rooms this node owns */
+    load_monitor_t load;
+    uint32_t ping_interval_ms;   /* 0 disables pings and the idle timeout */
+    uint32_t auth_timeout_ms;
+    bool compression;         /* granted to clients that ask for it in their hello */
+    pthread_t presence_thread;
+    volatile bool presence_running;
     bool running;
 } server_t;
 
 int server_init(server_t *server, const char *db_path);
 int server_start(server_t *server, int port);
 void server_stop(server_t *server);
+int server_enable_capture(server_t *server, const char *path);
 void *handle_client(void *arg);
 bool server_authenticate(server_t *server, int client_index, const char *username, const char *password);
 int server_register_user(server_t *server, int client_index, const char *username, const char *password);
 int server_create_room(server_t *server, int client_index, const char *room_name, char *room_id_out);
-int server_join_room(server_t *server, int client_index, const char *room_id);
-int server_leave_room(server_t *server, int client_index);
-int server_broadcast_message(server_t *server, const char *room_id, const char *username, const char *message);
+int server_join_room(server_t *server, int client_index, const char *room_id,
+                     bool resume, uint64_t since_seq, uint64_t *head_seq_out, char *room_name_out);
+void server_join_rooms(server_t *server, int client_index, login_join_entry_t *entries, int count,
+                       login_join_response_t *resp);
+int server_leave_room(server_t *server, int client_index, const char *room_id);
+void server_leave_all_rooms(server_t *server, int client_index);
+room_state_t *server_get_room(server_t *server, const char *room_id);
+room_state_t *server_find_room(server_t *server, const char *room_id);
+room_state_t **server_snapshot_rooms(server_t *server, int *count_out);
+bool server_client_in_room(const client_t *client, const room_state_t *room);
+int server_subscribe(server_t *server, int client_index, room_state_t *room);
+void server_unsubscribe(server_t *server, int client_index, room_state_t *room);
+int server_send(server_t *server, int client_index, const void *message, size_t length);
+int server_send_lane(server_t *server, int client_index, const void *message, size_t length, lane_t lane);
+int server_reply(server_t *server, int client_index, const void *message, size_t length);
+int server_send_chat(server_t *server, int client_index, const chat_message_t *chat_msg,
+                     const delivery_t *delivery, lane_t lane);
+int server_send_chat_conn(server_t *server, int client_index, uint32_t conn_id, const chat_message_t *chat_msg,
+                          const delivery_t *delivery, lane_t lane);
+int server_start_output(server_t *server, int client_index);
+void server_stop_output(server_t *server, int client_index);
+
+uint64_t timer_now_ms(void);
+int timers_start(timer_wheel_t *wheel);
+void timers_stop(timer_wheel_t *wheel);
+void timer_arm(timer_wheel_t *wheel, wheel_timer_t *timer, uint64_t due_ms);
+void timer_cancel(timer_wheel_t *wheel, wheel_timer_t *timer);
+void server_watch_client(server_t *server, int client_index);
+void server_unwatch_client(server_t *server, int client_index);
+
+void load_start(server_t *server);
+load_state_t server_load(const server_t *server);
+void load_frame_written(server_t *server, uint64_t delay_ms);
+void server_refuse(int sockfd, const char *reason);
+
+void server_handle_hello(server_t *server, int client_index, const hello_message_t *hello);
+int server_enable_compression(server_t *server, int client_index);
+void server_free_compression(server_t *server, int client_index);
+int server_unpack(server_t *server, int client_index, char *buffer, int size, size_t buffer_size);
+void server_prepare_delivery(server_t *server, room_state_t *room, const chat_message_t *chat_msg,
+                             delivery_t *delivery);
+
+int intern_init(intern_table_t *table);
+intern_entry_t *intern_find(const intern_table_t *table, const char *name);
+intern_entry_t *intern_add(intern_table_t *table, const char *name, void *value);
+void intern_free(intern_table_t *table);
+uint32_t server_user_handle(server_t *server, const char *username);
+
+void server_free_rooms(server_t *server);
+int server_broadcast_message(server_t *server, chat_message_t *chat_msg);
 int server_add_client(server_t *server, int sockfd, struct sockaddr_in addr);
 void server_remove_client(server_t *server, int client_index);
 int server_find_client_by_sockfd(server_t *server, int sockfd);
+void server_deliver_local(server_t *server, room_state_t *room, const chat_message_t *chat_msg);
+
+void presence_start(server_t *server);
+void presence_stop(server_t *server);
+void presence_member_added(server_t *server, room_state_t *room, int client_index);
+void presence_member_removed(server_t *server, room_state_t *room, int client_index);
+void presence_send_snapshot(server_t *server, int client_index, room_state_t *room);
+void presence_set(room_state_t *room, const char *username, uint16_t node_id, bool present);
+void presence_forget_node(room_state_t *room, uint16_t node_id);
+void presence_send_roster(server_t *server, room_state_t *room, uint16_t node_id);
+void presence_apply(server_t *server, room_state_t *room, const presence_update_t *update);
+
+int fanout_start(server_t *server, int workers);
+void fanout_stop(server_t *server);
+bool fanout_offload(server_t *server, room_state_t *room, const chat_message_t *chat_msg,
+                    const delivery_t *delivery);
+
+void window_record(server_t *server, room_state_t *room, const chat_message_t *chat_msg);
+void server_fetch_history(server_t *server, room_state_t *room, uint64_t since_seq, uint16_t tail,
+                          history_t *history);
+void server_free_history(history_t *history);
+void server_replay(server_t *server, int client_index, room_state_t *room, const history_t *history, lane_t lane);
+void server_handle_ack(server_t *server, int client_index, const ack_message_t *ack, size_t length);
+
+bool dedup_seen(server_t *server, uint32_t user_id, uint64_t msg_id);
+void dedup_free(server_t *server);
+
+int rate_limit_parse(const char *spec, rate_limit_t *limit);
+bool rate_take(rate_bucket_t *bucket, const rate_limit_t *limit, uint64_t now_ns);
+void rate_refund(rate_bucket_t *bucket, const rate_limit_t *limit);
+bool server_admit_message(server_t *server, int client_index, room_state_t *room);
+void server_refund_message(server_t *server, int client_index);
+
+void server_index_user(server_t *server, int client_index);
+void server_unindex_user(server_t *server, int client_index);
+int server_send_direct(server_t *server, const char *from, const char *to, const char *message);
+void direct_route(server_t *server, const direct_message_t *direct);
+void direct_deliver_local(server_t *server, const direct_message_t *direct);
+void direct_set_online(server_t *server, const char *username, uint16_t node_id, bool online);
+void direct_forget_node(server_t *server, uint16_t node_id);
+void direct_announce(server_t *server, uint16_t node_id);
+void server_free_users(server_t *server);
+
+int server_enable_cluster(server_t *server, int node_id, const char *spec);
+void cluster_stop(server_t *server);
+uint16_t cluster_owner(const cluster_t *cluster, const char *room_id);
+bool cluster_owns(const server_t *server, const room_state_t *room);
+int cluster_ensure_interest(server_t *server, room_state_t *room);
+void cluster_drop_interest(server_t *server, room_state_t *room);
+int cluster_forward(server_t *server, room_state_t *room, const chat_message_t *chat_msg);
+void cluster_relay(server_t *server, room_state_t *room, const chat_message_t *chat_msg);
+void cluster_handle_frame(server_t *server, uint16_t from, char *buffer, int size);
+void cluster_send_presence(server_t *server, room_state_t *room, uint8_t op, const char *username);
+void cluster_send_roster(server_t *server, uint16_t node_id, const presence_update_t *update);
+uint16_t cluster_user_home(const cluster_t *cluster, const char *username);
+void cluster_send_user(server_t *server, uint16_t node_id, uint8_t op, const char *username);
+void cluster_send_direct(server_t *server, uint16_t node_id, const direct_message_t *direct, bool deliver);
+
+int server_enable_bus(server_t *server, const char *name);
+void bus_stop(server_t *server);
+int bus_publish(server_t *server, uint8_t type, uint16_t target, const chat_message_t *chat_msg);
 
 #endif
\ No newline at end of file
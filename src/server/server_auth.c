@@ -12,11 +12,17 @@ bool server_authenticate(server_t *server, int client_index, const char *usernam
     }
 
     bool authenticated = db_authenticate_user(&server->db, username, password);
+    uint32_t user_id = authenticated ? server_user_handle(server, username) : USER_HANDLE_NONE;
+    if (user_id == USER_HANDLE_NONE) {
+        authenticated = false;
+    }
     if (authenticated) {
         pthread_mutex_lock(&server->clients_mutex);
         server->clients[client_index].authenticated = true;
         safe_strcpy(server->clients[client_index].username, username, MAX_USERNAME_LEN);
+        server->clients[client_index].user_id = user_id;
         pthread_mutex_unlock(&server->clients_mutex);
+        server_index_user(server, client_index);
         
         log_message("User authenticated: %s", username);
     } else {
@@ -0,0 +1,291 @@
+#include "server.h"
+#include "../common/include/protocol.h"
+#include "../common/include/message.h"
+#include "../common/include/utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#define BUS_MAGIC 0x53424843u      /* "CHBS" */
+#define BUS_VERSION 1
+#define BUS_IDLE_WAIT_MS 100
+#define BUS_STALL_LIMIT 1000        /* 1ms waits on a claimed slot before giving up on its writer */
+
+typedef struct {
+    uint64_t seq;                   /* seqlock: 2 * ticket + 1 while written, 2 * ticket + 2 once published */
+    uint16_t target;                /* forwards: the owner that should sequence the message */
+    cluster_chat_t frame;
+} __attribute__((aligned(64))) bus_slot_t;
+
+struct bus_ring {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slot_count;
+    uint32_t slot_size;
+    uint64_t head __attribute__((aligned(64)));     /* next ticket to claim */
+    uint32_t wake __attribute__((aligned(64)));     /* futex word, bumped on every publish */
+    uint32_t waiters;
+    bus_slot_t slots[];
+};
+
+static long futex(uint32_t *word, int op, uint32_t value, const struct timespec *timeout) {
+    return syscall(SYS_futex, word, op, value, timeout, NULL, 0);
+}
+
+int bus_publish(server_t *server, uint8_t type, uint16_t target, const chat_message_t *chat_msg) {
+    if (!server || !server->bus || !server->cluster || !chat_msg) {
+        return -1;
+    }
+    bus_ring_t *ring = server->bus->ring;
+    uint64_t ticket = __atomic_fetch_add(&ring->head, 1, __ATOMIC_ACQ_REL);
+    bus_slot_t *slot = &ring->slots[ticket % ring->slot_count];
+
+    __atomic_store_n(&slot->seq, 2 * ticket + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    slot->target = target;
+    slot->frame.header.type = type;
+    slot->frame.header.length = sizeof(cluster_chat_t);
+    slot->frame.node_id = server->cluster->self_id;
+    memcpy(&slot->frame.chat, chat_msg, sizeof(chat_message_t));
+    __atomic_store_n(&slot->seq, 2 * ticket + 2, __ATOMIC_RELEASE);
+
+    __atomic_add_fetch(&ring->wake, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&ring->waiters, __ATOMIC_SEQ_CST) > 0) {
+        futex(&ring->wake, FUTEX_WAKE, INT_MAX, NULL);
+    }
+    return 0;
+}
+
+/* Returns 1 with the next entry copied out, 0 if there is none yet, -1 if writers lapped us. */
+static int bus_read(shm_bus_t *bus, bus_slot_t *out) {
+    bus_ring_t *ring = bus->ring;
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    if (bus->cursor >= head) {
+        return 0;
+    }
+    if (head - bus->cursor > ring->slot_count) {
+        return -1;
+    }
+    bus_slot_t *slot = &ring->slots[bus->cursor % ring->slot_count];
+    uint64_t want = 2 * bus->cursor + 2;
+    uint64_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+    if (seq < want) {
+        return 0;
+    }
+    if (seq > want) {
+        return -1;
+    }
+    memcpy(out, slot, sizeof(bus_slot_t));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != seq) {
+        return -1;
+    }
+    bus->cursor++;
+    return 1;
+}
+
+/*
+ * After losing entries, bring every room we serve up to date from the
+ * database. The rows are read without room->lock, so live delivery and acks
+ * in the room never wait on the disk; under the lock only rows newer than
+ * what the room has seen since are delivered.
+ */
+static void catch_up(server_t *server) {
+    int count = 0;
+    room_state_t **rooms = server_snapshot_rooms(server, &count);
+    chat_message_t *chat_msg = create_chat_message("", "", "");
+    if (!rooms || !chat_msg) {
+        free(rooms);
+        free_message(chat_msg);
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        room_state_t *room = rooms[i];
+        if (cluster_owns(server, room)) {
+            continue;
+        }
+        pthread_mutex_lock(&room->lock);
+        uint64_t since_seq = room->last_seq;
+        bool has_members = room->member_count > 0;
+        pthread_mutex_unlock(&room->lock);
+
+        if (!has_members) {
+            uint64_t last_seq = 0;
+            if (db_get_last_message_seq(&server->db, room->room_id, &last_seq) == 0) {
+                pthread_mutex_lock(&room->lock);
+                if (last_seq > room->last_seq) {
+                    room->last_seq = last_seq;
+                }
+                pthread_mutex_unlock(&room->lock);
+            }
+            continue;
+        }
+        stored_message_t *messages = NULL;
+        int found = 0;
+        if (db_get_messages_since(&server->db, room->room_id, since_seq, MAX_HISTORY_REPLAY, &messages,
+                                  &found) != 0) {
+            continue;
+        }
+        safe_strcpy(chat_msg->room_id, room->room_id, MAX_ROOM_ID_LEN);
+        pthread_mutex_lock(&room->lock);
+        for (int j = 0; j < found; j++) {
+            if (messages[j].seq <= room->last_seq) {
+                continue;
+            }
+            safe_strcpy(chat_msg->username, messages[j].username, MAX_USERNAME_LEN);
+            safe_strcpy(chat_msg->message, messages[j].body, MAX_MESSAGE_LEN);
+            chat_msg->seq = messages[j].seq;
+            server_deliver_local(server, room, chat_msg);
+            room->last_seq = messages[j].seq;
+        }
+        pthread_mutex_unlock(&room->lock);
+        free(messages);
+    }
+    free_message(chat_msg);
+    free(rooms);
+}
+
+static void *bus_reader(void *arg) {
+    server_t *server = (server_t *)arg;
+    shm_bus_t *bus = server->bus;
+    bus_ring_t *ring = bus->ring;
+    uint16_t self_id = server->cluster->self_id;
+    bus_slot_t entry;
+    int stalls = 0;
+
+    while (bus->running) {
+        uint32_t wake = __atomic_load_n(&ring->wake, __ATOMIC_ACQUIRE);
+        int rc = bus_read(bus, &entry);
+        if (rc > 0) {
+            stalls = 0;
+            if (entry.frame.node_id == self_id ||
+                (entry.frame.header.type == CLUSTER_FORWARD && entry.target != self_id)) {
+                continue;
+            }
+            cluster_handle_frame(server, entry.frame.node_id, (char *)&entry.frame, sizeof(cluster_chat_t));
+            continue;
+        }
+        if (rc < 0 || stalls > BUS_STALL_LIMIT) {
+            uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+            bus->lapped++;
+            log_message("Bus %s: reader fell behind, skipped %llu entries and caught up from the database",
+                        bus->name, (unsigned long long)(head - bus->cursor));
+            bus->cursor = head;
+            stalls = 0;
+            catch_up(server);
+            continue;
+        }
+
+        /* A claimed slot is usually filled within microseconds; poll it closely. */
+        bool pending = bus->cursor < __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        stalls = pending ? stalls + 1 : 0;
+        struct timespec timeout = { 0, (pending ? 1 : BUS_IDLE_WAIT_MS) * 1000000L };
+        __atomic_add_fetch(&ring->waiters, 1, __ATOMIC_SEQ_CST);
+        futex(&ring->wake, FUTEX_WAIT, wake, &timeout);
+        __atomic_sub_fetch(&ring->waiters, 1, __ATOMIC_SEQ_CST);
+    }
+    return NULL;
+}
+
+static bus_ring_t *map_ring(const char *name, size_t size) {
+    bool creator = true;
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0 && errno == EEXIST) {
+        creator = false;
+        fd = shm_open(name, O_RDWR, 0);
+    }
+    if (fd < 0) {
+        return NULL;
+    }
+    if (creator && ftruncate(fd, (off_t)size) != 0) {
+        close(fd);
+        shm_unlink(name);
+        return NULL;
+    }
+    /* Another node may have just created it; give it a moment to size and initialize the ring. */
+    struct stat st;
+    for (int i = 0; !creator && (fstat(fd, &st) != 0 || (size_t)st.st_size < size) && i < 100; i++) {
+        usleep(10000);
+    }
+    if (!creator && (fstat(fd, &st) != 0 || (size_t)st.st_size != size)) {
+        close(fd);
+        return NULL;
+    }
+    bus_ring_t *ring = (bus_ring_t *)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ring == MAP_FAILED) {
+        return NULL;
+    }
+
+    if (creator) {
+        ring->version = BUS_VERSION;
+        ring->slot_count = BUS_SLOT_COUNT;
+        ring->slot_size = sizeof(bus_slot_t);
+        __atomic_store_n(&ring->magic, BUS_MAGIC, __ATOMIC_RELEASE);
+    } else {
+        for (int i = 0; __atomic_load_n(&ring->magic, __ATOMIC_ACQUIRE) != BUS_MAGIC && i < 100; i++) {
+            usleep(10000);
+        }
+    }
+    if (ring->magic != BUS_MAGIC || ring->version != BUS_VERSION ||
+        ring->slot_count != BUS_SLOT_COUNT || ring->slot_size != sizeof(bus_slot_t)) {
+        munmap(ring, size);
+        return NULL;
+    }
+    return ring;
+}
+
+int server_enable_bus(server_t *server, const char *name) {
+    if (!server || !name || name[0] == '\0' || server->bus) {
+        return -1;
+    }
+    if (!server->cluster) {
+        log_message("The shared-memory bus needs a cluster spec to know which node owns each room");
+        return -1;
+    }
+    shm_bus_t *bus = (shm_bus_t *)calloc(1, sizeof(shm_bus_t));
+    if (!bus) {
+        return -1;
+    }
+    snprintf(bus->name, sizeof(bus->name), "/%s", name[0] == '/' ? name + 1 : name);
+    bus->size = sizeof(bus_ring_t) + (size_t)BUS_SLOT_COUNT * sizeof(bus_slot_t);
+    bus->ring = map_ring(bus->name, bus->size);
+    if (!bus->ring) {
+        log_message("Failed to open shared-memory bus %s (remove it if it is left over from another build)",
+                    bus->name);
+        free(bus);
+        return -1;
+    }
+    bus->cursor = __atomic_load_n(&bus->ring->head, __ATOMIC_ACQUIRE);
+    bus->running = true;
+    server->bus = bus;
+    if (pthread_create(&bus->thread, NULL, bus_reader, server) != 0) {
+        munmap(bus->ring, bus->size);
+        free(bus);
+        server->bus = NULL;
+        return -1;
+    }
+    log_message("Relaying through shared-memory bus /dev/shm%s (%d slots)", bus->name, BUS_SLOT_COUNT);
+    return 0;
+}
+
+void bus_stop(server_t *server) {
+    if (!server || !server->bus) {
+        return;
+    }
+    shm_bus_t *bus = server->bus;
+    bus->running = false;
+    pthread_join(bus->thread, NULL);
+    munmap(bus->ring, bus->size);
+    free(bus);
+    server->bus = NULL;
+}
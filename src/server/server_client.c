@@ -8,30 +8,245 @@
 #include <unistd.h>
 
 extern server_t *g_server;
-int server_broadcast_message(server_t *server, const char *room_id, const char *username, const char *message) {
-    if (!server || !room_id || !username || !message) {
+
+/* Caller holds room->lock. */
+void server_deliver_local(server_t *server, room_state_t *room, const chat_message_t *chat_msg) {
+    window_record(server, room, chat_msg);
+    delivery_t delivery;
+    server_prepare_delivery(server, room, chat_msg, &delivery);
+    if (fanout_offload(server, room, chat_msg, &delivery)) {
+        return;
+    }
+    for (int i = 0; i < room->member_count; i++) {
+        server_send_chat(server, room->members[i], chat_msg, &delivery, LANE_CHAT);
+    }
+}
+
+/*
+ * Sequences, stores and delivers a chat frame that was validated and stamped
+ * with its sender where it arrived. The frame is numbered in place and is
+ * itself the payload handed to the window, the members and other nodes; it
+ * is never rebuilt. The caller's buffer must stay valid until this returns.
+ */
+int server_broadcast_message(server_t *server, chat_message_t *chat_msg) {
+    if (!server || !chat_msg) {
         return -1;
     }
     
-    chat_message_t *chat_msg = create_chat_message(room_id, username, message);
-    if (!chat_msg) {
+    room_state_t *room = server_get_room(server, chat_msg->room_id);
+    if (!room) {
         return -1;
     }
+    if (!cluster_owns(server, room)) {
+        return cluster_forward(server, room, chat_msg);
+    }
+    /* Only the owner deduplicates, so a retry is caught whichever node it arrives on. */
+    if (chat_msg->msg_id != 0 &&
+        dedup_seen(server, server_user_handle(server, chat_msg->username), chat_msg->msg_id)) {
+        return 0;
+    }
     
-    pthread_mutex_lock(&server->clients_mutex);
-    for (int i = 0; i < MAX_CLIENTS; i++) {
-        if (server->clients[i].connected && 
-            server->clients[i].authenticated && 
-            strcmp(server->clients[i].current_room_id, room_id) == 0) {
-            
-            send_message(server->clients[i].sockfd, chat_msg, sizeof(chat_message_t));
-        }
+    pthread_mutex_lock(&room->lock);
+    chat_msg->seq = ++room->last_seq;
+    if (db_store_message(&server->db, chat_msg->room_id, chat_msg->seq, chat_msg->username,
+                         chat_msg->message) != 0) {
+        log_message("Failed to store message %llu in room %s", (unsigned long long)chat_msg->seq,
+                    chat_msg->room_id);
+    }
+    server_deliver_local(server, room, chat_msg);
+    if (server->bus) {
+        bus_publish(server, CLUSTER_DELIVER, 0, chat_msg);
+    } else {
+        cluster_relay(server, room, chat_msg);
     }
-    pthread_mutex_unlock(&server->clients_mutex);
-    free_message(chat_msg);   
+    pthread_mutex_unlock(&room->lock);
     return 0;
 }
 
+static void refuse(server_t *server, int client_index, uint8_t code, const char *text) {
+    error_message_t *err = create_error_message(code, text);
+    server_reply(server, client_index, err, sizeof(error_message_t));
+    free_message(err);
+}
+
+static void handle_auth(server_t *server, int client_index, void *frame, size_t length) {
+    (void)length;
+    auth_request_t *req = (auth_request_t *)frame;
+    req->username[MAX_USERNAME_LEN - 1] = '\0';
+    req->password[MAX_PASSWORD_LEN - 1] = '\0';
+    bool success = server_authenticate(server, client_index, req->username, req->password);
+    auth_response_t *resp = create_auth_response(success ? RESP_SUCCESS : RESP_AUTH_FAILED);
+    server_reply(server, client_index, resp, sizeof(auth_response_t));
+    free_message(resp);
+}
+
+static void handle_login_join(server_t *server, int client_index, void *frame, size_t length) {
+    (void)length;
+    login_join_request_t *req = (login_join_request_t *)frame;
+    req->username[MAX_USERNAME_LEN - 1] = '\0';
+    req->password[MAX_PASSWORD_LEN - 1] = '\0';
+    bool success = server_authenticate(server, client_index, req->username, req->password);
+    login_join_response_t *resp = create_login_join_response(success ? RESP_SUCCESS : RESP_AUTH_FAILED);
+    if (!resp) {
+        return;
+    }
+    if (success) {
+        server_join_rooms(server, client_index, req->entries, req->count, resp);
+    }
+    server_reply(server, client_index, resp, resp->header.length);
+    free_message(resp);
+}
+
+static void handle_register(server_t *server, int client_index, void *frame, size_t length) {
+    (void)length;
+    register_request_t *req = (register_request_t *)frame;
+    req->username[MAX_USERNAME_LEN - 1] = '\0';
+    req->password[MAX_PASSWORD_LEN - 1] = '\0';
+    int result = server_register_user(server, client_index, req->username, req->password);
+    uint8_t status = (result > 0) ? RESP_SUCCESS : 
+                    (result == -2) ? RESP_USER_EXISTS : RESP_INTERNAL_ERROR;
+    register_response_t *resp = create_register_response(status);
+    server_reply(server, client_index, resp, sizeof(register_response_t));
+    free_message(resp);
+}
+
+static void handle_create_room(server_t *server, int client_index, void *frame, size_t length) {
+    (void)length;
+    create_room_request_t *req = (create_room_request_t *)frame;
+    req->room_name[MAX_ROOM_NAME_LEN - 1] = '\0';
+    char room_id[MAX_ROOM_ID_LEN];
+    int result = server_create_room(server, client_index, req->room_name, room_id);
+    create_room_response_t *resp = create_room_response(
+        result == 0 ? RESP_SUCCESS : RESP_INTERNAL_ERROR, 
+        result == 0 ? room_id : "");
+    server_reply(server, client_index, resp, sizeof(create_room_response_t));
+    free_message(resp);
+}
+
+/*
+ * Version 1 clients send chat and join frames that end early. The receive
+ * buffer holds nothing but the frame and has room for the whole struct, so
+ * the fields they leave out are read as zero.
+ */
+static void pad_frame(void *frame, size_t length, size_t size) {
+    if (length < size) {
+        memset((char *)frame + length, 0, size - length);
+    }
+}
+
+static void handle_join_room(server_t *server, int client_index, void *frame, size_t length) {
+    pad_frame(frame, length, sizeof(join_room_request_t));
+    join_room_request_t *req = (join_room_request_t *)frame;
+    req->room_id[MAX_ROOM_ID_LEN - 1] = '\0';
+    uint64_t head_seq = 0;
+    char room_name[MAX_ROOM_NAME_LEN] = "";
+    int result = server_join_room(server, client_index, req->room_id,
+                                  req->resume != 0, req->since_seq, &head_seq, room_name);
+    join_room_response_t *resp = create_join_room_response(
+        result == 0 ? RESP_SUCCESS : RESP_ROOM_NOT_FOUND, 
+        room_name,
+        req->room_id);
+    resp->head_seq = head_seq;
+    server_reply(server, client_index, resp, sizeof(join_room_response_t));
+    free_message(resp);
+}
+
+static void handle_leave_room(server_t *server, int client_index, void *frame, size_t length) {
+    (void)length;
+    leave_room_request_t *req = (leave_room_request_t *)frame;
+    req->room_id[MAX_ROOM_ID_LEN - 1] = '\0';
+    server_leave_room(server, client_index, req->room_id);
+}
+
+static void handle_chat(server_t *server, int client_index, void *frame, size_t length) {
+    pad_frame(frame, length, sizeof(chat_message_t));
+    chat_message_t *msg = (chat_message_t *)frame;
+    msg->room_id[MAX_ROOM_ID_LEN - 1] = '\0';
+    room_state_t *room = server_find_room(server, msg->room_id);
+    if (!server_client_in_room(&server->clients[client_index], room)) {
+        refuse(server, client_index, RESP_ROOM_NOT_FOUND, "You are not in this room");
+        return;
+    }
+    if (!server_admit_message(server, client_index, room)) {
+        return;
+    }
+    /* Validated and stamped in place; the buffer itself goes out to the room, zeroed past each string. */
+    size_t used = strlen(msg->room_id);
+    memset(msg->room_id + used, 0, MAX_ROOM_ID_LEN - used);
+    memset(msg->username, 0, MAX_USERNAME_LEN);
+    safe_strcpy(msg->username, server->clients[client_index].username, MAX_USERNAME_LEN);
+    used = strnlen(msg->message, MAX_MESSAGE_LEN - 1);
+    memset(msg->message + used, 0, MAX_MESSAGE_LEN - used);
+    msg->header.length = sizeof(chat_message_t);
+    msg->seq = 0;
+    server_broadcast_message(server, msg);
+}
+
+static void handle_direct(server_t *server, int client_index, void *frame, size_t length) {
+    (void)length;
+    direct_message_t *msg = (direct_message_t *)frame;
+    msg->to[MAX_USERNAME_LEN - 1] = '\0';
+    msg->message[MAX_MESSAGE_LEN - 1] = '\0';
+    if (!server_admit_message(server, client_index, NULL)) {
+        return;
+    }
+    if (server_send_direct(server, server->clients[client_index].username, msg->to, msg->message) == -2) {
+        server_refund_message(server, client_index);
+        refuse(server, client_index, RESP_USER_NOT_FOUND, "No such user");
+    }
+}
+
+static void handle_ping(server_t *server, int client_index, void *frame, size_t length) {
+    (void)length;
+    ping_message_t *pong = create_ping_message(MSG_PONG, ((ping_message_t *)frame)->stamp);
+    if (pong) {
+        server_reply(server, client_index, pong, sizeof(ping_message_t));
+        free_message(pong);
+    }
+}
+
+static void handle_pong(server_t *server, int client_index, void *frame, size_t length) {
+    (void)server;
+    (void)client_index;
+    (void)frame;
+    (void)length;
+}
+
+static void handle_hello(server_t *server, int client_index, void *frame, size_t length) {
+    (void)length;
+    server_handle_hello(server, client_index, (hello_message_t *)frame);
+}
+
+static void handle_ack(server_t *server, int client_index, void *frame, size_t length) {
+    server_handle_ack(server, client_index, (ack_message_t *)frame, length);
+}
+
+typedef struct {
+    void (*handle)(server_t *server, int client_index, void *frame, size_t length);
+    const char *login_required;    /* refused with this before login; NULL if anyone may send it */
+} route_t;
+
+/*
+ * What the server does with each message type a client may send. Frames
+ * reach a handler only after message_check() has passed them, so a handler
+ * may read its struct up to the length it is given; it terminates every
+ * string field before using it.
+ */
+static const route_t routes[256] = {
+    [MSG_AUTH_REQUEST]     = { handle_auth, NULL },
+    [MSG_LOGIN_JOIN]       = { handle_login_join, NULL },
+    [MSG_REGISTER_REQUEST] = { handle_register, NULL },
+    [MSG_CREATE_ROOM]      = { handle_create_room, "You must be logged in to create a room" },
+    [MSG_JOIN_ROOM]        = { handle_join_room, "You must be logged in to join a room" },
+    [MSG_LEAVE_ROOM]       = { handle_leave_room, "You must be logged in to leave a room" },
+    [MSG_CHAT_MESSAGE]     = { handle_chat, "You must be logged in to send messages" },
+    [MSG_DIRECT]           = { handle_direct, "You must be logged in to send messages" },
+    [MSG_PING]             = { handle_ping, NULL },
+    [MSG_PONG]             = { handle_pong, NULL },
+    [MSG_HELLO]            = { handle_hello, NULL },
+    [MSG_ACK]              = { handle_ack, "You must be logged in to acknowledge messages" },
+};
+
 void *handle_client(void *arg) {
     int client_index = (int)(intptr_t)arg;
     server_t *server = g_server;
@@ -45,125 +260,42 @@ void *handle_client(void *arg) {
     log_message("Handling client %d", client_index);
     
     while (server->running && server->clients[client_index].connected) {
-        int recv_size = receive_message(sockfd, buffer, sizeof(buffer));
+        int recv_size = receive_tagged_message(sockfd, buffer, sizeof(buffer),
+                                               &server->clients[client_index].request_id);
         if (recv_size <= 0) {
             break;
         }
-        
-
-        message_header_t *header = (message_header_t *)buffer;  
-        switch (header->type) {
-            case MSG_AUTH_REQUEST: {
-                auth_request_t *req = (auth_request_t *)buffer;
-                bool success = server_authenticate(server, client_index, req->username, req->password);
-                auth_response_t *resp = create_auth_response(success ? RESP_SUCCESS : RESP_AUTH_FAILED);
-                send_message(sockfd, resp, sizeof(auth_response_t));
-                free_message(resp);
-                break;
-            }
-            
-            case MSG_REGISTER_REQUEST: {
-                register_request_t *req = (register_request_t *)buffer;
-                int result = server_register_user(server, client_index, req->username, req->password);
-                uint8_t status = (result > 0) ? RESP_SUCCESS : 
-                                (result == -2) ? RESP_USER_EXISTS : RESP_INTERNAL_ERROR;
-                register_response_t *resp = create_register_response(status);
-                send_message(sockfd, resp, sizeof(register_response_t));
-                free_message(resp);
-                break;
-            }
-            
-            case MSG_CREATE_ROOM: {
-                if (!server->clients[client_index].authenticated) {
-                    error_message_t *err = create_error_message(RESP_AUTH_FAILED, 
-                                                              "You must be logged in to create a room");
-                    send_message(sockfd, err, sizeof(error_message_t));
-                    free_message(err);
-                    break;
-                }
-                
-                create_room_request_t *req = (create_room_request_t *)buffer;
-                char room_id[MAX_ROOM_ID_LEN];
-                int result = server_create_room(server, client_index, req->room_name, room_id);
-                create_room_response_t *resp = create_room_response(
-                    result == 0 ? RESP_SUCCESS : RESP_INTERNAL_ERROR, 
-                    result == 0 ? room_id : "");
-                send_message(sockfd, resp, sizeof(create_room_response_t));
-                free_message(resp);
-                break;
-            }
-            
-            case MSG_JOIN_ROOM: {
-                if (!server->clients[client_index].authenticated) {
-                    error_message_t *err = create_error_message(RESP_AUTH_FAILED, 
-                                                              "You must be logged in to join a room");
-                    send_message(sockfd, err, sizeof(error_message_t));
-                    free_message(err);
-                    break;
-                }
-                
-                join_room_request_t *req = (join_room_request_t *)buffer;
-                if (server->clients[client_index].current_room_id[0] != '\0') {
-                    server_leave_room(server, client_index);
-                }
-                
-                int result = server_join_room(server, client_index, req->room_id);
-                char room_name[MAX_ROOM_NAME_LEN] = "";
-                if (result == 0) {
-                    db_get_room_name(&server->db, req->room_id, room_name, sizeof(room_name));
-                }
-                join_room_response_t *resp = create_join_room_response(
-                    result == 0 ? RESP_SUCCESS : RESP_ROOM_NOT_FOUND, 
-                    room_name,
-                    req->room_id);
-                send_message(sockfd, resp, sizeof(join_room_response_t));
-                free_message(resp);
-                break;
-            }
-            
-            case MSG_LEAVE_ROOM: {
-                if (!server->clients[client_index].authenticated) {
-                    error_message_t *err = create_error_message(RESP_AUTH_FAILED, 
-                                                              "You must be logged in to leave a room");
-                    send_message(sockfd, err, sizeof(error_message_t));
-                    free_message(err);
-                    break;
-                }
-                
-                int result = server_leave_room(server, client_index);
-                break;
-            }
-            
-            case MSG_CHAT_MESSAGE: {
-                if (!server->clients[client_index].authenticated) {
-                    error_message_t *err = create_error_message(RESP_AUTH_FAILED, 
-                                                              "You must be logged in to send messages");
-                    send_message(sockfd, err, sizeof(error_message_t));
-                    free_message(err);
-                    break;
-                }
-                
-                chat_message_t *msg = (chat_message_t *)buffer;
-                if (strcmp(server->clients[client_index].current_room_id, msg->room_id) != 0) {
-                    error_message_t *err = create_error_message(RESP_ROOM_NOT_FOUND, 
-                                                              "You are not in this room");
-                    send_message(sockfd, err, sizeof(error_message_t));
-                    free_message(err);
-                    break;
-                }
-                safe_strcpy(msg->username, server->clients[client_index].username, MAX_USERNAME_LEN);
-                server_broadcast_message(server, msg->room_id, msg->username, msg->message);
-                break;
-            }
-            
-            default: {
-                error_message_t *err = create_error_message(RESP_INTERNAL_ERROR, 
-                                                          "Unknown message type");
-                send_message(sockfd, err, sizeof(error_message_t));
-                free_message(err);
+        if (((message_header_t *)buffer)->type == MSG_COMPRESSED &&
+            (recv_size = server_unpack(server, client_index, buffer, recv_size, sizeof(buffer))) < 0) {
+            break;
+        }
+        if (((message_header_t *)buffer)->type == MSG_CHAT_COMPACT) {
+            /* Handled, and captured, as the full frame it stands for. */
+            if (chat_expand(buffer, (size_t)recv_size, (chat_message_t *)buffer) != 0) {
                 break;
             }
+            recv_size = sizeof(chat_message_t);
+        }
+        if (server->capture) {
+            capture_record_frame(server->capture, server->clients[client_index].conn_id, buffer, recv_size);
+        }
+        __atomic_store_n(&server->clients[client_index].last_rx_ms, timer_now_ms(), __ATOMIC_RELAXED);
+
+        message_header_t *header = (message_header_t *)buffer;  
+        const route_t *route = &routes[header->type];
+        if (!route->handle) {
+            refuse(server, client_index, RESP_INTERNAL_ERROR, "Unknown message type");
+            continue;
+        }
+        if (!message_check(buffer, (size_t)recv_size)) {
+            log_message("Ignoring malformed frame of type %u from client %d", header->type, client_index);
+            continue;
+        }
+        if (route->login_required && !server->clients[client_index].authenticated) {
+            refuse(server, client_index, RESP_AUTH_FAILED, route->login_required);
+            continue;
         }
+        route->handle(server, client_index, buffer, (size_t)recv_size);
     }
     
     server_remove_client(server, client_index);
@@ -0,0 +1,755 @@
+#include "server.h"
+#include "../common/include/protocol.h"
+#include "../common/include/message.h"
+#include "../common/include/utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+
+#define CLUSTER_RETRY_MS 500
+
+extern server_t *g_server;
+
+uint16_t cluster_owner(const cluster_t *cluster, const char *room_id) {
+    if (!cluster || !room_id) {
+        return 0;
+    }
+    return ring_lookup(&cluster->ring, room_id);
+}
+
+/* Each user has a home node that tracks where they are logged in and keeps their offline queue. */
+uint16_t cluster_user_home(const cluster_t *cluster, const char *username) {
+    if (!cluster || !username) {
+        return 0;
+    }
+    return ring_lookup(&cluster->ring, username);
+}
+
+bool cluster_owns(const server_t *server, const room_state_t *room) {
+    if (!server || !room) {
+        return false;
+    }
+    return !server->cluster || room->owner == server->cluster->self_id;
+}
+
+/* Queues a frame for the peer's writer; frames are flushed in batches, one write per wakeup. */
+static int cluster_send(cluster_t *cluster, uint16_t node_id, const void *frame, size_t length) {
+    if (node_id >= MAX_CLUSTER_NODES || !cluster->peers[node_id].configured || node_id == cluster->self_id) {
+        return -1;
+    }
+    cluster_peer_t *peer = &cluster->peers[node_id];
+    pthread_mutex_lock(&peer->mutex);
+    if (peer->len + length > CLUSTER_MAX_BACKLOG) {
+        if (peer->dropped++ % 1000 == 0) {
+            log_message("Cluster link to node %d is backed up, dropped %llu frames",
+                        node_id, (unsigned long long)peer->dropped);
+        }
+        pthread_mutex_unlock(&peer->mutex);
+        return -1;
+    }
+    if (peer->len + length > peer->capacity) {
+        size_t capacity = peer->capacity ? peer->capacity : 64 * 1024;
+        while (capacity < peer->len + length) {
+            capacity *= 2;
+        }
+        char *buf = (char *)realloc(peer->buf, capacity);
+        if (!buf) {
+            pthread_mutex_unlock(&peer->mutex);
+            return -1;
+        }
+        peer->buf = buf;
+        peer->capacity = capacity;
+    }
+    message_header_t *header = (message_header_t *)(peer->buf + peer->len);
+    memcpy(header, frame, length);
+    header->length = htonl((uint32_t)length);
+    peer->len += length;
+    pthread_cond_signal(&peer->cond);
+    pthread_mutex_unlock(&peer->mutex);
+    return 0;
+}
+
+static void send_room_frame(cluster_t *cluster, uint16_t node_id, uint8_t type,
+                            const char *room_id, uint64_t last_seq) {
+    cluster_room_t frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.header.type = type;
+    frame.node_id = cluster->self_id;
+    safe_strcpy(frame.room_id, room_id, MAX_ROOM_ID_LEN);
+    frame.last_seq = last_seq;
+    cluster_send(cluster, node_id, &frame, sizeof(frame));
+}
+
+/* Caller holds room->lock. Waits until the owner acks, so live frames are ordered after last_seq. */
+int cluster_ensure_interest(server_t *server, room_state_t *room) {
+    if (!server || !room) {
+        return -1;
+    }
+    if (cluster_owns(server, room) || room->interest_ready) {
+        return 0;
+    }
+    if (!room->interest_pending) {
+        room->interest_pending = true;
+        send_room_frame(server->cluster, room->owner, CLUSTER_SUBSCRIBE, room->room_id, 0);
+    }
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += CLUSTER_SUBSCRIBE_TIMEOUT_MS / 1000;
+    deadline.tv_nsec += (long)(CLUSTER_SUBSCRIBE_TIMEOUT_MS % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    while (!room->interest_ready && room->interest_pending) {
+        if (pthread_cond_timedwait(&room->interest_cond, &room->lock, &deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+    if (!room->interest_ready) {
+        room->interest_pending = false;
+        log_message("Node %d did not answer for room %s", room->owner, room->room_id);
+        return -1;
+    }
+    return 0;
+}
+
+/* Caller holds room->lock. */
+void cluster_drop_interest(server_t *server, room_state_t *room) {
+    if (!server || !server->cluster || !room || cluster_owns(server, room)) {
+        return;
+    }
+    if (room->interest_ready || room->interest_pending) {
+        room->interest_ready = false;
+        room->interest_pending = false;
+        send_room_frame(server->cluster, room->owner, CLUSTER_UNSUBSCRIBE, room->room_id, 0);
+    }
+}
+
+int cluster_forward(server_t *server, room_state_t *room, const chat_message_t *chat_msg) {
+    if (!server || !server->cluster || !room || !chat_msg) {
+        return -1;
+    }
+    if (server->bus) {
+        return bus_publish(server, CLUSTER_FORWARD, room->owner, chat_msg);
+    }
+    cluster_chat_t frame;
+    frame.header.type = CLUSTER_FORWARD;
+    frame.node_id = server->cluster->self_id;
+    memcpy(&frame.chat, chat_msg, sizeof(chat_message_t));
+    return cluster_send(server->cluster, room->owner, &frame, sizeof(frame));
+}
+
+/* Caller holds room->lock, which keeps relayed frames in sequence order on every link. */
+void cluster_relay(server_t *server, room_state_t *room, const chat_message_t *chat_msg) {
+    if (!server || !server->cluster || !room || !chat_msg || room->interest == 0) {
+        return;
+    }
+    cluster_chat_t frame;
+    frame.header.type = CLUSTER_DELIVER;
+    frame.node_id = server->cluster->self_id;
+    memcpy(&frame.chat, chat_msg, sizeof(chat_message_t));
+    uint64_t nodes = room->interest;
+    while (nodes) {
+        uint16_t node_id = (uint16_t)__builtin_ctzll(nodes);
+        nodes &= nodes - 1;
+        cluster_send(server->cluster, node_id, &frame, sizeof(frame));
+    }
+}
+
+/* Caller holds room->lock. Tells the owner this node gained or lost its last local member named username. */
+void cluster_send_presence(server_t *server, room_state_t *room, uint8_t op, const char *username) {
+    if (!server || !server->cluster || !room || !username) {
+        return;
+    }
+    cluster_presence_t frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.header.type = CLUSTER_PRESENCE;
+    frame.node_id = server->cluster->self_id;
+    safe_strcpy(frame.room_id, room->room_id, MAX_ROOM_ID_LEN);
+    frame.op = op;
+    safe_strcpy(frame.username, username, MAX_USERNAME_LEN);
+    cluster_send(server->cluster, room->owner, &frame, sizeof(frame));
+}
+
+void cluster_send_roster(server_t *server, uint16_t node_id, const presence_update_t *update) {
+    if (!server || !server->cluster || !update) {
+        return;
+    }
+    cluster_roster_t frame;
+    size_t length = offsetof(cluster_roster_t, update) + update->header.length;
+    frame.header.type = CLUSTER_ROSTER;
+    frame.node_id = server->cluster->self_id;
+    memcpy(&frame.update, update, update->header.length);
+    cluster_send(server->cluster, node_id, &frame, length);
+}
+
+void cluster_send_user(server_t *server, uint16_t node_id, uint8_t op, const char *username) {
+    if (!server || !server->cluster || !username) {
+        return;
+    }
+    cluster_user_t frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.header.type = CLUSTER_USER;
+    frame.node_id = server->cluster->self_id;
+    frame.op = op;
+    safe_strcpy(frame.username, username, MAX_USERNAME_LEN);
+    cluster_send(server->cluster, node_id, &frame, sizeof(frame));
+}
+
+void cluster_send_direct(server_t *server, uint16_t node_id, const direct_message_t *direct, bool deliver) {
+    if (!server || !server->cluster || !direct) {
+        return;
+    }
+    cluster_direct_t frame;
+    frame.header.type = CLUSTER_DIRECT;
+    frame.node_id = server->cluster->self_id;
+    frame.deliver = deliver ? 1 : 0;
+    memcpy(&frame.direct, direct, sizeof(direct_message_t));
+    if (cluster_send(server->cluster, node_id, &frame, sizeof(frame)) != 0 && !deliver) {
+        /* The home node is unreachable; queue it so it is not lost. */
+        db_queue_direct(&server->db, direct->to, direct->from, direct->message, direct->sent_at);
+    }
+}
+
+void cluster_handle_frame(server_t *server, uint16_t from, char *buffer, int size) {
+    message_header_t *header = (message_header_t *)buffer;
+    switch (header->type) {
+        case CLUSTER_FORWARD: {
+            if (size != (int)sizeof(cluster_chat_t)) {
+                break;
+            }
+            cluster_chat_t *frame = (cluster_chat_t *)buffer;
+            frame->chat.room_id[MAX_ROOM_ID_LEN - 1] = '\0';
+            frame->chat.username[MAX_USERNAME_LEN - 1] = '\0';
+            frame->chat.message[MAX_MESSAGE_LEN - 1] = '\0';
+            server_broadcast_message(server, &frame->chat);
+            break;
+        }
+
+        case CLUSTER_DELIVER: {
+            if (size != (int)sizeof(cluster_chat_t)) {
+                break;
+            }
+            cluster_chat_t *frame = (cluster_chat_t *)buffer;
+            frame->chat.room_id[MAX_ROOM_ID_LEN - 1] = '\0';
+            room_state_t *room = server_find_room(server, frame->chat.room_id);
+            if (!room) {
+                break;
+            }
+            pthread_mutex_lock(&room->lock);
+            if (frame->chat.seq > room->last_seq) {
+                room->last_seq = frame->chat.seq;
+                server_deliver_local(server, room, &frame->chat);
+            }
+            pthread_mutex_unlock(&room->lock);
+            break;
+        }
+
+        case CLUSTER_SUBSCRIBE:
+        case CLUSTER_UNSUBSCRIBE:
+        case CLUSTER_SUBSCRIBED: {
+            if (size != (int)sizeof(cluster_room_t)) {
+                break;
+            }
+            cluster_room_t *frame = (cluster_room_t *)buffer;
+            frame->room_id[MAX_ROOM_ID_LEN - 1] = '\0';
+            room_state_t *room = header->type == CLUSTER_UNSUBSCRIBE ? server_find_room(server, frame->room_id)
+                                                                    : server_get_room(server, frame->room_id);
+            if (!room) {
+                break;
+            }
+            pthread_mutex_lock(&room->lock);
+            if (header->type == CLUSTER_SUBSCRIBE && cluster_owns(server, room)) {
+                room->interest |= 1ULL << from;
+                presence_send_roster(server, room, from);
+                send_room_frame(server->cluster, from, CLUSTER_SUBSCRIBED, room->room_id, room->last_seq);
+            } else if (header->type == CLUSTER_UNSUBSCRIBE) {
+                room->interest &= ~(1ULL << from);
+            } else if (header->type == CLUSTER_SUBSCRIBED && room->owner == from) {
+                if (frame->last_seq > room->last_seq) {
+                    room->last_seq = frame->last_seq;
+                }
+                if (room->interest_pending || room->member_count > 0) {
+                    room->interest_ready = true;
+                    room->interest_pending = false;
+                    pthread_cond_broadcast(&room->interest_cond);
+                } else {
+                    /* The joiner gave up waiting; don't keep a subscription nobody uses. */
+                    send_room_frame(server->cluster, from, CLUSTER_UNSUBSCRIBE, room->room_id, 0);
+                }
+            }
+            pthread_mutex_unlock(&room->lock);
+            break;
+        }
+
+        case CLUSTER_PRESENCE: {
+            if (size != (int)sizeof(cluster_presence_t)) {
+                break;
+            }
+            cluster_presence_t *frame = (cluster_presence_t *)buffer;
+            frame->room_id[MAX_ROOM_ID_LEN - 1] = '\0';
+            frame->username[MAX_USERNAME_LEN - 1] = '\0';
+            room_state_t *room = server_get_room(server, frame->room_id);
+            if (!room) {
+                break;
+            }
+            pthread_mutex_lock(&room->lock);
+            if (cluster_owns(server, room)) {
+                presence_set(room, frame->username, from, frame->op == PRESENCE_JOIN);
+            }
+            pthread_mutex_unlock(&room->lock);
+            break;
+        }
+
+        case CLUSTER_ROSTER: {
+            cluster_roster_t *frame = (cluster_roster_t *)buffer;
+            size_t offset = offsetof(cluster_roster_t, update);
+            if (size < (int)(offset + PRESENCE_UPDATE_SIZE(0)) || frame->update.count > PRESENCE_MAX_ENTRIES ||
+                size != (int)(offset + PRESENCE_UPDATE_SIZE(frame->update.count))) {
+                break;
+            }
+            frame->update.room_id[MAX_ROOM_ID_LEN - 1] = '\0';
+            room_state_t *room = server_find_room(server, frame->update.room_id);
+            if (!room) {
+                break;
+            }
+            pthread_mutex_lock(&room->lock);
+            if (room->owner == from) {
+                presence_apply(server, room, &frame->update);
+            }
+            pthread_mutex_unlock(&room->lock);
+            break;
+        }
+
+        case CLUSTER_USER: {
+            if (size != (int)sizeof(cluster_user_t)) {
+                break;
+            }
+            cluster_user_t *frame = (cluster_user_t *)buffer;
+            frame->username[MAX_USERNAME_LEN - 1] = '\0';
+            if (cluster_user_home(server->cluster, frame->username) == server->cluster->self_id) {
+                direct_set_online(server, frame->username, from, frame->op == PRESENCE_JOIN);
+            }
+            break;
+        }
+
+        case CLUSTER_DIRECT: {
+            if (size != (int)sizeof(cluster_direct_t)) {
+                break;
+            }
+            cluster_direct_t *frame = (cluster_direct_t *)buffer;
+            frame->direct.to[MAX_USERNAME_LEN - 1] = '\0';
+            frame->direct.from[MAX_USERNAME_LEN - 1] = '\0';
+            frame->direct.message[MAX_MESSAGE_LEN - 1] = '\0';
+            if (frame->deliver) {
+                direct_deliver_local(server, &frame->direct);
+            } else {
+                direct_route(server, &frame->direct);
+            }
+            break;
+        }
+
+        default:
+            break;
+    }
+}
+
+static void forget_node(server_t *server, uint16_t node_id) {
+    int count = 0;
+    room_state_t **rooms = server_snapshot_rooms(server, &count);
+    if (!rooms) {
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        pthread_mutex_lock(&rooms[i]->lock);
+        rooms[i]->interest &= ~(1ULL << node_id);
+        if (cluster_owns(server, rooms[i])) {
+            presence_forget_node(rooms[i], node_id);
+        }
+        pthread_mutex_unlock(&rooms[i]->lock);
+    }
+    free(rooms);
+    direct_forget_node(server, node_id);
+}
+
+static void *cluster_reader(void *arg) {
+    server_t *server = g_server;
+    cluster_t *cluster = server->cluster;
+    cluster_inbound_t *link = &cluster->inbound[(int)(intptr_t)arg];
+    char buffer[2048];
+
+    int size = receive_message(link->fd, buffer, sizeof(buffer));
+    cluster_hello_t *hello = (cluster_hello_t *)buffer;
+    if (size == (int)sizeof(cluster_hello_t) && hello->header.type == CLUSTER_HELLO &&
+        hello->node_id < MAX_CLUSTER_NODES && cluster->peers[hello->node_id].configured &&
+        hello->node_id != cluster->self_id) {
+        uint16_t from = hello->node_id;
+        link->node_id = from;
+        log_message("Cluster link from node %d up", from);
+        while (cluster->running) {
+            size = receive_message(link->fd, buffer, sizeof(buffer));
+            if (size <= 0) {
+                break;
+            }
+            cluster_handle_frame(server, from, buffer, size);
+        }
+        forget_node(server, from);
+        log_message("Cluster link from node %d down", from);
+    }
+
+    pthread_mutex_lock(&cluster->inbound_mutex);
+    close(link->fd);
+    link->fd = -1;
+    link->done = true;
+    pthread_mutex_unlock(&cluster->inbound_mutex);
+    return NULL;
+}
+
+static void *cluster_acceptor(void *arg) {
+    server_t *server = (server_t *)arg;
+    cluster_t *cluster = server->cluster;
+
+    while (cluster->running) {
+        int fd = accept(cluster->listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            break;
+        }
+        int opt = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+
+        pthread_mutex_lock(&cluster->inbound_mutex);
+        int slot = -1;
+        for (int i = 0; i < MAX_CLUSTER_NODES * 2; i++) {
+            if (cluster->inbound[i].used && cluster->inbound[i].done) {
+                pthread_join(cluster->inbound[i].thread, NULL);
+                cluster->inbound[i].used = false;
+            }
+            if (!cluster->inbound[i].used && slot < 0) {
+                slot = i;
+            }
+        }
+        if (slot < 0 || !cluster->running) {
+            pthread_mutex_unlock(&cluster->inbound_mutex);
+            close(fd);
+            continue;
+        }
+        cluster_inbound_t *link = &cluster->inbound[slot];
+        link->fd = fd;
+        link->used = true;
+        link->done = false;
+        if (pthread_create(&link->thread, NULL, cluster_reader, (void *)(intptr_t)slot) != 0) {
+            link->used = false;
+            close(fd);
+        }
+        pthread_mutex_unlock(&cluster->inbound_mutex);
+    }
+    return NULL;
+}
+
+static int connect_peer(const cluster_peer_t *peer) {
+    char port[16];
+    snprintf(port, sizeof(port), "%d", peer->port);
+    struct addrinfo hints;
+    struct addrinfo *result = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(peer->host, port, &hints, &result) != 0) {
+        return -1;
+    }
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd >= 0 && connect(fd, result->ai_addr, result->ai_addrlen) != 0) {
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(result);
+    if (fd >= 0) {
+        int opt = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+    }
+    return fd;
+}
+
+static int write_all(int fd, const char *data, size_t length) {
+    while (length > 0) {
+        ssize_t sent = send(fd, data, length, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            return -1;
+        }
+        data += sent;
+        length -= (size_t)sent;
+    }
+    return 0;
+}
+
+/* A restarted owner has lost our interest bits, so every new link re-announces them. */
+static void resubscribe(server_t *server, uint16_t node_id) {
+    int count = 0;
+    room_state_t **rooms = server_snapshot_rooms(server, &count);
+    if (!rooms) {
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        room_state_t *room = rooms[i];
+        if (room->owner != node_id) {
+            continue;
+        }
+        pthread_mutex_lock(&room->lock);
+        if (room->interest_ready || room->interest_pending) {
+            send_room_frame(server->cluster, node_id, CLUSTER_SUBSCRIBE, room->room_id, 0);
+            /* Announce each local user once; presence_member_added only fires on the first connection. */
+            for (int j = 0; j < room->member_count; j++) {
+                const char *username = server->clients[room->members[j]].username;
+                bool seen = false;
+                for (int k = 0; k < j && !seen; k++) {
+                    seen = server->clients[room->members[k]].user_id == server->clients[room->members[j]].user_id;
+                }
+                if (!seen) {
+                    cluster_send_presence(server, room, PRESENCE_JOIN, username);
+                }
+            }
+        }
+        pthread_mutex_unlock(&room->lock);
+    }
+    free(rooms);
+}
+
+static void retry_deadline(struct timespec *deadline) {
+    clock_gettime(CLOCK_REALTIME, deadline);
+    deadline->tv_nsec += CLUSTER_RETRY_MS * 1000000L;
+    if (deadline->tv_nsec >= 1000000000L) {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000L;
+    }
+}
+
+/* Peers never write on our outbound link, so anything readable means it was closed. */
+static bool link_alive(int fd) {
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    return poll(&pfd, 1, 0) == 0;
+}
+
+static void *cluster_writer(void *arg) {
+    server_t *server = g_server;
+    cluster_t *cluster = server->cluster;
+    cluster_peer_t *peer = (cluster_peer_t *)arg;
+    char *out = NULL;
+    size_t out_capacity = 0;
+    size_t out_len = 0;
+    struct timespec deadline;
+
+    while (cluster->running) {
+        if (peer->sockfd >= 0 && !link_alive(peer->sockfd)) {
+            log_message("Cluster link to node %d down", peer->node_id);
+            pthread_mutex_lock(&peer->mutex);
+            close(peer->sockfd);
+            peer->sockfd = -1;
+            pthread_mutex_unlock(&peer->mutex);
+        }
+        if (peer->sockfd < 0) {
+            int fd = connect_peer(peer);
+            if (fd < 0) {
+                retry_deadline(&deadline);
+                pthread_mutex_lock(&peer->mutex);
+                if (cluster->running) {
+                    pthread_cond_timedwait(&peer->cond, &peer->mutex, &deadline);
+                }
+                pthread_mutex_unlock(&peer->mutex);
+                continue;
+            }
+            cluster_hello_t hello;
+            hello.header.type = CLUSTER_HELLO;
+            hello.header.length = sizeof(cluster_hello_t);
+            hello.node_id = cluster->self_id;
+            if (send_message(fd, &hello, sizeof(hello)) != 0) {
+                close(fd);
+                continue;
+            }
+            pthread_mutex_lock(&peer->mutex);
+            peer->sockfd = fd;
+            pthread_mutex_unlock(&peer->mutex);
+            log_message("Cluster link to node %d (%s:%d) up", peer->node_id, peer->host, peer->port);
+            resubscribe(server, peer->node_id);
+            direct_announce(server, peer->node_id);
+        }
+
+        /* A batch that found the link dead is kept and goes out on the new one. */
+        if (out_len == 0) {
+            retry_deadline(&deadline);
+            pthread_mutex_lock(&peer->mutex);
+            while (cluster->running && peer->len == 0) {
+                if (pthread_cond_timedwait(&peer->cond, &peer->mutex, &deadline) == ETIMEDOUT) {
+                    break;
+                }
+            }
+            char *batch = peer->buf;
+            size_t batch_capacity = peer->capacity;
+            out_len = peer->len;
+            peer->buf = out;
+            peer->capacity = out_capacity;
+            peer->len = 0;
+            out = batch;
+            out_capacity = batch_capacity;
+            pthread_mutex_unlock(&peer->mutex);
+        }
+        if (out_len == 0 || !link_alive(peer->sockfd)) {
+            continue;
+        }
+
+        if (write_all(peer->sockfd, out, out_len) != 0) {
+            log_message("Cluster link to node %d down, lost %zu bytes", peer->node_id, out_len);
+            pthread_mutex_lock(&peer->mutex);
+            close(peer->sockfd);
+            peer->sockfd = -1;
+            pthread_mutex_unlock(&peer->mutex);
+        }
+        out_len = 0;
+    }
+
+    free(out);
+    return NULL;
+}
+
+static int listen_on(const cluster_peer_t *self) {
+    char port[16];
+    snprintf(port, sizeof(port), "%d", self->port);
+    struct addrinfo hints;
+    struct addrinfo *result = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    if (getaddrinfo(self->host, port, &hints, &result) != 0) {
+        return -1;
+    }
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int opt = 1;
+    if (fd >= 0 && (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) != 0 ||
+                    bind(fd, result->ai_addr, result->ai_addrlen) != 0 ||
+                    listen(fd, MAX_CLUSTER_NODES) != 0)) {
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(result);
+    return fd;
+}
+
+int server_enable_cluster(server_t *server, int node_id, const char *spec) {
+    if (!server || !spec || node_id < 0 || node_id >= MAX_CLUSTER_NODES || server->cluster) {
+        return -1;
+    }
+    cluster_t *cluster = (cluster_t *)calloc(1, sizeof(cluster_t));
+    if (!cluster) {
+        return -1;
+    }
+    ring_node_t nodes[MAX_CLUSTER_NODES];
+    int count = ring_parse_nodes(spec, nodes, MAX_CLUSTER_NODES);
+    for (int i = 0; i < count; i++) {
+        cluster_peer_t *peer = &cluster->peers[nodes[i].node_id];
+        peer->configured = true;
+        peer->node_id = nodes[i].node_id;
+        peer->port = nodes[i].port;
+        safe_strcpy(peer->host, nodes[i].host, sizeof(peer->host));
+    }
+    if (count <= 0 || !cluster->peers[node_id].configured) {
+        log_message("Invalid cluster spec (expected ID=HOST:PORT,... including node %d): %s", node_id, spec);
+        free(cluster);
+        return -1;
+    }
+    cluster->self_id = (uint16_t)node_id;
+    ring_build(&cluster->ring, nodes, count);
+
+    cluster->listen_fd = listen_on(&cluster->peers[node_id]);
+    if (cluster->listen_fd < 0) {
+        log_message("Failed to listen for cluster links on %s:%d",
+                    cluster->peers[node_id].host, cluster->peers[node_id].port);
+        free(cluster);
+        return -1;
+    }
+    pthread_mutex_init(&cluster->inbound_mutex, NULL);
+    for (int i = 0; i < MAX_CLUSTER_NODES; i++) {
+        cluster->peers[i].sockfd = -1;
+        pthread_mutex_init(&cluster->peers[i].mutex, NULL);
+        pthread_cond_init(&cluster->peers[i].cond, NULL);
+    }
+    cluster->running = true;
+    server->cluster = cluster;
+
+    pthread_create(&cluster->accept_thread, NULL, cluster_acceptor, server);
+    for (int i = 0; i < MAX_CLUSTER_NODES; i++) {
+        if (cluster->peers[i].configured && i != node_id) {
+            pthread_create(&cluster->peers[i].thread, NULL, cluster_writer, &cluster->peers[i]);
+        }
+    }
+    log_message("Cluster node %d of %d, links on %s:%d", node_id, count,
+                cluster->peers[node_id].host, cluster->peers[node_id].port);
+    return 0;
+}
+
+void cluster_stop(server_t *server) {
+    if (!server || !server->cluster) {
+        return;
+    }
+    cluster_t *cluster = server->cluster;
+    cluster->running = false;
+
+    shutdown(cluster->listen_fd, SHUT_RDWR);
+    pthread_join(cluster->accept_thread, NULL);
+    close(cluster->listen_fd);
+
+    for (int i = 0; i < MAX_CLUSTER_NODES; i++) {
+        cluster_peer_t *peer = &cluster->peers[i];
+        if (!peer->configured || i == cluster->self_id) {
+            continue;
+        }
+        pthread_mutex_lock(&peer->mutex);
+        if (peer->sockfd >= 0) {
+            shutdown(peer->sockfd, SHUT_RDWR);
+        }
+        pthread_cond_broadcast(&peer->cond);
+        pthread_mutex_unlock(&peer->mutex);
+        pthread_join(peer->thread, NULL);
+        if (peer->sockfd >= 0) {
+            close(peer->sockfd);
+        }
+    }
+
+    pthread_mutex_lock(&cluster->inbound_mutex);
+    for (int i = 0; i < MAX_CLUSTER_NODES * 2; i++) {
+        if (cluster->inbound[i].used && !cluster->inbound[i].done) {
+            shutdown(cluster->inbound[i].fd, SHUT_RDWR);
+        }
+    }
+    pthread_mutex_unlock(&cluster->inbound_mutex);
+    for (int i = 0; i < MAX_CLUSTER_NODES * 2; i++) {
+        if (cluster->inbound[i].used) {
+            pthread_join(cluster->inbound[i].thread, NULL);
+        }
+    }
+
+    for (int i = 0; i < MAX_CLUSTER_NODES; i++) {
+        free(cluster->peers[i].buf);
+        pthread_mutex_destroy(&cluster->peers[i].mutex);
+        pthread_cond_destroy(&cluster->peers[i].cond);
+    }
+    pthread_mutex_destroy(&cluster->inbound_mutex);
+    free(cluster);
+    server->cluster = NULL;
+}
@@ -0,0 +1,111 @@
+#include "server.h"
+#include "../common/include/protocol.h"
+#include "../common/include/compress.h"
+#include "../common/include/message.h"
+#include "../common/include/utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Called on the client's thread when its hello asks for compression. Frames
+ * the writer picks up from here on are deflated, the hello reply included if
+ * it has not gone out yet; the client inflates whatever arrives marked so.
+ */
+int server_enable_compression(server_t *server, int client_index) {
+    if (!server || client_index < 0 || client_index >= MAX_CLIENTS || !server->compression) {
+        return -1;
+    }
+    client_t *client = &server->clients[client_index];
+    if (client->inflater) {
+        return 0;
+    }
+    compress_stream_t *inflater = compress_stream_create(false);
+    compress_stream_t *deflater = compress_stream_create(true);
+    if (!inflater || !deflater) {
+        compress_stream_free(inflater);
+        compress_stream_free(deflater);
+        return -1;
+    }
+    client->inflater = inflater;
+    pthread_mutex_lock(&client->send_mutex);
+    __atomic_store_n(&client->deflater, deflater, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&client->send_mutex);
+    return 0;
+}
+
+/* After the writer has stopped. */
+void server_free_compression(server_t *server, int client_index) {
+    if (!server || client_index < 0 || client_index >= MAX_CLIENTS) {
+        return;
+    }
+    client_t *client = &server->clients[client_index];
+    compress_stream_t *deflater = __atomic_exchange_n(&client->deflater, NULL, __ATOMIC_RELAXED);
+    compress_stream_free(deflater);
+    compress_stream_free(client->inflater);
+    client->inflater = NULL;
+}
+
+/*
+ * Replaces the MSG_COMPRESSED frame in buffer with the frame it carries, as
+ * if that had been received instead, and stores its request id. Returns the
+ * new size, or -1 if the client never asked for compression or sent bad data.
+ */
+int server_unpack(server_t *server, int client_index, char *buffer, int size, size_t buffer_size) {
+    if (!server || client_index < 0 || client_index >= MAX_CLIENTS || !buffer || size <= 0) {
+        return -1;
+    }
+    client_t *client = &server->clients[client_index];
+    char wire[2048 + FRAME_TAG_SIZE];
+    int wire_length = decompress_frame(client->inflater, buffer, (size_t)size, wire, sizeof(wire));
+    int length = wire_length < 0 ? -1 : decode_frame(wire, (size_t)wire_length, buffer, buffer_size,
+                                                      &client->request_id);
+    if (length < 0 || ((message_header_t *)buffer)->type == MSG_COMPRESSED) {
+        log_message("Dropping client %s: corrupt compressed frame", client->username);
+        return -1;
+    }
+    return length;
+}
+
+static void pack(room_state_t *room, const void *frame, size_t length, packed_frame_t *packed) {
+    if (!room->packer) {
+        room->packer = compress_stream_create(true);
+        if (!room->packer) {
+            return;
+        }
+    }
+    int packed_length = compress_frame(room->packer, true, frame, length, 0, packed->data, sizeof(packed->data));
+    if (packed_length > 0 && (size_t)packed_length < length) {
+        packed->length = (size_t)packed_length;
+    }
+}
+
+/*
+ * Caller holds room->lock. Builds the compact frame if any member takes it,
+ * and deflates each form of the frame on its own, once, if any member taking
+ * that form has compression on; the results go to all of them as they are. A
+ * connection's own stream would compress a little better, but then a room of
+ * N would cost N compressions per message.
+ */
+void server_prepare_delivery(server_t *server, room_state_t *room, const chat_message_t *chat_msg,
+                             delivery_t *delivery) {
+    bool compact = false;
+    bool compressing[2] = { false, false };
+    for (int i = 0; i < room->member_count; i++) {
+        client_t *client = &server->clients[room->members[i]];
+        bool member_compact = (__atomic_load_n(&client->capabilities, __ATOMIC_RELAXED) & CAP_COMPACT) != 0;
+        compact = compact || member_compact;
+        if (__atomic_load_n(&client->deflater, __ATOMIC_RELAXED)) {
+            compressing[member_compact] = true;
+        }
+    }
+    delivery->compact_length = compact ? chat_compact(chat_msg, &delivery->compact) : 0;
+    delivery->packed[0].length = 0;
+    delivery->packed[1].length = 0;
+    if (compressing[0]) {
+        pack(room, chat_msg, sizeof(chat_message_t), &delivery->packed[0]);
+    }
+    if (compressing[1]) {
+        pack(room, &delivery->compact, delivery->compact_length, &delivery->packed[1]);
+    }
+}
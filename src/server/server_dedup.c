@@ -0,0 +1,135 @@
+#include "server.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BUCKET_MASK (DEDUP_BUCKETS - 1)
+#define SLOT_MASK (DEDUP_SLOTS - 1)
+
+static uint32_t home_slot(uint64_t msg_id) {
+    return (uint32_t)((msg_id * 0x9e3779b97f4a7c15ULL) >> 32) & SLOT_MASK;
+}
+
+static bool set_contains(const sender_window_t *sender, uint64_t msg_id) {
+    for (uint32_t slot = home_slot(msg_id); sender->set[slot] != 0; slot = (slot + 1) & SLOT_MASK) {
+        if (sender->set[slot] == msg_id) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void set_insert(sender_window_t *sender, uint64_t msg_id) {
+    uint32_t slot = home_slot(msg_id);
+    while (sender->set[slot] != 0) {
+        slot = (slot + 1) & SLOT_MASK;
+    }
+    sender->set[slot] = msg_id;
+}
+
+/* Backward-shift deletion: later entries of the probe run move up, so no tombstones build up. */
+static void set_remove(sender_window_t *sender, uint64_t msg_id) {
+    uint32_t hole = home_slot(msg_id);
+    while (sender->set[hole] != msg_id) {
+        if (sender->set[hole] == 0) {
+            return;
+        }
+        hole = (hole + 1) & SLOT_MASK;
+    }
+    for (uint32_t slot = (hole + 1) & SLOT_MASK; sender->set[slot] != 0; slot = (slot + 1) & SLOT_MASK) {
+        uint32_t home = home_slot(sender->set[slot]);
+        if (((slot - home) & SLOT_MASK) >= ((slot - hole) & SLOT_MASK)) {
+            sender->set[hole] = sender->set[slot];
+            hole = slot;
+        }
+    }
+    sender->set[hole] = 0;
+}
+
+/* Caller holds the table mutex. Unlinks the sender that has been quiet the longest, for reuse. */
+static sender_window_t *evict_oldest(dedup_table_t *table) {
+    sender_window_t **oldest = NULL;
+    for (int i = 0; i < DEDUP_BUCKETS; i++) {
+        for (sender_window_t **link = &table->buckets[i]; *link; link = &(*link)->next) {
+            if (!oldest || (*link)->used < (*oldest)->used) {
+                oldest = link;
+            }
+        }
+    }
+    sender_window_t *sender = *oldest;
+    *oldest = sender->next;
+    table->count--;
+    return sender;
+}
+
+/* Caller holds the table mutex. */
+static sender_window_t *find_sender(dedup_table_t *table, uint32_t user_id) {
+    sender_window_t **bucket = &table->buckets[user_id & BUCKET_MASK];
+    for (sender_window_t *sender = *bucket; sender; sender = sender->next) {
+        if (sender->user_id == user_id) {
+            return sender;
+        }
+    }
+
+    sender_window_t *sender = table->count >= DEDUP_MAX_SENDERS ? evict_oldest(table)
+                                                                : (sender_window_t *)malloc(sizeof(sender_window_t));
+    if (!sender) {
+        return NULL;
+    }
+    memset(sender, 0, sizeof(sender_window_t));
+    sender->user_id = user_id;
+    sender->next = *bucket;
+    *bucket = sender;
+    table->count++;
+    return sender;
+}
+
+/*
+ * True if the sender's message with this id was already accepted; otherwise
+ * remembers the id. Each sender keeps its last DEDUP_WINDOW ids in a ring,
+ * indexed by a small hash set, so a retry costs one probe and is dropped
+ * before it is sequenced or stored. Id 0 is never deduplicated.
+ */
+bool dedup_seen(server_t *server, uint32_t user_id, uint64_t msg_id) {
+    if (!server || user_id == USER_HANDLE_NONE || msg_id == 0) {
+        return false;
+    }
+    dedup_table_t *table = &server->dedup;
+    pthread_mutex_lock(&table->mutex);
+    sender_window_t *sender = find_sender(table, user_id);
+    if (!sender) {
+        pthread_mutex_unlock(&table->mutex);
+        return false;
+    }
+    sender->used = ++table->clock;
+    if (set_contains(sender, msg_id)) {
+        pthread_mutex_unlock(&table->mutex);
+        return true;
+    }
+    uint64_t evicted = sender->ring[sender->ring_next];
+    if (evicted != 0) {
+        set_remove(sender, evicted);
+    }
+    sender->ring[sender->ring_next] = msg_id;
+    sender->ring_next = (sender->ring_next + 1) % DEDUP_WINDOW;
+    set_insert(sender, msg_id);
+    pthread_mutex_unlock(&table->mutex);
+    return false;
+}
+
+void dedup_free(server_t *server) {
+    if (!server) {
+        return;
+    }
+    for (int i = 0; i < DEDUP_BUCKETS; i++) {
+        sender_window_t *sender = server->dedup.buckets[i];
+        while (sender) {
+            sender_window_t *next = sender->next;
+            free(sender);
+            sender = next;
+        }
+        server->dedup.buckets[i] = NULL;
+    }
+    server->dedup.count = 0;
+    pthread_mutex_destroy(&server->dedup.mutex);
+}
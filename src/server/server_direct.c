@@ -0,0 +1,294 @@
+#include "server.h"
+#include "../common/include/protocol.h"
+#include "../common/include/message.h"
+#include "../common/include/utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static uint32_t hash_username(const char *username) {
+    uint32_t hash = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)username; *p; p++) {
+        hash ^= *p;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static uint16_t self_node(const server_t *server) {
+    return server->cluster ? server->cluster->self_id : 0;
+}
+
+static uint16_t home_node(const server_t *server, const char *username) {
+    return server->cluster ? cluster_user_home(server->cluster, username) : 0;
+}
+
+/* Caller holds users_mutex. */
+static int count_logged_in(server_t *server, uint32_t user_id) {
+    int count = 0;
+    for (int i = server->user_index[user_id & (USER_BUCKETS - 1)]; i >= 0; i = server->clients[i].next_user) {
+        count += server->clients[i].user_id == user_id;
+    }
+    return count;
+}
+
+/* Tells the user's home node whether this node has them logged in. */
+static void report_online(server_t *server, const char *username, bool online) {
+    uint16_t home = home_node(server, username);
+    if (home == self_node(server)) {
+        direct_set_online(server, username, home, online);
+    } else {
+        cluster_send_user(server, home, online ? PRESENCE_JOIN : PRESENCE_LEAVE, username);
+    }
+}
+
+void server_index_user(server_t *server, int client_index) {
+    if (!server || client_index < 0 || client_index >= MAX_CLIENTS) {
+        return;
+    }
+    client_t *client = &server->clients[client_index];
+    uint32_t bucket = client->user_id & (USER_BUCKETS - 1);
+    pthread_mutex_lock(&server->users_mutex);
+    for (int i = server->user_index[bucket]; i >= 0 && !client->user_rate; i = server->clients[i].next_user) {
+        if (server->clients[i].user_id == client->user_id) {
+            client->user_rate = server->clients[i].user_rate;
+        }
+    }
+    if (!client->user_rate) {
+        client->user_rate = (user_bucket_t *)calloc(1, sizeof(user_bucket_t));
+    }
+    if (client->user_rate) {
+        client->user_rate->refs++;
+    }
+    client->next_user = server->user_index[bucket];
+    server->user_index[bucket] = client_index;
+    bool first = count_logged_in(server, client->user_id) == 1;
+    pthread_mutex_unlock(&server->users_mutex);
+    if (first) {
+        report_online(server, client->username, true);
+    }
+}
+
+void server_unindex_user(server_t *server, int client_index) {
+    if (!server || client_index < 0 || client_index >= MAX_CLIENTS) {
+        return;
+    }
+    client_t *client = &server->clients[client_index];
+    uint32_t bucket = client->user_id & (USER_BUCKETS - 1);
+    bool found = false;
+    pthread_mutex_lock(&server->users_mutex);
+    for (int *link = &server->user_index[bucket]; *link >= 0; link = &server->clients[*link].next_user) {
+        if (*link == client_index) {
+            *link = client->next_user;
+            found = true;
+            break;
+        }
+    }
+    client->next_user = -1;
+    if (client->user_rate && --client->user_rate->refs == 0) {
+        free(client->user_rate);
+    }
+    client->user_rate = NULL;
+    bool last = found && count_logged_in(server, client->user_id) == 0;
+    pthread_mutex_unlock(&server->users_mutex);
+    if (last) {
+        report_online(server, client->username, false);
+    }
+}
+
+void direct_deliver_local(server_t *server, const direct_message_t *direct) {
+    int delivered = 0;
+    /* A name never interned here has never logged in here. */
+    intern_entry_t *user = intern_find(&server->user_names, direct->to);
+    if (user) {
+        pthread_mutex_lock(&server->users_mutex);
+        for (int i = server->user_index[user->handle & (USER_BUCKETS - 1)]; i >= 0;
+             i = server->clients[i].next_user) {
+            if (server->clients[i].user_id == user->handle &&
+                server_send(server, i, direct, sizeof(direct_message_t)) == 0) {
+                delivered++;
+            }
+        }
+        pthread_mutex_unlock(&server->users_mutex);
+    }
+    /* The user logged out while the message was on its way; keep it for their next login. */
+    if (delivered == 0) {
+        db_queue_direct(&server->db, direct->to, direct->from, direct->message, direct->sent_at);
+    }
+}
+
+/* Caller holds homes_mutex. */
+static user_home_t *find_home(server_t *server, const char *username, bool create) {
+    if (create && (server->home_count + 1) * 2 > server->home_size) {
+        uint32_t size = server->home_size ? server->home_size * 2 : 256;
+        user_home_t *homes = (user_home_t *)calloc(size, sizeof(user_home_t));
+        if (!homes) {
+            return NULL;
+        }
+        for (uint32_t i = 0; i < server->home_size; i++) {
+            if (server->homes[i].username[0] == '\0') {
+                continue;
+            }
+            uint32_t slot = hash_username(server->homes[i].username) & (size - 1);
+            while (homes[slot].username[0] != '\0') {
+                slot = (slot + 1) & (size - 1);
+            }
+            homes[slot] = server->homes[i];
+        }
+        free(server->homes);
+        server->homes = homes;
+        server->home_size = size;
+    }
+    if (server->home_size == 0) {
+        return NULL;
+    }
+    uint32_t mask = server->home_size - 1;
+    uint32_t slot = hash_username(username) & mask;
+    while (server->homes[slot].username[0] != '\0') {
+        if (strcmp(server->homes[slot].username, username) == 0) {
+            return &server->homes[slot];
+        }
+        slot = (slot + 1) & mask;
+    }
+    if (!create) {
+        return NULL;
+    }
+    safe_strcpy(server->homes[slot].username, username, MAX_USERNAME_LEN);
+    server->homes[slot].nodes = 0;
+    server->home_count++;
+    return &server->homes[slot];
+}
+
+/* Caller holds homes_mutex. */
+static void send_to_node(server_t *server, uint16_t node_id, const direct_message_t *direct) {
+    if (node_id == self_node(server)) {
+        direct_deliver_local(server, direct);
+    } else {
+        cluster_send_direct(server, node_id, direct, true);
+    }
+}
+
+/* Only authenticated names are interned or given a home entry, so either proves the user exists. */
+static bool known_user(server_t *server, const char *username) {
+    if (intern_find(&server->user_names, username)) {
+        return true;
+    }
+    pthread_mutex_lock(&server->homes_mutex);
+    bool found = find_home(server, username, false) != NULL;
+    pthread_mutex_unlock(&server->homes_mutex);
+    return found;
+}
+
+/* Runs on the recipient's home node: hand the message to every node they are on, or queue it. */
+void direct_route(server_t *server, const direct_message_t *direct) {
+    pthread_mutex_lock(&server->homes_mutex);
+    user_home_t *home = find_home(server, direct->to, false);
+    uint64_t nodes = home ? home->nodes : 0;
+    if (nodes == 0) {
+        db_queue_direct(&server->db, direct->to, direct->from, direct->message, direct->sent_at);
+    }
+    for (; nodes; nodes &= nodes - 1) {
+        send_to_node(server, (uint16_t)__builtin_ctzll(nodes), direct);
+    }
+    pthread_mutex_unlock(&server->homes_mutex);
+}
+
+/* Runs on the user's home node. The offline queue is drained, in one pass, as the user comes online. */
+void direct_set_online(server_t *server, const char *username, uint16_t node_id, bool online) {
+    if (!server || !username || node_id >= MAX_CLUSTER_NODES) {
+        return;
+    }
+    pthread_mutex_lock(&server->homes_mutex);
+    user_home_t *home = find_home(server, username, online);
+    if (!home) {
+        pthread_mutex_unlock(&server->homes_mutex);
+        return;
+    }
+    bool was_offline = home->nodes == 0;
+    if (online) {
+        home->nodes |= 1ULL << node_id;
+    } else {
+        home->nodes &= ~(1ULL << node_id);
+    }
+    if (!online || !was_offline) {
+        pthread_mutex_unlock(&server->homes_mutex);
+        return;
+    }
+
+    stored_direct_t *messages = NULL;
+    int count = 0;
+    direct_message_t *direct = create_direct_message(username, "", "");
+    if (direct && db_take_directs(&server->db, username, &messages, &count) == 0) {
+        for (int i = 0; i < count; i++) {
+            safe_strcpy(direct->from, messages[i].sender, MAX_USERNAME_LEN);
+            safe_strcpy(direct->message, messages[i].body, MAX_MESSAGE_LEN);
+            direct->sent_at = messages[i].sent_at;
+            send_to_node(server, node_id, direct);
+        }
+        if (count > 0) {
+            log_message("Delivered %d queued direct messages to %s", count, username);
+        }
+    }
+    free(messages);
+    free_message(direct);
+    pthread_mutex_unlock(&server->homes_mutex);
+}
+
+void direct_forget_node(server_t *server, uint16_t node_id) {
+    pthread_mutex_lock(&server->homes_mutex);
+    for (uint32_t i = 0; i < server->home_size; i++) {
+        server->homes[i].nodes &= ~(1ULL << node_id);
+    }
+    pthread_mutex_unlock(&server->homes_mutex);
+}
+
+/* A restarted home node has lost its directory, so every new link re-announces our users. */
+void direct_announce(server_t *server, uint16_t node_id) {
+    pthread_mutex_lock(&server->users_mutex);
+    for (int bucket = 0; bucket < USER_BUCKETS; bucket++) {
+        for (int i = server->user_index[bucket]; i >= 0; i = server->clients[i].next_user) {
+            const char *username = server->clients[i].username;
+            bool seen = false;
+            for (int j = server->user_index[bucket]; j != i && !seen; j = server->clients[j].next_user) {
+                seen = server->clients[j].user_id == server->clients[i].user_id;
+            }
+            if (!seen && home_node(server, username) == node_id) {
+                cluster_send_user(server, node_id, PRESENCE_JOIN, username);
+            }
+        }
+    }
+    pthread_mutex_unlock(&server->users_mutex);
+}
+
+int server_send_direct(server_t *server, const char *from, const char *to, const char *message) {
+    if (!server || !from || !to || !message) {
+        return -1;
+    }
+    if (!known_user(server, to) && db_get_user_id(&server->db, to) <= 0) {
+        return -2;
+    }
+    direct_message_t *direct = create_direct_message(to, from, message);
+    if (!direct) {
+        return -1;
+    }
+    direct->sent_at = (uint64_t)time(NULL);
+    uint16_t home = home_node(server, to);
+    if (home == self_node(server)) {
+        direct_route(server, direct);
+    } else {
+        cluster_send_direct(server, home, direct, false);
+    }
+    free_message(direct);
+    return 0;
+}
+
+void server_free_users(server_t *server) {
+    if (!server) {
+        return;
+    }
+    free(server->homes);
+    server->homes = NULL;
+    server->home_size = 0;
+    server->home_count = 0;
+}
@@ -0,0 +1,258 @@
+#include "server.h"
+#include "../common/include/protocol.h"
+#include "../common/include/utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+extern server_t *g_server;
+
+typedef struct {
+    chat_message_t chat;
+    delivery_t delivery;
+    int refs;                 /* jobs still holding it, updated atomically */
+} fanout_msg_t;
+
+typedef struct {
+    int client_index;
+    uint32_t conn_id;         /* skips the slot if it was reused after the job was queued */
+} fanout_target_t;
+
+struct fanout_job {
+    fanout_job_t *next;
+    fanout_msg_t *msg;
+    room_state_t *room;
+    int count;
+    fanout_target_t targets[];
+};
+
+static void release_msg(fanout_msg_t *msg) {
+    if (__atomic_sub_fetch(&msg->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        free(msg);
+    }
+}
+
+static void run_job(server_t *server, fanout_job_t *job) {
+    for (int i = 0; i < job->count; i++) {
+        server_send_chat_conn(server, job->targets[i].client_index, job->targets[i].conn_id, &job->msg->chat,
+                              &job->msg->delivery, LANE_CHAT);
+    }
+    __atomic_sub_fetch(&job->room->fanout_pending, 1, __ATOMIC_RELEASE);
+    release_msg(job->msg);
+    free(job);
+}
+
+static void *fanout_worker(void *arg) {
+    server_t *server = g_server;
+    fanout_worker_t *worker = (fanout_worker_t *)arg;
+
+    pthread_mutex_lock(&worker->mutex);
+    for (;;) {
+        while (!worker->head && server->fanout->running) {
+            pthread_cond_wait(&worker->ready, &worker->mutex);
+        }
+        fanout_job_t *job = worker->head;
+        if (!job) {
+            break;
+        }
+        worker->head = job->next;
+        if (!worker->head) {
+            worker->tail = NULL;
+        }
+        worker->depth--;
+        pthread_mutex_unlock(&worker->mutex);
+        run_job(server, job);
+        pthread_mutex_lock(&worker->mutex);
+    }
+    pthread_mutex_unlock(&worker->mutex);
+    return NULL;
+}
+
+/* Caller holds room->lock. */
+static bool room_is_hot(room_state_t *room) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    uint64_t second = (uint64_t)ts.tv_sec;
+    if (second != room->rate_window) {
+        room->recent_rate = second == room->rate_window + 1 ? room->window_count : 0;
+        room->rate_window = second;
+        room->window_count = 0;
+    }
+    room->window_count++;
+
+    uint32_t rate = room->recent_rate > room->window_count ? room->recent_rate : room->window_count;
+    bool hot = room->member_count >= FANOUT_HOT_MEMBERS ||
+               (room->member_count >= FANOUT_WARM_MEMBERS && rate >= FANOUT_HOT_RATE);
+    if (hot != room->hot) {
+        room->hot = hot;
+        log_message("Room %s is %s (%d members, %u msg/s)", room->room_id,
+                    hot ? "hot, fanning out on workers" : "quiet again, delivering inline",
+                    room->member_count, rate);
+    }
+    return hot;
+}
+
+/*
+ * Never waits, as the caller holds room->lock. A full worker refuses the job; its members see
+ * a gap in the room's sequence and ask for the missing messages from the retransmit window.
+ */
+static bool enqueue(fanout_worker_t *worker, fanout_job_t *job) {
+    pthread_mutex_lock(&worker->mutex);
+    if (worker->depth >= FANOUT_QUEUE_LIMIT) {
+        uint64_t dropped = ++worker->dropped;
+        pthread_mutex_unlock(&worker->mutex);
+        if ((dropped & (dropped - 1)) == 0) {
+            log_message("Fan-out worker full, %llu jobs dropped so far", (unsigned long long)dropped);
+        }
+        return false;
+    }
+    job->next = NULL;
+    if (worker->tail) {
+        worker->tail->next = job;
+    } else {
+        worker->head = job;
+    }
+    worker->tail = job;
+    worker->depth++;
+    pthread_cond_signal(&worker->ready);
+    pthread_mutex_unlock(&worker->mutex);
+    return true;
+}
+
+/*
+ * Caller holds room->lock. Hands a hot room's delivery to the workers and returns true, or
+ * returns false for the caller to deliver inline. Every member always goes to the same worker
+ * (client index modulo the pool size), so each member still sees the room in sequence order;
+ * a room stays on the workers until its queued jobs drain, so inline sends never overtake them.
+ */
+bool fanout_offload(server_t *server, room_state_t *room, const chat_message_t *chat_msg,
+                    const delivery_t *delivery) {
+    fanout_pool_t *pool = server->fanout;
+    if (!pool || !pool->running || room->member_count == 0) {
+        return false;
+    }
+    bool hot = room_is_hot(room);
+    if (!hot && __atomic_load_n(&room->fanout_pending, __ATOMIC_ACQUIRE) == 0) {
+        return false;
+    }
+
+    fanout_msg_t *msg = (fanout_msg_t *)malloc(sizeof(fanout_msg_t));
+    int *counts = (int *)calloc(pool->count, sizeof(int));
+    fanout_job_t **jobs = (fanout_job_t **)calloc(pool->count, sizeof(fanout_job_t *));
+    bool ok = msg && counts && jobs;
+    for (int i = 0; ok && i < room->member_count; i++) {
+        counts[room->members[i] % pool->count]++;
+    }
+    for (int w = 0; ok && w < pool->count; w++) {
+        if (counts[w] == 0) {
+            continue;
+        }
+        jobs[w] = (fanout_job_t *)malloc(sizeof(fanout_job_t) + counts[w] * sizeof(fanout_target_t));
+        if (!jobs[w]) {
+            ok = false;
+            break;
+        }
+        jobs[w]->msg = msg;
+        jobs[w]->room = room;
+        jobs[w]->count = 0;
+    }
+    if (!ok) {
+        for (int w = 0; jobs && w < pool->count; w++) {
+            free(jobs[w]);
+        }
+        free(jobs);
+        free(counts);
+        free(msg);
+        /* Inline sends would overtake jobs still queued, so then it is dropped like a refused job. */
+        return __atomic_load_n(&room->fanout_pending, __ATOMIC_ACQUIRE) > 0;
+    }
+
+    memcpy(&msg->chat, chat_msg, sizeof(chat_message_t));
+    memcpy(&msg->delivery, delivery, sizeof(delivery_t));
+    msg->refs = 0;
+    for (int i = 0; i < room->member_count; i++) {
+        int client_index = room->members[i];
+        fanout_job_t *job = jobs[client_index % pool->count];
+        job->targets[job->count].client_index = client_index;
+        job->targets[job->count].conn_id = server->clients[client_index].conn_id;
+        job->count++;
+    }
+    for (int w = 0; w < pool->count; w++) {
+        if (jobs[w]) {
+            msg->refs++;
+        }
+    }
+    for (int w = 0; w < pool->count; w++) {
+        if (!jobs[w]) {
+            continue;
+        }
+        __atomic_add_fetch(&room->fanout_pending, 1, __ATOMIC_ACQ_REL);
+        if (!enqueue(&pool->workers[w], jobs[w])) {
+            __atomic_sub_fetch(&room->fanout_pending, 1, __ATOMIC_RELEASE);
+            release_msg(msg);
+            free(jobs[w]);
+        }
+    }
+    free(jobs);
+    free(counts);
+    return true;
+}
+
+int fanout_start(server_t *server, int workers) {
+    if (!server || workers <= 0 || server->fanout) {
+        return -1;
+    }
+    fanout_pool_t *pool = (fanout_pool_t *)calloc(1, sizeof(fanout_pool_t));
+    if (!pool) {
+        return -1;
+    }
+    pool->workers = (fanout_worker_t *)calloc(workers, sizeof(fanout_worker_t));
+    if (!pool->workers) {
+        free(pool);
+        return -1;
+    }
+    pool->running = true;
+    server->fanout = pool;
+    for (int i = 0; i < workers; i++) {
+        fanout_worker_t *worker = &pool->workers[i];
+        pthread_mutex_init(&worker->mutex, NULL);
+        pthread_cond_init(&worker->ready, NULL);
+        if (pthread_create(&worker->thread, NULL, fanout_worker, worker) != 0) {
+            pthread_mutex_destroy(&worker->mutex);
+            pthread_cond_destroy(&worker->ready);
+            break;
+        }
+        pool->count++;
+    }
+    if (pool->count == 0) {
+        free(pool->workers);
+        free(pool);
+        server->fanout = NULL;
+        return -1;
+    }
+    log_message("Fanning out hot rooms on %d worker threads", pool->count);
+    return 0;
+}
+
+/* Workers finish what is queued before they exit. */
+void fanout_stop(server_t *server) {
+    if (!server || !server->fanout) {
+        return;
+    }
+    fanout_pool_t *pool = server->fanout;
+    pool->running = false;
+    for (int i = 0; i < pool->count; i++) {
+        pthread_mutex_lock(&pool->workers[i].mutex);
+        pthread_cond_broadcast(&pool->workers[i].ready);
+        pthread_mutex_unlock(&pool->workers[i].mutex);
+    }
+    for (int i = 0; i < pool->count; i++) {
+        pthread_join(pool->workers[i].thread, NULL);
+        pthread_mutex_destroy(&pool->workers[i].mutex);
+        pthread_cond_destroy(&pool->workers[i].ready);
+    }
+    free(pool->workers);
+    free(pool);
+    server->fanout = NULL;
+}
@@ -0,0 +1,42 @@
+#include "server.h"
+#include "../common/include/protocol.h"
+#include "../common/include/message.h"
+#include "../common/include/utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SERVER_CAPABILITIES (CAP_COMPACT | CAP_MULTI_ROOM | CAP_PIPELINING)
+
+/*
+ * Agrees on the older of the two versions and grants the capabilities the
+ * client asked for that this server has. A client that never says hello
+ * stays on version 1 with none: its short join and chat frames are accepted,
+ * and it is never sent a compact, compressed or tagged frame.
+ */
+void server_handle_hello(server_t *server, int client_index, const hello_message_t *hello) {
+    if (!server || client_index < 0 || client_index >= MAX_CLIENTS || !hello) {
+        return;
+    }
+    client_t *client = &server->clients[client_index];
+    uint16_t version = hello->version < PROTOCOL_VERSION ? hello->version : PROTOCOL_VERSION;
+    uint32_t granted = 0;
+    if (version < PROTOCOL_MIN_VERSION) {
+        /* Nothing in common: version 0 tells the client so. */
+        version = 0;
+    } else {
+        granted = hello->capabilities & SERVER_CAPABILITIES;
+        if ((hello->capabilities & CAP_COMPRESSION) && server_enable_compression(server, client_index) == 0) {
+            granted |= CAP_COMPRESSION;
+        }
+        client->version = version;
+        __atomic_store_n(&client->capabilities, granted, __ATOMIC_RELAXED);
+    }
+
+    hello_message_t *reply = create_hello_message(version, granted);
+    if (reply) {
+        server_reply(server, client_index, reply, sizeof(hello_message_t));
+        free_message(reply);
+    }
+    log_message("Client %d speaks version %u with capabilities 0x%x", client_index, version, granted);
+}
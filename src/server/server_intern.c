@@ -0,0 +1,145 @@
+#include "server.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct intern_slots {
+    uint32_t size;            /* power of two */
+    intern_slots_t *retired;  /* the table this one replaced */
+    intern_entry_t *slots[];  /* NULL when empty */
+};
+
+static uint32_t hash_name(const char *name) {
+    uint32_t hash = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)name; *p; p++) {
+        hash ^= *p;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static intern_slots_t *alloc_slots(uint32_t size) {
+    intern_slots_t *slots = (intern_slots_t *)calloc(1, sizeof(intern_slots_t) + size * sizeof(intern_entry_t *));
+    if (slots) {
+        slots->size = size;
+    }
+    return slots;
+}
+
+static intern_entry_t *probe(const intern_slots_t *slots, const char *name, uint32_t hash) {
+    uint32_t mask = slots->size - 1;
+    for (uint32_t i = hash & mask;; i = (i + 1) & mask) {
+        intern_entry_t *entry = __atomic_load_n(&slots->slots[i], __ATOMIC_ACQUIRE);
+        if (!entry) {
+            return NULL;
+        }
+        if (entry->hash == hash && strcmp(entry->name, name) == 0) {
+            return entry;
+        }
+    }
+}
+
+static void place(intern_slots_t *slots, intern_entry_t *entry) {
+    uint32_t mask = slots->size - 1;
+    uint32_t i = entry->hash & mask;
+    while (slots->slots[i]) {
+        i = (i + 1) & mask;
+    }
+    __atomic_store_n(&slots->slots[i], entry, __ATOMIC_RELEASE);
+}
+
+int intern_init(intern_table_t *table) {
+    if (!table) {
+        return -1;
+    }
+    table->slots = alloc_slots(INTERN_INITIAL_SLOTS);
+    table->count = 0;
+    if (!table->slots || pthread_mutex_init(&table->mutex, NULL) != 0) {
+        free(table->slots);
+        table->slots = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Takes no lock. Entries are never removed or moved, and a grown table is
+ * published whole, so a reader sees every name interned before it started;
+ * one interned meanwhile may be missed, as if the lookup had come first.
+ */
+intern_entry_t *intern_find(const intern_table_t *table, const char *name) {
+    if (!table || !name) {
+        return NULL;
+    }
+    intern_slots_t *slots = __atomic_load_n(&table->slots, __ATOMIC_ACQUIRE);
+    return slots ? probe(slots, name, hash_name(name)) : NULL;
+}
+
+/* Returns the existing entry, or adds one with the next handle and the given value. */
+intern_entry_t *intern_add(intern_table_t *table, const char *name, void *value) {
+    if (!table || !name || !table->slots) {
+        return NULL;
+    }
+    uint32_t hash = hash_name(name);
+    pthread_mutex_lock(&table->mutex);
+    intern_entry_t *entry = probe(table->slots, name, hash);
+    if (entry) {
+        pthread_mutex_unlock(&table->mutex);
+        return entry;
+    }
+    if ((table->count + 1) * 2 > table->slots->size) {
+        intern_slots_t *grown = alloc_slots(table->slots->size * 2);
+        if (!grown) {
+            pthread_mutex_unlock(&table->mutex);
+            return NULL;
+        }
+        for (uint32_t i = 0; i < table->slots->size; i++) {
+            if (table->slots->slots[i]) {
+                place(grown, table->slots->slots[i]);
+            }
+        }
+        /* Readers may still be probing the old table, so it is only freed with the whole table. */
+        grown->retired = table->slots;
+        __atomic_store_n(&table->slots, grown, __ATOMIC_RELEASE);
+    }
+    size_t length = strlen(name);
+    entry = (intern_entry_t *)malloc(sizeof(intern_entry_t) + length + 1);
+    if (!entry) {
+        pthread_mutex_unlock(&table->mutex);
+        return NULL;
+    }
+    entry->hash = hash;
+    entry->handle = table->count++;
+    entry->value = value;
+    memcpy(entry->name, name, length + 1);
+    place(table->slots, entry);
+    pthread_mutex_unlock(&table->mutex);
+    return entry;
+}
+
+void intern_free(intern_table_t *table) {
+    if (!table || !table->slots) {
+        return;
+    }
+    for (uint32_t i = 0; i < table->slots->size; i++) {
+        free(table->slots->slots[i]);
+    }
+    intern_slots_t *slots = table->slots;
+    while (slots) {
+        intern_slots_t *retired = slots->retired;
+        free(slots);
+        slots = retired;
+    }
+    table->slots = NULL;
+    table->count = 0;
+    pthread_mutex_destroy(&table->mutex);
+}
+
+/* Interns the name on first sight; USER_HANDLE_NONE only if memory runs out. */
+uint32_t server_user_handle(server_t *server, const char *username) {
+    intern_entry_t *entry = intern_find(&server->user_names, username);
+    if (!entry) {
+        entry = intern_add(&server->user_names, username, NULL);
+    }
+    return entry ? entry->handle : USER_HANDLE_NONE;
+}
@@ -0,0 +1,127 @@
+#include "server.h"
+#include "../common/include/protocol.h"
+#include "../common/include/message.h"
+#include "../common/include/utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define RATE_NOTICE_INTERVAL_NS 1000000000ULL
+
+/* Parses RATE or RATE/BURST; the burst defaults to one second's worth. */
+int rate_limit_parse(const char *spec, rate_limit_t *limit) {
+    if (!spec || !limit) {
+        return -1;
+    }
+    char *end = NULL;
+    long rate = strtol(spec, &end, 10);
+    long burst = rate;
+    if (end == spec || rate < 0) {
+        return -1;
+    }
+    if (*end == '/') {
+        const char *burst_spec = end + 1;
+        burst = strtol(burst_spec, &end, 10);
+        if (end == burst_spec || burst < 1) {
+            return -1;
+        }
+    }
+    if (*end != '\0' || rate > 1000000 || burst > 1000000) {
+        return -1;
+    }
+    limit->rate = (uint32_t)rate;
+    limit->burst = (uint32_t)burst;
+    return 0;
+}
+
+/*
+ * Token bucket in GCRA form: the whole state is the time the bucket will be
+ * full again, so taking a token is a single compare-and-swap and needs no lock.
+ */
+bool rate_take(rate_bucket_t *bucket, const rate_limit_t *limit, uint64_t now_ns) {
+    if (!bucket || !limit || limit->rate == 0) {
+        return true;
+    }
+    uint64_t interval = 1000000000ULL / limit->rate;
+    uint64_t tolerance = interval * limit->burst;
+    uint64_t tat = __atomic_load_n(&bucket->tat, __ATOMIC_RELAXED);
+    for (;;) {
+        uint64_t start = tat > now_ns ? tat : now_ns;
+        if (start + interval - now_ns > tolerance) {
+            return false;
+        }
+        if (__atomic_compare_exchange_n(&bucket->tat, &tat, start + interval, true,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            return true;
+        }
+    }
+}
+
+/* Gives back a token rate_take granted, for a message refused after it was charged. */
+void rate_refund(rate_bucket_t *bucket, const rate_limit_t *limit) {
+    if (!bucket || !limit || limit->rate == 0) {
+        return;
+    }
+    /* The take moved tat forward by one interval and nothing moves it back but a refund. */
+    __atomic_fetch_sub(&bucket->tat, 1000000000ULL / limit->rate, __ATOMIC_RELAXED);
+}
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/*
+ * Charges a chat or direct message to the connection, the user and, for chat,
+ * the room it goes to; false drops it. Called once the message is otherwise
+ * deliverable, and a bucket that says no hands back what the others took.
+ */
+bool server_admit_message(server_t *server, int client_index, room_state_t *room) {
+    if (!server || client_index < 0 || client_index >= MAX_CLIENTS) {
+        return false;
+    }
+    client_t *client = &server->clients[client_index];
+    uint64_t now = monotonic_ns();
+    const char *scope = NULL;
+
+    if (!rate_take(&client->rate, &server->conn_limit, now)) {
+        scope = "connection";
+    } else if (client->user_rate && !rate_take(&client->user_rate->bucket, &server->user_limit, now)) {
+        rate_refund(&client->rate, &server->conn_limit);
+        scope = "user";
+    } else if (room && !rate_take(&room->rate, &server->room_limit, now)) {
+        server_refund_message(server, client_index);
+        scope = "room";
+    }
+    if (!scope) {
+        return true;
+    }
+
+    /* One notice per interval, so a flood does not turn into a flood of errors. */
+    if (now - client->limited_at >= RATE_NOTICE_INTERVAL_NS) {
+        client->limited_at = now;
+        char text[MAX_MESSAGE_LEN];
+        snprintf(text, sizeof(text), "Slow down: %s message rate exceeded, messages are being dropped", scope);
+        error_message_t *err = create_error_message(RESP_RATE_LIMITED, text);
+        if (err) {
+            server_send(server, client_index, err, sizeof(error_message_t));
+            free_message(err);
+        }
+        log_message("Rate limiting %s (%s limit)", client->username, scope);
+    }
+    return false;
+}
+
+/* Returns the connection and user tokens of an admitted message that was then refused. */
+void server_refund_message(server_t *server, int client_index) {
+    if (!server || client_index < 0 || client_index >= MAX_CLIENTS) {
+        return;
+    }
+    client_t *client = &server->clients[client_index];
+    rate_refund(&client->rate, &server->conn_limit);
+    if (client->user_rate) {
+        rate_refund(&client->user_rate->bucket, &server->user_limit);
+    }
+}
@@ -0,0 +1,84 @@
+#include "server.h"
+#include "../common/include/protocol.h"
+#include "../common/include/message.h"
+#include "../common/include/utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+extern server_t *g_server;
+
+static const char *state_names[] = { "normal", "shedding", "refusing" };
+
+load_state_t server_load(const server_t *server) {
+    return (load_state_t)__atomic_load_n(&server->load.state, __ATOMIC_RELAXED);
+}
+
+/* Called by writer threads for each chat frame, with how long it waited in its lane. */
+void load_frame_written(server_t *server, uint64_t delay_ms) {
+    uint64_t worst = __atomic_load_n(&server->load.chat_delay_ms, __ATOMIC_RELAXED);
+    while (delay_ms > worst &&
+           !__atomic_compare_exchange_n(&server->load.chat_delay_ms, &worst, delay_ms, true, __ATOMIC_RELAXED,
+                                        __ATOMIC_RELAXED)) {
+    }
+}
+
+/*
+ * Rises to the level the last interval called for at once, and steps back
+ * down one level only after LOAD_CALM_CHECKS quieter checks in a row, so the
+ * state does not flap around a threshold.
+ */
+static uint64_t check_load(wheel_timer_t *timer, uint64_t now) {
+    server_t *server = g_server;
+    load_monitor_t *load = &server->load;
+    uint64_t queued = __atomic_load_n(&load->queued, __ATOMIC_RELAXED);
+    uint64_t delay = __atomic_exchange_n(&load->chat_delay_ms, 0, __ATOMIC_RELAXED);
+
+    load_state_t wanted = LOAD_NORMAL;
+    if (delay > load->budget_ms || queued > LOAD_REFUSE_FRAMES) {
+        wanted = LOAD_REFUSING;
+    } else if (delay > load->budget_ms / 2 || queued > LOAD_SHED_FRAMES) {
+        wanted = LOAD_SHEDDING;
+    }
+
+    load_state_t state = server_load(server);
+    load_state_t next = state;
+    if (wanted > state) {
+        next = wanted;
+        load->calm = 0;
+    } else if (wanted < state) {
+        if (++load->calm >= LOAD_CALM_CHECKS) {
+            next = (load_state_t)(state - 1);
+            load->calm = 0;
+        }
+    } else {
+        load->calm = 0;
+    }
+    if (next != state) {
+        __atomic_store_n(&load->state, next, __ATOMIC_RELAXED);
+        log_message("Load %s -> %s: chat delay %llu ms (budget %u), %llu frames queued", state_names[state],
+                    state_names[next], (unsigned long long)delay, load->budget_ms, (unsigned long long)queued);
+    }
+    (void)timer;
+    return now + LOAD_CHECK_MS;
+}
+
+void load_start(server_t *server) {
+    if (!server || server->load.budget_ms == 0) {
+        return;
+    }
+    server->load.timer.fire = check_load;
+    server->load.timer.arg = server;
+    timer_arm(&server->timers, &server->load.timer, timer_now_ms() + LOAD_CHECK_MS);
+}
+
+/* Turns a connection away before it takes a slot or a thread. */
+void server_refuse(int sockfd, const char *reason) {
+    error_message_t *err = create_error_message(RESP_OVERLOADED, reason);
+    if (err) {
+        send_message(sockfd, err, sizeof(error_message_t));
+        free_message(err);
+    }
+    close(sockfd);
+}
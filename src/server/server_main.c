@@ -0,0 +1,153 @@
+#include "server.h"
+#include "../common/include/utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int main(int argc, char *argv[]) {
+    const char *db_path = "../chat.db"; 
+    int port = SERVER_PORT;
+    const char *capture_path = NULL;
+    int node_id = -1;
+    const char *cluster_spec = NULL;
+    const char *bus_name = NULL;
+    int fanout_workers = FANOUT_DEFAULT_WORKERS;
+    int ping_interval = DEFAULT_PING_INTERVAL_MS / 1000;
+    int auth_timeout = DEFAULT_AUTH_TIMEOUT_MS / 1000;
+    int latency_budget = DEFAULT_LATENCY_BUDGET_MS;
+    bool compression = true;
+    rate_limit_t limits[3];
+    memset(limits, 0, sizeof(limits));
+    
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-d") == 0 || strcmp(argv[i], "--db") == 0) {
+            if (i + 1 < argc) {
+                db_path = argv[i + 1];
+                i++;
+            }
+        } else if (strcmp(argv[i], "-p") == 0 || strcmp(argv[i], "--port") == 0) {
+            if (i + 1 < argc) {
+                port = atoi(argv[i + 1]);
+                if (port <= 0) {
+                    port = SERVER_PORT;
+                }
+                i++;
+            }
+        } else if (strcmp(argv[i], "-c") == 0 || strcmp(argv[i], "--capture") == 0) {
+            if (i + 1 < argc) {
+                capture_path = argv[i + 1];
+                i++;
+            }
+        } else if (strcmp(argv[i], "-n") == 0 || strcmp(argv[i], "--node-id") == 0) {
+            if (i + 1 < argc) {
+                node_id = atoi(argv[i + 1]);
+                i++;
+            }
+        } else if (strcmp(argv[i], "-C") == 0 || strcmp(argv[i], "--cluster") == 0) {
+            if (i + 1 < argc) {
+                cluster_spec = argv[i + 1];
+                i++;
+            }
+        } else if (strcmp(argv[i], "-b") == 0 || strcmp(argv[i], "--bus") == 0) {
+            if (i + 1 < argc) {
+                bus_name = argv[i + 1];
+                i++;
+            }
+        } else if (strcmp(argv[i], "-w") == 0 || strcmp(argv[i], "--workers") == 0) {
+            if (i + 1 < argc) {
+                fanout_workers = atoi(argv[i + 1]);
+                i++;
+            }
+        } else if (strcmp(argv[i], "--ping-interval") == 0 || strcmp(argv[i], "--auth-timeout") == 0) {
+            if (i + 1 < argc) {
+                int seconds = atoi(argv[i + 1]);
+                if (seconds < 0) {
+                    seconds = 0;
+                }
+                if (argv[i][2] == 'p') {
+                    ping_interval = seconds;
+                } else {
+                    auth_timeout = seconds;
+                }
+                i++;
+            }
+        } else if (strcmp(argv[i], "--no-compression") == 0) {
+            compression = false;
+        } else if (strcmp(argv[i], "--latency-budget") == 0) {
+            if (i + 1 < argc) {
+                latency_budget = atoi(argv[i + 1]);
+                if (latency_budget < 0) {
+                    latency_budget = 0;
+                }
+                i++;
+            }
+        } else if (strcmp(argv[i], "--conn-rate") == 0 || strcmp(argv[i], "--user-rate") == 0 ||
+                   strcmp(argv[i], "--room-rate") == 0) {
+            int which = argv[i][2] == 'c' ? 0 : argv[i][2] == 'u' ? 1 : 2;
+            if (i + 1 < argc) {
+                if (rate_limit_parse(argv[i + 1], &limits[which]) != 0) {
+                    printf("Invalid rate %s, expected RATE or RATE/BURST\n", argv[i + 1]);
+                    return 1;
+                }
+                i++;
+            }
+        } else if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            printf("Usage: %s [options]\n", argv[0]);
+            printf("Options:\n");
+            printf("  -d, --db PATH         Database path (default: %s)\n", db_path);
+            printf("  -p, --port PORT       Port to listen on (default: %d)\n", SERVER_PORT);
+            printf("  -c, --capture PATH    Record every inbound frame to a capture file\n");
+            printf("  -n, --node-id ID      This node's ID in the cluster spec\n");
+            printf("  -C, --cluster SPEC    Cluster nodes as ID=HOST:PORT,... (same on every node)\n");
+            printf("  -b, --bus NAME        Relay between co-located nodes through /dev/shm/NAME\n");
+            printf("  -w, --workers N       Fan-out threads for busy rooms (default: %d, 0 disables)\n",
+                   FANOUT_DEFAULT_WORKERS);
+            printf("  --ping-interval SECS  Ping idle clients, dropping them after twice this (default: %d, 0 disables)\n",
+                   DEFAULT_PING_INTERVAL_MS / 1000);
+            printf("  --auth-timeout SECS   Drop connections not logged in by then (default: %d, 0 disables)\n",
+                   DEFAULT_AUTH_TIMEOUT_MS / 1000);
+            printf("  --latency-budget MS   Shed load when chat frames wait longer than this (default: %d, 0 disables)\n",
+                   DEFAULT_LATENCY_BUDGET_MS);
+            printf("  --no-compression      Turn down clients that ask to compress their connection\n");
+            printf("  --conn-rate R[/B]     Chat and direct messages per second per connection, burst B\n");
+            printf("  --user-rate R[/B]     Same, shared by all of a user's connections on this node\n");
+            printf("  --room-rate R[/B]     Chat messages per second per room accepted by this node\n");
+            printf("  -h, --help            Show this help message\n");
+            return 0;
+        }
+    }
+    
+    printf("Debug: Using database path: %s\n", db_path);
+    server_t server;
+    if (server_init(&server, db_path) != 0) {
+        log_message("Failed to initialize server");
+        return 1;
+    }
+    server.conn_limit = limits[0];
+    server.user_limit = limits[1];
+    server.room_limit = limits[2];
+    server.ping_interval_ms = (uint32_t)ping_interval * 1000;
+    server.auth_timeout_ms = (uint32_t)auth_timeout * 1000;
+    server.load.budget_ms = (uint32_t)latency_budget;
+    server.compression = compression;
+    if (capture_path && server_enable_capture(&server, capture_path) != 0) {
+        return 1;
+    }
+    if (cluster_spec && server_enable_cluster(&server, node_id, cluster_spec) != 0) {
+        log_message("Failed to join cluster");
+        return 1;
+    }
+    if (bus_name && server_enable_bus(&server, bus_name) != 0) {
+        return 1;
+    }
+    if (fanout_workers > 0 && fanout_start(&server, fanout_workers) != 0) {
+        log_message("Failed to start fan-out workers, delivering every room inline");
+    }
+    
+    if (server_start(&server, port) != 0) {
+        log_message("Failed to start server");
+        return 1;
+    }
+    
+    return 0;
+} 
\ No newline at end of file
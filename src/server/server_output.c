@@ -0,0 +1,268 @@
+#include "server.h"
+#include "../common/include/protocol.h"
+#include "../common/include/compress.h"
+#include "../common/include/message.h"
+#include "../common/include/utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+
+struct out_frame {
+    out_frame_t *next;
+    lane_t lane;
+    uint64_t queued_ms;
+    uint32_t request_id;      /* tag to write with the frame, 0 for none */
+    bool packed;              /* already a MSG_COMPRESSED frame, written as it is */
+    size_t length;
+    char data[];
+};
+
+extern server_t *g_server;
+
+static const int lane_limits[LANE_COUNT] = { LANE_CONTROL_LIMIT, LANE_CHAT_LIMIT, LANE_BULK_LIMIT };
+static const char *lane_names[LANE_COUNT] = { "control", "chat", "bulk" };
+
+static lane_t lane_for(const void *message) {
+    switch (((const message_header_t *)message)->type) {
+        case MSG_CHAT_MESSAGE:
+        case MSG_CHAT_COMPACT:
+        case MSG_DIRECT:
+            return LANE_CHAT;
+        case MSG_PRESENCE:
+            return LANE_BULK;
+        default:
+            return LANE_CONTROL;
+    }
+}
+
+/* Caller holds send_mutex. */
+static out_frame_t *pop_frame(client_t *client) {
+    for (int lane = 0; lane < LANE_COUNT; lane++) {
+        out_lane_t *out = &client->lanes[lane];
+        out_frame_t *frame = out->head;
+        if (frame) {
+            out->head = frame->next;
+            if (!out->head) {
+                out->tail = NULL;
+            }
+            out->depth--;
+            __atomic_sub_fetch(&g_server->load.queued, 1, __ATOMIC_RELAXED);
+            return frame;
+        }
+    }
+    return NULL;
+}
+
+/* Caller holds send_mutex. */
+static void drop_frames(client_t *client) {
+    out_frame_t *frame;
+    while ((frame = pop_frame(client)) != NULL) {
+        free(frame);
+    }
+}
+
+static int enqueue_frame(server_t *server, int client_index, uint32_t conn_id, const void *message, size_t length,
+                         lane_t lane, uint32_t request_id, bool packed);
+
+int server_send(server_t *server, int client_index, const void *message, size_t length) {
+    if (!message) {
+        return -1;
+    }
+    return server_send_lane(server, client_index, message, length, lane_for(message));
+}
+
+/* Answers the request the client's thread is handling, tagged with its request id if it had one. */
+int server_reply(server_t *server, int client_index, const void *message, size_t length) {
+    if (!server || client_index < 0 || client_index >= MAX_CLIENTS || !message) {
+        return -1;
+    }
+    return enqueue_frame(server, client_index, 0, message, length, lane_for(message),
+                         server->clients[client_index].request_id, false);
+}
+
+int server_send_lane(server_t *server, int client_index, const void *message, size_t length, lane_t lane) {
+    return enqueue_frame(server, client_index, 0, message, length, lane, 0, false);
+}
+
+/*
+ * Sends a chat frame in the encoding the client negotiated, taking it from
+ * the delivery's shared copies when there is one. Without a delivery, as for
+ * replays, a compact frame is built just for this client.
+ */
+static int send_chat(server_t *server, int client_index, uint32_t conn_id, const chat_message_t *chat_msg,
+                     const delivery_t *delivery, lane_t lane) {
+    if (!server || client_index < 0 || client_index >= MAX_CLIENTS || !chat_msg) {
+        return -1;
+    }
+    client_t *client = &server->clients[client_index];
+    bool compact = (__atomic_load_n(&client->capabilities, __ATOMIC_RELAXED) & CAP_COMPACT) != 0;
+    if (delivery) {
+        const packed_frame_t *packed = &delivery->packed[compact];
+        if (packed->length > 0 && __atomic_load_n(&client->deflater, __ATOMIC_RELAXED)) {
+            return enqueue_frame(server, client_index, conn_id, packed->data, packed->length, lane, 0, true);
+        }
+        if (compact && delivery->compact_length > 0) {
+            return enqueue_frame(server, client_index, conn_id, &delivery->compact, delivery->compact_length, lane,
+                                 0, false);
+        }
+    }
+    if (compact) {
+        chat_compact_t frame;
+        size_t length = chat_compact(chat_msg, &frame);
+        return enqueue_frame(server, client_index, conn_id, &frame, length, lane, 0, false);
+    }
+    return enqueue_frame(server, client_index, conn_id, chat_msg, sizeof(chat_message_t), lane, 0, false);
+}
+
+int server_send_chat(server_t *server, int client_index, const chat_message_t *chat_msg,
+                     const delivery_t *delivery, lane_t lane) {
+    return send_chat(server, client_index, 0, chat_msg, delivery, lane);
+}
+
+/* For senders outside room->lock: the frame is dropped if the slot now holds another connection. */
+int server_send_chat_conn(server_t *server, int client_index, uint32_t conn_id, const chat_message_t *chat_msg,
+                          const delivery_t *delivery, lane_t lane) {
+    return send_chat(server, client_index, conn_id, chat_msg, delivery, lane);
+}
+
+/*
+ * Queues the frame on its lane for the connection's writer thread, which always
+ * empties the control lane first. A sender never blocks on a slow socket, and a
+ * response waits behind at most the one frame already being written.
+ */
+static int enqueue_frame(server_t *server, int client_index, uint32_t conn_id, const void *message, size_t length,
+                         lane_t lane, uint32_t request_id, bool packed) {
+    if (!server || client_index < 0 || client_index >= MAX_CLIENTS || !message || lane >= LANE_COUNT) {
+        return -1;
+    }
+    client_t *client = &server->clients[client_index];
+    pthread_mutex_lock(&client->send_mutex);
+    /* A closed slot stays closing until it is reused, and conn_id is set before that is cleared. */
+    if (client->slow || client->closing || (conn_id != 0 && client->conn_id != conn_id)) {
+        pthread_mutex_unlock(&client->send_mutex);
+        return -1;
+    }
+    if (lane == LANE_BULK && server_load(server) >= LOAD_SHEDDING) {
+        /* Presence is shed first under load; member lists may be stale until the next join. */
+        pthread_mutex_unlock(&client->send_mutex);
+        return 0;
+    }
+    out_lane_t *out = &client->lanes[lane];
+    if (out->depth >= lane_limits[lane]) {
+        /* Too far behind to catch up; it resumes from its last sequence numbers on reconnect. */
+        client->slow = true;
+        drop_frames(client);
+        shutdown(client->sockfd, SHUT_RDWR);
+        pthread_mutex_unlock(&client->send_mutex);
+        log_message("Dropping slow client %s: %s lane full", client->username, lane_names[lane]);
+        return -1;
+    }
+    out_frame_t *frame = (out_frame_t *)malloc(sizeof(out_frame_t) + length);
+    if (!frame) {
+        pthread_mutex_unlock(&client->send_mutex);
+        return -1;
+    }
+    frame->next = NULL;
+    frame->lane = lane;
+    frame->queued_ms = timer_now_ms();
+    frame->request_id = request_id;
+    frame->packed = packed;
+    frame->length = length;
+    memcpy(frame->data, message, length);
+    if (out->tail) {
+        out->tail->next = frame;
+    } else {
+        out->head = frame;
+    }
+    out->tail = frame;
+    out->depth++;
+    __atomic_add_fetch(&server->load.queued, 1, __ATOMIC_RELAXED);
+    pthread_cond_signal(&client->send_ready);
+    pthread_mutex_unlock(&client->send_mutex);
+    return 0;
+}
+
+/* Deflates the frame into the connection's stream first if the client asked for compression. */
+static int write_frame(int sockfd, compress_stream_t *deflater, const out_frame_t *frame, char *scratch,
+                       size_t scratch_size) {
+    if (frame->packed) {
+        return send_message(sockfd, frame->data, frame->length);
+    }
+    if (!deflater || frame->length < COMPRESS_MIN_FRAME || COMPRESS_BOUND(frame->length) > scratch_size) {
+        return send_tagged_message(sockfd, frame->data, frame->length, frame->request_id);
+    }
+    int length = compress_frame(deflater, false, frame->data, frame->length, frame->request_id, scratch,
+                                scratch_size);
+    return length < 0 ? -1 : send_message(sockfd, scratch, (size_t)length);
+}
+
+static void *client_writer(void *arg) {
+    client_t *client = (client_t *)arg;
+    char scratch[COMPRESS_BOUND(4096)];
+    pthread_mutex_lock(&client->send_mutex);
+    for (;;) {
+        out_frame_t *frame = NULL;
+        while (!client->closing && (frame = pop_frame(client)) == NULL) {
+            pthread_cond_wait(&client->send_ready, &client->send_mutex);
+        }
+        if (client->closing) {
+            free(frame);
+            break;
+        }
+        int sockfd = client->sockfd;
+        compress_stream_t *deflater = client->deflater;
+        pthread_mutex_unlock(&client->send_mutex);
+        uint64_t now = timer_now_ms();
+        if (frame->lane == LANE_CHAT) {
+            load_frame_written(g_server, now - frame->queued_ms);
+        }
+        __atomic_store_n(&client->write_since_ms, now, __ATOMIC_RELAXED);
+        int sent = write_frame(sockfd, deflater, frame, scratch, sizeof(scratch));
+        __atomic_store_n(&client->write_since_ms, 0, __ATOMIC_RELAXED);
+        free(frame);
+        pthread_mutex_lock(&client->send_mutex);
+        if (sent != 0) {
+            client->slow = true;
+            drop_frames(client);
+        }
+    }
+    drop_frames(client);
+    pthread_mutex_unlock(&client->send_mutex);
+    return NULL;
+}
+
+int server_start_output(server_t *server, int client_index) {
+    if (!server || client_index < 0 || client_index >= MAX_CLIENTS) {
+        return -1;
+    }
+    client_t *client = &server->clients[client_index];
+    pthread_mutex_lock(&client->send_mutex);
+    client->closing = false;
+    client->slow = false;
+    pthread_mutex_unlock(&client->send_mutex);
+    if (pthread_create(&client->writer, NULL, client_writer, client) != 0) {
+        client->closing = true;
+        return -1;
+    }
+    return 0;
+}
+
+/* Called before the socket is closed; unsent frames are discarded. */
+void server_stop_output(server_t *server, int client_index) {
+    if (!server || client_index < 0 || client_index >= MAX_CLIENTS) {
+        return;
+    }
+    client_t *client = &server->clients[client_index];
+    pthread_mutex_lock(&client->send_mutex);
+    if (client->closing) {
+        pthread_mutex_unlock(&client->send_mutex);
+        return;
+    }
+    client->closing = true;
+    pthread_cond_signal(&client->send_ready);
+    /* Unblocks a writer stuck on a peer that stopped reading. */
+    shutdown(client->sockfd, SHUT_RDWR);
+    pthread_mutex_unlock(&client->send_mutex);
+    pthread_join(client->writer, NULL);
+}
@@ -0,0 +1,285 @@
+#include "server.h"
+#include "../common/include/protocol.h"
+#include "../common/include/message.h"
+#include "../common/include/utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static uint16_t self_node(const server_t *server) {
+    return server->cluster ? server->cluster->self_id : 0;
+}
+
+static roster_entry_t *find_entry(room_state_t *room, const char *username) {
+    for (int i = 0; i < room->roster_count; i++) {
+        if (strcmp(room->roster[i].username, username) == 0) {
+            return &room->roster[i];
+        }
+    }
+    return NULL;
+}
+
+static roster_entry_t *add_entry(room_state_t *room, const char *username) {
+    if (room->roster_count == room->roster_capacity) {
+        int capacity = room->roster_capacity ? room->roster_capacity * 2 : 8;
+        roster_entry_t *roster = (roster_entry_t *)realloc(room->roster, capacity * sizeof(roster_entry_t));
+        if (!roster) {
+            return NULL;
+        }
+        room->roster = roster;
+        room->roster_capacity = capacity;
+    }
+    roster_entry_t *entry = &room->roster[room->roster_count++];
+    safe_strcpy(entry->username, username, MAX_USERNAME_LEN);
+    entry->nodes = 0;
+    return entry;
+}
+
+static void remove_entry(room_state_t *room, roster_entry_t *entry) {
+    *entry = room->roster[--room->roster_count];
+}
+
+/* Only the first change in a window is recorded, so join-then-leave cancels out at flush. */
+static void note_change(room_state_t *room, const char *username, bool was_present) {
+    for (int i = 0; i < room->change_count; i++) {
+        if (strcmp(room->changes[i].username, username) == 0) {
+            return;
+        }
+    }
+    if (room->change_count == room->change_capacity) {
+        int capacity = room->change_capacity ? room->change_capacity * 2 : 8;
+        presence_change_t *changes = (presence_change_t *)realloc(room->changes, capacity * sizeof(presence_change_t));
+        if (!changes) {
+            return;
+        }
+        room->changes = changes;
+        room->change_capacity = capacity;
+    }
+    presence_change_t *change = &room->changes[room->change_count++];
+    safe_strcpy(change->username, username, MAX_USERNAME_LEN);
+    change->was_present = was_present;
+}
+
+/* Caller holds room->lock. */
+void presence_set(room_state_t *room, const char *username, uint16_t node_id, bool present) {
+    if (!room || !username || node_id >= MAX_CLUSTER_NODES) {
+        return;
+    }
+    roster_entry_t *entry = find_entry(room, username);
+    bool was_present = entry != NULL;
+    if (present) {
+        if (!entry && !(entry = add_entry(room, username))) {
+            return;
+        }
+        entry->nodes |= 1ULL << node_id;
+    } else if (entry) {
+        entry->nodes &= ~(1ULL << node_id);
+        if (entry->nodes == 0) {
+            remove_entry(room, entry);
+        }
+    }
+    if (was_present != (find_entry(room, username) != NULL)) {
+        note_change(room, username, was_present);
+    }
+}
+
+/* Caller holds room->lock. */
+void presence_forget_node(room_state_t *room, uint16_t node_id) {
+    if (!room || node_id >= MAX_CLUSTER_NODES) {
+        return;
+    }
+    for (int i = room->roster_count - 1; i >= 0; i--) {
+        roster_entry_t *entry = &room->roster[i];
+        if (entry->nodes & (1ULL << node_id)) {
+            presence_set(room, entry->username, node_id, false);
+        }
+    }
+}
+
+static int local_members_named(server_t *server, room_state_t *room, uint32_t user_id) {
+    int count = 0;
+    for (int i = 0; i < room->member_count; i++) {
+        if (server->clients[room->members[i]].user_id == user_id) {
+            count++;
+        }
+    }
+    return count;
+}
+
+/* Caller holds room->lock; the member is already in room->members. */
+void presence_member_added(server_t *server, room_state_t *room, int client_index) {
+    const char *username = server->clients[client_index].username;
+    if (local_members_named(server, room, server->clients[client_index].user_id) != 1) {
+        return;
+    }
+    if (cluster_owns(server, room)) {
+        presence_set(room, username, self_node(server), true);
+    } else {
+        cluster_send_presence(server, room, PRESENCE_JOIN, username);
+    }
+}
+
+/* Caller holds room->lock; the member is already gone from room->members. */
+void presence_member_removed(server_t *server, room_state_t *room, int client_index) {
+    const char *username = server->clients[client_index].username;
+    if (local_members_named(server, room, server->clients[client_index].user_id) != 0) {
+        return;
+    }
+    if (cluster_owns(server, room)) {
+        presence_set(room, username, self_node(server), false);
+    } else {
+        cluster_send_presence(server, room, PRESENCE_LEAVE, username);
+    }
+}
+
+static void deliver_update(server_t *server, room_state_t *room, const presence_update_t *update) {
+    for (int i = 0; i < room->member_count; i++) {
+        server_send(server, room->members[i], update, update->header.length);
+    }
+}
+
+typedef void (*snapshot_emit_t)(server_t *server, const presence_update_t *update, int target);
+
+/* Splits the roster into PRESENCE_RESET ... PRESENCE_MORE frames; an empty room still gets one. */
+static void send_snapshot(server_t *server, room_state_t *room, snapshot_emit_t emit, int target) {
+    presence_update_t *update = create_presence_update(room->room_id, PRESENCE_RESET);
+    if (!update) {
+        return;
+    }
+    for (int i = 0; i < room->roster_count; i++) {
+        if (update->count == PRESENCE_MAX_ENTRIES) {
+            update->flags |= PRESENCE_MORE;
+            emit(server, update, target);
+            update->flags = 0;
+            update->count = 0;
+            update->header.length = PRESENCE_UPDATE_SIZE(0);
+        }
+        presence_update_add(update, PRESENCE_JOIN, room->roster[i].username);
+    }
+    emit(server, update, target);
+    free_message(update);
+}
+
+static void emit_to_client(server_t *server, const presence_update_t *update, int client_index) {
+    server_send(server, client_index, update, update->header.length);
+}
+
+static void emit_to_node(server_t *server, const presence_update_t *update, int node_id) {
+    cluster_send_roster(server, (uint16_t)node_id, update);
+}
+
+/* Caller holds room->lock. */
+void presence_send_snapshot(server_t *server, int client_index, room_state_t *room) {
+    if (!server || !room || client_index < 0 || client_index >= MAX_CLIENTS) {
+        return;
+    }
+    if (server_load(server) >= LOAD_SHEDDING) {
+        return;
+    }
+    send_snapshot(server, room, emit_to_client, client_index);
+}
+
+/* Caller holds room->lock. Sent ahead of SUBSCRIBED so the subscriber's mirror is ready for its joiner. */
+void presence_send_roster(server_t *server, room_state_t *room, uint16_t node_id) {
+    if (!server || !room) {
+        return;
+    }
+    send_snapshot(server, room, emit_to_node, node_id);
+}
+
+/* Caller holds room->lock. Applies an update from the owner to our mirror and passes it on. */
+void presence_apply(server_t *server, room_state_t *room, const presence_update_t *update) {
+    if (!server || !room || !update) {
+        return;
+    }
+    if (update->flags & PRESENCE_RESET) {
+        room->roster_count = 0;
+    }
+    for (int i = 0; i < update->count; i++) {
+        char username[MAX_USERNAME_LEN];
+        safe_strcpy(username, update->entries[i].username, sizeof(username));
+        roster_entry_t *entry = find_entry(room, username);
+        if (update->entries[i].op == PRESENCE_JOIN && !entry) {
+            entry = add_entry(room, username);
+            if (entry) {
+                entry->nodes = 1ULL << room->owner;
+            }
+        } else if (update->entries[i].op == PRESENCE_LEAVE && entry) {
+            remove_entry(room, entry);
+        }
+    }
+    deliver_update(server, room, update);
+}
+
+static void publish_update(server_t *server, room_state_t *room, presence_update_t *update) {
+    deliver_update(server, room, update);
+    for (uint64_t nodes = room->interest; nodes; nodes &= nodes - 1) {
+        cluster_send_roster(server, (uint16_t)__builtin_ctzll(nodes), update);
+    }
+    update->count = 0;
+    update->header.length = PRESENCE_UPDATE_SIZE(0);
+}
+
+/* Caller holds room->lock. */
+static void flush_room(server_t *server, room_state_t *room) {
+    presence_update_t *update = create_presence_update(room->room_id, 0);
+    if (!update) {
+        return;
+    }
+    for (int i = 0; i < room->change_count; i++) {
+        const presence_change_t *change = &room->changes[i];
+        bool present = find_entry(room, change->username) != NULL;
+        if (present == change->was_present) {
+            continue;
+        }
+        if (update->count == PRESENCE_MAX_ENTRIES) {
+            publish_update(server, room, update);
+        }
+        presence_update_add(update, present ? PRESENCE_JOIN : PRESENCE_LEAVE, change->username);
+    }
+    if (update->count > 0) {
+        publish_update(server, room, update);
+    }
+    room->change_count = 0;
+    free_message(update);
+}
+
+/* Presence changes are batched per room for PRESENCE_WINDOW_MS, so a burst of joins costs one frame. */
+static void *presence_thread(void *arg) {
+    server_t *server = (server_t *)arg;
+    while (server->presence_running) {
+        usleep(PRESENCE_WINDOW_MS * 1000);
+        int count = 0;
+        room_state_t **rooms = server_snapshot_rooms(server, &count);
+        for (int i = 0; i < count; i++) {
+            if (rooms[i]->change_count == 0) {
+                continue;
+            }
+            pthread_mutex_lock(&rooms[i]->lock);
+            flush_room(server, rooms[i]);
+            pthread_mutex_unlock(&rooms[i]->lock);
+        }
+        free(rooms);
+    }
+    return NULL;
+}
+
+void presence_start(server_t *server) {
+    if (!server || server->presence_running) {
+        return;
+    }
+    server->presence_running = true;
+    if (pthread_create(&server->presence_thread, NULL, presence_thread, server) != 0) {
+        server->presence_running = false;
+        log_message("Failed to start presence thread");
+    }
+}
+
+void presence_stop(server_t *server) {
+    if (!server || !server->presence_running) {
+        return;
+    }
+    server->presence_running = false;
+    pthread_join(server->presence_thread, NULL);
+}
@@ -3,6 +3,287 @@
 #include "../common/include/message.h"
 #include "../common/include/utils.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Lock-free, so every inbound chat frame resolves its room without contending on rooms_mutex. */
+room_state_t *server_find_room(server_t *server, const char *room_id) {
+    if (!server || !room_id) {
+        return NULL;
+    }
+    intern_entry_t *entry = intern_find(&server->room_names, room_id);
+    return entry ? (room_state_t *)entry->value : NULL;
+}
+
+room_state_t *server_get_room(server_t *server, const char *room_id) {
+    if (!server || !room_id) {
+        return NULL;
+    }
+    
+    room_state_t *room = server_find_room(server, room_id);
+    if (room) {
+        return room;
+    }
+    pthread_mutex_lock(&server->rooms_mutex);
+    intern_entry_t *entry = intern_find(&server->room_names, room_id);
+    if (entry) {
+        pthread_mutex_unlock(&server->rooms_mutex);
+        return (room_state_t *)entry->value;
+    }
+    
+    if (server->room_count == server->room_capacity) {
+        int capacity = server->room_capacity ? server->room_capacity * 2 : MAX_ROOMS;
+        room_state_t **rooms = (room_state_t **)realloc(server->rooms, capacity * sizeof(room_state_t *));
+        if (!rooms) {
+            pthread_mutex_unlock(&server->rooms_mutex);
+            return NULL;
+        }
+        server->rooms = rooms;
+        server->room_capacity = capacity;
+    }
+    
+    room = (room_state_t *)calloc(1, sizeof(room_state_t));
+    if (!room) {
+        pthread_mutex_unlock(&server->rooms_mutex);
+        return NULL;
+    }
+    safe_strcpy(room->room_id, room_id, MAX_ROOM_ID_LEN);
+    /* Rooms are interned only here, under rooms_mutex, so the handle is also the room's index. */
+    room->handle = server->room_names.count;
+    if (db_get_last_message_seq(&server->db, room_id, &room->last_seq) != 0) {
+        room->last_seq = 0;
+    }
+    room->owner = server->cluster ? cluster_owner(server->cluster, room_id) : 0;
+    pthread_mutex_init(&room->lock, NULL);
+    pthread_cond_init(&room->interest_cond, NULL);
+    server->rooms[server->room_count++] = room;
+    if (!intern_add(&server->room_names, room->room_id, room)) {
+        server->room_count--;
+        pthread_mutex_unlock(&server->rooms_mutex);
+        pthread_mutex_destroy(&room->lock);
+        pthread_cond_destroy(&room->interest_cond);
+        free(room);
+        return NULL;
+    }
+    pthread_mutex_unlock(&server->rooms_mutex);
+    
+    return room;
+}
+
+/* Rooms are never freed while the server runs, so the copy stays valid after unlocking. */
+room_state_t **server_snapshot_rooms(server_t *server, int *count_out) {
+    if (!server || !count_out) {
+        return NULL;
+    }
+    pthread_mutex_lock(&server->rooms_mutex);
+    int count = server->room_count;
+    room_state_t **rooms = (room_state_t **)malloc((count ? count : 1) * sizeof(room_state_t *));
+    if (rooms) {
+        memcpy(rooms, server->rooms, count * sizeof(room_state_t *));
+    }
+    pthread_mutex_unlock(&server->rooms_mutex);
+    *count_out = rooms ? count : 0;
+    return rooms;
+}
+
+void server_free_rooms(server_t *server) {
+    if (!server) {
+        return;
+    }
+    for (int i = 0; i < server->room_count; i++) {
+        pthread_mutex_destroy(&server->rooms[i]->lock);
+        pthread_cond_destroy(&server->rooms[i]->interest_cond);
+        free(server->rooms[i]->members);
+        free(server->rooms[i]->acks);
+        free(server->rooms[i]->window);
+        compress_stream_free(server->rooms[i]->packer);
+        free(server->rooms[i]->roster);
+        free(server->rooms[i]->changes);
+        free(server->rooms[i]);
+    }
+    free(server->rooms);
+    intern_free(&server->room_names);
+    server->rooms = NULL;
+    server->room_count = 0;
+    server->room_capacity = 0;
+}
+
+bool server_client_in_room(const client_t *client, const room_state_t *room) {
+    if (!client || !room || room->handle / 64 >= client->room_words) {
+        return false;
+    }
+    return (client->room_bits[room->handle / 64] >> (room->handle % 64)) & 1;
+}
+
+/* Caller holds room->lock. */
+int server_subscribe(server_t *server, int client_index, room_state_t *room) {
+    if (!server || client_index < 0 || client_index >= MAX_CLIENTS || !room) {
+        return -1;
+    }
+    client_t *client = &server->clients[client_index];
+    if (server_client_in_room(client, room)) {
+        return 0;
+    }
+    if (client->room_count >= MAX_CLIENT_ROOMS) {
+        return -1;
+    }
+    
+    uint32_t word = room->handle / 64;
+    if (word >= client->room_words) {
+        uint32_t words = word + 1;
+        uint64_t *bits = (uint64_t *)realloc(client->room_bits, words * sizeof(uint64_t));
+        if (!bits) {
+            return -1;
+        }
+        memset(bits + client->room_words, 0, (words - client->room_words) * sizeof(uint64_t));
+        client->room_bits = bits;
+        client->room_words = words;
+    }
+    if (room->member_count == room->member_capacity) {
+        int capacity = room->member_capacity ? room->member_capacity * 2 : 8;
+        int *members = (int *)realloc(room->members, capacity * sizeof(int));
+        if (!members) {
+            return -1;
+        }
+        room->members = members;
+        member_ack_t *acks = (member_ack_t *)realloc(room->acks, capacity * sizeof(member_ack_t));
+        if (!acks) {
+            return -1;
+        }
+        room->acks = acks;
+        room->member_capacity = capacity;
+    }
+    
+    room->acks[room->member_count].seq = 0;
+    room->acks[room->member_count].lagging = false;
+    room->members[room->member_count++] = client_index;
+    client->room_bits[word] |= 1ULL << (room->handle % 64);
+    client->room_count++;
+    presence_member_added(server, room, client_index);
+    return 0;
+}
+
+/* Caller holds room->lock. */
+void server_unsubscribe(server_t *server, int client_index, room_state_t *room) {
+    if (!server || client_index < 0 || client_index >= MAX_CLIENTS || !room) {
+        return;
+    }
+    client_t *client = &server->clients[client_index];
+    if (!server_client_in_room(client, room)) {
+        return;
+    }
+    
+    for (int i = 0; i < room->member_count; i++) {
+        if (room->members[i] == client_index) {
+            room->member_count--;
+            room->members[i] = room->members[room->member_count];
+            room->acks[i] = room->acks[room->member_count];
+            break;
+        }
+    }
+    client->room_bits[room->handle / 64] &= ~(1ULL << (room->handle % 64));
+    client->room_count--;
+    presence_member_removed(server, room, client_index);
+    if (room->member_count == 0) {
+        cluster_drop_interest(server, room);
+    }
+}
+
+void server_leave_all_rooms(server_t *server, int client_index) {
+    if (!server || client_index < 0 || client_index >= MAX_CLIENTS) {
+        return;
+    }
+    client_t *client = &server->clients[client_index];
+    
+    for (uint32_t word = 0; word < client->room_words; word++) {
+        uint64_t bits = client->room_bits[word];
+        while (bits) {
+            uint32_t handle = word * 64 + (uint32_t)__builtin_ctzll(bits);
+            bits &= bits - 1;
+            pthread_mutex_lock(&server->rooms_mutex);
+            room_state_t *room = server->rooms[handle];
+            pthread_mutex_unlock(&server->rooms_mutex);
+            
+            pthread_mutex_lock(&room->lock);
+            server_unsubscribe(server, client_index, room);
+            pthread_mutex_unlock(&room->lock);
+        }
+    }
+    
+    free(client->room_bits);
+    client->room_bits = NULL;
+    client->room_words = 0;
+    client->room_count = 0;
+}
+
+/* Rooms are never renamed or removed, so a name confirmed once spares later joins the lookup. */
+static void name_room(room_state_t *room, const char *room_name) {
+    if (!room->named) {
+        safe_strcpy(room->room_name, room_name, MAX_ROOM_NAME_LEN);
+        __atomic_store_n(&room->named, true, __ATOMIC_RELEASE);
+    }
+}
+
+/* Copies out the name of a loaded room; false means only the database can tell. */
+static bool known_room_name(server_t *server, const char *room_id, char *room_name) {
+    room_state_t *room = server_find_room(server, room_id);
+    if (!room || !__atomic_load_n(&room->named, __ATOMIC_ACQUIRE)) {
+        return false;
+    }
+    safe_strcpy(room_name, room->room_name, MAX_ROOM_NAME_LEN);
+    return true;
+}
+
+/*
+ * Joins a room already known to exist under room_name. History after
+ * since_seq, or else the latest `tail` messages, is replayed first.
+ */
+static int join_room(server_t *server, int client_index, const char *room_id, const char *room_name,
+                     bool resume, uint64_t since_seq, uint16_t tail, uint64_t *head_seq_out) {
+    room_state_t *room = server_get_room(server, room_id);
+    if (!room) {
+        return -1;
+    }
+
+    /* The stored part of the history is read first, outside the room lock. */
+    history_t history = { .since_seq = since_seq };
+    bool replay = resume || tail > 0;
+    if (replay) {
+        server_fetch_history(server, room, since_seq, resume ? 0 : tail, &history);
+    }
+
+    /* Holding the room lock keeps live messages behind the replayed gap. */
+    pthread_mutex_lock(&room->lock);
+    name_room(room, room_name);
+    bool already_member = server_client_in_room(&server->clients[client_index], room);
+    if (cluster_ensure_interest(server, room) != 0) {
+        pthread_mutex_unlock(&room->lock);
+        server_free_history(&history);
+        return -1;
+    }
+    if (server_subscribe(server, client_index, room) != 0) {
+        pthread_mutex_unlock(&room->lock);
+        server_free_history(&history);
+        log_message("User %s cannot join more rooms", server->clients[client_index].username);
+        return -1;
+    }
+    if (replay) {
+        /* Rides with the join response so it still arrives ahead of it and of live messages. */
+        server_replay(server, client_index, room, &history, LANE_CONTROL);
+    }
+    if (head_seq_out) {
+        *head_seq_out = room->last_seq;
+    }
+    presence_send_snapshot(server, client_index, room);
+    pthread_mutex_unlock(&room->lock);
+    server_free_history(&history);
+
+    if (!already_member) {
+        log_message("User %s joined room: %s (ID: %s)", 
+                   server->clients[client_index].username, room_name, room_id);
+    }
+    return 0;
+}
 
 int server_create_room(server_t *server, int client_index, const char *room_name, char *room_id_out) {
     if (!server || client_index < 0 || client_index >= MAX_CLIENTS || !room_name || !room_id_out) {
@@ -24,7 +305,7 @@ int server_create_room(server_t *server, int client_index, const char *room_name
         log_message("New room created: %s (ID: %s) by user %s", 
                    room_name, room_id_out, server->clients[client_index].username);
                    
-        server_join_room(server, client_index, room_id_out);
+        join_room(server, client_index, room_id_out, room_name, false, 0, 0, NULL);
     } else {
         log_message("Failed to create room: %s", room_name);
     }
@@ -32,58 +313,93 @@ int server_create_room(server_t *server, int client_index, const char *room_name
     return result;
 }
 
-int server_join_room(server_t *server, int client_index, const char *room_id) {
+int server_join_room(server_t *server, int client_index, const char *room_id,
+                     bool resume, uint64_t since_seq, uint64_t *head_seq_out, char *room_name_out) {
     if (!server || client_index < 0 || client_index >= MAX_CLIENTS || !room_id) {
         return -1;
     }
     if (!server->clients[client_index].authenticated) {
         return -1;
     }
-    if (!db_room_exists(&server->db, room_id)) {
+    char room_name[MAX_ROOM_NAME_LEN];
+    if (!known_room_name(server, room_id, room_name) &&
+        db_get_room_name(&server->db, room_id, room_name, sizeof(room_name)) != 0) {
         return -1;
     }
-
-    pthread_mutex_lock(&server->clients_mutex);
-    safe_strcpy(server->clients[client_index].current_room_id, room_id, MAX_ROOM_ID_LEN);
-    pthread_mutex_unlock(&server->clients_mutex);
-    char room_name[MAX_ROOM_NAME_LEN];
-    if (db_get_room_name(&server->db, room_id, room_name, sizeof(room_name)) != 0) {
+    if (join_room(server, client_index, room_id, room_name, resume, since_seq, 0, head_seq_out) != 0) {
         return -1;
     }
-    
-    log_message("User %s joined room: %s (ID: %s)", 
-               server->clients[client_index].username, room_name, room_id);
-    char system_message[MAX_MESSAGE_LEN];
-    snprintf(system_message, sizeof(system_message), "User %s has joined the room.", 
-            server->clients[client_index].username);
-    server_broadcast_message(server, room_id, "SYSTEM", system_message);
-    
+    if (room_name_out) {
+        safe_strcpy(room_name_out, room_name, MAX_ROOM_NAME_LEN);
+    }
     return 0;
 }
 
-int server_leave_room(server_t *server, int client_index) {
-    if (!server || client_index < 0 || client_index >= MAX_CLIENTS) {
+/*
+ * Joins each requested room in order and adds its result to resp. Rooms not
+ * loaded yet, as after a restart, are looked up together in one query.
+ */
+void server_join_rooms(server_t *server, int client_index, login_join_entry_t *entries, int count,
+                       login_join_response_t *resp) {
+    if (!server || client_index < 0 || client_index >= MAX_CLIENTS || !entries || !resp ||
+        count > LOGIN_JOIN_MAX_ROOMS || !server->clients[client_index].authenticated) {
+        return;
+    }
+    char names[LOGIN_JOIN_MAX_ROOMS][MAX_ROOM_NAME_LEN];
+    bool known[LOGIN_JOIN_MAX_ROOMS];
+    const char *lookup[LOGIN_JOIN_MAX_ROOMS];
+    int lookups = 0;
+    for (int i = 0; i < count; i++) {
+        entries[i].room_id[MAX_ROOM_ID_LEN - 1] = '\0';
+        known[i] = known_room_name(server, entries[i].room_id, names[i]);
+        if (!known[i]) {
+            lookup[lookups++] = entries[i].room_id;
+        }
+    }
+
+    room_t rooms[LOGIN_JOIN_MAX_ROOMS];
+    int found = 0;
+    if (lookups > 0 && db_get_rooms(&server->db, lookup, lookups, rooms, &found) != 0) {
+        found = 0;
+    }
+    for (int r = 0; r < found; r++) {
+        for (int i = 0; i < count; i++) {
+            if (!known[i] && strcmp(entries[i].room_id, rooms[r].id) == 0) {
+                safe_strcpy(names[i], rooms[r].name, MAX_ROOM_NAME_LEN);
+                known[i] = true;
+            }
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        login_join_entry_t *entry = &entries[i];
+        uint64_t head_seq = 0;
+        bool joined = known[i] && join_room(server, client_index, entry->room_id, names[i], entry->resume != 0,
+                                            entry->since_seq, entry->tail, &head_seq) == 0;
+        login_join_response_add(resp, entry->room_id, joined ? RESP_SUCCESS : RESP_ROOM_NOT_FOUND,
+                                joined ? names[i] : "", head_seq);
+    }
+}
+
+int server_leave_room(server_t *server, int client_index, const char *room_id) {
+    if (!server || client_index < 0 || client_index >= MAX_CLIENTS || !room_id) {
         return -1;
     }
-    if (server->clients[client_index].current_room_id[0] == '\0') {
+    room_state_t *room = server_find_room(server, room_id);
+    if (!room || !server_client_in_room(&server->clients[client_index], room)) {
         return 0; 
     }
     char room_name[MAX_ROOM_NAME_LEN];
-    if (db_get_room_name(&server->db, server->clients[client_index].current_room_id, 
-                        room_name, sizeof(room_name)) != 0) {
+    if (!known_room_name(server, room_id, room_name) &&
+        db_get_room_name(&server->db, room_id, room_name, sizeof(room_name)) != 0) {
         return -1;
     }
-    char system_message[MAX_MESSAGE_LEN];
-    snprintf(system_message, sizeof(system_message), "User %s has left the room.", 
-            server->clients[client_index].username);
-    server_broadcast_message(server, server->clients[client_index].current_room_id, "SYSTEM", system_message);
-    
     log_message("User %s left room: %s (ID: %s)", 
-               server->clients[client_index].username, room_name, server->clients[client_index].current_room_id);
+               server->clients[client_index].username, room_name, room_id);
     
-    pthread_mutex_lock(&server->clients_mutex);
-    server->clients[client_index].current_room_id[0] = '\0';
-    pthread_mutex_unlock(&server->clients_mutex);
+    pthread_mutex_lock(&room->lock);
+    server_unsubscribe(server, client_index, room);
+    pthread_mutex_unlock(&room->lock);
     
     return 0;
-} 
\ No newline at end of file
+}
@@ -0,0 +1,221 @@
+#include "server.h"
+#include "../common/include/protocol.h"
+#include "../common/include/message.h"
+#include "../common/include/utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#define SLOT_MASK (TIMER_SLOTS - 1)
+#define WHEEL_SPAN (1ULL << (TIMER_LEVELS * TIMER_SLOT_BITS))
+
+extern server_t *g_server;
+
+uint64_t timer_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000ULL + (uint64_t)ts.tv_nsec / 1000000ULL;
+}
+
+/*
+ * Hierarchical timing wheel: level L holds timers due within 64^(L+1) ticks,
+ * slotted by bits L*6.. of their expiry, and a level's slot is re-filed into
+ * the levels below when the tick reaches it. Arming and cancelling are a
+ * list insert or unlink; each tick touches one slot. Caller holds the mutex.
+ */
+static void place(timer_wheel_t *wheel, wheel_timer_t *timer) {
+    uint64_t delta = timer->expires - wheel->tick;
+    if (delta >= WHEEL_SPAN) {
+        /* Fires early; callbacks recheck their deadlines and re-arm. */
+        delta = WHEEL_SPAN - 1;
+        timer->expires = wheel->tick + delta;
+    }
+    int level = 0;
+    while (level < TIMER_LEVELS - 1 && delta >= (1ULL << ((level + 1) * TIMER_SLOT_BITS))) {
+        level++;
+    }
+    wheel_timer_t **head = &wheel->slots[level][(timer->expires >> (level * TIMER_SLOT_BITS)) & SLOT_MASK];
+    timer->next = *head;
+    if (*head) {
+        (*head)->pprev = &timer->next;
+    }
+    *head = timer;
+    timer->pprev = head;
+}
+
+static void unlink_timer(wheel_timer_t *timer) {
+    *timer->pprev = timer->next;
+    if (timer->next) {
+        timer->next->pprev = timer->pprev;
+    }
+    timer->next = NULL;
+    timer->pprev = NULL;
+}
+
+static void arm_locked(timer_wheel_t *wheel, wheel_timer_t *timer, uint64_t due_ms) {
+    uint64_t expires = (due_ms + TIMER_TICK_MS - 1) / TIMER_TICK_MS;
+    timer->expires = expires > wheel->tick ? expires : wheel->tick + 1;
+    place(wheel, timer);
+}
+
+static void advance(timer_wheel_t *wheel, uint64_t now_ms) {
+    wheel->tick++;
+    for (int level = 1; level < TIMER_LEVELS; level++) {
+        if (wheel->tick & ((1ULL << (level * TIMER_SLOT_BITS)) - 1)) {
+            break;
+        }
+        wheel_timer_t **head = &wheel->slots[level][(wheel->tick >> (level * TIMER_SLOT_BITS)) & SLOT_MASK];
+        wheel_timer_t *timer;
+        while ((timer = *head) != NULL) {
+            unlink_timer(timer);
+            place(wheel, timer);
+        }
+    }
+
+    wheel_timer_t **head = &wheel->slots[0][wheel->tick & SLOT_MASK];
+    wheel_timer_t *timer;
+    while ((timer = *head) != NULL) {
+        unlink_timer(timer);
+        uint64_t next = timer->fire(timer, now_ms);
+        if (next) {
+            arm_locked(wheel, timer, next);
+        }
+    }
+}
+
+static void *timer_thread(void *arg) {
+    timer_wheel_t *wheel = (timer_wheel_t *)arg;
+    while (wheel->running) {
+        usleep(TIMER_TICK_MS * 1000);
+        uint64_t now = timer_now_ms();
+        pthread_mutex_lock(&wheel->mutex);
+        while (wheel->tick < now / TIMER_TICK_MS) {
+            advance(wheel, now);
+        }
+        pthread_mutex_unlock(&wheel->mutex);
+    }
+    return NULL;
+}
+
+int timers_start(timer_wheel_t *wheel) {
+    if (!wheel) {
+        return -1;
+    }
+    pthread_mutex_lock(&wheel->mutex);
+    wheel->tick = timer_now_ms() / TIMER_TICK_MS;
+    wheel->running = true;
+    pthread_mutex_unlock(&wheel->mutex);
+    if (pthread_create(&wheel->thread, NULL, timer_thread, wheel) != 0) {
+        wheel->running = false;
+        log_message("Failed to start timer thread");
+        return -1;
+    }
+    return 0;
+}
+
+void timers_stop(timer_wheel_t *wheel) {
+    if (!wheel || !wheel->running) {
+        return;
+    }
+    wheel->running = false;
+    pthread_join(wheel->thread, NULL);
+}
+
+void timer_arm(timer_wheel_t *wheel, wheel_timer_t *timer, uint64_t due_ms) {
+    pthread_mutex_lock(&wheel->mutex);
+    if (timer->pprev) {
+        unlink_timer(timer);
+    }
+    arm_locked(wheel, timer, due_ms);
+    pthread_mutex_unlock(&wheel->mutex);
+}
+
+/* Once this returns the timer's callback is not running and will not run. */
+void timer_cancel(timer_wheel_t *wheel, wheel_timer_t *timer) {
+    pthread_mutex_lock(&wheel->mutex);
+    if (timer->pprev) {
+        unlink_timer(timer);
+    }
+    pthread_mutex_unlock(&wheel->mutex);
+}
+
+static uint64_t earlier(uint64_t a, uint64_t b) {
+    return a < b ? a : b;
+}
+
+/* A connection's single timer: acts on whichever deadline has passed and re-arms for the next one. */
+static uint64_t check_client(wheel_timer_t *timer, uint64_t now) {
+    server_t *server = g_server;
+    client_t *client = (client_t *)timer->arg;
+    const char *reason = NULL;
+    uint64_t next = now + WRITE_STALL_TIMEOUT_MS;
+
+    uint64_t writing = __atomic_load_n(&client->write_since_ms, __ATOMIC_RELAXED);
+    if (writing && now - writing >= WRITE_STALL_TIMEOUT_MS) {
+        reason = "write stalled";
+    } else if (writing) {
+        next = earlier(next, writing + WRITE_STALL_TIMEOUT_MS);
+    }
+    if (!client->authenticated && server->auth_timeout_ms) {
+        uint64_t due = client->connected_ms + server->auth_timeout_ms;
+        if (now >= due) {
+            reason = "did not log in";
+        }
+        next = earlier(next, due);
+    }
+    if (server->ping_interval_ms) {
+        uint64_t last = __atomic_load_n(&client->last_rx_ms, __ATOMIC_RELAXED);
+        uint64_t ping_due = last + server->ping_interval_ms;
+        uint64_t drop_due = ping_due + server->ping_interval_ms;
+        if (now >= drop_due) {
+            reason = "ping timed out";
+        } else if (now >= ping_due) {
+            if (client->ping_sent_ms <= last) {
+                ping_message_t *ping = create_ping_message(MSG_PING, now);
+                if (ping) {
+                    server_send_lane(server, (int)(client - server->clients), ping, sizeof(ping_message_t),
+                                     LANE_CONTROL);
+                    free_message(ping);
+                }
+                client->ping_sent_ms = now;
+            }
+            next = earlier(next, drop_due);
+        } else {
+            next = earlier(next, ping_due);
+        }
+    }
+
+    if (reason) {
+        /* The client's thread sees the shutdown and releases the slot as for any disconnect. */
+        log_message("Dropping client %s: %s", client->authenticated ? client->username : "(not logged in)",
+                    reason);
+        shutdown(client->sockfd, SHUT_RDWR);
+        return 0;
+    }
+    return next;
+}
+
+void server_watch_client(server_t *server, int client_index) {
+    if (!server || client_index < 0 || client_index >= MAX_CLIENTS) {
+        return;
+    }
+    client_t *client = &server->clients[client_index];
+    uint64_t now = timer_now_ms();
+    client->connected_ms = now;
+    client->last_rx_ms = now;
+    client->ping_sent_ms = 0;
+    client->write_since_ms = 0;
+    client->timer.fire = check_client;
+    client->timer.arg = client;
+    timer_arm(&server->timers, &client->timer, now + TIMER_TICK_MS);
+}
+
+void server_unwatch_client(server_t *server, int client_index) {
+    if (!server || client_index < 0 || client_index >= MAX_CLIENTS) {
+        return;
+    }
+    timer_cancel(&server->timers, &server->clients[client_index].timer);
+}
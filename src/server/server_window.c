@@ -0,0 +1,188 @@
+#include "server.h"
+#include "../common/include/protocol.h"
+#include "../common/include/message.h"
+#include "../common/include/utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define WINDOW_MASK (RETRANSMIT_WINDOW - 1)
+
+/* Caller holds room->lock. */
+static void update_lag(server_t *server, room_state_t *room, int member) {
+    member_ack_t *ack = &room->acks[member];
+    bool lagging = ack->seq != 0 && room->last_seq - ack->seq > RETRANSMIT_WINDOW;
+    if (lagging != ack->lagging) {
+        ack->lagging = lagging;
+        log_message("%s is %s in room %s (acked %llu of %llu)", server->clients[room->members[member]].username,
+                    lagging ? "lagging" : "caught up", room->room_id, (unsigned long long)ack->seq,
+                    (unsigned long long)room->last_seq);
+    }
+}
+
+/* Caller holds room->lock. */
+void window_record(server_t *server, room_state_t *room, const chat_message_t *chat_msg) {
+    if (chat_msg->seq == 0) {
+        return;
+    }
+    if (!room->window) {
+        room->window = (chat_message_t *)calloc(RETRANSMIT_WINDOW, sizeof(chat_message_t));
+        if (!room->window) {
+            return;
+        }
+    }
+    memcpy(&room->window[chat_msg->seq & WINDOW_MASK], chat_msg, sizeof(chat_message_t));
+    /* Members that stopped acking are found by a scan every LAG_CHECK_INTERVAL messages. */
+    if (chat_msg->seq % LAG_CHECK_INTERVAL == 0) {
+        for (int i = 0; i < room->member_count; i++) {
+            update_lag(server, room, i);
+        }
+    }
+}
+
+/* Caller holds room->lock. True if every message after since_seq is still in the window. */
+static bool window_covers(const room_state_t *room, uint64_t since_seq) {
+    if (!room->window || room->last_seq - since_seq > RETRANSMIT_WINDOW) {
+        return false;
+    }
+    for (uint64_t seq = since_seq + 1; seq <= room->last_seq; seq++) {
+        if (room->window[seq & WINDOW_MASK].seq != seq) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Called without room->lock. Reads from the database whatever a replay after
+ * since_seq, or of the latest `tail` messages when tail is set, will need that
+ * the window no longer holds, so the disk read never stalls the room.
+ */
+void server_fetch_history(server_t *server, room_state_t *room, uint64_t since_seq, uint16_t tail,
+                          history_t *history) {
+    memset(history, 0, sizeof(*history));
+    pthread_mutex_lock(&room->lock);
+    if (tail > 0) {
+        if (tail > MAX_HISTORY_REPLAY) {
+            tail = MAX_HISTORY_REPLAY;
+        }
+        since_seq = room->last_seq > tail ? room->last_seq - tail : 0;
+    }
+    bool covered = since_seq >= room->last_seq || window_covers(room, since_seq);
+    pthread_mutex_unlock(&room->lock);
+    history->since_seq = since_seq;
+
+    if (covered || server_load(server) >= LOAD_SHEDDING) {
+        /* History from the database is shed under load; the client skips ahead to the head. */
+        return;
+    }
+    if (db_get_messages_since(&server->db, room->room_id, since_seq, MAX_HISTORY_REPLAY, &history->messages,
+                              &history->count) != 0) {
+        history->messages = NULL;
+        history->count = 0;
+    }
+}
+
+void server_free_history(history_t *history) {
+    free(history->messages);
+    history->messages = NULL;
+    history->count = 0;
+}
+
+/*
+ * Caller holds room->lock, which keeps live messages behind the replay. Recent
+ * messages come from the window; a longer gap from the rows fetched for it,
+ * followed by whatever was sequenced after they were read.
+ */
+void server_replay(server_t *server, int client_index, room_state_t *room, const history_t *history, lane_t lane) {
+    uint64_t seq = history->since_seq;
+    if (seq >= room->last_seq) {
+        return;
+    }
+    if (!window_covers(room, seq)) {
+        if (history->count == 0) {
+            return;
+        }
+        chat_message_t *chat_msg = create_chat_message(room->room_id, "", "");
+        if (!chat_msg) {
+            return;
+        }
+        int sent = 0;
+        for (int i = 0; i < history->count && history->messages[i].seq <= room->last_seq; i++) {
+            safe_strcpy(chat_msg->username, history->messages[i].username, MAX_USERNAME_LEN);
+            safe_strcpy(chat_msg->message, history->messages[i].body, MAX_MESSAGE_LEN);
+            chat_msg->seq = history->messages[i].seq;
+            if (server_send_chat(server, client_index, chat_msg, NULL, lane) != 0) {
+                break;
+            }
+            seq = chat_msg->seq;
+            sent++;
+        }
+        free_message(chat_msg);
+        log_message("Replayed %d missed messages to %s", sent, server->clients[client_index].username);
+        if (sent < history->count && history->messages[sent].seq <= room->last_seq) {
+            return;
+        }
+    }
+    /* Stops at the first message the window has lost; the client reports the gap. */
+    for (seq++; seq <= room->last_seq && room->window && room->window[seq & WINDOW_MASK].seq == seq; seq++) {
+        if (server_send_chat(server, client_index, &room->window[seq & WINDOW_MASK], NULL, lane) != 0) {
+            break;
+        }
+    }
+}
+
+/* Records cumulative acks and answers gap reports with a resend followed by a done marker. */
+void server_handle_ack(server_t *server, int client_index, const ack_message_t *ack, size_t length) {
+    if (!server || client_index < 0 || client_index >= MAX_CLIENTS || !ack ||
+        length < ACK_MESSAGE_SIZE(0) || ack->count > ACK_MAX_ENTRIES || length < ACK_MESSAGE_SIZE(ack->count)) {
+        return;
+    }
+    client_t *client = &server->clients[client_index];
+    for (int i = 0; i < ack->count; i++) {
+        char room_id[MAX_ROOM_ID_LEN];
+        safe_strcpy(room_id, ack->entries[i].room_id, sizeof(room_id));
+        room_state_t *room = server_find_room(server, room_id);
+        if (!room) {
+            continue;
+        }
+        history_t history = { .since_seq = ack->entries[i].seq };
+        if (ack->entries[i].flags & ACK_GAP) {
+            /* Only members get a history read; membership is checked again once the lock is retaken. */
+            pthread_mutex_lock(&room->lock);
+            bool member = server_client_in_room(client, room);
+            pthread_mutex_unlock(&room->lock);
+            if (!member) {
+                continue;
+            }
+            server_fetch_history(server, room, ack->entries[i].seq, 0, &history);
+        }
+        pthread_mutex_lock(&room->lock);
+        if (!server_client_in_room(client, room)) {
+            pthread_mutex_unlock(&room->lock);
+            server_free_history(&history);
+            continue;
+        }
+        uint64_t seq = ack->entries[i].seq < room->last_seq ? ack->entries[i].seq : room->last_seq;
+        for (int j = 0; j < room->member_count; j++) {
+            if (room->members[j] == client_index) {
+                if (room->acks[j].seq < seq) {
+                    room->acks[j].seq = seq;
+                }
+                update_lag(server, room, j);
+                break;
+            }
+        }
+        if (ack->entries[i].flags & ACK_GAP) {
+            /* Same lane as live chat, so the resend and marker stay in sequence with it. */
+            server_replay(server, client_index, room, &history, LANE_CHAT);
+            ack_message_t *done = create_ack_message();
+            if (done && ack_message_add(done, room_id, room->last_seq, ACK_GAP) == 0) {
+                server_send_lane(server, client_index, done, done->header.length, LANE_CHAT);
+            }
+            free_message(done);
+        }
+        pthread_mutex_unlock(&room->lock);
+        server_free_history(&history);
+    }
+}